@@ -22,6 +22,7 @@
  */
 
 - (id)init;
+- (id)initWithMaxConnections:(UInt32)maxConnections;
 
 /*
  * I/O control methods
@@ -32,12 +33,15 @@
 - (UInt32)reset:(void*)handle;
 - (NSInteger)write:(void*)handle
            command:(NSData*)command
+           barrier:(BOOL)barrier
       timeoutMsecs:(UInt32)timeoutMsecs;
 - (NSInteger)read:(void*)handle
-         response:(NSData* __autoreleasing*)response
-           length:(UInt32)length
+           buffer:(UInt8*)buffer
+        minLength:(UInt32)minLength
+        maxLength:(UInt32)maxLength
      timeoutMsecs:(UInt32)timeoutMsecs;
 - (UInt32)clearReceiveBuffer:(void*)handle;
+- (UInt32)maxWriteLength:(void*)handle;
 - (UInt32)registerNotifyCallback:(void*)handle
                   notifyCallback:(BLENotifyCallback)notifyCallback
                          content:(id)content;
@@ -56,6 +60,7 @@
  */
 
 @property (readonly, nonatomic) UInt32 errcode;
+@property (readonly, nonatomic) UInt32 maxConnections;
 @property (nonatomic) UInt32 initTimeout;
 @property (nonatomic) UInt32 readChTimeout;
 @property (nonatomic) UInt32 notifyChTimeout;
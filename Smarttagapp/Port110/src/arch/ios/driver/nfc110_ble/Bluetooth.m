@@ -8,6 +8,10 @@
 #define ICSLOG_MODULE "DBb"
 
 #import <CoreBluetooth/CoreBluetooth.h>
+#import <libkern/OSAtomic.h>
+
+#include <stdlib.h>
+#include <sched.h>
 
 #include "ics_error.h"
 
@@ -46,17 +50,25 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
 @property (nonatomic) CBUUID* notifyUUID;
 @property (nonatomic) CBUUID* writeUUID;
 @property (nonatomic) NSDictionary* connectOption;
+@property (nonatomic) NSMutableDictionary* knownPeripherals;
 
 @property (nonatomic) NSMutableDictionary* handleList;
 @property (nonatomic) CBCentralManager* centralManager;
 
+/* for handle lookup */
+@property (nonatomic) ble_slot_t* slots;
+@property (nonatomic) NSMutableArray* slotObjects;
+@property (nonatomic) UInt32 freeSlotHead;
+@property (nonatomic) UInt32 freeSlotTail;
+
 /* for callback */
 @property (nonatomic) BLEConnectionStateCallback connectionStateCallback;
 @property (nonatomic) id connectionStateCallbackContent;
 
-- (void)setHandleObject:(void*)handle object:(id)object;
+- (void*)addHandleObject:(BluetoothHandle*)object;
 - (BluetoothHandle*)getHandleObject:(void*)handle;
 - (void)removeHandleObject:(void*)handle;
+- (NSString*)keyOfPeripheralUUID:(CFUUIDRef)uuid;
 - (void)callConnectionStateCallback:(CBPeripheral*)peripheral
                               state:(BLEConnectionState)state;
 
@@ -87,10 +99,17 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
     CBUUID* _notifyUUID;
     CBUUID* _writeUUID;
     NSDictionary* _connectOption;
+    NSMutableDictionary* _knownPeripherals;
 
     NSMutableDictionary* _handleList;
     CBCentralManager* _centralManager;
 
+    /* for handle lookup */
+    ble_slot_t* _slots;
+    NSMutableArray* _slotObjects;
+    UInt32 _freeSlotHead;
+    UInt32 _freeSlotTail;
+
     /* for callback */
     BLEConnectionStateCallback _connectionStateCallback;
     id _connectionStateCallbackContent;
@@ -106,7 +125,8 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
 #pragma mark - initialize methods
 
 /**
- * This method initializes to the Bluetooth class instance.
+ * This method initializes to the Bluetooth class instance
+ * for BLE_DEFAULT_MAX_CONNECTION connections.
  *
  * \retval not nil                     Pointer to the instance.
  * \retval nil                         Initialization failure.
@@ -115,11 +135,38 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
  * errcode cannot be accessible.
  */
 - (id)init
+{
+    return [self initWithMaxConnections:BLE_DEFAULT_MAX_CONNECTION];
+}
+
+/**
+ * This method initializes to the Bluetooth class instance.
+ *
+ * \param  maxConnections         [IN] The maximum number of the handles
+ *                                     opened at once.
+ *                                     (1 to BLE_MAX_CONNECTION_LIMIT)
+ *
+ * \retval not nil                     Pointer to the instance.
+ * \retval nil                         Initialization failure.
+ *
+ * Error codes (the value can be gotten from errcode).
+ * errcode cannot be accessible.
+ */
+- (id)initWithMaxConnections:(UInt32)maxConnections
 {
 #undef ICSLOG_FUNC
-#define ICSLOG_FUNC "Bluetooth:init"
+#define ICSLOG_FUNC "Bluetooth:initWithMaxConnections"
+    UInt32 i;
     ICSLOG_FUNC_BEGIN;
 
+    if ((maxConnections == 0) ||
+        (maxConnections > BLE_MAX_CONNECTION_LIMIT)) {
+        BLELOG_ERR_PRINT(ICS_ERROR_INVALID_PARAM,
+                         @"maxConnections(%u) is out of range.",
+                         (unsigned int)maxConnections);
+        return nil;
+    }
+
     self = [super init];
     if (self == nil) {
         BLELOG_ERR_PRINT(ICS_ERROR_NO_RESOURCES,
@@ -127,6 +174,34 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
         return nil;
     }
 
+    _maxConnections = maxConnections;
+
+    BLELOG_DBG_PRINT(@"Begin alloc: _slots");
+    _slots = (ble_slot_t*)calloc(_maxConnections, sizeof(ble_slot_t));
+    BLELOG_DBG_PRINT(@"End alloc: _slots");
+    if (_slots == NULL) {
+        BLELOG_ERR_PRINT(ICS_ERROR_NO_RESOURCES,
+                         @"_slots initialization failed.");
+        return nil;
+    }
+
+    BLELOG_DBG_PRINT(@"Begin alloc: _slotObjects");
+    _slotObjects = [NSMutableArray arrayWithCapacity:_maxConnections];
+    BLELOG_DBG_PRINT(@"End alloc: _slotObjects");
+    if (_slotObjects == nil) {
+        BLELOG_ERR_PRINT(ICS_ERROR_NO_RESOURCES,
+                         @"_slotObjects initialization failed.");
+        return nil;
+    }
+
+    /* all the slots are free, in order */
+    for (i = 0; i < _maxConnections; i++) {
+        [_slotObjects addObject:[NSNull null]];
+        _slots[i].next_free = (((i + 1) < _maxConnections) ? (i + 2) : 0);
+    }
+    _freeSlotHead = 1;
+    _freeSlotTail = _maxConnections;
+
     errcode = ICS_ERROR_SUCCESS;
 
     BLELOG_DBG_PRINT(@"Begin alloc: _semUpdateState");
@@ -193,6 +268,16 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
         return nil;
     }
 
+    BLELOG_DBG_PRINT(@"Begin alloc: _knownPeripherals");
+    _knownPeripherals = [NSMutableDictionary
+                             dictionaryWithCapacity:BLE_MAX_UUID_LIST];
+    BLELOG_DBG_PRINT(@"End alloc: _knownPeripherals");
+    if (_knownPeripherals == nil) {
+        BLELOG_ERR_PRINT(ICS_ERROR_NO_RESOURCES,
+                         @"_knownPeripherals initialization failed.");
+        return nil;
+    }
+
     BLELOG_DBG_PRINT(@"Begin alloc: _connectOption");
     _connectOption = @{CBConnectPeripheralOptionNotifyOnConnectionKey:@YES,
                        CBConnectPeripheralOptionNotifyOnDisconnectionKey:@YES,
@@ -228,6 +313,17 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
     return self;
 }
 
+/**
+ * This method releases the connection slots.
+ */
+- (void)dealloc
+{
+    if (_slots != NULL) {
+        free(_slots);
+        _slots = NULL;
+    }
+}
+
 #pragma mark - public methods
 
 /**
@@ -256,6 +352,8 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
     UInt32 rc;
     dispatch_time_t timeout;
     void* handle;
+    NSString* knownKey;
+    CBPeripheral* knownPeripheral;
     ICSLOG_FUNC_BEGIN;
 
     /* --------------------------------- *
@@ -270,6 +368,7 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
      * --------------------------------- */
 
     handle = NULL;
+    knownKey = nil;
 
     /* --------------------------------- *
      * Parameter checks                  *
@@ -302,7 +401,7 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
      * --------------------------------- */
 
     @synchronized (self) {
-        if (_handleList.count >= BLE_MAX_CONNECTION) {
+        if (_handleList.count >= _maxConnections) {
             errcode = ICS_ERROR_BUSY;
             BLELOG_ERR_PRINT(errcode, @"Handle list is max.");
             return NULL;
@@ -373,27 +472,57 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
                 }
             }
 
-            [_centralManager retrieveConnectedPeripherals];
-
-            rc = [_semConnect waitTimeout:timeout];
-            if (rc != ICS_ERROR_SUCCESS) {
-                errcode = ICS_ERROR_TIMEOUT;
-                BLELOG_ERR_PRINT(errcode, @"A connection timeout occurred.");
-                break;
+            /*
+             * A peripheral opened before is connected directly, without
+             * retrieving it again.
+             */
+            knownKey = [self keyOfPeripheralUUID:_peripheralUUID];
+            knownPeripheral = nil;
+            if (knownKey != nil) {
+                @synchronized (self) {
+                    knownPeripheral =
+                        [_knownPeripherals objectForKey:knownKey];
+                }
             }
 
-            if (errcode != ICS_ERROR_SUCCESS) {
-                if (errcode != ICS_ERROR_BUSY) {
-                    errcode = ICS_ERROR_IO;
-                    BLELOG_ERR_PRINT(errcode, @"Some error occurred.");
+            if (knownPeripheral != nil) {
+                rc = [self connectKnownPeripheral:knownPeripheral
+                                          timeout:timeout];
+                if (rc != ICS_ERROR_SUCCESS) {
+                    BLELOG_ERR_PRINT(rc, @"Some error occurred.");
+                    @synchronized (self) {
+                        [_knownPeripherals removeObjectForKey:knownKey];
+                    }
+                    if (rc != ICS_ERROR_BUSY) {
+                        [_centralManager
+                            cancelPeripheralConnection:knownPeripheral];
+                    }
+                    break;
                 }
-                break;
-            }
+            } else {
+                [_centralManager retrieveConnectedPeripherals];
 
-            rc = [self connectRetrievedPeripheral:timeout];
-            if (rc != ICS_ERROR_SUCCESS) {
-                BLELOG_ERR_PRINT(rc, @"Some error occurred.");
-                break;
+                rc = [_semConnect waitTimeout:timeout];
+                if (rc != ICS_ERROR_SUCCESS) {
+                    errcode = ICS_ERROR_TIMEOUT;
+                    BLELOG_ERR_PRINT(errcode,
+                                     @"A connection timeout occurred.");
+                    break;
+                }
+
+                if (errcode != ICS_ERROR_SUCCESS) {
+                    if (errcode != ICS_ERROR_BUSY) {
+                        errcode = ICS_ERROR_IO;
+                        BLELOG_ERR_PRINT(errcode, @"Some error occurred.");
+                    }
+                    break;
+                }
+
+                rc = [self connectRetrievedPeripheral:timeout];
+                if (rc != ICS_ERROR_SUCCESS) {
+                    BLELOG_ERR_PRINT(rc, @"Some error occurred.");
+                    break;
+                }
             }
         } else {
             rc = [self connectScannedPeripheral:timeout];
@@ -407,46 +536,28 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
          * Device state settings             *
          * --------------------------------- */
 
-        /* Set notify value to read characteristic */
+        /*
+         * Set notify value to the read and the notify characteristics.
+         * Both the requests are sent at once.
+         */
 
         timeout = dispatch_time(DISPATCH_TIME_NOW,
-                                NSEC_PER_MSEC * _readChTimeout);
+                                NSEC_PER_MSEC *
+                                ((UInt64)_readChTimeout + _notifyChTimeout));
 
-        rc = [_connectingHandle setNotifyValueToReadCharacteristic:YES
-                                                           timeout:timeout];
+        rc = [_connectingHandle setNotifyValues:YES timeout:timeout];
         if (rc != ICS_ERROR_SUCCESS) {
             if (rc == ICS_ERROR_TIMEOUT) {
                 errcode = ICS_ERROR_TIMEOUT;
-                BLELOG_ERR_PRINT(
-                    errcode,
-                    @"setNotifyValueToReadCharacteristic timeout.");
+                BLELOG_ERR_PRINT(errcode, @"setNotifyValues timeout.");
             } else {
                 errcode = ICS_ERROR_IO;
-                BLELOG_ERR_PRINT(
-                    errcode,
-                    @"setNotifyValueToReadCharacteristic failed.");
+                BLELOG_ERR_PRINT(errcode, @"setNotifyValues failed.");
             }
-            break;
-        }
-
-        /* Set notify value to notify characteristic */
-
-        timeout = dispatch_time(DISPATCH_TIME_NOW,
-                                NSEC_PER_MSEC * _notifyChTimeout);
-
-        rc = [_connectingHandle setNotifyValueToNotifyCharacteristic:YES
-                                                             timeout:timeout];
-        if (rc != ICS_ERROR_SUCCESS) {
-            if (rc == ICS_ERROR_TIMEOUT) {
-                errcode = ICS_ERROR_TIMEOUT;
-                BLELOG_ERR_PRINT(
-                    errcode,
-                    @"setNotifyValueToNotifyCharacteristic timeout.");
-            } else {
-                errcode = ICS_ERROR_IO;
-                BLELOG_ERR_PRINT(
-                    errcode,
-                    @"setNotifyValueToNotifyCharacteristic failed.");
+            if (knownKey != nil) {
+                @synchronized (self) {
+                    [_knownPeripherals removeObjectForKey:knownKey];
+                }
             }
             break;
         }
@@ -455,9 +566,26 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
          * Handle register                   *
          * --------------------------------- */
 
-        handle = (__bridge void*)_connectingHandle;
+        handle = [self addHandleObject:_connectingHandle];
+        if (handle == NULL) {
+            errcode = ICS_ERROR_BUSY;
+            BLELOG_ERR_PRINT(errcode, @"No free slot.");
+            [_centralManager
+                cancelPeripheralConnection:[_connectingHandle getPeripheral]];
+            break;
+        }
 
-        [self setHandleObject:handle object:_connectingHandle];
+        /* remember the peripheral for the next open */
+        if (knownKey == nil) {
+            knownKey = [self keyOfPeripheralUUID:
+                            [_connectingHandle getPeripheral].UUID];
+        }
+        if (knownKey != nil) {
+            @synchronized (self) {
+                [_knownPeripherals setObject:[_connectingHandle getPeripheral]
+                                      forKey:knownKey];
+            }
+        }
 
         errcode = ICS_ERROR_SUCCESS;
     } while(0);
@@ -567,6 +695,8 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
  *
  * \param  handle                 [IN] The handle to write.
  * \param  command                [IN] Command written to the device.
+ * \param  barrier                [IN] YES to wait for the write response.
+ *                                     NO may write without response.
  * \param  timeoutMsecs           [IN] Time-out period. (ms)
  *
  * \retval not -1                      The number of bytes written.
@@ -580,6 +710,7 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
  */
 - (NSInteger)write:(void*)handle
            command:(NSData*)command
+           barrier:(BOOL)barrier
       timeoutMsecs:(UInt32)timeoutMsecs;
 {
 #undef ICSLOG_FUNC
@@ -605,7 +736,7 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
         return -1;
     }
 
-    rc = [bleh write:command timeout:timeout];
+    rc = [bleh write:command barrier:barrier timeout:timeout];
     if (rc != ICS_ERROR_SUCCESS) {
         if (rc == ICS_ERROR_TIMEOUT) {
             errcode = ICS_ERROR_TIMEOUT;
@@ -627,8 +758,9 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
  * This method reads the response from the device.
  *
  * \param  handle                 [IN] The handle to read.
- * \param  response              [OUT] Response data from the device.
- * \param  length                 [IN] Read length.
+ * \param  buffer                [OUT] Response data from the device.
+ * \param  minLength              [IN] The minimum length to be read.
+ * \param  maxLength              [IN] The maximum length to be read.
  * \param  timeoutMsecs           [IN] Time-out period. (ms)
  *
  * \retval not -1                      The number of bytes read.
@@ -642,13 +774,15 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
  * ICS_ERROR_IO                        Other I/O error occurred.
  */
 - (NSInteger)read:(void*)handle
-         response:(NSData* __autoreleasing*)response
-           length:(UInt32)length
+           buffer:(UInt8*)buffer
+        minLength:(UInt32)minLength
+        maxLength:(UInt32)maxLength
      timeoutMsecs:(UInt32)timeoutMsecs
 {
 #undef ICSLOG_FUNC
 #define ICSLOG_FUNC "Bluetooth:read"
     UInt32 rc;
+    UInt32 readLength;
     dispatch_time_t timeout;
     BluetoothHandle* bleh;
     ICSLOG_FUNC_BEGIN;
@@ -669,7 +803,11 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
         return -1;
     }
 
-    rc = [bleh read:response length:length timeout:timeout];
+    rc = [bleh read:buffer
+          minLength:minLength
+          maxLength:maxLength
+         readLength:&readLength
+            timeout:timeout];
     if (rc != ICS_ERROR_SUCCESS) {
         if (rc == ICS_ERROR_TIMEOUT) {
             errcode = ICS_ERROR_TIMEOUT;
@@ -681,16 +819,10 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
         return -1;
     }
 
-    if (*response == nil) {
-        errcode = ICS_ERROR_INVALID_RESPONSE;
-        BLELOG_ERR_PRINT(errcode, @"read returned nil.");
-        return -1;
-    }
-
     errcode = ICS_ERROR_SUCCESS;
 
     ICSLOG_FUNC_END;
-    return (*response).length;
+    return readLength;
 }
 
 /**
@@ -727,6 +859,35 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
     return ICS_ERROR_SUCCESS;
 }
 
+/**
+ * This method returns the longest data which the handle writes in a
+ * packet. (see BluetoothHandle:maxWriteLength)
+ *
+ * \param  handle                 [IN] The handle.
+ *
+ * \retval BLE_MIN_DATA_LEN to BLE_MAX_DATA_LEN
+ *                                     (BLE_MIN_DATA_LEN if not opened)
+ */
+- (UInt32)maxWriteLength:(void*)handle
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "Bluetooth:maxWriteLength"
+    BluetoothHandle* bleh;
+    UInt32 length;
+    ICSLOG_FUNC_BEGIN;
+
+    bleh = [self getHandleObject:handle];
+    if (bleh == nil) {
+        BLELOG_ERR_PRINT(ICS_ERROR_IO, @"The device is not opened.");
+        return BLE_MIN_DATA_LEN;
+    }
+
+    length = [bleh maxWriteLength];
+
+    ICSLOG_FUNC_END;
+    return length;
+}
+
 /**
  * This method registers the notify callback function to the handle.
  *
@@ -865,42 +1026,88 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
 #pragma mark - private methods
 
 /**
- * This method sets the handle object with handle key.
+ * This method registers the handle object in a free slot.
+ * The slots are reused in the order they are freed. The object of the
+ * last handle of the slot is released after the lookups which are
+ * retaining it leave the slot.
  *
- * \param  handle                 [IN] The handle pointer.
- * \param  object                 [IN] The object to set.
+ * \param  object                 [IN] The object to register.
+ *
+ * \retval not NULL                    The handle of the object.
+ * \retval NULL                        No free slot.
  */
-- (void)setHandleObject:(void*)handle object:(id)object
+- (void*)addHandleObject:(BluetoothHandle*)object
 {
 #undef ICSLOG_FUNC
-#define ICSLOG_FUNC "Bluetooth:setHandleObject"
+#define ICSLOG_FUNC "Bluetooth:addHandleObject"
     NSValue* handleKey;
+    ble_slot_t* slot;
+    UInt32 index;
+    void* handle;
     ICSLOG_FUNC_BEGIN;
 
     if (object == nil) {
         BLELOG_ERR_PRINT(ICS_ERROR_INVALID_PARAM,
                          @"object is nil.");
-        return;
-    }
-
-    BLELOG_DBG_PRINT(@"Begin alloc: NSValue");
-    handleKey = [NSValue valueWithPointer:handle];
-    BLELOG_DBG_PRINT(@"End alloc: NSValue");
-    if (handleKey == nil) {
-        BLELOG_ERR_PRINT(ICS_ERROR_NO_RESOURCES,
-                         @"handleKey initialization failed.");
-        return;
+        return NULL;
     }
 
     @synchronized (self) {
+        if (_freeSlotHead == 0) {
+            BLELOG_ERR_PRINT(ICS_ERROR_BUSY, @"No free slot.");
+            return NULL;
+        }
+        index = (_freeSlotHead - 1);
+        slot = &_slots[index];
+
+        /*
+         * release the object of the last handle of the slot, after the
+         * lookups which found the handle just before it was closed
+         * (the new lookups see the slot closed)
+         */
+        while (slot->readers != 0) {
+            sched_yield();
+        }
+        [_slotObjects replaceObjectAtIndex:index withObject:object];
+        slot->object = (__bridge void*)object;
+
+        /* publish the object before the handle becomes valid */
+        OSAtomicIncrement32Barrier(&slot->generation);
+        handle = (void*)(((unsigned long)(slot->generation &
+                                          BLE_HANDLE_GENERATION_MASK)
+                          << BLE_HANDLE_INDEX_BITS) |
+                         (unsigned long)(index + 1));
+
+        BLELOG_DBG_PRINT(@"Begin alloc: NSValue");
+        handleKey = [NSValue valueWithPointer:handle];
+        BLELOG_DBG_PRINT(@"End alloc: NSValue");
+        if (handleKey == nil) {
+            BLELOG_ERR_PRINT(ICS_ERROR_NO_RESOURCES,
+                             @"handleKey initialization failed.");
+            OSAtomicIncrement32Barrier(&slot->generation);
+            return NULL;
+        }
         [_handleList setObject:object forKey:handleKey];
+
+        _freeSlotHead = slot->next_free;
+        if (_freeSlotHead == 0) {
+            _freeSlotTail = 0;
+        }
+        slot->next_free = 0;
     }
 
+    BLELOG_DBG_PRINT(@"handle:%p", handle);
+
     ICSLOG_FUNC_END;
+    return handle;
 }
 
 /**
  * This method returns the handle object match to the specified handle.
+ * The handle indexes its slot, and the generation of the slot tells
+ * whether or not the handle is still open, without any lock.
+ * The object is retained while the slot counts the lookup as a reader,
+ * so the slot is not reused before the retain.
  *
  * \param  handle                 [IN] The handle pointer.
  *
@@ -911,29 +1118,39 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
 {
 #undef ICSLOG_FUNC
 #define ICSLOG_FUNC "Bluetooth:getHandleObject"
-    NSValue* handleKey;
-    BluetoothHandle* bleh;
+    ble_slot_t* slot;
+    UInt32 index;
+    int32_t generation;
+    void* object;
     ICSLOG_FUNC_BEGIN;
 
-    BLELOG_DBG_PRINT(@"Begin alloc: NSValue");
-    handleKey = [NSValue valueWithPointer:handle];
-    BLELOG_DBG_PRINT(@"End alloc: NSValue");
-    if (handleKey == nil) {
-        BLELOG_ERR_PRINT(ICS_ERROR_NO_RESOURCES,
-                         @"handleKey initialization failed.");
+    index = (UInt32)((unsigned long)handle & BLE_HANDLE_INDEX_MASK);
+    generation = (int32_t)(((unsigned long)handle >> BLE_HANDLE_INDEX_BITS) &
+                           BLE_HANDLE_GENERATION_MASK);
+    if ((index == 0) || (index > _maxConnections) ||
+        ((generation & 1) == 0)) {
         return nil;
     }
+    slot = &_slots[index - 1];
 
-    @synchronized (self) {
-        bleh = [_handleList objectForKey:handleKey];
+    /* retain explicitly, so that the retain is not moved out of the count */
+    object = NULL;
+    OSAtomicIncrement32Barrier(&slot->readers);
+    if ((slot->generation & BLE_HANDLE_GENERATION_MASK) == generation) {
+        object = (void*)CFBridgingRetain((__bridge id)slot->object);
+    }
+    OSAtomicDecrement32Barrier(&slot->readers);
+    if (object == NULL) {
+        return nil;
     }
 
     ICSLOG_FUNC_END;
-    return bleh;
+    return CFBridgingRelease(object);
 }
 
 /**
  * This method removes the handle object match to the specified handle.
+ * The slot keeps the object until it is reused.
  *
  * \param  handle                 [IN] The handle pointer.
  */
@@ -942,8 +1159,16 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
 #undef ICSLOG_FUNC
 #define ICSLOG_FUNC "Bluetooth:removeHandleObject"
     NSValue* handleKey;
+    ble_slot_t* slot;
+    UInt32 index;
     ICSLOG_FUNC_BEGIN;
 
+    if ([self getHandleObject:handle] == nil) {
+        return;
+    }
+    index = (UInt32)((unsigned long)handle & BLE_HANDLE_INDEX_MASK);
+    slot = &_slots[index - 1];
+
     BLELOG_DBG_PRINT(@"Begin alloc: NSValue");
     handleKey = [NSValue valueWithPointer:handle];
     BLELOG_DBG_PRINT(@"End alloc: NSValue");
@@ -954,7 +1179,21 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
     }
 
     @synchronized (self) {
+        if ([_handleList objectForKey:handleKey] == nil) {
+            /* closed by another thread */
+            return;
+        }
         [_handleList removeObjectForKey:handleKey];
+
+        /* invalidate the handle, and append the slot to the free list */
+        OSAtomicIncrement32Barrier(&slot->generation);
+        slot->next_free = 0;
+        if (_freeSlotTail == 0) {
+            _freeSlotHead = index;
+        } else {
+            _slots[_freeSlotTail - 1].next_free = index;
+        }
+        _freeSlotTail = index;
     }
 
     ICSLOG_FUNC_END;
@@ -1097,6 +1336,105 @@ static NSString* const kUUIDWriteCh  = @"233e8103-3a1b-1c59-9bee-180373dd03a1";
     return ICS_ERROR_SUCCESS;
 }
 
+/**
+ * This method connects to the peripheral which was opened before.
+ * The peripheral is not retrieved again, and its services are not
+ * discovered again if it still holds them.
+ *
+ * \param  peripheral             [IN] The peripheral to connect.
+ * \param  timeout                [IN] timeout.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_BUSY              The peripheral is already connected.
+ * \retval ICS_ERROR_TIMEOUT           Time-out.
+ * \retval ICS_ERROR_IO                Other I/O error occurred.
+ *
+ * Error codes (the value can be gotten from errcode).
+ * ICS_ERROR_SUCCESS                   No error.
+ * ICS_ERROR_BUSY                      The peripheral is already connected.
+ * ICS_ERROR_TIMEOUT                   Time-out.
+ * ICS_ERROR_IO                        Other I/O error occurred.
+ */
+- (UInt32)connectKnownPeripheral:(CBPeripheral*)peripheral
+                         timeout:(dispatch_time_t)timeout
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "Bluetooth:connectKnownPeripheral"
+    UInt32 rc;
+    ICSLOG_FUNC_BEGIN;
+
+    BLELOG_DBG_PRINT(@"A known peripheral: %@", peripheral);
+    if (peripheral.isConnected) {
+        rc = ICS_ERROR_BUSY;
+        errcode = rc;
+        BLELOG_ERR_PRINT(rc, @"The UUID is already connected.");
+        return rc;
+    }
+
+    @synchronized (self) {
+        [_connectingHandle setPeripheral:peripheral];
+    }
+
+    if (_connectOptionEnable == YES) {
+        BLELOG_DBG_PRINT(@"connectPeripheral:%@ options:%@",
+                         peripheral,
+                         _connectOption);
+        [_centralManager connectPeripheral:peripheral options:_connectOption];
+    } else {
+        BLELOG_DBG_PRINT(@"connectPeripheral:%@ options:nil", peripheral);
+        [_centralManager connectPeripheral:peripheral options:nil];
+    }
+
+    rc = [_semConnect waitTimeout:timeout];
+    if (rc != ICS_ERROR_SUCCESS) {
+        rc = ICS_ERROR_TIMEOUT;
+        errcode = rc;
+        BLELOG_ERR_PRINT(rc, @"connectPeripheral timeout.");
+        return rc;
+    }
+
+    if (errcode != ICS_ERROR_SUCCESS) {
+        rc = ICS_ERROR_IO;
+        errcode = rc;
+        BLELOG_ERR_PRINT(rc, @"connectPeripheral failed.");
+        return rc;
+    }
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This method returns the key of a peripheral in _knownPeripherals.
+ *
+ * \param  uuid                   [IN] The UUID of the peripheral.
+ *
+ * \retval not nil                     The key.
+ * \retval nil                         uuid is NULL, or an allocation failure.
+ */
+- (NSString*)keyOfPeripheralUUID:(CFUUIDRef)uuid
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "Bluetooth:keyOfPeripheralUUID"
+    CFStringRef uuidCFStr;
+    ICSLOG_FUNC_BEGIN;
+
+    if (uuid == NULL) {
+        return nil;
+    }
+
+    BLELOG_DBG_PRINT(@"Begin alloc: uuidCFStr");
+    uuidCFStr = CFUUIDCreateString(kCFAllocatorDefault, uuid);
+    BLELOG_DBG_PRINT(@"End alloc: uuidCFStr");
+    if (uuidCFStr == NULL) {
+        BLELOG_ERR_PRINT(ICS_ERROR_NO_RESOURCES, @"uuidCFStr is nil.");
+        return nil;
+    }
+
+    ICSLOG_FUNC_END;
+    return (__bridge_transfer NSString*)uuidCFStr;
+}
+
 /**
  * This method calls the registered connection state callback function with
  * user's content.
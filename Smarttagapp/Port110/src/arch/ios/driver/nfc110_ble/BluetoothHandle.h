@@ -41,13 +41,21 @@
                                      timeout:(dispatch_time_t)timeout;
 - (UInt32)setNotifyValueToNotifyCharacteristic:(BOOL)enabled
                                        timeout:(dispatch_time_t)timeout;
+- (UInt32)setNotifyValues:(BOOL)enabled
+                  timeout:(dispatch_time_t)timeout;
 - (void)registerNotifyCallback:(BLENotifyCallback)notifyCallback
                        content:(id)content;
 - (UInt32)write:(NSData*)data timeout:(dispatch_time_t)timeout;
-- (UInt32)read:(NSData* __autoreleasing*)data
-        length:(UInt32)length
+- (UInt32)write:(NSData*)data
+        barrier:(BOOL)barrier
+        timeout:(dispatch_time_t)timeout;
+- (UInt32)read:(UInt8*)data
+     minLength:(UInt32)minLength
+     maxLength:(UInt32)maxLength
+    readLength:(UInt32*)readLength
        timeout:(dispatch_time_t)timeout;
 - (void)clearReceiveBuffer;
+- (UInt32)maxWriteLength;
 - (BOOL)isConnected;
 - (BOOL)isEqualPeripheralUUID:(CFUUIDRef)uuid;
 
@@ -9,6 +9,10 @@
 
 #import <CoreBluetooth/CoreBluetooth.h>
 
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+
 #include "ics_error.h"
 
 #import "blelog.h"
@@ -23,6 +27,89 @@
 #define BLEH_ERROR_DOMAIN @"BluetoothHandleErrorDomain"
 #define BLEH_ERROR_CODE   ICS_ERROR_IO
 
+/* must be a power of 2, and hold a whole response of the device */
+#define BLEH_RX_RING_LEN  4096U
+
+/* --------------------------------
+ * Receive ring buffer
+ * -------------------------------- */
+
+/*
+ * A single-producer/single-consumer byte ring.
+ * The producer is the CoreBluetooth delegate queue (the read
+ * characteristic), the consumer is the thread in read/clearReceiveBuffer.
+ * head and tail are free-running; (tail - head) is the length of data.
+ */
+typedef struct {
+    UInt8 buf[BLEH_RX_RING_LEN];
+    atomic_uint head;       /* written by the consumer only */
+    atomic_uint tail;       /* written by the producer only */
+    atomic_bool waiting;    /* the consumer waits for the semaphore */
+    atomic_bool overflow;   /* the producer dropped data */
+} bleh_rx_ring_t;
+
+static UInt32 bleh_rx_ring_push(
+    bleh_rx_ring_t* ring,
+    const UInt8* data,
+    UInt32 len)
+{
+    UInt32 head;
+    UInt32 tail;
+    UInt32 off;
+    UInt32 n;
+
+    head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (len > (BLEH_RX_RING_LEN - (tail - head))) {
+        atomic_store(&ring->overflow, true);
+        return ICS_ERROR_BUF_OVERFLOW;
+    }
+
+    off = (tail & (BLEH_RX_RING_LEN - 1));
+    n = (BLEH_RX_RING_LEN - off);
+    if (n > len) {
+        n = len;
+    }
+    memcpy(ring->buf + off, data, n);
+    memcpy(ring->buf, data + n, (len - n));
+
+    /* publish the data before looking at the waiting flag */
+    atomic_store(&ring->tail, (tail + len));
+
+    return ICS_ERROR_SUCCESS;
+}
+
+static UInt32 bleh_rx_ring_pop(
+    bleh_rx_ring_t* ring,
+    UInt8* data,
+    UInt32 len)
+{
+    UInt32 head;
+    UInt32 off;
+    UInt32 n;
+
+    head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    off = (head & (BLEH_RX_RING_LEN - 1));
+    n = (BLEH_RX_RING_LEN - off);
+    if (n > len) {
+        n = len;
+    }
+    memcpy(data, ring->buf + off, n);
+    memcpy(data + n, ring->buf, (len - n));
+
+    /* release the space after the copy */
+    atomic_store_explicit(&ring->head, (head + len), memory_order_release);
+
+    return len;
+}
+
+static UInt32 bleh_rx_ring_count(
+    bleh_rx_ring_t* ring)
+{
+    return (atomic_load(&ring->tail) -
+            atomic_load_explicit(&ring->head, memory_order_relaxed));
+}
+
 /* --------------------------------
  * Private members
  * -------------------------------- */
@@ -43,9 +130,9 @@
 @property (nonatomic) CBCharacteristic* readCh;
 @property (nonatomic) CBCharacteristic* notifyCh;
 @property (nonatomic) CBCharacteristic* writeCh;
-@property (nonatomic) Semaphore* semReadValue;
+@property (nonatomic) dispatch_semaphore_t semRxRing;
 @property (nonatomic) Semaphore* semWriteValue;
-@property (nonatomic) NSMutableArray* receiveBuffer;
+@property (nonatomic) UInt32 txCredits;
 @property (nonatomic) BLENotifyCallback notifyCallback;
 @property (nonatomic) id notifyCallbackContent;
 
@@ -56,6 +143,8 @@
 @property (nonatomic) NSError* updateStateError;
 
 - (void)callNotifyCallback:(NSData*)data;
+- (void)wakeReader;
+- (BOOL)setCachedCharacteristics;
 
 @end
 
@@ -84,9 +173,9 @@
     CBCharacteristic* _readCh;
     CBCharacteristic* _notifyCh;
     CBCharacteristic* _writeCh;
-    Semaphore* _semReadValue;
+    dispatch_semaphore_t _semRxRing;
     Semaphore* _semWriteValue;
-    NSMutableArray* _receiveBuffer;
+    UInt32 _txCredits;
     BLENotifyCallback _notifyCallback;
     id _notifyCallbackContent;
 
@@ -96,6 +185,9 @@
     NSError* _writeError;
     NSError* _updateStateError;
 #endif
+
+    /* for receiving (not a property; the ring holds atomics) */
+    bleh_rx_ring_t _rxRing;
 }
 
 #pragma mark - public methods
@@ -133,14 +225,20 @@
         return nil;
     }
 
-    BLELOG_DBG_PRINT(@"Begin alloc: _semReadValue");
-    _semReadValue = [[Semaphore alloc] initWithCount:0];
-    BLELOG_DBG_PRINT(@"End alloc: _semReadValue");
-    if (_semReadValue == nil) {
+    BLELOG_DBG_PRINT(@"Begin alloc: _semRxRing");
+    _semRxRing = dispatch_semaphore_create(0);
+    BLELOG_DBG_PRINT(@"End alloc: _semRxRing");
+    if (_semRxRing == nil) {
         BLELOG_ERR_PRINT(ICS_ERROR_NO_RESOURCES,
-                         @"_semReadValue initialization failed.");
+                         @"_semRxRing initialization failed.");
         return nil;
     }
+    atomic_init(&_rxRing.head, 0);
+    atomic_init(&_rxRing.tail, 0);
+    atomic_init(&_rxRing.waiting, false);
+    atomic_init(&_rxRing.overflow, false);
+
+    _txCredits = BLE_TX_CREDITS;
 
     BLELOG_DBG_PRINT(@"Begin alloc: _semWriteValue");
     _semWriteValue = [[Semaphore alloc] initWithCount:0];
@@ -151,15 +249,6 @@
         return nil;
     }
 
-    BLELOG_DBG_PRINT(@"Begin alloc: _receiveBuffer");
-    _receiveBuffer = [[NSMutableArray alloc] init];
-    BLELOG_DBG_PRINT(@"End alloc: _receiveBuffer");
-    if (_receiveBuffer == nil) {
-        BLELOG_ERR_PRINT(ICS_ERROR_NO_RESOURCES,
-                         @"NSMutableArray initialization failed.");
-        return nil;
-    }
-
     BLELOG_DBG_PRINT(@"Begin alloc: _defaultError");
     _defaultError = [NSError errorWithDomain:BLEH_ERROR_DOMAIN
                                         code:BLEH_ERROR_CODE
@@ -275,6 +364,17 @@
         return rc;
     }
 
+    /*
+     * A peripheral which was connected before may still hold the service
+     * and the characteristics, then the discovery round trips are skipped.
+     */
+    if ([self setCachedCharacteristics]) {
+        BLELOG_DBG_PRINT(@"The cached characteristics are used.");
+        [_connectionDelegate bluetoothHandle:self didPrepareServices:nil];
+        ICSLOG_FUNC_END;
+        return ICS_ERROR_SUCCESS;
+    }
+
     _isConnecting = YES;
 
     [_peripheral discoverServices:services];
@@ -391,6 +491,66 @@
     return ICS_ERROR_SUCCESS;
 }
 
+/**
+ * This method sets notify value to the read characteristic and the notify
+ * characteristic at once, so that the two updates share the round trips.
+ *
+ * \param  enabled                [IN] Whether or not notifications/indications
+ *                                     should be enabled.
+ * \param  timeout                [IN] When to timeout.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_NOT_INITIALIZED   Not Initialized.
+ * \retval ICS_ERROR_TIMEOUT           Time-out.
+ * \retval ICS_ERROR_IO                Other I/O error occurred.
+ */
+- (UInt32)setNotifyValues:(BOOL)enabled
+                  timeout:(dispatch_time_t)timeout
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "BluetoothHandle:setNotifyValues"
+    UInt32 rc;
+    int i;
+    ICSLOG_FUNC_BEGIN;
+
+    if (_peripheral == nil) {
+        rc = ICS_ERROR_NOT_INITIALIZED;
+        BLELOG_ERR_PRINT(rc, @"_peripheral is nil.");
+        return rc;
+    }
+
+    if ((_readCh == nil) || (_notifyCh == nil)) {
+        rc = ICS_ERROR_NOT_INITIALIZED;
+        BLELOG_ERR_PRINT(rc, @"_readCh or _notifyCh is nil.");
+        return rc;
+    }
+
+    [_peripheral setNotifyValue:enabled forCharacteristic:_readCh];
+    [_peripheral setNotifyValue:enabled forCharacteristic:_notifyCh];
+
+    /* one signal for each characteristic */
+    for (i = 0; i < 2; i++) {
+        rc = [_semUpdateNotification waitTimeout:timeout];
+        if (rc != ICS_ERROR_SUCCESS) {
+            if (rc == ICS_ERROR_TIMEOUT) {
+                BLELOG_ERR_PRINT(rc, @"An update timeout occurred.");
+            } else {
+                rc = ICS_ERROR_IO;
+            }
+            return rc;
+        }
+    }
+
+    if (_updateStateError != nil) {
+        rc = ICS_ERROR_IO;
+        _updateStateError = nil;
+        return rc;
+    }
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
 /**
  * This method registers a notification callback function to the handle.
  *
@@ -414,7 +574,8 @@
 }
 
 /**
- * This method calls writeValue method of the peripheral.
+ * This method calls writeValue method of the peripheral,
+ * and waits for the response.
  *
  * \param  data                   [IN] The data written to the device.
  * \param  timeout                [IN] When to timeout.
@@ -425,6 +586,31 @@
  * \retval ICS_ERROR_IO                Other I/O error occurred.
  */
 - (UInt32)write:(NSData*)data timeout:(dispatch_time_t)timeout
+{
+    return [self write:data barrier:YES timeout:timeout];
+}
+
+/**
+ * This method calls writeValue method of the peripheral.
+ *
+ * If the characteristic allows, the data is written without response
+ * while the handle has credits. Otherwise, or if barrier is YES, the data
+ * is written with response; the response tells that every packet before
+ * has reached the device, so it restores the credits.
+ *
+ * \param  data                   [IN] The data written to the device.
+ * \param  barrier                [IN] YES to wait for the response.
+ *                                     (the last packet of a frame)
+ * \param  timeout                [IN] When to timeout.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_NOT_INITIALIZED   Not Initialized.
+ * \retval ICS_ERROR_TIMEOUT           Time-out.
+ * \retval ICS_ERROR_IO                Other I/O error occurred.
+ */
+- (UInt32)write:(NSData*)data
+        barrier:(BOOL)barrier
+        timeout:(dispatch_time_t)timeout
 {
 #undef ICSLOG_FUNC
 #define ICSLOG_FUNC "BluetoothHandle:write"
@@ -439,12 +625,12 @@
 
     BLELOG_DBG_PRINT(@"%@", data.description);
 
-    if (data.length > BLE_MAX_DATA_LEN) {
+    if (data.length > [self maxWriteLength]) {
         rc = ICS_ERROR_INVALID_PARAM;
         BLELOG_ERR_PRINT(rc,
-                         @"data length(%lu) must be <= %d.",
+                         @"data length(%lu) must be <= %u.",
                          (unsigned long)data.length,
-                         BLE_MAX_DATA_LEN);
+                         (unsigned int)[self maxWriteLength]);
         return rc;
     }
 
@@ -460,6 +646,19 @@
         return rc;
     }
 
+    if ((barrier == NO) && (_txCredits > 0) &&
+        ((_writeCh.properties &
+          CBCharacteristicPropertyWriteWithoutResponse) != 0)) {
+        /* stream it; nothing tells when the packet is sent */
+        _txCredits--;
+        [_peripheral writeValue:data
+              forCharacteristic:_writeCh
+                           type:CBCharacteristicWriteWithoutResponse];
+
+        ICSLOG_FUNC_END;
+        return ICS_ERROR_SUCCESS;
+    }
+
     [_peripheral writeValue:data
           forCharacteristic:_writeCh
                        type:CBCharacteristicWriteWithResponse];
@@ -474,6 +673,9 @@
         return rc;
     }
 
+    /* the packets before have been delivered */
+    _txCredits = BLE_TX_CREDITS;
+
     if (_writeError != nil) {
         rc = ICS_ERROR_IO;
         _writeError = nil;
@@ -485,43 +687,71 @@
 }
 
 /**
- * This method reads data from the data buffer.
+ * This method reads data from the receive buffer.
+ *
+ * It waits until minLength bytes have been received, and copies up to
+ * maxLength bytes of them. Only one thread may read at a time.
  *
- * \param  data                  [OUT] The dequeued data from the buffer.
- * \param  length                 [IN] The length to be read.
+ * \param  data                  [OUT] The buffer for the read data.
+ * \param  minLength              [IN] The minimum length to be read.
+ * \param  maxLength              [IN] The maximum length to be read.
+ * \param  readLength            [OUT] The length of the read data.
  * \param  timeout                [IN] When to timeout.
  *
  * \retval ICS_ERROR_SUCCESS           No error.
  * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
- * \retval ICS_ERROR_NO_RESOURCES      An instance allocation failure.
- * \retval ICS_ERROR_INVALID_RESPONSE  The device responds invalid data.
  * \retval ICS_ERROR_TIMEOUT           Time-out.
  * \retval ICS_ERROR_IO                Other I/O error occurred.
  */
-- (UInt32)read:(NSData* __autoreleasing*)data
-        length:(UInt32)length
+- (UInt32)read:(UInt8*)data
+     minLength:(UInt32)minLength
+     maxLength:(UInt32)maxLength
+    readLength:(UInt32*)readLength
        timeout:(dispatch_time_t)timeout
 {
 #undef ICSLOG_FUNC
 #define ICSLOG_FUNC "BluetoothHandle:read"
     UInt32 rc;
-    NSData* response;
+    UInt32 count;
     ICSLOG_FUNC_BEGIN;
 
-    if (data == nil) {
+    if ((data == NULL) || (readLength == NULL) ||
+        (minLength > maxLength) || (minLength > BLEH_RX_RING_LEN)) {
         rc = ICS_ERROR_INVALID_PARAM;
         BLELOG_ERR_PRINT(rc, @"Invalid parameter.");
         return rc;
     }
 
-    rc = [_semReadValue waitTimeout:timeout];
-    if (rc != ICS_ERROR_SUCCESS) {
-        if (rc == ICS_ERROR_TIMEOUT) {
+    for (;;) {
+        count = bleh_rx_ring_count(&_rxRing);
+        if ((count >= minLength) || (_readError != nil) ||
+            atomic_load(&_rxRing.overflow)) {
+            break;
+        }
+
+        /* announce the wait, then check again not to miss a wake-up */
+        atomic_store(&_rxRing.waiting, true);
+        count = bleh_rx_ring_count(&_rxRing);
+        if ((count >= minLength) || (_readError != nil) ||
+            atomic_load(&_rxRing.overflow)) {
+            atomic_store(&_rxRing.waiting, false);
+            break;
+        }
+
+        if (dispatch_semaphore_wait(_semRxRing, timeout) != 0) {
+            atomic_store(&_rxRing.waiting, false);
+
+            /* the data notified just before the time-out is not late */
+            count = bleh_rx_ring_count(&_rxRing);
+            if ((count >= minLength) || (_readError != nil) ||
+                atomic_load(&_rxRing.overflow)) {
+                break;
+            }
+
+            rc = ICS_ERROR_TIMEOUT;
             BLELOG_ERR_PRINT(rc, @"A readValue timeout occurred.");
-        } else {
-            rc = ICS_ERROR_IO;
+            return rc;
         }
-        return rc;
     }
 
     if (_readError != nil) {
@@ -530,54 +760,16 @@
         return rc;
     }
 
-    @synchronized (self) {
-        if (_receiveBuffer.count == 0) {
-            rc = ICS_ERROR_IO;
-            BLELOG_ERR_PRINT(rc, @"_receiveBuffer count is 0.");
-            return rc;
-        }
-
-        response = [_receiveBuffer objectAtIndex:0];
-
-        if (response.length > BLE_MAX_DATA_LEN) {
-            rc = ICS_ERROR_INVALID_RESPONSE;
-            BLELOG_ERR_PRINT(rc,
-                             @"Response data length(%lu) must be <= %d.",
-                             (unsigned long)response.length,
-                             BLE_MAX_DATA_LEN);
-            return rc;
-        }
-
-        if (response.length <= length) {
-            [_receiveBuffer removeObjectAtIndex:0];
-        } else {
-            NSData* restData = response;
-
-            BLELOG_DBG_PRINT(@"Begin alloc: response");
-            response = [response subdataWithRange:NSMakeRange(0, length)];
-            BLELOG_DBG_PRINT(@"End alloc: response");
-            if (response == nil) {
-                rc = ICS_ERROR_NO_RESOURCES;
-                BLELOG_ERR_PRINT(rc, @"response initialization failed.");
-                return rc;
-            }
-
-            BLELOG_DBG_PRINT(@"Begin alloc: restData");
-            restData = [restData subdataWithRange:
-                            NSMakeRange(length, restData.length - length)];
-            BLELOG_DBG_PRINT(@"End alloc: restData");
-            if (restData == nil) {
-                rc = ICS_ERROR_NO_RESOURCES;
-                BLELOG_ERR_PRINT(rc, @"restData initialization failed.");
-                return rc;
-            }
-
-            [_receiveBuffer replaceObjectAtIndex:0 withObject:restData];
-            [_semReadValue signal];
-        }
+    if (atomic_load(&_rxRing.overflow)) {
+        rc = ICS_ERROR_IO;
+        BLELOG_ERR_PRINT(rc, @"The receive buffer overflowed.");
+        return rc;
     }
 
-    *data = response;
+    if (count > maxLength) {
+        count = maxLength;
+    }
+    *readLength = bleh_rx_ring_pop(&_rxRing, data, count);
 
     ICSLOG_FUNC_END;
     return ICS_ERROR_SUCCESS;
@@ -592,12 +784,54 @@
 #define ICSLOG_FUNC "BluetoothHandle:clearReceiveBuffer"
     ICSLOG_FUNC_BEGIN;
 
-    @synchronized (self) {
-        [_receiveBuffer removeAllObjects];
-        [_semReadValue reset];
+    /* called by the reader, the only one moving the head */
+    atomic_store_explicit(&_rxRing.head, atomic_load(&_rxRing.tail),
+                          memory_order_release);
+    atomic_store(&_rxRing.overflow, false);
+    while (dispatch_semaphore_wait(_semRxRing, DISPATCH_TIME_NOW) == 0) {
+        /* drop the stale wake-ups */
+    }
+
+    ICSLOG_FUNC_END;
+}
+
+/**
+ * This method returns the longest data written in a packet, which the
+ * connection negotiated (ATT_MTU - 3).
+ *
+ * CoreBluetooth exchanges the ATT_MTU on connecting; the systems which
+ * do not tell the result (before iOS 9) use the default ATT_MTU. A write
+ * with response is limited to the same length, since a longer one
+ * would be split into prepared writes.
+ *
+ * \retval BLE_MIN_DATA_LEN to BLE_MAX_DATA_LEN
+ */
+- (UInt32)maxWriteLength
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "BluetoothHandle:maxWriteLength"
+    NSUInteger length;
+    ICSLOG_FUNC_BEGIN;
+
+    length = BLE_MIN_DATA_LEN;
+#ifdef __IPHONE_9_0
+    if ((_peripheral != nil) &&
+        [_peripheral respondsToSelector:
+                         @selector(maximumWriteValueLengthForType:)]) {
+        length = [_peripheral maximumWriteValueLengthForType:
+                                  CBCharacteristicWriteWithoutResponse];
+    }
+#endif
+    if (length < BLE_MIN_DATA_LEN) {
+        length = BLE_MIN_DATA_LEN;
+    } else if (length > BLE_MAX_DATA_LEN) {
+        length = BLE_MAX_DATA_LEN;
     }
 
+    BLELOG_DBG_PRINT(@"maxWriteLength: %lu", (unsigned long)length);
+
     ICSLOG_FUNC_END;
+    return (UInt32)length;
 }
 
 /**
@@ -674,6 +908,16 @@
 
 #pragma mark - private methods
 
+/**
+ * This method wakes up the reader if it waits for data.
+ */
+- (void)wakeReader
+{
+    if (atomic_exchange(&_rxRing.waiting, false)) {
+        dispatch_semaphore_signal(_semRxRing);
+    }
+}
+
 /**
  * This method calls the registered notification callback function with user's
  * content.
@@ -719,6 +963,57 @@
     ICSLOG_FUNC_END;
 }
 
+/**
+ * This method sets the characteristics which the peripheral already holds
+ * from a previous connection.
+ *
+ * \retval YES                         All the characteristics are set.
+ * \retval NO                          The services need to be discovered.
+ */
+- (BOOL)setCachedCharacteristics
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "BluetoothHandle:setCachedCharacteristics"
+    CBCharacteristic* readCh;
+    CBCharacteristic* notifyCh;
+    CBCharacteristic* writeCh;
+    ICSLOG_FUNC_BEGIN;
+
+    readCh = nil;
+    notifyCh = nil;
+    writeCh = nil;
+
+    /* If _peripheral.services is nil, nothing occurs. */
+    for (CBService* service in _peripheral.services) {
+        if (![service.UUID isEqual:_serviceUUID]) {
+            continue;
+        }
+        for (CBCharacteristic* characteristic in service.characteristics) {
+            if ([characteristic.UUID isEqual:_readChUUID]) {
+                readCh = characteristic;
+            } else if ([characteristic.UUID isEqual:_notifyChUUID]) {
+                notifyCh = characteristic;
+            } else if ([characteristic.UUID isEqual:_writeChUUID]) {
+                writeCh = characteristic;
+            } else {
+                /* Do nothing */
+            }
+        }
+        break;
+    }
+
+    if ((readCh == nil) || (notifyCh == nil) || (writeCh == nil)) {
+        return NO;
+    }
+
+    _readCh = readCh;
+    _notifyCh = notifyCh;
+    _writeCh = writeCh;
+
+    ICSLOG_FUNC_END;
+    return YES;
+}
+
 #pragma mark - CBPeripheralDelegate
 
 - (void)peripheral:(CBPeripheral*)peripheral
@@ -878,6 +1173,7 @@
     if (error != nil) {
         _readError = error;
         BLELOG_ERR_PRINT(ICS_ERROR_IO, @"%@", error.localizedDescription);
+        [self wakeReader];
         return;
     }
 
@@ -891,10 +1187,12 @@
 
         BLELOG_DBG_PRINT(@"%@", value.description);
 
-        @synchronized (self) {
-            [_receiveBuffer addObject:value];
-            [_semReadValue signal];
+        if (bleh_rx_ring_push(&_rxRing, [value bytes],
+                              (UInt32)value.length) != ICS_ERROR_SUCCESS) {
+            BLELOG_ERR_PRINT(ICS_ERROR_BUF_OVERFLOW,
+                             @"The receive buffer is full.");
         }
+        [self wakeReader];
     } else if ([characteristic isEqual:_notifyCh]) {
         NSData* value = characteristic.value;
         if (value == nil) {
@@ -11,11 +11,24 @@
  * Constants
  * -------------------------------- */
 
-#define BLE_MAX_DATA_LEN        27U
-#define BLE_MAX_CONNECTION       8U  /* Bluetooth.m implementation is only
+/* the data in a packet: ATT_MTU - 3, from the default ATT_MTU (23) up to
+ * the longest attribute value; the connection negotiates the ATT_MTU */
+#define BLE_MIN_DATA_LEN        20U
+#define BLE_MAX_DATA_LEN        512U
+#define BLE_DEFAULT_MAX_CONNECTION 8U /* Bluetooth.m implementation is only
                                       * tested for 1 connection.
                                       */
-#define BLE_MAX_UUID_LIST       BLE_MAX_CONNECTION
+#define BLE_MAX_CONNECTION_LIMIT 4096U
+#define BLE_MAX_UUID_LIST       BLE_DEFAULT_MAX_CONNECTION
+
+/* a handle: (the generation of the slot << 16) | (the slot index + 1) */
+#define BLE_HANDLE_INDEX_BITS   16U
+#define BLE_HANDLE_INDEX_MASK   0x0000ffffU
+#define BLE_HANDLE_GENERATION_MASK 0x00007fffU
+
+/* packets written without response before a write with response
+ * (0: every packet is written with response) */
+#define BLE_TX_CREDITS           4U
 
 #define BLE_INIT_DEFAULT_TIMEOUT            10000U
 #define BLE_READCH_UPDATE_DEFAULT_TIMEOUT   120000U
@@ -23,6 +36,19 @@
 
 #define BLE_INVALID_RSSI                    0x00000000
 
+/* --------------------------------
+ * Types
+ * -------------------------------- */
+
+/* a connection slot of Bluetooth */
+typedef struct {
+    volatile int32_t generation;    /* odd: in use */
+    volatile int32_t readers;       /* the lookups retaining the object */
+    void* object;                   /* BluetoothHandle (retained by the
+                                     * slot array of Bluetooth) */
+    UInt32 next_free;               /* the next free slot index + 1 */
+} ble_slot_t;
+
 /* --------------------------------
  * Macros
  * -------------------------------- */
@@ -12,6 +12,7 @@
 #include "icslib_chk.h"
 #include "icslog.h"
 #include "utl.h"
+#include "icstrace.h"
 #include "nfc110_ble.h"
 
 #import "Bluetooth.h"
@@ -22,7 +23,6 @@
 
 #define NFC110_BLE_COMMAND_BUF_LEN \
     (8 + (3 + NFC110_MAX_TRANSMIT_DATA_LEN) + 2)
-#define NFC110_BLE_MAX_BULK_LEN             20U
 #define NFC110_ALARM_PACKET_MIN_SIZE        3U
 
 /* --------------------------------
@@ -192,30 +192,27 @@ UINT32 nfc110_ble_raw_close(
  * \param  handle                 [IN] The handle to access the port.
  * \param  data                   [IN] The data to write.
  * \param  data_len               [IN] The length of the data.
- * \param  time0                  [IN] The base time for time-out. (ms)
- * \param  timeout                [IN] Time-out period. (ms)
+ * \param  deadline               [IN] The deadline.
  *
  * \retval ICS_ERROR_SUCCESS           No error.
  * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
  * \retval ICS_ERROR_TIMEOUT           Time-out.
  * \retval ICS_ERROR_IO                Other driver error.
  */
-UINT32 nfc110_ble_raw_write(
+UINT32 nfc110_ble_raw_write_until(
     ICS_HANDLE handle,
     const UINT8* data,
     UINT32 data_len,
-    UINT32 time0,
-    UINT32 timeout)
+    const utl_deadline_t* deadline)
 {
 #undef ICSLOG_FUNC
-#define ICSLOG_FUNC "nfc110_ble_raw_write"
+#define ICSLOG_FUNC "nfc110_ble_raw_write_until"
     @autoreleasepool {
         UINT32 rc;
         NSInteger res;
         unsigned int nfc110_bulk_len;
         UINT32 nwritten;
         UINT32 write_len;
-        UINT32 current_time;
         UINT32 rest_timeout;
         NSData* command;
         ICSLOG_FUNC_BEGIN;
@@ -229,16 +226,16 @@ UINT32 nfc110_ble_raw_write(
         ICSLOG_DBG_PTR(handle);
         ICSLOG_DBG_UINT(data_len);
         ICSLOG_DUMP(data, data_len);
-        ICSLOG_DBG_UINT(time0);
-        ICSLOG_DBG_UINT(timeout);
+        ICSLOG_DBG_UINT(utl_deadline_get_rest_nsec(deadline));
 
-        nfc110_bulk_len = NFC110_BLE_MAX_BULK_LEN;
+        /* a packet as long as the connection negotiated */
+        nfc110_bulk_len = [s_bluetooth maxWriteLength:handle];
 
         ICSLOG_DBG_UINT(nfc110_bulk_len);
 
         nwritten = 0;
         do {
-            rest_timeout = utl_get_rest_timeout(time0, timeout, &current_time);
+            rest_timeout = utl_deadline_get_rest_msec(deadline);
             if (rest_timeout == 0) {
                 rc = ICS_ERROR_TIMEOUT;
                 ICSLOG_ERR_STR(rc, "Time-out.");
@@ -254,8 +251,10 @@ UINT32 nfc110_ble_raw_write(
                                            length:write_len
                                      freeWhenDone:NO];
 
+            /* stream the packets, and wait for the last one */
             res = [s_bluetooth write:handle
                              command:command
+                             barrier:((nwritten + write_len) == data_len)
                         timeoutMsecs:rest_timeout];
             if (res < 0) {
                 if (s_bluetooth.errcode == ICS_ERROR_TIMEOUT) {
@@ -266,6 +265,7 @@ UINT32 nfc110_ble_raw_write(
                 ICSLOG_ERR_STR(rc, "Bluetooth write");
                 return rc;
             }
+            ICSTRACE(ICSTRACE_EVENT_BLE_TX, 0, res);
             nwritten += res;
         } while (nwritten < data_len);
 
@@ -283,8 +283,7 @@ UINT32 nfc110_ble_raw_write(
  * \param  data                  [OUT] The read data.
  * \param  read_len              [OUT] The length of read data or NULL.
  *                                     (NULL means reading the whole data)
- * \param  time0                  [IN] The base time for time-out. (ms)
- * \param  timeout                [IN] Time-out period. (ms)
+ * \param  deadline               [IN] The deadline.
  *
  * \retval ICS_ERROR_SUCCESS           No error.
  * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
@@ -292,26 +291,21 @@ UINT32 nfc110_ble_raw_write(
  * \retval ICS_ERROR_IO                Other driver error.
  * \retval ICS_ERROR_BUF_OVERFLOW      Response buffer overflow.
  */
-UINT32 nfc110_ble_raw_read(
+UINT32 nfc110_ble_raw_read_until(
     ICS_HANDLE handle,
     UINT32 min_read_len,
     UINT32 max_read_len,
     UINT8* data,
     UINT32* read_len,
-    UINT32 time0,
-    UINT32 timeout)
+    const utl_deadline_t* deadline)
 {
 #undef ICSLOG_FUNC
-#define ICSLOG_FUNC "nfc110_ble_raw_read"
+#define ICSLOG_FUNC "nfc110_ble_raw_read_until"
     @autoreleasepool {
         UINT32 rc;
         NSInteger res;
-        unsigned int nfc110_bulk_len;
         UINT32 nread;
-        UINT32 n;
-        UINT32 current_time;
         UINT32 rest_timeout;
-        NSData* response;
         ICSLOG_FUNC_BEGIN;
 
         /* check the prameters */
@@ -323,49 +317,33 @@ UINT32 nfc110_ble_raw_read(
 
         ICSLOG_DBG_PTR(handle);
         ICSLOG_DBG_UINT(max_read_len);
-        ICSLOG_DBG_UINT(time0);
-        ICSLOG_DBG_UINT(timeout);
-
-        nfc110_bulk_len = NFC110_BLE_MAX_BULK_LEN;
+        ICSLOG_DBG_UINT(utl_deadline_get_rest_nsec(deadline));
 
-        ICSLOG_DBG_UINT(nfc110_bulk_len);
-
-        nread = 0;
-        do {
-            n = (max_read_len - nread);
-            if (n > nfc110_bulk_len) {
-                n = nfc110_bulk_len;
-            }
+        rest_timeout = utl_deadline_get_rest_msec(deadline);
+        if (rest_timeout == 0) {
+            rc = ICS_ERROR_TIMEOUT;
+            ICSLOG_ERR_STR(rc, "Time-out.");
+            return rc;
+        }
 
-            rest_timeout = utl_get_rest_timeout(time0, timeout, &current_time);
-            if (rest_timeout == 0) {
+        /* wait for min_read_len bytes at once, take up to max_read_len */
+        res = [s_bluetooth read:handle
+                         buffer:data
+                      minLength:min_read_len
+                      maxLength:max_read_len
+                   timeoutMsecs:rest_timeout];
+        if (res < 0) {
+            if (s_bluetooth.errcode == ICS_ERROR_TIMEOUT) {
                 rc = ICS_ERROR_TIMEOUT;
-                ICSLOG_ERR_STR(rc, "Time-out.");
-                return rc;
-            }
-
-            res = [s_bluetooth read:handle
-                           response:&response
-                             length:n
-                       timeoutMsecs:rest_timeout];
-            if (res < 0) {
-                if (s_bluetooth.errcode == ICS_ERROR_TIMEOUT) {
-                    rc = ICS_ERROR_TIMEOUT;
-                } else {
-                    rc = ICS_ERROR_IO;
-                }
-                ICSLOG_ERR_STR(rc, "Bluetooth read");
-                return rc;
-            }
-            if ((UINT32)res > n) {
-                rc = ICS_ERROR_BUF_OVERFLOW;
-                ICSLOG_ERR_STR(rc, "Buffer overflow.");
-                return rc;
+            } else {
+                rc = ICS_ERROR_IO;
             }
-            utl_memcpy(data + nread, [response bytes], res);
+            ICSLOG_ERR_STR(rc, "Bluetooth read");
+            return rc;
+        }
 
-            nread += res;
-        } while (nread < min_read_len);
+        nread = (UINT32)res;
+        ICSTRACE(ICSTRACE_EVENT_BLE_RX, 0, nread);
 
         if (read_len != NULL) {
             *read_len = nread;
@@ -378,6 +356,70 @@ UINT32 nfc110_ble_raw_read(
     }
 }
 
+/**
+ * This function writes data to the device.
+ * (nfc110_ble_raw_write_until() with the time-out in millisecond)
+ *
+ * \param  handle                 [IN] The handle to access the port.
+ * \param  data                   [IN] The data to write.
+ * \param  data_len               [IN] The length of the data.
+ * \param  time0                  [IN] The base time for time-out. (ms)
+ * \param  timeout                [IN] Time-out period. (ms)
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_TIMEOUT           Time-out.
+ * \retval ICS_ERROR_IO                Other driver error.
+ */
+UINT32 nfc110_ble_raw_write(
+    ICS_HANDLE handle,
+    const UINT8* data,
+    UINT32 data_len,
+    UINT32 time0,
+    UINT32 timeout)
+{
+    utl_deadline_t deadline;
+
+    utl_deadline_set_msec(&deadline, time0, timeout);
+
+    return nfc110_ble_raw_write_until(handle, data, data_len, &deadline);
+}
+
+/**
+ * This function reads data from the device.
+ * (nfc110_ble_raw_read_until() with the time-out in millisecond)
+ *
+ * \param  handle                 [IN] The handle to access the port.
+ * \param  min_read_len           [IN] The minimum length of read data.
+ * \param  max_read_len           [IN] The maximum length of read data.
+ * \param  data                  [OUT] The read data.
+ * \param  read_len              [OUT] The length of read data or NULL.
+ * \param  time0                  [IN] The base time for time-out. (ms)
+ * \param  timeout                [IN] Time-out period. (ms)
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_TIMEOUT           Time-out.
+ * \retval ICS_ERROR_IO                Other driver error.
+ * \retval ICS_ERROR_BUF_OVERFLOW      Response buffer overflow.
+ */
+UINT32 nfc110_ble_raw_read(
+    ICS_HANDLE handle,
+    UINT32 min_read_len,
+    UINT32 max_read_len,
+    UINT8* data,
+    UINT32* read_len,
+    UINT32 time0,
+    UINT32 timeout)
+{
+    utl_deadline_t deadline;
+
+    utl_deadline_set_msec(&deadline, time0, timeout);
+
+    return nfc110_ble_raw_read_until(handle, min_read_len, max_read_len,
+                                     data, read_len, &deadline);
+}
+
 /**
  * This function clears the receiving queue of the BLE.
  *
@@ -831,6 +873,56 @@ UINT32 nfc110_ble_raw_set_cb_parameter(
     }
 }
 
+/**
+ * This function sets the maximum number of the devices opened at once.
+ * Call this function before the other functions of the driver.
+ *
+ * \param  max_connections        [IN] The maximum number of the devices.
+ *                                     (1 to 4096, 8 by default)
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_BUSY              The driver is already used with
+ *                                     another maximum.
+ * \retval ICS_ERROR_IO                Other driver error.
+ */
+UINT32 nfc110_ble_raw_set_max_connections(
+    UINT32 max_connections)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_ble_raw_set_max_connections"
+    @autoreleasepool {
+        UINT32 rc;
+        ICSLOG_FUNC_BEGIN;
+
+        ICSLIB_CHKARG_NE(max_connections, 0, ICS_ERROR_INVALID_PARAM);
+        ICSLIB_CHKARG_LE(max_connections, 4096, ICS_ERROR_INVALID_PARAM);
+
+        ICSLOG_DBG_UINT(max_connections);
+
+        if (s_bluetooth != nil) {
+            if (s_bluetooth.maxConnections != max_connections) {
+                rc = ICS_ERROR_BUSY;
+                ICSLOG_ERR_STR(rc, "Bluetooth is already initialized.");
+                return rc;
+            }
+        } else {
+            ICSLOG_DBG_PRINT(("Begin alloc: Bluetooth\n"));
+            s_bluetooth = [[Bluetooth alloc]
+                              initWithMaxConnections:max_connections];
+            ICSLOG_DBG_PRINT(("End alloc: Bluetooth\n"));
+            if (s_bluetooth == nil) {
+                rc = ICS_ERROR_IO;
+                ICSLOG_ERR_STR(rc, "Bluetooth initialization failed.");
+                return rc;
+            }
+        }
+
+        ICSLOG_FUNC_END;
+        return ICS_ERROR_SUCCESS;
+    }
+}
+
 /**
  * This function gets BLE attributes.
  *
@@ -48,6 +48,8 @@ typedef signed short   INT16;
 typedef unsigned short UINT16;
 typedef signed int     INT32;
 typedef unsigned int   UINT32;
+typedef signed long long   INT64;
+typedef unsigned long long UINT64;
 
 #ifdef __cplusplus
 }
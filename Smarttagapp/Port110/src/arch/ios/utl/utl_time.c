@@ -6,18 +6,60 @@
 
 #include "utl.h"
 
-#include <sys/time.h>
+#include <mach/mach_time.h>
+#include <pthread.h>
+
+static mach_timebase_info_data_t s_utl_timebase;
+static pthread_once_t s_utl_timebase_once = PTHREAD_ONCE_INIT;
+
+/*
+ * This function gets the timebase of mach_absolute_time().
+ * (Called once by pthread_once(), which orders it before the readers.)
+ */
+static void utl_get_timebase(void)
+{
+    mach_timebase_info(&s_utl_timebase);
+}
+
+/**
+ * This function returns the current time of the monotonic clock
+ * in nanosecond.
+ *
+ * \return the current time (nanosecond)
+ */
+UINT64 utl_get_time_nsec(void)
+{
+    UINT64 ticks;
+    UINT32 numer;
+    UINT32 denom;
+
+    pthread_once(&s_utl_timebase_once, utl_get_timebase);
+    numer = s_utl_timebase.numer;
+    denom = s_utl_timebase.denom;
+    ticks = mach_absolute_time();
+
+    /* split so that the multiplication does not overflow */
+    return (((ticks / denom) * numer) +
+            (((ticks % denom) * numer) / denom));
+}
 
 /**
  * This function returns the current time in millisecond.
+ * (It wraps around in about 49 days.)
  *
  * \return the current time (millisecond)
  */
 UINT32 utl_get_time_msec(void)
 {
-    struct timeval tv;
-
-    gettimeofday(&tv, NULL);
+    return (UINT32)(utl_get_time_nsec() / UTL_NSEC_PER_MSEC);
+}
 
-    return (((UINT32)tv.tv_sec * 1000) + (tv.tv_usec / 1000));
+/**
+ * This function returns the current time in microsecond.
+ *
+ * \return the current time (microsecond)
+ */
+UINT64 utl_get_time_usec(void)
+{
+    return (utl_get_time_nsec() / UTL_NSEC_PER_USEC);
 }
@@ -0,0 +1,54 @@
+/**
+ * \brief    Definition of types used in ICS Library (Linux)
+ * \date     2026/10/17
+ * \author   Copyright 2005,2006,2007,2008,2013 Sony Corporation
+ */
+
+#ifndef ARCH_ICS_TYPES_H_
+#define ARCH_ICS_TYPES_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * [Porting Note]
+ *   Modify these definitions according to your system.
+ */
+
+/* file handle */
+
+typedef void* ICS_HANDLE;
+#define ICS_INVALID_HANDLE ((void*)-1)
+
+/* integer types */
+
+typedef int            INT;
+typedef unsigned int   UINT;
+
+/* boolean */
+
+typedef int            BOOL;
+#ifndef TRUE
+#define TRUE   1
+#endif
+#ifndef FALSE
+#define FALSE  0
+#endif
+
+/* bit-width-specific integer types */
+
+typedef signed char    INT8;
+typedef unsigned char  UINT8;
+typedef signed short   INT16;
+typedef unsigned short UINT16;
+typedef signed int     INT32;
+typedef unsigned int   UINT32;
+typedef signed long long   INT64;
+typedef unsigned long long UINT64;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !ARCH_ICS_TYPES_H_ */
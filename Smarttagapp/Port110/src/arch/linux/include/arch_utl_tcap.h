@@ -0,0 +1,20 @@
+/**
+ * \file
+ * \brief  utilities for tcap library (Linux).
+ * \date   2013/05/14
+ * \author Copyright 2007,2008,2013 Sony Corporation
+ */
+#ifndef ARCH_UTL_TCAP_H_INCLUDED__
+#define ARCH_UTL_TCAP_H_INCLUDED__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* utility of ansi c library. */
+#define UTL_CALLOC          calloc
+#define UTL_FREE            free
+#define UTL_MALLOC          malloc
+#define UTL_REALLOC         realloc
+
+#endif /* !ARCH_UTL_TCAP_H_INCLUDED__ */
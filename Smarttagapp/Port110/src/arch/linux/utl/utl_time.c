@@ -0,0 +1,45 @@
+/**
+ * \brief    Time routines (Linux)
+ * \date     2013/03/20
+ * \author   Copyright 2005,2006,2008,2013 Sony Corporation
+ */
+
+#include "utl.h"
+
+#include <time.h>
+
+/**
+ * This function returns the current time of the monotonic clock
+ * in nanosecond.
+ *
+ * \return the current time (nanosecond)
+ */
+UINT64 utl_get_time_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (((UINT64)ts.tv_sec * 1000000000) + (UINT64)ts.tv_nsec);
+}
+
+/**
+ * This function returns the current time in millisecond.
+ * (It wraps around in about 49 days.)
+ *
+ * \return the current time (millisecond)
+ */
+UINT32 utl_get_time_msec(void)
+{
+    return (UINT32)(utl_get_time_nsec() / UTL_NSEC_PER_MSEC);
+}
+
+/**
+ * This function returns the current time in microsecond.
+ *
+ * \return the current time (microsecond)
+ */
+UINT64 utl_get_time_usec(void)
+{
+    return (utl_get_time_nsec() / UTL_NSEC_PER_USEC);
+}
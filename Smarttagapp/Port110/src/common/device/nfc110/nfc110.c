@@ -12,9 +12,25 @@
 #include "icslib_chk.h"
 #include "icslog.h"
 #include "utl.h"
+#include "icstrace.h"
 
 #include "nfc110.h"
 
+/*
+ * The checksums of the frames are calculated 16 bytes at a time with
+ * SSE2 or NEON, or a word at a time without them.
+ * Define NFC110_USE_SCALAR_CHECKSUM to calculate them byte by byte.
+ */
+#if !defined(NFC110_USE_SCALAR_CHECKSUM)
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define NFC110_CHECKSUM_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define NFC110_CHECKSUM_NEON
+#endif
+#endif
+
 /* --------------------------------
  * Constant
  * -------------------------------- */
@@ -27,6 +43,11 @@
 #define NFC110_COMMAND_POS              8
 #define NFC110_RESPONSE_POS             8
 
+#define NFC110_ACK_LEN                  6
+/* the response may follow the ACK in the same read */
+#define NFC110_FRAME_BUF_LEN            (NFC110_ACK_LEN + NFC110_COMMAND_BUF_LEN)
+#define NFC110_MAX_FRAME_SEGS           4
+
 #define NFC110_COMMAND_TYPE_LEN         8
 
 #define NFC110_DEFAULT_SPEED            NFC110_BLE_SPEED
@@ -44,6 +65,39 @@
 /* the time until a finish to send a 1013bytes data at 400bps. */
 #define NFC110_CANCEL_COMMAND_SWEEP_TIME_OUT                26000 /* ms */
 
+/* the number of words summed before the 16-bit lanes may overflow */
+#define NFC110_CHECKSUM_MAX_WORDS       128
+
+/* the devices whose protocol settings are shadowed at once */
+#define NFC110_MAX_SHADOWS              8
+
+/* --------------------------------
+ * Struct Declaration
+ * -------------------------------- */
+
+#if defined(__GNUC__)
+typedef UINT64 __attribute__((__may_alias__)) nfc110_word_t;
+#else
+typedef UINT64 nfc110_word_t;
+#endif
+
+/* a caller-owned piece of the command (scatter/gather) */
+typedef struct {
+    const UINT8* data;
+    UINT32 len;
+} nfc110_frame_seg_t;
+
+/*
+ * The protocol settings last set to a device by InSetProtocol.
+ * A slot is claimed by the device and written only by the calls on it,
+ * which are serialized by the caller.
+ */
+typedef struct {
+    ICS_HW_DEVICE* volatile nfc110;     /* NULL: free */
+    UINT32 valid;                       /* bit n: protocol[n] is known */
+    UINT8 protocol[NFC110_MAX_IN_SET_PROTOCOL_SETTING_NUM + 1];
+} nfc110_shadow_t;
+
 /* --------------------------------
  * Prototype Declaration
  * -------------------------------- */
@@ -53,18 +107,38 @@ static UINT32 nfc110_get_command_type(
     UINT8 cmd_type[NFC110_COMMAND_TYPE_LEN],
     UINT32 timeout);
 
+static UINT32 nfc110_set_command_type(
+    ICS_HW_DEVICE* nfc110,
+    UINT32 timeout);
+
 static UINT32 nfc110_execute_command_internal(
     ICS_HW_DEVICE* nfc110,
-    UINT8 command_buf[NFC110_COMMAND_BUF_LEN],
-    UINT32 command_len,
+    const nfc110_frame_seg_t* segs,
+    UINT32 nsegs,
+    UINT8 frame_buf[NFC110_FRAME_BUF_LEN],
     UINT32* response_pos,
+    const UINT8** response,
     UINT32* response_len,
     UINT32 timeout);
 
 static UINT32 nfc110_sweep(
     ICS_HW_DEVICE* nfc110);
 
-static UINT8 nfc110_calc_dcs(
+static UINT32 nfc110_raw_write(
+    ICS_HW_DEVICE* nfc110,
+    const UINT8* data,
+    UINT32 data_len,
+    const utl_deadline_t* deadline);
+
+static UINT32 nfc110_raw_read(
+    ICS_HW_DEVICE* nfc110,
+    UINT32 min_read_len,
+    UINT32 max_read_len,
+    UINT8* data,
+    UINT32* read_len,
+    const utl_deadline_t* deadline);
+
+static UINT8 nfc110_calc_sum(
     const UINT8* data,
     UINT32 data_len);
 
@@ -74,6 +148,19 @@ static UINT32 nfc110_convert_dev_status(
 static UINT32 nfc110_convert_rf_status(
     UINT32 status);
 
+static nfc110_shadow_t* nfc110_get_shadow(
+    ICS_HW_DEVICE* nfc110,
+    BOOL claim);
+
+static void nfc110_invalidate_rf_state(
+    ICS_HW_DEVICE* nfc110);
+
+/* --------------------------------
+ * Global Variable
+ * -------------------------------- */
+
+static nfc110_shadow_t s_nfc110_shadows[NFC110_MAX_SHADOWS];
+
 /* --------------------------------
  * Function
  * -------------------------------- */
@@ -82,11 +169,20 @@ static UINT32 nfc110_convert_rf_status(
  * Macro
  * ------------------------ */
 
+/* the lower 32 bits of utl_get_time_usec() */
 #define NFC110_ACK_TIME(nfc110) ((nfc110)->priv_value)
 #define NFC110_RAW_FUNC(nfc110) ((icsdrv_raw_func_t*)((nfc110)->priv_data))
 #define NFC110_RAW_EXT_FUNC(nfc110) \
     ((nfc110_raw_ext_func_t*)(NFC110_RAW_FUNC(nfc110)->ext))
 
+/* the RF speed set by InSetRF (RBT 0: unknown) */
+#define NFC110_IS_RF_SPEED(nfc110, tx_rbt, tx_speed, rx_rbt, rx_speed) \
+    ((NFC110_TX_RBT(nfc110) != 0) && \
+     (NFC110_TX_RBT(nfc110) == (tx_rbt)) && \
+     (NFC110_TX_SPEED(nfc110) == (tx_speed)) && \
+     (NFC110_RX_RBT(nfc110) == (rx_rbt)) && \
+     (NFC110_RX_SPEED(nfc110) == (rx_speed)))
+
 /* ------------------------
  * Exported
  * ------------------------ */
@@ -181,6 +277,9 @@ UINT32 nfc110_open(
 
     NFC110_ACK_TIME(nfc110) = 0;
 
+    /* the device may have been reset since the last connection */
+    nfc110_invalidate_rf_state(nfc110);
+
     ICSLOG_DBG_HEX(nfc110->handle);
 
     ICSLOG_FUNC_END;
@@ -202,6 +301,7 @@ UINT32 nfc110_close(
 #undef ICSLOG_FUNC
 #define ICSLOG_FUNC "nfc110_close"
     UINT32 rc;
+    nfc110_shadow_t* shadow;
     ICSLOG_FUNC_BEGIN;
 
     ICSLIB_CHKARG_NE(nfc110, NULL, ICS_ERROR_INVALID_PARAM);
@@ -209,6 +309,16 @@ UINT32 nfc110_close(
 
     ICSLOG_DBG_PTR(nfc110);
 
+    /*
+     * release the shadow of the protocol settings, even if the port
+     * fails to close, so that the slots are not used up by reopens
+     */
+    nfc110_invalidate_rf_state(nfc110);
+    shadow = nfc110_get_shadow(nfc110, FALSE);
+    if (shadow != NULL) {
+        shadow->nfc110 = NULL;
+    }
+
     if (NFC110_RAW_FUNC(nfc110)->close != NULL) {
         rc = NFC110_RAW_FUNC(nfc110)->close(nfc110->handle);
         if (rc != ICS_ERROR_SUCCESS) {
@@ -243,9 +353,6 @@ UINT32 nfc110_initialize_device(
 #undef ICSLOG_FUNC
 #define ICSLOG_FUNC "nfc110_initialize_device"
     UINT32 rc;
-    UINT8 command[3];
-    UINT8 response[10];
-    UINT32 response_len;
     UINT8 cmd_type[NFC110_COMMAND_TYPE_LEN];
     UINT8 cmd_type_offset_byte;
     ICSLOG_FUNC_BEGIN;
@@ -281,40 +388,71 @@ UINT32 nfc110_initialize_device(
     }
 
     /* send a SetCommandType */
-    command[0] = NFC110_COMMAND_CODE;
-    command[1] = NFC110_CMD_SET_COMMAND_TYPE;
-    command[2] = NFC110_SUPPORTED_COMMAND_TYPE;
-    rc = nfc110_execute_command(nfc110,
-                                command,
-                                3,
-                                3,
-                                response,
-                                &response_len,
-                                timeout);
+    rc = nfc110_set_command_type(nfc110, timeout);
     if (rc != ICS_ERROR_SUCCESS) {
-        ICSLOG_ERR_STR(rc, "nfc110_execute_command()");
-        if (rc == ICS_ERROR_BUF_OVERFLOW) {
-            rc = ICS_ERROR_INVALID_RESPONSE;
-            ICSLOG_ERR_STR(rc, "Buffer overflow.");
-        }
+        ICSLOG_ERR_STR(rc, "nfc110_set_command_type()");
         return rc;
     }
-    if ((response_len != 3) ||
-        (response[0] != NFC110_RESPONSE_CODE) ||
-        (response[1] != NFC110_RES_SET_COMMAND_TYPE)) {
-        rc = ICS_ERROR_INVALID_RESPONSE;
-        ICSLOG_ERR_STR(rc, "Invalid response.");
+
+    /* forget the settings, and reset the mode of driver */
+    nfc110_invalidate_rf_state(nfc110);
+    rc = nfc110_reset(nfc110, timeout);
+    if (rc != ICS_ERROR_SUCCESS) {
+        ICSLOG_ERR_STR(rc, "nfc110_reset()");
         return rc;
     }
 
-    /* check the response status */
-    rc = nfc110_convert_dev_status(response[2]);
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function initializes a device which nfc110_initialize_device()
+ * initialized before, e.g. a reader reconnected over BLE.
+ * The command type which the device supports is not checked again.
+ * If this function fails, call nfc110_initialize_device().
+ *
+ * \param  nfc110                 [IN] The handle to access the port.
+ * \param  timeout                [IN] Time-out period. (ms)
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_TIMEOUT           Time-out.
+ * \retval ICS_ERROR_IO                Other driver error.
+ * \retval ICS_ERROR_INVALID_RESPONSE  Invalid response.
+ * \retval ICS_ERROR_DEVICE            Error at device.
+ */
+UINT32 nfc110_resume_device(
+    ICS_HW_DEVICE* nfc110,
+    UINT32 timeout)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_resume_device"
+    UINT32 rc;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(nfc110, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(NFC110_RAW_FUNC(nfc110), NULL, ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_PTR(nfc110);
+    ICSLOG_DBG_UINT(timeout);
+
+    /* cancel the previous command */
+    rc = nfc110_cancel_command(nfc110);
     if (rc != ICS_ERROR_SUCCESS) {
-        ICSLOG_ERR_STR(rc, "nfc110_convert_dev_status()");
+        ICSLOG_ERR_STR(rc, "nfc110_cancel_command()");
         return rc;
     }
 
-    /* reset the mode of driver */
+    /* send a SetCommandType */
+    rc = nfc110_set_command_type(nfc110, timeout);
+    if (rc != ICS_ERROR_SUCCESS) {
+        ICSLOG_ERR_STR(rc, "nfc110_set_command_type()");
+        return rc;
+    }
+
+    /* forget the settings, and reset the mode of driver */
+    nfc110_invalidate_rf_state(nfc110);
     rc = nfc110_reset(nfc110, timeout);
     if (rc != ICS_ERROR_SUCCESS) {
         ICSLOG_ERR_STR(rc, "nfc110_reset()");
@@ -459,15 +597,15 @@ UINT32 nfc110_reset(
     ICSLOG_DBG_PTR(nfc110);
     ICSLOG_DBG_UINT(timeout);
 
-    /* reset NFC Port-110 to default protocol setting */
-    rc = nfc110_set_rf_speed(nfc110,
-                             NFC110_DEFAULT_RF_RBT_TX,
-                             NFC110_DEFAULT_RF_SPEED_TX,
-                             NFC110_DEFAULT_RF_RBT_RX,
-                             NFC110_DEFAULT_RF_SPEED_RX,
-                             timeout);
+    /* reset NFC Port-110 to default RF speed, unless it is already */
+    rc = nfc110_update_rf_speed(nfc110,
+                                NFC110_DEFAULT_RF_RBT_TX,
+                                NFC110_DEFAULT_RF_SPEED_TX,
+                                NFC110_DEFAULT_RF_RBT_RX,
+                                NFC110_DEFAULT_RF_SPEED_RX,
+                                timeout);
     if (rc != ICS_ERROR_SUCCESS) {
-        ICSLOG_ERR_STR(rc, "nfc110_set_rf_speed()");
+        ICSLOG_ERR_STR(rc, "nfc110_update_rf_speed()");
         return rc;
     }
     NFC110_SET_LAST_MODE(nfc110, NFC110_DEFAULT_MODE);
@@ -507,7 +645,9 @@ UINT32 nfc110_execute_command(
 #define ICSLOG_FUNC "nfc110_execute_command"
     UINT32 rc;
     UINT32 response_pos;
-    UINT8 buf[NFC110_COMMAND_BUF_LEN];
+    const UINT8* res;
+    nfc110_frame_seg_t seg;
+    UINT8 buf[NFC110_FRAME_BUF_LEN];
     ICSLOG_FUNC_BEGIN;
 
     ICSLIB_CHKARG_NE(nfc110, NULL, ICS_ERROR_INVALID_PARAM);
@@ -524,14 +664,15 @@ UINT32 nfc110_execute_command(
     ICSLOG_DBG_UINT(max_response_len);
     ICSLOG_DBG_UINT(timeout);
 
-    /* copy the command to the buffer */
-    utl_memcpy((buf + NFC110_COMMAND_POS), command, command_len);
-
     /* execute the command */
+    seg.data = command;
+    seg.len = command_len;
     rc = nfc110_execute_command_internal(nfc110,
+                                         &seg,
+                                         1,
                                          buf,
-                                         command_len,
                                          &response_pos,
+                                         &res,
                                          response_len,
                                          timeout);
     if (rc != ICS_ERROR_SUCCESS) {
@@ -541,10 +682,10 @@ UINT32 nfc110_execute_command(
     ICSLOG_DBG_UINT(*response_len);
 
     if (*response_len <= max_response_len) {
-        utl_memcpy(response, (buf + response_pos), *response_len);
+        utl_memcpy(response, res, *response_len);
         ICSLOG_DUMP(response, *response_len);
     } else {
-        utl_memcpy(response, (buf + response_pos), max_response_len);
+        utl_memcpy(response, res, max_response_len);
         ICSLOG_DUMP(response, max_response_len);
         rc = ICS_ERROR_BUF_OVERFLOW;
         return rc;
@@ -598,10 +739,13 @@ UINT32 nfc110_rf_command(
     UINT32 rc2;
     UINT32 nfield;
     UINT32 timeout_0_1;
-    UINT32 nfc110_command_len;
     UINT32 nfc110_response_len;
     UINT32 nfc110_response_pos;
-    UINT8 buf[NFC110_COMMAND_BUF_LEN];
+    const UINT8* res;
+    UINT8 header[5];
+    nfc110_frame_seg_t segs[2];
+    UINT32 nsegs;
+    UINT8 buf[NFC110_FRAME_BUF_LEN];
     UINT32 stat;
     UINT8 vbit;
     ICSLOG_FUNC_BEGIN;
@@ -648,31 +792,36 @@ UINT32 nfc110_rf_command(
         timeout_0_1 = (command_timeout * 10);
     }
 
-    buf[NFC110_COMMAND_POS + 0] = NFC110_COMMAND_CODE;
-    buf[NFC110_COMMAND_POS + 1] = NFC110_CMD_IN_COMM_RF;
+    header[0] = NFC110_COMMAND_CODE;
+    header[1] = NFC110_CMD_IN_COMM_RF;
     if (response == NULL) {
-        buf[NFC110_COMMAND_POS + 2] = 0; /* no data to receive */
-        buf[NFC110_COMMAND_POS + 3] = 0;
+        header[2] = 0; /* no data to receive */
+        header[3] = 0;
     } else {
-        buf[NFC110_COMMAND_POS + 2] = (UINT8)((timeout_0_1 >> 0) & 0xff);
-        buf[NFC110_COMMAND_POS + 3] = (UINT8)((timeout_0_1 >> 8) & 0xff);
+        header[2] = (UINT8)((timeout_0_1 >> 0) & 0xff);
+        header[3] = (UINT8)((timeout_0_1 >> 8) & 0xff);
     }
+    segs[0].data = header;
     if (command_len > 0) {
         if (need_len) {
-            buf[NFC110_COMMAND_POS + 4] = (command_len + 1);
+            header[4] = (command_len + 1);
         }
-        utl_memcpy(
-            (buf + NFC110_COMMAND_POS + 4 + nfield), command, command_len);
-        nfc110_command_len = (4 + nfield + command_len);
+        segs[0].len = (4 + nfield);
+        segs[1].data = command;
+        segs[1].len = command_len;
+        nsegs = 2;
     } else {
-        nfc110_command_len = 4;
+        segs[0].len = 4;
+        nsegs = 1;
     }
 
     /* send the packet to NFC Port-110 */
     rc = nfc110_execute_command_internal(nfc110,
+                                         segs,
+                                         nsegs,
                                          buf,
-                                         nfc110_command_len,
                                          &nfc110_response_pos,
+                                         &res,
                                          &nfc110_response_len,
                                          timeout);
     if (rc != ICS_ERROR_SUCCESS) {
@@ -692,8 +841,8 @@ UINT32 nfc110_rf_command(
      response does not include "RxLastBit" field */
     if ((nfc110_response_pos != NFC110_RESPONSE_POS) ||
         (nfc110_response_len < 6) ||
-        (buf[nfc110_response_pos + 0] != NFC110_RESPONSE_CODE) ||
-        (buf[nfc110_response_pos + 1] != NFC110_RES_IN_COMM_RF)) {
+        (res[0] != NFC110_RESPONSE_CODE) ||
+        (res[1] != NFC110_RES_IN_COMM_RF)) {
         rc = ICS_ERROR_INVALID_RESPONSE;
         ICSLOG_ERR_STR(rc, "Invalid response.");
 
@@ -708,7 +857,7 @@ UINT32 nfc110_rf_command(
 
     vbit = 0;
     if ((nfc110_response_len > 7) && (response != NULL)) {
-        vbit = buf[nfc110_response_pos + 6];
+        vbit = res[6];
         if ((vbit != 8) && (valid_bit == NULL)) {
             rc = ICS_ERROR_INVALID_RESPONSE;
             ICSLOG_ERR_STR(rc, "Invalid RxLastBit.");
@@ -716,7 +865,7 @@ UINT32 nfc110_rf_command(
         }
 
         if (need_len &&
-            (buf[nfc110_response_pos + 7] != (nfc110_response_len - 7))) {
+            (res[7] != (nfc110_response_len - 7))) {
             rc = ICS_ERROR_INVALID_RESPONSE;
             ICSLOG_ERR_STR(rc, "Invalid response.");
             return rc;
@@ -724,18 +873,14 @@ UINT32 nfc110_rf_command(
         *response_len = (nfc110_response_len - 7 - nfield);
         ICSLOG_DBG_UINT(*response_len);
         if (*response_len > max_response_len) {
-            utl_memcpy(response,
-                       (buf + nfc110_response_pos + 7 + nfield),
-                       max_response_len);
+            utl_memcpy(response, (res + 7 + nfield), max_response_len);
             ICSLOG_DUMP(response, max_response_len);
 
             rc = ICS_ERROR_BUF_OVERFLOW;
             ICSLOG_ERR_STR(rc, "Buffer overflow.");
             return rc;
         }
-        utl_memcpy(response,
-                   (buf + nfc110_response_pos + 7 + nfield),
-                   *response_len);
+        utl_memcpy(response, (res + 7 + nfield), *response_len);
         ICSLOG_DUMP(response, *response_len);
     } else if (response_len != NULL) {
         vbit = 0;
@@ -743,10 +888,10 @@ UINT32 nfc110_rf_command(
         ICSLOG_DBG_UINT(*response_len);
     }
 
-    stat = (((UINT32)buf[nfc110_response_pos + 2] <<  0) |
-            ((UINT32)buf[nfc110_response_pos + 3] <<  8) |
-            ((UINT32)buf[nfc110_response_pos + 4] << 16) |
-            ((UINT32)buf[nfc110_response_pos + 5] << 24));
+    stat = (((UINT32)res[2] <<  0) |
+            ((UINT32)res[3] <<  8) |
+            ((UINT32)res[4] << 16) |
+            ((UINT32)res[5] << 24));
 
     ICSLOG_DBG_HEX(stat);
     ICSLOG_DBG_UINT(vbit);
@@ -788,7 +933,7 @@ UINT32 nfc110_send_ack(
 #define ICSLOG_FUNC "nfc110_send_ack"
     UINT32 rc;
     static const UINT8 ack[6] = {0x00, 0x00, 0xff, 0x00, 0xff, 0x00};
-    UINT32 time0;
+    utl_deadline_t deadline;
     ICSLOG_FUNC_BEGIN;
 
     ICSLIB_CHKARG_NE(nfc110, NULL, ICS_ERROR_INVALID_PARAM);
@@ -797,15 +942,11 @@ UINT32 nfc110_send_ack(
     ICSLOG_DBG_PTR(nfc110);
     ICSLOG_DBG_UINT(timeout);
 
-    time0 = utl_get_time_msec();
+    utl_deadline_set(&deadline, ((UINT64)timeout * UTL_NSEC_PER_MSEC));
 
     /* send command */
     if (NFC110_RAW_FUNC(nfc110)->write != NULL) {
-        rc = NFC110_RAW_FUNC(nfc110)->write(nfc110->handle,
-                                            ack,
-                                            sizeof(ack),
-                                            time0,
-                                            timeout);
+        rc = nfc110_raw_write(nfc110, ack, sizeof(ack), &deadline);
         if (rc != ICS_ERROR_SUCCESS) {
             ICSLOG_ERR_STR(rc, "icsdrv_raw_func->write()");
             return rc;
@@ -838,6 +979,7 @@ UINT32 nfc110_cancel_command(
     ICSLIB_CHKARG_NE(NFC110_RAW_FUNC(nfc110), NULL, ICS_ERROR_INVALID_PARAM);
 
     ICSLOG_DBG_PTR(nfc110);
+    ICSTRACE(ICSTRACE_EVENT_CANCEL, ICSTRACE_TAG_NFC110, 0);
 
     /* drain the transmitting queue */
     if (NFC110_RAW_FUNC(nfc110)->drain_tx_queue != NULL) {
@@ -943,6 +1085,7 @@ UINT32 nfc110_felica_command(
 
 /**
  * This function turns RF off.
+ * The RF speed and the protocol settings of the device are kept.
  *
  * \param  nfc110                 [IN] The handle to access the port.
  * \param  timeout                [IN] Time-out period. (ms)
@@ -1144,6 +1287,12 @@ UINT32 nfc110_set_rf_speed(
     command[4] = rx_rbt;
     command[5] = rx_speed;
     command_len = 6;
+    /*
+     * The device may load the protocol settings of the RF type,
+     * and the settings are unknown until InSetRF succeeds.
+     */
+    nfc110_invalidate_rf_state(nfc110);
+
     rc = nfc110_execute_command(nfc110,
                                 command,
                                 command_len,
@@ -1212,6 +1361,8 @@ UINT32 nfc110_set_protocol(
     UINT8 response[3];
     UINT32 response_len;
     UINT32 len;
+    nfc110_shadow_t* shadow;
+    UINT32 i;
     ICSLOG_FUNC_BEGIN;
 
     /* check the parameters */
@@ -1229,6 +1380,16 @@ UINT32 nfc110_set_protocol(
     ICSLOG_DUMP(setting, setting_len);
     ICSLOG_DBG_UINT(timeout);
 
+    /* the settings are unknown until the command succeeds */
+    shadow = nfc110_get_shadow(nfc110, TRUE);
+    if (shadow != NULL) {
+        for (i = 0; i < setting_len; i += 2) {
+            if (setting[i] <= NFC110_MAX_IN_SET_PROTOCOL_SETTING_NUM) {
+                shadow->valid &= ~(1UL << setting[i]);
+            }
+        }
+    }
+
     /* send a InSetProtocol command */
     command[0] = NFC110_COMMAND_CODE;
     command[1] = NFC110_CMD_IN_SET_PROTOCOL;
@@ -1264,10 +1425,157 @@ UINT32 nfc110_set_protocol(
         return rc;
     }
 
+    if (shadow != NULL) {
+        for (i = 0; i < setting_len; i += 2) {
+            if (setting[i] <= NFC110_MAX_IN_SET_PROTOCOL_SETTING_NUM) {
+                shadow->protocol[setting[i]] = setting[i + 1];
+                shadow->valid |= (1UL << setting[i]);
+            }
+        }
+    }
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function sets the RF speed of the device, unless the device is
+ * known to be set to it already.
+ *
+ * \param  nfc110                 [IN] The handle to access the port.
+ * \param  tx_rbt                 [IN] The TX RBT number to set.
+ * \param  tx_speed               [IN] The TX RF speed to set.
+ * \param  rx_rbt                 [IN] The RX RBT number to set.
+ * \param  rx_speed               [IN] The RX RF speed to set.
+ * \param  timeout                [IN] Time-out period. (ms)
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_TIMEOUT           Time-out.
+ * \retval ICS_ERROR_IO                Other driver error.
+ * \retval ICS_ERROR_INVALID_RESPONSE  Invalid response.
+ * \retval ICS_ERROR_DEVICE            Error at device.
+ */
+UINT32 nfc110_update_rf_speed(
+    ICS_HW_DEVICE* nfc110,
+    UINT8 tx_rbt,
+    UINT8 tx_speed,
+    UINT8 rx_rbt,
+    UINT8 rx_speed,
+    UINT32 timeout)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_update_rf_speed"
+    UINT32 rc;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(nfc110, NULL, ICS_ERROR_INVALID_PARAM);
+
+    if (NFC110_IS_RF_SPEED(nfc110, tx_rbt, tx_speed, rx_rbt, rx_speed)) {
+        ICSLOG_DBG_PRINT(("The RF speed is already set.\n"));
+        ICSLOG_FUNC_END;
+        return ICS_ERROR_SUCCESS;
+    }
+
+    rc = nfc110_set_rf_speed(nfc110, tx_rbt, tx_speed, rx_rbt, rx_speed,
+                             timeout);
+    if (rc != ICS_ERROR_SUCCESS) {
+        ICSLOG_ERR_STR(rc, "nfc110_set_rf_speed()");
+        return rc;
+    }
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function sets the rf protocol setting data of the device,
+ * sending only the settings which the device is not known to have.
+ *
+ * \param  nfc110                 [IN] The handle to access the port.
+ * \param  setting                [IN] The bytes of setting data.
+ * \param  setting_len            [IN] The length of the setting data.
+ * \param  timeout                [IN] Time-out period. (ms)
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_TIMEOUT           Time-out.
+ * \retval ICS_ERROR_IO                Other driver error.
+ * \retval ICS_ERROR_INVALID_RESPONSE  Invalid response.
+ * \retval ICS_ERROR_DEVICE            Error at device.
+ */
+UINT32 nfc110_update_protocol(
+    ICS_HW_DEVICE* nfc110,
+    const UINT8* setting,
+    UINT32 setting_len,
+    UINT32 timeout)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_update_protocol"
+    UINT32 rc;
+    UINT8 changed[NFC110_MAX_IN_SET_PROTOCOL_SETTING_NUM * 2];
+    UINT32 changed_len;
+    UINT32 len;
+    const nfc110_shadow_t* shadow;
+    UINT32 i;
+    ICSLOG_FUNC_BEGIN;
+
+    /* check the parameters */
+    ICSLIB_CHKARG_NE(nfc110, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(setting, NULL, ICS_ERROR_INVALID_PARAM);
+    len = (setting_len % 2);
+    ICSLIB_CHKARG_EQ(len, 0, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_IN_RANGE((setting_len / 2),
+                           1, NFC110_MAX_IN_SET_PROTOCOL_SETTING_NUM,
+                           ICS_ERROR_INVALID_PARAM);
+
+    /* pick up the settings which differ from the shadow */
+    shadow = nfc110_get_shadow(nfc110, TRUE);
+    changed_len = 0;
+    for (i = 0; i < setting_len; i += 2) {
+        if ((shadow != NULL) &&
+            (setting[i] <= NFC110_MAX_IN_SET_PROTOCOL_SETTING_NUM) &&
+            ((shadow->valid & (1UL << setting[i])) != 0) &&
+            (shadow->protocol[setting[i]] == setting[i + 1])) {
+            continue;
+        }
+        changed[changed_len + 0] = setting[i + 0];
+        changed[changed_len + 1] = setting[i + 1];
+        changed_len += 2;
+    }
+    ICSLOG_DBG_UINT(changed_len);
+
+    if (changed_len > 0) {
+        rc = nfc110_set_protocol(nfc110, changed, changed_len, timeout);
+        if (rc != ICS_ERROR_SUCCESS) {
+            ICSLOG_ERR_STR(rc, "nfc110_set_protocol()");
+            return rc;
+        }
+    }
+
     ICSLOG_FUNC_END;
     return ICS_ERROR_SUCCESS;
 }
 
+/**
+ * This function returns whether or not the protocol settings of the
+ * device are shadowed, claiming a free slot if the device has none.
+ * Without a shadow, nfc110_update_protocol() sends all the settings,
+ * so the caller should send them only when the mode changes.
+ *
+ * \param  nfc110                 [IN] The handle to access the port.
+ *
+ * \return TRUE if the settings are shadowed.
+ */
+BOOL nfc110_has_protocol_shadow(
+    ICS_HW_DEVICE* nfc110)
+{
+    if (nfc110 == NULL) {
+        return FALSE;
+    }
+    return (nfc110_get_shadow(nfc110, TRUE) != NULL);
+}
+
 /**
  * This function gets the rf protocol setting data of the device.
  *
@@ -1426,7 +1734,9 @@ UINT32 nfc110_get_ack_time(
 
     ICSLOG_DBG_PTR(nfc110);
 
-    *ack_time = NFC110_ACK_TIME(nfc110);
+    *ack_time = (utl_get_time_msec() -
+                 (((UINT32)utl_get_time_usec() - NFC110_ACK_TIME(nfc110)) /
+                  1000));
 
     ICSLOG_DBG_UINT(*ack_time);
 
@@ -1434,6 +1744,38 @@ UINT32 nfc110_get_ack_time(
     return ICS_ERROR_SUCCESS;
 }
 
+/**
+ * This function returns the time when this driver received the last ACK
+ * in microsecond. The time is the lower 32 bits of utl_get_time_usec(),
+ * so compare it by the difference.
+ *
+ * \param  nfc110                 [IN] The handle to access the port.
+ * \param  ack_time_usec         [OUT] The time when received an ACK.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ */
+UINT32 nfc110_get_ack_time_usec(
+    ICS_HW_DEVICE* nfc110,
+    UINT32* ack_time_usec)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_get_ack_time_usec"
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(nfc110, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(ack_time_usec, NULL, ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_PTR(nfc110);
+
+    *ack_time_usec = NFC110_ACK_TIME(nfc110);
+
+    ICSLOG_DBG_UINT(*ack_time_usec);
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
 /**
  * This function gets version of the BLE.
  *
@@ -2182,6 +2524,107 @@ UINT32 nfc110_reset_device(
     return ICS_ERROR_SUCCESS;
 }
 
+/**
+ * This function checks a frame received from the device.
+ *
+ * The preamble, the LCS, the DCS and the postamble are checked in one
+ * pass. If the frame is not complete yet, what has been received is
+ * checked, and needed_len is set to the length to receive before the
+ * frame can be checked further.
+ *
+ * \param  frame                  [IN] The received frame.
+ * \param  frame_len              [IN] The length of the received frame.
+ * \param  needed_len            [OUT] The length of the whole frame
+ *                                      (or of its header).
+ * \param  response_pos          [OUT] Position of the response in the
+ *                                      frame. (Not set until the header
+ *                                      has been received.)
+ * \param  response_len          [OUT] The length of the response.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_INVALID_RESPONSE  Invalid frame.
+ */
+UINT32 nfc110_check_frame(
+    const UINT8* frame,
+    UINT32 frame_len,
+    UINT32* needed_len,
+    UINT32* response_pos,
+    UINT32* response_len)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_check_frame"
+    UINT32 rc;
+    UINT32 pos;
+    UINT32 len;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(frame, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(needed_len, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(response_pos, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(response_len, NULL, ICS_ERROR_INVALID_PARAM);
+
+    /* preamble, start of packet and LEN/LCS (or the extended marker) */
+    *needed_len = 6;
+    if (frame_len < *needed_len) {
+        ICSLOG_FUNC_END;
+        return ICS_ERROR_SUCCESS;
+    }
+    if ((frame[0] != 0x00) || (frame[1] != 0x00) || (frame[2] != 0xff)) {
+        rc = ICS_ERROR_INVALID_RESPONSE;
+        ICSLOG_ERR_STR(rc, "Invalid response header.");
+        return rc;
+    }
+    if ((frame[3] == 0xff) && (frame[4] == 0xff)) {
+        /* extended frame */
+        *needed_len = 9;
+        if (frame_len < *needed_len) {
+            ICSLOG_FUNC_END;
+            return ICS_ERROR_SUCCESS;
+        }
+        if ((UINT8)(frame[5] + frame[6] + frame[7]) != 0) {
+            rc = ICS_ERROR_INVALID_RESPONSE;
+            ICSLOG_ERR_STR(rc, "Invalid response - lcs");
+            return rc;
+        }
+        pos = 8;
+        len = (((UINT32)frame[5] << 0) |
+               ((UINT32)frame[6] << 8));
+    } else {
+        /* normal frame */
+        if ((UINT8)(frame[3] + frame[4]) != 0) {
+            rc = ICS_ERROR_INVALID_RESPONSE;
+            ICSLOG_ERR_STR(rc, "Invalid response header.");
+            return rc;
+        }
+        pos = 5;
+        len = frame[3];
+    }
+    if (len > NFC110_MAX_RESPONSE_LEN) {
+        rc = ICS_ERROR_INVALID_RESPONSE;
+        ICSLOG_ERR_STR(rc, "Too long response length.");
+        return rc;
+    }
+    *response_pos = pos;
+    *response_len = len;
+    *needed_len = (pos + len + 2);
+    if (frame_len < *needed_len) {
+        ICSLOG_FUNC_END;
+        return ICS_ERROR_SUCCESS;
+    }
+
+    /* the data and the DCS sum up to zero, followed by the postamble */
+    if ((nfc110_calc_sum(frame + pos, (len + 1)) != 0) ||
+        (frame[pos + len + 1] != 0x00)) {
+        rc = ICS_ERROR_INVALID_RESPONSE;
+        ICSLOG_ERR_STR(rc, "Invalid response body.");
+        return rc;
+    }
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
 /* ------------------------
  * Internal
  * ------------------------ */
@@ -2255,15 +2698,83 @@ static UINT32 nfc110_get_command_type(
     return ICS_ERROR_SUCCESS;
 }
 
+/**
+ * This function sets the command type of the device to
+ * NFC110_SUPPORTED_COMMAND_TYPE.
+ *
+ * \param  nfc110         [IN] The handle to access the port.
+ * \param  timeout        [IN] Time-out period. (ms)
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_TIMEOUT           Time-out.
+ * \retval ICS_ERROR_IO                Other driver error.
+ * \retval ICS_ERROR_INVALID_RESPONSE  Received an invalid response.
+ * \retval ICS_ERROR_DEVICE            Error at device.
+ */
+static UINT32 nfc110_set_command_type(
+    ICS_HW_DEVICE* nfc110,
+    UINT32 timeout)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_set_command_type"
+    UINT32 rc;
+    UINT8 command[3];
+    UINT8 response[3];
+    UINT32 response_len;
+    ICSLOG_FUNC_BEGIN;
+
+    command[0] = NFC110_COMMAND_CODE;
+    command[1] = NFC110_CMD_SET_COMMAND_TYPE;
+    command[2] = NFC110_SUPPORTED_COMMAND_TYPE;
+    rc = nfc110_execute_command(nfc110,
+                                command,
+                                3,
+                                sizeof(response),
+                                response,
+                                &response_len,
+                                timeout);
+    if (rc != ICS_ERROR_SUCCESS) {
+        ICSLOG_ERR_STR(rc, "nfc110_execute_command()");
+        if (rc == ICS_ERROR_BUF_OVERFLOW) {
+            rc = ICS_ERROR_INVALID_RESPONSE;
+            ICSLOG_ERR_STR(rc, "Buffer overflow.");
+        }
+        return rc;
+    }
+    if ((response_len != 3) ||
+        (response[0] != NFC110_RESPONSE_CODE) ||
+        (response[1] != NFC110_RES_SET_COMMAND_TYPE)) {
+        rc = ICS_ERROR_INVALID_RESPONSE;
+        ICSLOG_ERR_STR(rc, "Invalid response.");
+        return rc;
+    }
+
+    /* check the response status */
+    rc = nfc110_convert_dev_status(response[2]);
+    if (rc != ICS_ERROR_SUCCESS) {
+        ICSLOG_ERR_STR(rc, "nfc110_convert_dev_status()");
+        return rc;
+    }
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
 /**
  * This function sends a command to the device and receives response.
  *
+ * The command is given as a list of caller-owned segments. They are
+ * gathered into frame_buf behind the frame header in a single pass that
+ * also calculates the DCS. The response is not copied; response points
+ * into frame_buf, past the ACK if it was received in the same read.
+ *
  * \param  nfc110                 [IN] The handle to access the port.
- * \param  command_buf        [IN/OUT] The buffer for command and response.
- *                                     The command should be placed at
- *                                     NFC110_COMMAND_POS.
- * \param  command_len            [IN] The length of the command.
- * \param  response_pos          [OUT] Start position of the recieved response.
+ * \param  segs                   [IN] The segments of the command.
+ * \param  nsegs                  [IN] The number of the segments.
+ * \param  frame_buf          [IN/OUT] The buffer for command and response.
+ * \param  response_pos          [OUT] Position of the response in the frame.
+ * \param  response              [OUT] The received response in frame_buf.
  * \param  response_len          [OUT] The length of the response.
  * \param  timeout                [IN] Time-out period. (ms)
  *
@@ -2276,9 +2787,11 @@ static UINT32 nfc110_get_command_type(
  */
 static UINT32 nfc110_execute_command_internal(
     ICS_HW_DEVICE* nfc110,
-    UINT8 command_buf[NFC110_COMMAND_BUF_LEN],
-    UINT32 command_len,
+    const nfc110_frame_seg_t* segs,
+    UINT32 nsegs,
+    UINT8 frame_buf[NFC110_FRAME_BUF_LEN],
     UINT32* response_pos,
+    const UINT8** response,
     UINT32* response_len,
     UINT32 timeout)
 {
@@ -2286,17 +2799,33 @@ static UINT32 nfc110_execute_command_internal(
 #define ICSLOG_FUNC "nfc110_execute_command_internal"
     UINT32 rc;
     UINT8 dcs;
-    UINT32 time0;
+    UINT8 sum;
+    utl_deadline_t deadline;
     UINT32 read_len;
+    UINT32 command_len;
+    UINT32 frame_len;
     UINT32 n;
+    UINT32 i;
+    UINT8* p;
+    UINT8* frame;
     BOOL ack_read;
     UINT32 preamble_len;
+#ifdef ICSTRACE_ENABLE
+    UINT16 trace_tag;
+#endif
     ICSLOG_FUNC_BEGIN;
 
     ICSLIB_CHKARG_NE(NFC110_RAW_FUNC(nfc110)->write, NULL,
                      ICS_ERROR_INVALID_PARAM);
     ICSLIB_CHKARG_NE(NFC110_RAW_FUNC(nfc110)->read, NULL,
                      ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_IN_RANGE(nsegs, 1, NFC110_MAX_FRAME_SEGS,
+                           ICS_ERROR_INVALID_PARAM);
+
+    command_len = 0;
+    for (i = 0; i < nsegs; i++) {
+        command_len += segs[i].len;
+    }
     ICSLIB_CHKARG_IN_RANGE(command_len, 1, NFC110_MAX_COMMAND_LEN,
                            ICS_ERROR_INVALID_PARAM);
 
@@ -2312,153 +2841,126 @@ static UINT32 nfc110_execute_command_internal(
         }
     }
 
-    time0 = utl_get_time_msec();
+    utl_deadline_set(&deadline, ((UINT64)timeout * UTL_NSEC_PER_MSEC));
 
     /* send command (extended frame) */
-    command_buf[NFC110_COMMAND_POS - 8] = 0x00;
-    command_buf[NFC110_COMMAND_POS - 7] = 0x00;
-    command_buf[NFC110_COMMAND_POS - 6] = 0xff;
-    command_buf[NFC110_COMMAND_POS - 5] = 0xff;
-    command_buf[NFC110_COMMAND_POS - 4] = 0xff;
-    command_buf[NFC110_COMMAND_POS - 3] =
+    frame_buf[NFC110_COMMAND_POS - 8] = 0x00;
+    frame_buf[NFC110_COMMAND_POS - 7] = 0x00;
+    frame_buf[NFC110_COMMAND_POS - 6] = 0xff;
+    frame_buf[NFC110_COMMAND_POS - 5] = 0xff;
+    frame_buf[NFC110_COMMAND_POS - 4] = 0xff;
+    frame_buf[NFC110_COMMAND_POS - 3] =
         (UINT8)((command_len >> 0) & 0xff);
-    command_buf[NFC110_COMMAND_POS - 2] =
+    frame_buf[NFC110_COMMAND_POS - 2] =
         (UINT8)((command_len >> 8) & 0xff);
-    command_buf[NFC110_COMMAND_POS - 1] =
-        (UINT8)-(command_buf[NFC110_COMMAND_POS - 3] +
-        command_buf[NFC110_COMMAND_POS - 2]);
-
-    dcs = nfc110_calc_dcs(command_buf + NFC110_COMMAND_POS, command_len);
-    command_buf[NFC110_COMMAND_POS + command_len] = dcs;
-    command_buf[NFC110_COMMAND_POS + command_len + 1] = 0x00;
-
-    rc = NFC110_RAW_FUNC(nfc110)->write(nfc110->handle,
-                                        command_buf,
-                                        (preamble_len + command_len + 2),
-                                        time0,
-                                        timeout);
+    frame_buf[NFC110_COMMAND_POS - 1] =
+        (UINT8)-(frame_buf[NFC110_COMMAND_POS - 3] +
+        frame_buf[NFC110_COMMAND_POS - 2]);
+
+    /* gather the segments behind the header */
+    p = (frame_buf + NFC110_COMMAND_POS);
+    for (i = 0; i < nsegs; i++) {
+        if (segs[i].data != p) {
+            utl_memcpy(p, segs[i].data, segs[i].len);
+        }
+        p += segs[i].len;
+    }
+    sum = nfc110_calc_sum(frame_buf + NFC110_COMMAND_POS, command_len);
+    dcs = (UINT8)-sum;
+    ICSLOG_DBG_HEX8(dcs);
+    p[0] = dcs;
+    p[1] = 0x00;
+
+#ifdef ICSTRACE_ENABLE
+    trace_tag = (UINT16)(ICSTRACE_TAG_NFC110 |
+                         ((command_len > 1) ?
+                          frame_buf[NFC110_COMMAND_POS + 1] : 0));
+#endif
+    ICSTRACE(ICSTRACE_EVENT_CMD_BEGIN, trace_tag, command_len);
+
+    rc = nfc110_raw_write(nfc110,
+                          frame_buf,
+                          (preamble_len + command_len + 2),
+                          &deadline);
     if (rc != ICS_ERROR_SUCCESS) {
         ICSLOG_ERR_STR(rc, "icsdrv_raw_write()");
+        ICSTRACE(ICSTRACE_EVENT_CMD_END, trace_tag, rc);
         return rc;
     }
 
     /* receive ACK, response header */
-    rc = NFC110_RAW_FUNC(nfc110)->read(nfc110->handle,
-                                       6,
-                                       NFC110_COMMAND_BUF_LEN,
-                                       command_buf,
-                                       &read_len,
-                                       time0,
-                                       timeout);
+    frame = frame_buf;
+    rc = nfc110_raw_read(nfc110,
+                         NFC110_ACK_LEN,
+                         NFC110_FRAME_BUF_LEN,
+                         frame,
+                         &read_len,
+                         &deadline);
     if (rc != ICS_ERROR_SUCCESS) {
         ICSLOG_ERR_STR(rc, "icsdrv_raw_read() - ack");
+        ICSTRACE(ICSTRACE_EVENT_CMD_END, trace_tag, rc);
         return rc;
     }
-    if (utl_memcmp(command_buf, "\x00\x00\xff\x00\xff\x00", 6) == 0) {
-        NFC110_ACK_TIME(nfc110) = utl_get_time_msec();
+    if (utl_memcmp(frame, "\x00\x00\xff\x00\xff\x00", NFC110_ACK_LEN) == 0) {
+        NFC110_ACK_TIME(nfc110) = (UINT32)utl_get_time_usec();
         ICSLOG_DBG_UINT(NFC110_ACK_TIME(nfc110));
+        ICSTRACE(ICSTRACE_EVENT_ACK, trace_tag, 0);
 
+        /* skip the ACK instead of moving the rest of data */
         ack_read = TRUE;
-        read_len -= 6;
-        utl_memcpy(command_buf, (command_buf + 6), read_len);
-
-        if (read_len < 6) {
-            n = read_len;
-            rc = NFC110_RAW_FUNC(nfc110)->read(nfc110->handle,
-                                               (6 - read_len),
-                                               (NFC110_COMMAND_BUF_LEN - n),
-                                               (command_buf + n),
-                                               &read_len,
-                                               time0,
-                                               timeout);
-            if (rc != ICS_ERROR_SUCCESS) {
-                ICSLOG_ERR_STR(rc, "icsdrv_raw_read() - response header");
-                return rc;
-            }
-            read_len += n;
-        }
+        read_len -= NFC110_ACK_LEN;
+        frame += NFC110_ACK_LEN;
     }
-
-    /* check header */
-    if (utl_memcmp(command_buf, "\x00\x00\xff", 3) != 0) {
+    if (read_len > NFC110_COMMAND_BUF_LEN) {
         rc = ICS_ERROR_INVALID_RESPONSE;
-        ICSLOG_ERR_STR(rc, "Invalid response header.");
+        ICSLOG_ERR_STR(rc, "Too long response.");
+        ICSTRACE(ICSTRACE_EVENT_CMD_END, trace_tag, rc);
         return rc;
     }
-    if ((command_buf[3] == 0xff) && (command_buf[4] == 0xff)) {
-        /* extended frame */
-        if (read_len < 9) {
-            n = read_len;
-            rc = NFC110_RAW_FUNC(nfc110)->read(nfc110->handle,
-                                               (9 - read_len),
-                                               (NFC110_COMMAND_BUF_LEN - n),
-                                               (command_buf + n),
-                                               &read_len,
-                                               time0,
-                                               timeout);
-            if (rc != ICS_ERROR_SUCCESS) {
-                ICSLOG_ERR_STR(rc, "icsdrv_raw_read() - response");
-                return rc;
-            }
-            read_len += n;
-        }
-        if (((command_buf[5] + command_buf[6] + command_buf[7]) & 0xff) != 0) {
-            rc = ICS_ERROR_INVALID_RESPONSE;
-            ICSLOG_ERR_STR(rc, "Invalid response - lcs");
-        }
-        preamble_len = 8;
-        *response_pos = 8;
-        *response_len = (((UINT32)command_buf[5] << 0) |
-                         ((UINT32)command_buf[6] << 8));
-    } else {
-        /* normal frame */
-        if (((command_buf[3] + command_buf[4]) & 0xff) != 0) {
-            rc = ICS_ERROR_INVALID_RESPONSE;
-            ICSLOG_ERR_STR(rc, "Invalid response header.");
+
+    /* receive the rest of the response, checking the frame as it grows */
+    *response_pos = 0;
+    for (;;) {
+        rc = nfc110_check_frame(frame, read_len, &frame_len,
+                                response_pos, response_len);
+        if (rc != ICS_ERROR_SUCCESS) {
+            ICSLOG_ERR_STR(rc, "nfc110_check_frame()");
+            ICSTRACE(ICSTRACE_EVENT_CMD_END, trace_tag, rc);
             return rc;
         }
-        preamble_len = 5;
-        *response_pos = 5;
-        *response_len = command_buf[3];
-    }
-    ICSLOG_DBG_UINT(*response_pos);
-    ICSLOG_DBG_UINT(*response_len);
-
-    if (*response_len > NFC110_MAX_RESPONSE_LEN) {
-        rc = ICS_ERROR_INVALID_RESPONSE;
-        ICSLOG_ERR_STR(rc, "Too long response length.");
-        return rc;
-    }
+        if (read_len >= frame_len) {
+            break;
+        }
 
-    /* read the rest of packet */
-    if (read_len < (preamble_len + *response_len + 2)) {
-        n = ((preamble_len + *response_len + 2) - read_len);
-        rc = NFC110_RAW_FUNC(nfc110)->read(nfc110->handle,
-                                           n,
-                                           n,
-                                           (command_buf + read_len),
-                                           NULL,
-                                           time0,
-                                           timeout);
+        /* read ahead while the length is unknown, then just the rest */
+        n = read_len;
+        rc = nfc110_raw_read(
+            nfc110,
+            (frame_len - n),
+            ((*response_pos == 0) ?
+             (NFC110_COMMAND_BUF_LEN - n) : (frame_len - n)),
+            (frame + n),
+            &read_len,
+            &deadline);
         if (rc != ICS_ERROR_SUCCESS) {
-            ICSLOG_ERR_STR(rc, "icsdrv_raw_read() - rest of packet");
+            ICSLOG_ERR_STR(rc, "icsdrv_raw_read() - response");
+            ICSTRACE(ICSTRACE_EVENT_CMD_END, trace_tag, rc);
             return rc;
         }
+        read_len += n;
     }
+    preamble_len = *response_pos;
+    ICSLOG_DBG_UINT(*response_pos);
+    ICSLOG_DBG_UINT(*response_len);
 
-    /* check response */
-    dcs = nfc110_calc_dcs(command_buf + preamble_len, *response_len);
-    if ((command_buf[preamble_len + *response_len + 0] != dcs) ||
-        (command_buf[preamble_len + *response_len + 1] != 0x00)) {
-        rc = ICS_ERROR_INVALID_RESPONSE;
-        ICSLOG_ERR_STR(rc, "Invalid response body.");
-        return rc;
-    }
+    *response = (frame + preamble_len);
 
     if (!ack_read) {
-        NFC110_ACK_TIME(nfc110) = utl_get_time_msec();
+        NFC110_ACK_TIME(nfc110) = (UINT32)utl_get_time_usec();
         ICSLOG_DBG_UINT(NFC110_ACK_TIME(nfc110));
+        ICSTRACE(ICSTRACE_EVENT_ACK, trace_tag, 0);
     }
+    ICSTRACE(ICSTRACE_EVENT_CMD_END, trace_tag, ICS_ERROR_SUCCESS);
 
     ICSLOG_FUNC_END;
     return ICS_ERROR_SUCCESS;
@@ -2480,7 +2982,7 @@ static UINT32 nfc110_sweep(
 #undef ICSLOG_FUNC
 #define ICSLOG_FUNC "nfc110_sweep"
     UINT32 rc;
-    UINT32 time0;
+    utl_deadline_t deadline;
     UINT8 purge_buf[64];
     const UINT8 zero_buf[NFC110_COMMAND_BUF_LEN] = {0};
     ICSLOG_FUNC_BEGIN;
@@ -2490,16 +2992,16 @@ static UINT32 nfc110_sweep(
 
     ICSLOG_DBG_PTR(nfc110);
 
-    time0 = utl_get_time_msec();
+    utl_deadline_set(&deadline, ((UINT64)NFC110_CANCEL_COMMAND_SWEEP_TIME_OUT *
+                                 UTL_NSEC_PER_MSEC));
 
     /* swept away the unnecessary data */
     if (NFC110_RAW_FUNC(nfc110)->write != NULL) {
-        rc = NFC110_RAW_FUNC(nfc110)->write(
-            nfc110->handle,
+        rc = nfc110_raw_write(
+            nfc110,
             zero_buf,
             sizeof(zero_buf),
-            time0,
-            NFC110_CANCEL_COMMAND_SWEEP_TIME_OUT);
+            &deadline);
         if (rc != ICS_ERROR_SUCCESS) {
             ICSLOG_ERR_STR(rc, "icsdrv_raw_func->write()");
             return rc;
@@ -2531,15 +3033,16 @@ static UINT32 nfc110_sweep(
     rc = ICS_ERROR_TIMEOUT;
     do {
         if (NFC110_RAW_FUNC(nfc110)->read != NULL) {
-            time0 = utl_get_time_msec();
-            rc = NFC110_RAW_FUNC(nfc110)->read(
-                nfc110->handle,
+            utl_deadline_set(&deadline,
+                             ((UINT64)NFC110_CANCEL_COMMAND_PURGE_TIMEOUT *
+                              UTL_NSEC_PER_MSEC));
+            rc = nfc110_raw_read(
+                nfc110,
                 1,
                 sizeof(purge_buf),
                 purge_buf,
                 NULL,
-                time0,
-                NFC110_CANCEL_COMMAND_PURGE_TIMEOUT);
+                &deadline);
             if (rc == ICS_ERROR_SUCCESS) {
                 continue;
             } else if (rc == ICS_ERROR_TIMEOUT) {
@@ -2560,33 +3063,160 @@ static UINT32 nfc110_sweep(
 }
 
 /**
- * This function calculates the DCS of a data.
+ * This function writes data to the device until a deadline.
+ * A driver without write_until() gets the rest in millisecond.
+ *
+ * \param  nfc110                 [IN] The handle to access the port.
+ * \param  data                   [IN] The data to write.
+ * \param  data_len               [IN] The length of the data.
+ * \param  deadline               [IN] The deadline.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_TIMEOUT           Time-out.
+ * \retval ICS_ERROR_IO                Other driver error.
+ */
+static UINT32 nfc110_raw_write(
+    ICS_HW_DEVICE* nfc110,
+    const UINT8* data,
+    UINT32 data_len,
+    const utl_deadline_t* deadline)
+{
+    if (NFC110_RAW_FUNC(nfc110)->write_until != NULL) {
+        return NFC110_RAW_FUNC(nfc110)->write_until(nfc110->handle,
+                                                    data,
+                                                    data_len,
+                                                    deadline);
+    }
+
+    return NFC110_RAW_FUNC(nfc110)->write(
+        nfc110->handle,
+        data,
+        data_len,
+        utl_get_time_msec(),
+        utl_deadline_get_rest_msec(deadline));
+}
+
+/**
+ * This function reads data from the device until a deadline.
+ * A driver without read_until() gets the rest in millisecond.
+ *
+ * \param  nfc110                 [IN] The handle to access the port.
+ * \param  min_read_len           [IN] The minimum length to read.
+ * \param  max_read_len           [IN] The maximum length to read.
+ * \param  data                  [OUT] The read data.
+ * \param  read_len              [OUT] The length of the read data or NULL.
+ * \param  deadline               [IN] The deadline.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_TIMEOUT           Time-out.
+ * \retval ICS_ERROR_IO                Other driver error.
+ * \retval ICS_ERROR_BUF_OVERFLOW      Response buffer overflow.
+ */
+static UINT32 nfc110_raw_read(
+    ICS_HW_DEVICE* nfc110,
+    UINT32 min_read_len,
+    UINT32 max_read_len,
+    UINT8* data,
+    UINT32* read_len,
+    const utl_deadline_t* deadline)
+{
+    if (NFC110_RAW_FUNC(nfc110)->read_until != NULL) {
+        return NFC110_RAW_FUNC(nfc110)->read_until(nfc110->handle,
+                                                   min_read_len,
+                                                   max_read_len,
+                                                   data,
+                                                   read_len,
+                                                   deadline);
+    }
+
+    return NFC110_RAW_FUNC(nfc110)->read(
+        nfc110->handle,
+        min_read_len,
+        max_read_len,
+        data,
+        read_len,
+        utl_get_time_msec(),
+        utl_deadline_get_rest_msec(deadline));
+}
+
+/**
+ * This function calculates the sum of a data modulo 256.
+ *
+ * This is called for every frame, so it does not log.
  *
  * \param  data                   [IN] A data.
  * \param  data_len               [IN] The length of the data.
  *
- * \return The DCS of the data.
+ * \return The sum of the data.
  */
-static UINT8 nfc110_calc_dcs(
+static UINT8 nfc110_calc_sum(
     const UINT8* data,
     UINT32 data_len)
 {
-#undef ICSLOG_FUNC
-#define ICSLOG_FUNC "nfc110_calc_dcs"
     UINT8 sum;
-    UINT32 i;
-    UINT8 dcs;
-    ICSLOG_FUNC_BEGIN;
+#if defined(NFC110_CHECKSUM_SSE2)
+    __m128i acc;
+    const __m128i zero = _mm_setzero_si128();
+
+    /* sum 16 bytes into two 64-bit lanes at a time */
+    acc = zero;
+    for (; data_len >= 16; data_len -= 16, data += 16) {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(
+            _mm_loadu_si128((const __m128i*)data), zero));
+    }
+    sum = (UINT8)(_mm_cvtsi128_si32(acc) +
+                  _mm_cvtsi128_si32(_mm_srli_si128(acc, 8)));
+#elif defined(NFC110_CHECKSUM_NEON)
+    uint16x8_t acc;
+    uint64x2_t acc64;
+
+    /* sum 16 bytes into eight 16-bit lanes at a time;
+       a lane wraps by itself, which keeps the sum modulo 256 */
+    acc = vdupq_n_u16(0);
+    for (; data_len >= 16; data_len -= 16, data += 16) {
+        acc = vpadalq_u8(acc, vld1q_u8(data));
+    }
+    acc64 = vpaddlq_u32(vpaddlq_u16(acc));
+    sum = (UINT8)(vgetq_lane_u64(acc64, 0) + vgetq_lane_u64(acc64, 1));
+#elif !defined(NFC110_USE_SCALAR_CHECKSUM)
+    UINT64 acc;
+    UINT64 w;
+    UINT32 n;
 
+    /* align to a word */
     sum = 0;
-    for (i = 0; i < data_len; i++) {
-        sum += data[i];
+    while ((data_len > 0) &&
+           ((((unsigned long)data) & (sizeof(nfc110_word_t) - 1)) != 0)) {
+        sum += *data++;
+        data_len--;
+    }
+
+    /* sum a word into four 16-bit lanes at a time;
+       fold them before a lane may overflow into the next one */
+    while (data_len >= sizeof(nfc110_word_t)) {
+        n = (data_len / sizeof(nfc110_word_t));
+        if (n > NFC110_CHECKSUM_MAX_WORDS) {
+            n = NFC110_CHECKSUM_MAX_WORDS;
+        }
+        data_len -= (n * sizeof(nfc110_word_t));
+        acc = 0;
+        for (; n > 0; n--, data += sizeof(nfc110_word_t)) {
+            w = *(const nfc110_word_t*)data;
+            acc += (w & 0x00ff00ff00ff00ffULL);
+            acc += ((w >> 8) & 0x00ff00ff00ff00ffULL);
+        }
+        sum += (UINT8)(acc + (acc >> 16) + (acc >> 32) + (acc >> 48));
     }
-    dcs = (UINT8)-(sum & 0xff);
-    ICSLOG_DBG_HEX8(dcs);
+#else
+    sum = 0;
+#endif
 
-    ICSLOG_FUNC_END;
-    return dcs;
+    /* the rest (or all) byte by byte */
+    for (; data_len > 0; data_len--) {
+        sum += *data++;
+    }
+
+    return sum;
 }
 
 /**
@@ -2681,3 +3311,62 @@ static UINT32 nfc110_convert_rf_status(
     ICSLOG_FUNC_END;
     return rc;
 }
+
+/**
+ * This function returns the shadow of the protocol settings of a device.
+ *
+ * \param  nfc110                 [IN] The handle to access the port.
+ * \param  claim                  [IN] TRUE to claim a free slot if the
+ *                                     device has none.
+ *
+ * \return The shadow. (NULL: none, or no free slot)
+ */
+static nfc110_shadow_t* nfc110_get_shadow(
+    ICS_HW_DEVICE* nfc110,
+    BOOL claim)
+{
+    nfc110_shadow_t* shadow;
+    UINT32 i;
+
+    for (i = 0; i < NFC110_MAX_SHADOWS; i++) {
+        if (s_nfc110_shadows[i].nfc110 == nfc110) {
+            return &s_nfc110_shadows[i];
+        }
+    }
+    if (!claim) {
+        return NULL;
+    }
+
+    for (i = 0; i < NFC110_MAX_SHADOWS; i++) {
+        shadow = &s_nfc110_shadows[i];
+        if (__sync_bool_compare_and_swap(&shadow->nfc110, NULL, nfc110)) {
+            shadow->valid = 0;
+            return shadow;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * This function forgets the RF speed and the protocol settings of a
+ * device, so that they are sent again.
+ *
+ * \param  nfc110                 [IN] The handle to access the port.
+ */
+static void nfc110_invalidate_rf_state(
+    ICS_HW_DEVICE* nfc110)
+{
+    nfc110_shadow_t* shadow;
+
+    NFC110_SET_TX_RBT(nfc110, 0);
+    NFC110_SET_TX_SPEED(nfc110, 0);
+    NFC110_SET_RX_RBT(nfc110, 0);
+    NFC110_SET_RX_SPEED(nfc110, 0);
+    NFC110_SET_LAST_MODE(nfc110, NFC110_DEFAULT_MODE);
+
+    shadow = nfc110_get_shadow(nfc110, FALSE);
+    if (shadow != NULL) {
+        shadow->valid = 0;
+    }
+}
@@ -0,0 +1,1349 @@
+/**
+ * \brief    Simulated NFC Port-110 Driver (loopback)
+ * \date     2026/10/17
+ * \author   Copyright 2013 Sony Corporation
+ */
+
+#undef ICSLOG_MODULE
+#define ICSLOG_MODULE "DBS"
+
+#include "ics_types.h"
+#include "ics_error.h"
+#include "icslib_chk.h"
+#include "icslog.h"
+#include "utl.h"
+#include "icstrace.h"
+
+#include "nfc110_sim.h"
+
+/* --------------------------------
+ * Constant
+ * -------------------------------- */
+
+#define NFC110_SIM_HANDLE                       ((ICS_HANDLE)&s_nfc110_sim)
+#define NFC110_SIM_ACK_LEN                      6
+#define NFC110_SIM_RF_PREAMBLE_BITS             (48 + 16) /* preamble, sync */
+#define NFC110_SIM_RF_CRC_BITS                  16
+#define NFC110_SIM_POLLING_T_DELAY_USEC         2417 /* 512 * 64 / fc */
+#define NFC110_SIM_POLLING_T_TIMESLOT_USEC      1208 /* 256 * 64 / fc */
+#define NFC110_SIM_POLLING_MAX_TIME_SLOTS       16
+
+/* --------------------------------
+ * Struct Declaration
+ * -------------------------------- */
+
+typedef struct nfc110_sim_t {
+    BOOL is_initialized;
+    BOOL is_open;
+    nfc110_sim_config_t config;
+    nfc110_sim_stat_t stat;
+    nfc110_sim_card_t cards[NFC110_SIM_MAX_CARDS];
+    UINT32 rand;
+
+    /* simulated clock */
+    UINT64 now;
+    UINT64 stat_base;
+    UINT64 slept;
+
+    /* host to device */
+    UINT8 command_buf[NFC110_SIM_FRAME_BUF_LEN];
+    UINT32 command_len;
+
+    /* device to host (notified packets) */
+    UINT8 rx_buf[NFC110_SIM_RX_BUF_LEN];
+    UINT32 rx_pos;
+    UINT32 rx_len;
+    UINT32 rx_packet_len[NFC110_SIM_RX_MAX_PACKETS];
+    UINT32 rx_packet_pos;
+    UINT32 rx_num_of_packets;
+
+    /* firmware state */
+    BOOL rf_on;
+    UINT8 tx_speed;
+    UINT8 rx_speed;
+    UINT8 protocol[NFC110_MAX_IN_SET_PROTOCOL_SETTING_NUM + 1];
+    UINT8 command_type;
+} nfc110_sim_t;
+
+static nfc110_sim_t s_nfc110_sim;
+
+/* --------------------------------
+ * Prototype Declaration
+ * -------------------------------- */
+
+static void nfc110_sim_initialize_once(void);
+static UINT32 nfc110_sim_rand(nfc110_sim_t* sim);
+static void nfc110_sim_advance(nfc110_sim_t* sim, UINT64 usec);
+static void nfc110_sim_sync(nfc110_sim_t* sim);
+static void nfc110_sim_shift(
+    UINT8* buf,
+    UINT32 pos,
+    UINT32 len);
+static void nfc110_sim_push(
+    nfc110_sim_t* sim,
+    const UINT8* data,
+    UINT32 data_len);
+static void nfc110_sim_push_frame(
+    nfc110_sim_t* sim,
+    const UINT8* payload,
+    UINT32 payload_len);
+static void nfc110_sim_parse(nfc110_sim_t* sim);
+static void nfc110_sim_process(
+    nfc110_sim_t* sim,
+    const UINT8* command,
+    UINT32 command_len);
+static UINT32 nfc110_sim_in_comm_rf(
+    nfc110_sim_t* sim,
+    const UINT8* command,
+    UINT32 command_len,
+    UINT8* response);
+static UINT32 nfc110_sim_polling(
+    nfc110_sim_t* sim,
+    const UINT8* rf_command,
+    UINT32 rf_command_len,
+    UINT8* rf_response,
+    UINT32* rf_response_len,
+    UINT32* rf_usec);
+static UINT32 nfc110_sim_rf_usec(
+    nfc110_sim_t* sim,
+    UINT32 rf_len);
+static UINT32 nfc110_sim_num_of_pdus(
+    nfc110_sim_t* sim,
+    UINT32 packet_len);
+
+/* --------------------------------
+ * Function
+ * -------------------------------- */
+
+/* ------------------------
+ * Exported
+ * ------------------------ */
+
+/**
+ * This function opens a port to the simulated device.
+ *
+ * \param  nfc110                [OUT] Handle to access the port.
+ * \param  port_name              [IN] The port name to open. (ignored)
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_BUSY              Device busy.
+ * \retval ICS_ERROR_TIMEOUT           Time-out.
+ * \retval ICS_ERROR_IO                Other driver error.
+ */
+UINT32 nfc110_sim_open(
+    ICS_HW_DEVICE* nfc110,
+    const char* port_name)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_open"
+    UINT32 rc;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(nfc110, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(port_name, NULL, ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_PTR(nfc110);
+    ICSLOG_DBG_STR(port_name);
+
+    rc = nfc110_initialize(nfc110, &nfc110_sim_raw_func);
+    if (rc != ICS_ERROR_SUCCESS) {
+        ICSLOG_ERR_STR(rc, "nfc110_initialize()");
+        return rc;
+    }
+
+    rc = nfc110_open(nfc110, port_name);
+    if (rc != ICS_ERROR_SUCCESS) {
+        ICSLOG_ERR_STR(rc, "nfc110_open()");
+        return rc;
+    }
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function opens the loopback port.
+ *
+ * \param  handle                [OUT] Handle to access the port.
+ * \param  port_name              [IN] The port name to open. (ignored)
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_BUSY              Device busy.
+ */
+UINT32 nfc110_sim_raw_open(
+    ICS_HANDLE* handle,
+    const char* port_name)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_raw_open"
+    UINT32 rc;
+    nfc110_sim_t* sim = &s_nfc110_sim;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(handle, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(port_name, NULL, ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_PTR(handle);
+    ICSLOG_DBG_STR(port_name);
+
+    nfc110_sim_initialize_once();
+    if (sim->is_open) {
+        rc = ICS_ERROR_BUSY;
+        ICSLOG_ERR_STR(rc, "Already opened.");
+        return rc;
+    }
+
+    sim->is_open = TRUE;
+    sim->command_len = 0;
+    sim->rx_pos = 0;
+    sim->rx_len = 0;
+    sim->rx_packet_pos = 0;
+    sim->rx_num_of_packets = 0;
+    sim->rf_on = FALSE;
+
+    *handle = NFC110_SIM_HANDLE;
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function closes the loopback port.
+ *
+ * \param  handle                 [IN] The handle to access the port.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ */
+UINT32 nfc110_sim_raw_close(
+    ICS_HANDLE handle)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_raw_close"
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_EQ(handle, NFC110_SIM_HANDLE, ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_PTR(handle);
+
+    s_nfc110_sim.is_open = FALSE;
+    s_nfc110_sim.rf_on = FALSE;
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function writes data to the simulated device.
+ * The data is split into packets of the configured MTU,
+ * and the device processes every complete frame at once.
+ *
+ * Like the BLE driver, up to tx_credits packets are written without
+ * response, and the next packet (and the last one of the data) is written
+ * with response as the barrier. The link layer sends the packets in PDUs
+ * of ll_data_len, up to tx_pdus_per_event in a connection event.
+ * A write with response takes tx_packet_usec, which is two connection
+ * intervals: the request and the response.
+ *
+ * The simulated device always acknowledges the writes, so a write never
+ * times out and the deadline is only logged. (It is of the real clock,
+ * not of the simulated one.)
+ *
+ * \param  handle                 [IN] The handle to access the port.
+ * \param  data                   [IN] The data to write.
+ * \param  data_len               [IN] The length of the data.
+ * \param  deadline               [IN] The deadline. (not used)
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_IO                Other driver error.
+ */
+UINT32 nfc110_sim_raw_write_until(
+    ICS_HANDLE handle,
+    const UINT8* data,
+    UINT32 data_len,
+    const utl_deadline_t* deadline)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_raw_write_until"
+    UINT32 rc;
+    UINT32 npackets;
+    UINT32 ngroup;
+    UINT32 npdus;
+    UINT32 nevents;
+    UINT32 nbytes;
+    UINT32 n;
+    nfc110_sim_t* sim = &s_nfc110_sim;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_EQ(handle, NFC110_SIM_HANDLE, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(data, NULL, ICS_ERROR_INVALID_PARAM);
+
+    /* a write never times out (logged only in the debug build) */
+    (void)deadline;
+
+    ICSLOG_DBG_PTR(handle);
+    ICSLOG_DBG_UINT(data_len);
+    ICSLOG_DBG_UINT(utl_deadline_get_rest_nsec(deadline));
+    ICSLOG_DUMP(data, data_len);
+
+    if (!sim->is_open) {
+        rc = ICS_ERROR_IO;
+        ICSLOG_ERR_STR(rc, "Not opened.");
+        return rc;
+    }
+
+    npackets = ((data_len + sim->config.mtu - 1) / sim->config.mtu);
+    sim->stat.num_of_tx_packets += npackets;
+    sim->stat.num_of_tx_bytes += data_len;
+    nbytes = data_len;
+    while (npackets > 0) {
+        /* the packets without response and the barrier */
+        ngroup = (sim->config.tx_credits + 1);
+        if (ngroup > npackets) {
+            ngroup = npackets;
+        }
+        npackets -= ngroup;
+
+        /* the bytes in the group */
+        n = (ngroup * sim->config.mtu);
+        if (n > nbytes) {
+            n = nbytes;
+        }
+        nbytes -= n;
+
+        /* the packets are full but the last one of the data */
+        npdus = (((ngroup - 1) *
+                  nfc110_sim_num_of_pdus(sim, sim->config.mtu)) +
+                 nfc110_sim_num_of_pdus(sim, (n - ((ngroup - 1) *
+                                                   sim->config.mtu))));
+        sim->stat.num_of_tx_pdus += npdus;
+
+        /* the barrier goes in the last event, the response in the next */
+        nevents = ((npdus + sim->config.tx_pdus_per_event - 1) /
+                   sim->config.tx_pdus_per_event);
+        sim->stat.num_of_tx_intervals += (nevents + 1);
+        nfc110_sim_advance(sim, (((UINT64)(nevents + 1) *
+                                  sim->config.tx_packet_usec) / 2));
+        ICSTRACE(ICSTRACE_EVENT_BLE_TX, 0, n);
+    }
+
+    if ((sim->command_len + data_len) > sizeof(sim->command_buf)) {
+        /* the device drops the broken frame */
+        sim->stat.num_of_invalid_frames++;
+        sim->command_len = 0;
+    }
+    if (data_len > sizeof(sim->command_buf)) {
+        rc = ICS_ERROR_IO;
+        ICSLOG_ERR_STR(rc, "Too long data.");
+        return rc;
+    }
+    utl_memcpy(sim->command_buf + sim->command_len, data, data_len);
+    sim->command_len += data_len;
+
+    nfc110_sim_parse(sim);
+    nfc110_sim_sync(sim);
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function reads data from the simulated device.
+ * Like the BLE driver, a read returns the notified packets piece by piece
+ * until min_read_len bytes are read.
+ *
+ * \param  handle                 [IN] The handle to access the port.
+ * \param  min_read_len           [IN] The minimum length to read.
+ * \param  max_read_len           [IN] The maximum length to read.
+ * \param  data                  [OUT] The buffer to store the read data.
+ * \param  read_len              [OUT] The length of the read data.
+ * \param  deadline               [IN] The deadline.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_TIMEOUT           Time-out.
+ * \retval ICS_ERROR_IO                Other driver error.
+ */
+UINT32 nfc110_sim_raw_read_until(
+    ICS_HANDLE handle,
+    UINT32 min_read_len,
+    UINT32 max_read_len,
+    UINT8* data,
+    UINT32* read_len,
+    const utl_deadline_t* deadline)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_raw_read_until"
+    UINT32 rc;
+    UINT32 nread;
+    UINT32 n;
+    UINT64 rest_nsec;
+    UINT32* packet_len;
+    nfc110_sim_t* sim = &s_nfc110_sim;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_EQ(handle, NFC110_SIM_HANDLE, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(data, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_LE(min_read_len, max_read_len, ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_PTR(handle);
+    ICSLOG_DBG_UINT(max_read_len);
+    ICSLOG_DBG_UINT(utl_deadline_get_rest_nsec(deadline));
+
+    if (!sim->is_open) {
+        rc = ICS_ERROR_IO;
+        ICSLOG_ERR_STR(rc, "Not opened.");
+        return rc;
+    }
+
+    nread = 0;
+    do {
+        if (sim->rx_num_of_packets == 0) {
+            /* nothing will be notified any more: wait for the time-out */
+            rest_nsec = utl_deadline_get_rest_nsec(deadline);
+            sim->stat.num_of_read_timeouts++;
+            nfc110_sim_advance(sim, (rest_nsec / UTL_NSEC_PER_USEC));
+            nfc110_sim_sync(sim);
+
+            rc = ICS_ERROR_TIMEOUT;
+            ICSLOG_ERR_STR(rc, "Time-out.");
+            return rc;
+        }
+
+        packet_len = &sim->rx_packet_len[sim->rx_packet_pos];
+        n = (max_read_len - nread);
+        if (n > *packet_len) {
+            n = *packet_len;
+        }
+        utl_memcpy(data + nread, sim->rx_buf + sim->rx_pos, n);
+        ICSTRACE(ICSTRACE_EVENT_BLE_RX, 0, n);
+        nread += n;
+        sim->rx_pos += n;
+        sim->rx_len -= n;
+        *packet_len -= n;
+        if (*packet_len == 0) {
+            sim->rx_packet_pos = ((sim->rx_packet_pos + 1) %
+                                  NFC110_SIM_RX_MAX_PACKETS);
+            sim->rx_num_of_packets--;
+        }
+    } while ((nread < min_read_len) && (nread < max_read_len));
+
+    if (sim->rx_len == 0) {
+        sim->rx_pos = 0;
+    }
+
+    if (read_len != NULL) {
+        *read_len = nread;
+    }
+    ICSLOG_DBG_UINT(nread);
+    ICSLOG_DUMP(data, nread);
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function writes data to the simulated device.
+ * (nfc110_sim_raw_write_until() with the time-out in millisecond)
+ *
+ * \param  handle                 [IN] The handle to access the port.
+ * \param  data                   [IN] The data to write.
+ * \param  data_len               [IN] The length of the data.
+ * \param  time0                  [IN] The base time for time-out. (ms)
+ * \param  timeout                [IN] Time-out. (ms)
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_IO                Other driver error.
+ */
+UINT32 nfc110_sim_raw_write(
+    ICS_HANDLE handle,
+    const UINT8* data,
+    UINT32 data_len,
+    UINT32 time0,
+    UINT32 timeout)
+{
+    utl_deadline_t deadline;
+
+    utl_deadline_set_msec(&deadline, time0, timeout);
+
+    return nfc110_sim_raw_write_until(handle, data, data_len, &deadline);
+}
+
+/**
+ * This function reads data from the simulated device.
+ * (nfc110_sim_raw_read_until() with the time-out in millisecond)
+ *
+ * \param  handle                 [IN] The handle to access the port.
+ * \param  min_read_len           [IN] The minimum length to read.
+ * \param  max_read_len           [IN] The maximum length to read.
+ * \param  data                  [OUT] The buffer to store the read data.
+ * \param  read_len              [OUT] The length of the read data.
+ * \param  time0                  [IN] The base time for time-out. (ms)
+ * \param  timeout                [IN] Time-out. (ms)
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_TIMEOUT           Time-out.
+ * \retval ICS_ERROR_IO                Other driver error.
+ */
+UINT32 nfc110_sim_raw_read(
+    ICS_HANDLE handle,
+    UINT32 min_read_len,
+    UINT32 max_read_len,
+    UINT8* data,
+    UINT32* read_len,
+    UINT32 time0,
+    UINT32 timeout)
+{
+    utl_deadline_t deadline;
+
+    utl_deadline_set_msec(&deadline, time0, timeout);
+
+    return nfc110_sim_raw_read_until(handle, min_read_len, max_read_len,
+                                     data, read_len, &deadline);
+}
+
+/**
+ * This function clears the receiving queue.
+ *
+ * \param  handle                 [IN] The handle to access the port.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ */
+UINT32 nfc110_sim_raw_clear_rx_queue(
+    ICS_HANDLE handle)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_raw_clear_rx_queue"
+    nfc110_sim_t* sim = &s_nfc110_sim;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_EQ(handle, NFC110_SIM_HANDLE, ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_PTR(handle);
+
+    sim->rx_pos = 0;
+    sim->rx_len = 0;
+    sim->rx_packet_pos = 0;
+    sim->rx_num_of_packets = 0;
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function waits until all data written to the device.
+ * (The loopback port writes synchronously.)
+ *
+ * \param  handle                 [IN] The handle to access the port.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ */
+UINT32 nfc110_sim_raw_drain_tx_queue(
+    ICS_HANDLE handle)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_raw_drain_tx_queue"
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_EQ(handle, NFC110_SIM_HANDLE, ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_PTR(handle);
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function gets the attributes of the port (the port name).
+ *
+ * \param  handle                 [IN] The handle to get the attributes.
+ * \param  arg                   [OUT] The buffer to be set the attributes.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ */
+UINT32 nfc110_sim_raw_get_attribute(
+    ICS_HANDLE handle,
+    void* arg)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_raw_get_attribute"
+    static const char port_name[] = "nfc110_sim";
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_EQ(handle, NFC110_SIM_HANDLE, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(arg, NULL, ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_PTR(handle);
+    ICSLOG_DBG_PTR(arg);
+
+    utl_memcpy(arg, port_name, sizeof(port_name));
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function gets the default configuration of the simulator.
+ *
+ * \param  config                [OUT] The default configuration.
+ */
+void nfc110_sim_get_default_config(
+    nfc110_sim_config_t* config)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_get_default_config"
+    ICSLOG_FUNC_BEGIN;
+
+    config->mtu = NFC110_SIM_DEFAULT_MTU;
+    config->ll_data_len = NFC110_SIM_DEFAULT_LL_DATA_LEN;
+    config->tx_packet_usec = NFC110_SIM_DEFAULT_TX_PACKET_USEC;
+    config->tx_credits = NFC110_SIM_DEFAULT_TX_CREDITS;
+    config->tx_pdus_per_event = NFC110_SIM_DEFAULT_TX_PDUS_PER_EVENT;
+    config->rx_packet_usec = NFC110_SIM_DEFAULT_RX_PACKET_USEC;
+    config->rx_pdus_per_event = NFC110_SIM_DEFAULT_RX_PDUS_PER_EVENT;
+    config->command_usec = NFC110_SIM_DEFAULT_COMMAND_USEC;
+    config->card_time_percent = NFC110_SIM_DEFAULT_CARD_TIME_PERCENT;
+    config->rf_error_per_mille = 0;
+    config->seed = 1;
+    config->realtime = FALSE;
+
+    ICSLOG_FUNC_END;
+}
+
+/**
+ * This function sets the configuration of the simulator.
+ *
+ * \param  config                 [IN] The configuration.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ */
+UINT32 nfc110_sim_set_config(
+    const nfc110_sim_config_t* config)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_set_config"
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(config, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(config->mtu, 0, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(config->ll_data_len, 0, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(config->tx_pdus_per_event, 0,
+                     ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(config->rx_pdus_per_event, 0,
+                     ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_LE(config->rf_error_per_mille, 1000,
+                     ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_UINT(config->mtu);
+    ICSLOG_DBG_UINT(config->ll_data_len);
+    ICSLOG_DBG_UINT(config->tx_packet_usec);
+    ICSLOG_DBG_UINT(config->tx_credits);
+    ICSLOG_DBG_UINT(config->tx_pdus_per_event);
+    ICSLOG_DBG_UINT(config->rx_packet_usec);
+    ICSLOG_DBG_UINT(config->rx_pdus_per_event);
+    ICSLOG_DBG_UINT(config->rf_error_per_mille);
+
+    nfc110_sim_initialize_once();
+    s_nfc110_sim.config = *config;
+    s_nfc110_sim.rand = config->seed;
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function gets a card in the field of the simulated device.
+ * The card 0 is a present SmartTag by default, and the other cards
+ * are absent until the caller sets them present.
+ *
+ * \param  index                  [IN] The index of the card.
+ *
+ * \return The card. (NULL if the index is out of range)
+ */
+nfc110_sim_card_t* nfc110_sim_get_card(
+    UINT32 index)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_get_card"
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLOG_DBG_UINT(index);
+
+    nfc110_sim_initialize_once();
+    if (index >= NFC110_SIM_MAX_CARDS) {
+        return NULL;
+    }
+
+    ICSLOG_FUNC_END;
+    return &s_nfc110_sim.cards[index];
+}
+
+/**
+ * This function gets the statistics since the last clear.
+ *
+ * \param  stat                  [OUT] The statistics.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ */
+UINT32 nfc110_sim_get_stat(
+    nfc110_sim_stat_t* stat)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_get_stat"
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(stat, NULL, ICS_ERROR_INVALID_PARAM);
+
+    nfc110_sim_initialize_once();
+    *stat = s_nfc110_sim.stat;
+    stat->time_usec = (s_nfc110_sim.now - s_nfc110_sim.stat_base);
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function clears the statistics.
+ * (The simulated clock keeps running.)
+ */
+void nfc110_sim_clear_stat(void)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_clear_stat"
+    ICSLOG_FUNC_BEGIN;
+
+    nfc110_sim_initialize_once();
+    utl_memset(&s_nfc110_sim.stat, 0, sizeof(s_nfc110_sim.stat));
+    s_nfc110_sim.stat_base = s_nfc110_sim.now;
+
+    ICSLOG_FUNC_END;
+}
+
+/**
+ * This function returns the simulated clock.
+ *
+ * \return The simulated time. (us)
+ */
+UINT64 nfc110_sim_get_time_usec(void)
+{
+    nfc110_sim_initialize_once();
+    return s_nfc110_sim.now;
+}
+
+/**
+ * This function lets the host wait without any communication.
+ * (The simulated clock advances.)
+ *
+ * \param  usec                   [IN] The time to wait. (us)
+ */
+void nfc110_sim_wait(
+    UINT64 usec)
+{
+    nfc110_sim_initialize_once();
+    nfc110_sim_advance(&s_nfc110_sim, usec);
+    nfc110_sim_sync(&s_nfc110_sim);
+}
+
+/* ------------------------
+ * Internal
+ * ------------------------ */
+
+/**
+ * This function initializes the simulator at the first use.
+ */
+static void nfc110_sim_initialize_once(void)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_initialize_once"
+    static const UINT8 default_idm[8] = {
+        0x03, 0xfe, 0x00, 0x1d, 0x12, 0x34, 0x56, 0x78
+    };
+    nfc110_sim_t* sim = &s_nfc110_sim;
+    UINT32 i;
+
+    if (sim->is_initialized) {
+        return;
+    }
+    ICSLOG_FUNC_BEGIN;
+
+    utl_memset(sim, 0, sizeof(*sim));
+    nfc110_sim_get_default_config(&sim->config);
+    sim->rand = sim->config.seed;
+    for (i = 0; i < NFC110_SIM_MAX_CARDS; i++) {
+        nfc110_sim_card_initialize(&sim->cards[i], default_idm);
+        sim->cards[i].idm[7] = (UINT8)(default_idm[7] + i);
+        sim->cards[i].present = (i == 0);
+    }
+    sim->tx_speed = NFC110_RF_INITIATOR_ISO18092_212K;
+    sim->rx_speed = NFC110_RF_INITIATOR_ISO18092_212K;
+    sim->is_initialized = TRUE;
+
+    ICSLOG_FUNC_END;
+}
+
+/**
+ * This function generates a pseudo-random number of the simulator.
+ * (independent of utl_rand() to keep the sequence reproducible)
+ *
+ * \param  sim                    [IN] The simulator.
+ *
+ * \return a pseudo-random number
+ */
+static UINT32 nfc110_sim_rand(nfc110_sim_t* sim)
+{
+    sim->rand = ((sim->rand * 1183164753) + 7203);
+
+    return (sim->rand >> 16);
+}
+
+/**
+ * This function advances the simulated clock.
+ *
+ * \param  sim                    [IN] The simulator.
+ * \param  usec                   [IN] The elapsed time. (us)
+ */
+static void nfc110_sim_advance(nfc110_sim_t* sim, UINT64 usec)
+{
+    sim->now += usec;
+}
+
+/**
+ * This function sleeps until the real time catches up with
+ * the simulated clock. (only in the realtime mode)
+ *
+ * \param  sim                    [IN] The simulator.
+ */
+static void nfc110_sim_sync(nfc110_sim_t* sim)
+{
+    UINT64 msec;
+
+    if (!sim->config.realtime) {
+        sim->slept = sim->now;
+        return;
+    }
+
+    msec = ((sim->now - sim->slept) / 1000);
+    if (msec > 0) {
+        utl_msleep((UINT32)msec);
+        sim->slept += (msec * 1000);
+    }
+}
+
+/**
+ * This function moves the data in a buffer to the top.
+ *
+ * \param  buf                    [IN] The buffer.
+ * \param  pos                    [IN] The position of the data.
+ * \param  len                    [IN] The length of the data.
+ */
+static void nfc110_sim_shift(
+    UINT8* buf,
+    UINT32 pos,
+    UINT32 len)
+{
+    UINT32 i;
+
+    for (i = 0; i < len; i++) {
+        buf[i] = buf[pos + i];
+    }
+}
+
+/**
+ * This function notifies data to the host in packets of the MTU.
+ *
+ * \param  sim                    [IN] The simulator.
+ * \param  data                   [IN] The data to notify.
+ * \param  data_len               [IN] The length of the data.
+ */
+static void nfc110_sim_push(
+    nfc110_sim_t* sim,
+    const UINT8* data,
+    UINT32 data_len)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_push"
+    UINT32 n;
+    UINT32 idx;
+    UINT32 npdus;
+    UINT32 nevents;
+
+    if ((sim->rx_pos + sim->rx_len + data_len) > sizeof(sim->rx_buf)) {
+        nfc110_sim_shift(sim->rx_buf, sim->rx_pos, sim->rx_len);
+        sim->rx_pos = 0;
+    }
+    if ((sim->rx_len + data_len) > sizeof(sim->rx_buf)) {
+        ICSLOG_ERR_STR(ICS_ERROR_BUF_OVERFLOW, "Host does not read.");
+        return;
+    }
+
+    while (data_len > 0) {
+        if (sim->rx_num_of_packets >= NFC110_SIM_RX_MAX_PACKETS) {
+            ICSLOG_ERR_STR(ICS_ERROR_BUF_OVERFLOW, "Too many packets.");
+            return;
+        }
+        n = data_len;
+        if (n > sim->config.mtu) {
+            n = sim->config.mtu;
+        }
+        utl_memcpy(sim->rx_buf + sim->rx_pos + sim->rx_len, data, n);
+        sim->rx_len += n;
+        idx = ((sim->rx_packet_pos + sim->rx_num_of_packets) %
+               NFC110_SIM_RX_MAX_PACKETS);
+        sim->rx_packet_len[idx] = n;
+        sim->rx_num_of_packets++;
+
+        /* a notification takes the events for its PDUs */
+        npdus = nfc110_sim_num_of_pdus(sim, n);
+        nevents = ((npdus + sim->config.rx_pdus_per_event - 1) /
+                   sim->config.rx_pdus_per_event);
+        sim->stat.num_of_rx_packets++;
+        sim->stat.num_of_rx_bytes += n;
+        sim->stat.num_of_rx_pdus += npdus;
+        sim->stat.num_of_rx_intervals += nevents;
+        nfc110_sim_advance(sim, ((UINT64)nevents *
+                                 sim->config.rx_packet_usec));
+
+        data += n;
+        data_len -= n;
+    }
+}
+
+/**
+ * This function notifies a response frame (extended frame) to the host.
+ *
+ * \param  sim                    [IN] The simulator.
+ * \param  payload                [IN] The response. (d7 ...)
+ * \param  payload_len            [IN] The length of the response.
+ */
+static void nfc110_sim_push_frame(
+    nfc110_sim_t* sim,
+    const UINT8* payload,
+    UINT32 payload_len)
+{
+    UINT8 frame[NFC110_SIM_FRAME_BUF_LEN];
+    UINT8 dcs;
+    UINT32 i;
+
+    frame[0] = 0x00;
+    frame[1] = 0x00;
+    frame[2] = 0xff;
+    frame[3] = 0xff;
+    frame[4] = 0xff;
+    frame[5] = (UINT8)((payload_len >> 0) & 0xff);
+    frame[6] = (UINT8)((payload_len >> 8) & 0xff);
+    frame[7] = (UINT8)(0x100 - ((frame[5] + frame[6]) & 0xff));
+    dcs = 0;
+    for (i = 0; i < payload_len; i++) {
+        frame[8 + i] = payload[i];
+        dcs += payload[i];
+    }
+    frame[8 + payload_len] = (UINT8)(0x100 - dcs);
+    frame[9 + payload_len] = 0x00;
+
+    nfc110_sim_push(sim, frame, (10 + payload_len));
+}
+
+/**
+ * This function parses the frames written by the host,
+ * and processes every complete frame.
+ *
+ * \param  sim                    [IN] The simulator.
+ */
+static void nfc110_sim_parse(nfc110_sim_t* sim)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_parse"
+    const UINT8* p;
+    UINT32 header_len;
+    UINT32 payload_len;
+    UINT32 frame_len;
+    UINT32 i;
+    UINT8 sum;
+
+    while (sim->command_len >= NFC110_SIM_ACK_LEN) {
+        p = sim->command_buf;
+        frame_len = 0;
+
+        if ((p[0] != 0x00) || (p[1] != 0x00) || (p[2] != 0xff)) {
+            /* skip a garbage byte */
+            sim->stat.num_of_invalid_frames++;
+            frame_len = 1;
+        } else if ((p[3] == 0x00) && (p[4] == 0xff)) {
+            /* ACK: cancel the current command */
+            sim->stat.num_of_acks++;
+            frame_len = NFC110_SIM_ACK_LEN;
+        } else {
+            if ((p[3] == 0xff) && (p[4] == 0xff)) {
+                if (sim->command_len < 8) {
+                    return;
+                }
+                payload_len = (((UINT32)p[5] << 0) | ((UINT32)p[6] << 8));
+                sum = (UINT8)(p[5] + p[6] + p[7]);
+                header_len = 8;
+            } else {
+                payload_len = p[3];
+                sum = (UINT8)(p[3] + p[4]);
+                header_len = 5;
+            }
+            if ((sum != 0) ||
+                ((header_len + payload_len + 2) > sizeof(sim->command_buf))) {
+                ICSLOG_ERR_STR(ICS_ERROR_INVALID_RESPONSE, "Invalid LCS.");
+                sim->stat.num_of_invalid_frames++;
+                frame_len = 3;
+            } else {
+                frame_len = (header_len + payload_len + 2);
+                if (sim->command_len < frame_len) {
+                    return;
+                }
+                sum = 0;
+                for (i = 0; i <= payload_len; i++) {
+                    sum += p[header_len + i];
+                }
+                if ((sum != 0) || (p[frame_len - 1] != 0x00)) {
+                    ICSLOG_ERR_STR(ICS_ERROR_INVALID_RESPONSE,
+                                   "Invalid DCS.");
+                    sim->stat.num_of_invalid_frames++;
+                } else {
+                    nfc110_sim_process(sim, p + header_len, payload_len);
+                }
+            }
+        }
+
+        sim->command_len -= frame_len;
+        nfc110_sim_shift(sim->command_buf, frame_len, sim->command_len);
+    }
+}
+
+/**
+ * This function processes a command of NFC Port-110,
+ * and notifies an ACK and the response to the host.
+ *
+ * \param  sim                    [IN] The simulator.
+ * \param  command                [IN] The command. (d6 ...)
+ * \param  command_len            [IN] The length of the command.
+ */
+static void nfc110_sim_process(
+    nfc110_sim_t* sim,
+    const UINT8* command,
+    UINT32 command_len)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_process"
+    static const UINT8 ack[NFC110_SIM_ACK_LEN] = {
+        0x00, 0x00, 0xff, 0x00, 0xff, 0x00
+    };
+    UINT8 response[NFC110_SIM_FRAME_BUF_LEN];
+    UINT32 response_len;
+    UINT32 i;
+
+    ICSLOG_DUMP(command, command_len);
+
+    if ((command_len < 2) || (command[0] != NFC110_COMMAND_CODE)) {
+        ICSLOG_ERR_STR(ICS_ERROR_INVALID_RESPONSE, "Invalid command.");
+        sim->stat.num_of_invalid_frames++;
+        return;
+    }
+    sim->stat.num_of_frames++;
+    nfc110_sim_push(sim, ack, sizeof(ack));
+    nfc110_sim_advance(sim, sim->config.command_usec);
+
+    response[0] = NFC110_RESPONSE_CODE;
+    response[1] = (UINT8)(command[1] + 1);
+    response[2] = NFC110_DEV_STATUS_SUCCESS;
+    response_len = 3;
+
+    switch (command[1]) {
+    case NFC110_CMD_IN_SET_RF:
+        sim->stat.num_of_in_set_rf++;
+        if (command_len != 6) {
+            response[2] = NFC110_DEV_STATUS_PARAMETER_ERROR;
+            break;
+        }
+        sim->tx_speed = command[3];
+        sim->rx_speed = command[5];
+        break;
+    case NFC110_CMD_IN_SET_PROTOCOL:
+        sim->stat.num_of_in_set_protocol++;
+        if ((command_len % 2) != 0) {
+            response[2] = NFC110_DEV_STATUS_PARAMETER_ERROR;
+            break;
+        }
+        for (i = 2; i < command_len; i += 2) {
+            if (command[i] > NFC110_MAX_IN_SET_PROTOCOL_SETTING_NUM) {
+                response[2] = NFC110_DEV_STATUS_PARAMETER_ERROR;
+                break;
+            }
+            sim->protocol[command[i]] = command[i + 1];
+        }
+        break;
+    case NFC110_CMD_SWITCH_RF:
+        sim->stat.num_of_switch_rf++;
+        if (command_len != 3) {
+            response[2] = NFC110_DEV_STATUS_PARAMETER_ERROR;
+            break;
+        }
+        sim->rf_on = (command[2] != 0);
+        break;
+    case NFC110_CMD_IN_COMM_RF:
+        sim->stat.num_of_in_comm_rf++;
+        response_len = nfc110_sim_in_comm_rf(sim, command, command_len,
+                                             response);
+        break;
+    case NFC110_CMD_GET_FIRMWARE_VERSION:
+        response[2] = ((NFC110_SIM_DEFAULT_FIRMWARE_VERSION >> 0) & 0xff);
+        response[3] = ((NFC110_SIM_DEFAULT_FIRMWARE_VERSION >> 8) & 0xff);
+        response_len = 4;
+        break;
+    case NFC110_CMD_GET_COMMAND_TYPE:
+        utl_memset(response + 2, 0, 8);
+        response[9] = 0x0f; /* command type 0 - 3 */
+        response_len = 10;
+        break;
+    case NFC110_CMD_SET_COMMAND_TYPE:
+        if ((command_len != 3) || (command[2] > 3)) {
+            response[2] = NFC110_DEV_STATUS_COMMANDTYPE_ERROR;
+            break;
+        }
+        sim->command_type = command[2];
+        break;
+    default:
+        response[2] = NFC110_DEV_STATUS_PARAMETER_ERROR;
+        break;
+    }
+
+    nfc110_sim_push_frame(sim, response, response_len);
+}
+
+/**
+ * This function processes InCommRF: sends the RF command to the cards
+ * in the field, and makes the response of the first card which answers.
+ *
+ * \param  sim                    [IN] The simulator.
+ * \param  command                [IN] The command. (d6 04 ...)
+ * \param  command_len            [IN] The length of the command.
+ * \param  response              [OUT] The response. (d7 05 ...)
+ *
+ * \return The length of the response.
+ */
+static UINT32 nfc110_sim_in_comm_rf(
+    nfc110_sim_t* sim,
+    const UINT8* command,
+    UINT32 command_len,
+    UINT8* response)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_in_comm_rf"
+    UINT32 rc;
+    UINT32 timeout_usec;
+    const UINT8* rf_command;
+    UINT32 rf_command_len;
+    UINT8* rf_response;
+    UINT32 rf_response_len;
+    UINT32 rf_usec;
+    UINT32 i;
+    nfc110_sim_card_t* card;
+
+    response[2] = 0x00;
+    response[3] = 0x00;
+    response[4] = 0x00;
+    response[5] = 0x00;
+    if (command_len < 4) {
+        response[2] = (NFC110_RF_STATUS_PROTOCOL_ERROR & 0xff);
+        return 6;
+    }
+    timeout_usec = ((((UINT32)command[2] << 0) |
+                     ((UINT32)command[3] << 8)) * 100);
+    rf_command = (command + 4);
+    rf_command_len = (command_len - 4);
+    rf_response = (response + 7);
+    sim->rf_on = TRUE;
+
+    if ((rf_command_len < 2) || (rf_command[0] != rf_command_len)) {
+        response[2] = (NFC110_RF_STATUS_PROTOCOL_ERROR & 0xff);
+        return 6;
+    }
+    nfc110_sim_advance(sim, nfc110_sim_rf_usec(sim, rf_command_len));
+
+    rc = ICS_ERROR_TIMEOUT;
+    rf_usec = 0;
+    rf_response_len = 0;
+    if ((sim->config.rf_error_per_mille > 0) &&
+        ((nfc110_sim_rand(sim) % 1000) < sim->config.rf_error_per_mille)) {
+        /* the frame is lost */
+    } else if (rf_command[1] == 0x00) {
+        rc = nfc110_sim_polling(sim, rf_command, rf_command_len,
+                                rf_response, &rf_response_len, &rf_usec);
+    } else if (rf_command_len >= 10) {
+        for (i = 0; i < NFC110_SIM_MAX_CARDS; i++) {
+            card = &sim->cards[i];
+            if (card->present &&
+                (utl_memcmp(card->idm, rf_command + 2, 8) == 0)) {
+                rc = nfc110_sim_card_command(card, sim->now,
+                                             rf_command + 1,
+                                             rf_command_len - 1,
+                                             rf_response + 1,
+                                             &rf_response_len,
+                                             &rf_usec);
+                rf_usec = ((rf_usec / 100) * sim->config.card_time_percent);
+                rf_response[0] = (UINT8)(rf_response_len + 1);
+                rf_response_len++;
+                break;
+            }
+        }
+    }
+
+    if ((rc == ICS_ERROR_SUCCESS) && (rf_usec <= timeout_usec)) {
+        nfc110_sim_advance(sim, rf_usec);
+        nfc110_sim_advance(sim, nfc110_sim_rf_usec(sim, rf_response_len));
+        response[6] = 8; /* RxLastBit */
+        return (7 + rf_response_len);
+    }
+
+    sim->stat.num_of_rf_timeouts++;
+    nfc110_sim_advance(sim, timeout_usec);
+    response[2] = (NFC110_RF_STATUS_REC_TIMEOUT_ERROR & 0xff);
+    return 6;
+}
+
+/**
+ * This function emulates Polling to the cards in the field.
+ * Each card answers in a random time slot; the cards in the same
+ * time slot collide and are lost.
+ *
+ * \param  sim                    [IN] The simulator.
+ * \param  rf_command             [IN] The Polling command. (len 00 ...)
+ * \param  rf_command_len         [IN] The length of the command.
+ * \param  rf_response           [OUT] The responses. (len 01 IDm PMm ...)
+ * \param  rf_response_len       [OUT] The length of the responses.
+ * \param  rf_usec               [OUT] The response time. (us)
+ *
+ * \retval ICS_ERROR_SUCCESS           At least one card answers.
+ * \retval ICS_ERROR_TIMEOUT           No card answers.
+ */
+static UINT32 nfc110_sim_polling(
+    nfc110_sim_t* sim,
+    const UINT8* rf_command,
+    UINT32 rf_command_len,
+    UINT8* rf_response,
+    UINT32* rf_response_len,
+    UINT32* rf_usec)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_polling"
+    UINT8 card_response[20];
+    UINT8 slot_response[NFC110_SIM_POLLING_MAX_TIME_SLOTS][20];
+    UINT32 slot_response_len[NFC110_SIM_POLLING_MAX_TIME_SLOTS];
+    UINT32 slot_count[NFC110_SIM_POLLING_MAX_TIME_SLOTS];
+    UINT16 system_code;
+    UINT32 num_of_slots;
+    UINT32 slot;
+    UINT32 len;
+    UINT32 pos;
+    UINT32 i;
+
+    *rf_response_len = 0;
+    if (rf_command_len != 6) {
+        return ICS_ERROR_TIMEOUT;
+    }
+    system_code = (UINT16)(((UINT16)rf_command[2] << 8) | rf_command[3]);
+    num_of_slots = ((UINT32)rf_command[5] + 1);
+    if (num_of_slots > NFC110_SIM_POLLING_MAX_TIME_SLOTS) {
+        num_of_slots = NFC110_SIM_POLLING_MAX_TIME_SLOTS;
+    }
+    for (i = 0; i < num_of_slots; i++) {
+        slot_count[i] = 0;
+    }
+
+    for (i = 0; i < NFC110_SIM_MAX_CARDS; i++) {
+        if (!nfc110_sim_card_polling(&sim->cards[i], sim->now,
+                                     system_code, rf_command[4],
+                                     card_response, &len)) {
+            continue;
+        }
+        slot = (nfc110_sim_rand(sim) % num_of_slots);
+        if (slot_count[slot] == 0) {
+            utl_memcpy(slot_response[slot], card_response, len);
+            slot_response_len[slot] = len;
+        }
+        slot_count[slot]++;
+    }
+
+    /* the first response, or all responses in the multi card mode */
+    pos = 0;
+    for (slot = 0; slot < num_of_slots; slot++) {
+        if (slot_count[slot] != 1) {
+            continue;
+        }
+        rf_response[pos] = (UINT8)(slot_response_len[slot] + 1);
+        utl_memcpy(rf_response + pos + 1, slot_response[slot],
+                   slot_response_len[slot]);
+        pos += (slot_response_len[slot] + 1);
+        *rf_usec = (NFC110_SIM_POLLING_T_DELAY_USEC +
+                    (slot * NFC110_SIM_POLLING_T_TIMESLOT_USEC));
+        if (sim->protocol[0x03] == 0) {
+            break;
+        }
+        *rf_usec = (NFC110_SIM_POLLING_T_DELAY_USEC +
+                    (num_of_slots * NFC110_SIM_POLLING_T_TIMESLOT_USEC));
+    }
+    *rf_response_len = pos;
+    if (pos == 0) {
+        return ICS_ERROR_TIMEOUT;
+    }
+
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function returns the time to transfer an RF frame.
+ *
+ * \param  sim                    [IN] The simulator.
+ * \param  rf_len                 [IN] The length of the frame (LEN to data).
+ *
+ * \return The transfer time. (us)
+ */
+static UINT32 nfc110_sim_rf_usec(
+    nfc110_sim_t* sim,
+    UINT32 rf_len)
+{
+    UINT32 bps;
+
+    if (rf_len == 0) {
+        return 0;
+    }
+    if (sim->tx_speed == NFC110_RF_INITIATOR_ISO18092_424K) {
+        bps = 424;
+    } else {
+        bps = 212;
+    }
+
+    return (((NFC110_SIM_RF_PREAMBLE_BITS + NFC110_SIM_RF_CRC_BITS +
+              (rf_len * 8)) * 1000) / bps);
+}
+
+/**
+ * This function returns the number of the link layer PDUs which carry
+ * a BLE packet with the L2CAP header and the ATT header.
+ *
+ * \param  sim                    [IN] The simulator.
+ * \param  packet_len             [IN] The length of the packet.
+ *
+ * \return The number of the PDUs.
+ */
+static UINT32 nfc110_sim_num_of_pdus(
+    nfc110_sim_t* sim,
+    UINT32 packet_len)
+{
+    return ((packet_len + NFC110_SIM_ATT_HEADER_LEN +
+             sim->config.ll_data_len - 1) / sim->config.ll_data_len);
+}
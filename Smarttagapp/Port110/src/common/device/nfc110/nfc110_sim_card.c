@@ -0,0 +1,560 @@
+/**
+ * \brief    Simulated SmartTag card for the simulated NFC Port-110
+ * \date     2026/10/17
+ * \author   Copyright 2013 Sony Corporation
+ */
+
+#undef ICSLOG_MODULE
+#define ICSLOG_MODULE "DBs"
+
+#include "ics_types.h"
+#include "ics_error.h"
+#include "icslib_chk.h"
+#include "icslog.h"
+#include "utl.h"
+
+#include "felica_cc.h"
+#include "epaper.h"
+#include "nfc110_sim.h"
+
+/* --------------------------------
+ * Constant
+ * -------------------------------- */
+
+#define NFC110_SIM_CARD_CMD_POLLING             0x00
+#define NFC110_SIM_CARD_CMD_READ_WE             0x06
+#define NFC110_SIM_CARD_CMD_WRITE_WE            0x08
+
+#define NFC110_SIM_CARD_SF2_ILLEGAL_NUM_OF_BLOCKS       0xa2
+#define NFC110_SIM_CARD_SF2_ILLEGAL_BLOCK_LIST          0xa3
+#define NFC110_SIM_CARD_SF2_ILLEGAL_NUM_OF_SERVICES     0xa1
+#define NFC110_SIM_CARD_SF2_ILLEGAL_SERVICE_CODE        0xa6
+#define NFC110_SIM_CARD_SF2_ILLEGAL_BLOCK_NUMBER        0xa8
+
+#define NFC110_SIM_CARD_IS_27INCH(card) (((card)->idm[4] & 0x10) != 0)
+#define NFC110_SIM_CARD_IMAGE_LEN(card) \
+    (NFC110_SIM_CARD_IS_27INCH(card) ? \
+     ((EPAPER_PANEL_27INCH_WIDTH * EPAPER_PANEL_27INCH_HEIGHT) / 8) : \
+     ((EPAPER_PANEL_20INCH_WIDTH * EPAPER_PANEL_20INCH_HEIGHT) / 8))
+
+/* --------------------------------
+ * Prototype Declaration
+ * -------------------------------- */
+
+static UINT8 nfc110_sim_card_parse_block_list(
+    const UINT8* command,
+    UINT32 command_len,
+    UINT32 pos,
+    UINT32 max_num_of_blocks,
+    UINT32* num_of_blocks,
+    UINT8* block_numbers,
+    UINT32* end_pos);
+static void nfc110_sim_card_update(
+    nfc110_sim_card_t* card,
+    UINT64 now);
+static void nfc110_sim_card_read_block(
+    nfc110_sim_card_t* card,
+    UINT8 block_number,
+    UINT8* data);
+static void nfc110_sim_card_write_header(
+    nfc110_sim_card_t* card,
+    UINT64 now,
+    const UINT8* header);
+
+/* --------------------------------
+ * Function
+ * -------------------------------- */
+
+/* ------------------------
+ * Exported
+ * ------------------------ */
+
+/**
+ * This function initializes a simulated SmartTag.
+ *
+ * \param  card                  [OUT] The card.
+ * \param  idm                    [IN] IDm of the card.
+ */
+void nfc110_sim_card_initialize(
+    nfc110_sim_card_t* card,
+    const UINT8 idm[8])
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_card_initialize"
+    /* Read/Write Without Encryption need 1.8 ms / 19.3 ms for 4 / 12 blocks */
+    static const UINT8 default_pmm[8] = {
+        0x00, 0xf1, 0x00, 0x00, 0x00, 0x01, 0x43, 0x00
+    };
+    ICSLOG_FUNC_BEGIN;
+
+    utl_memset(card, 0, sizeof(*card));
+    card->present = TRUE;
+    utl_memcpy(card->idm, idm, 8);
+    utl_memcpy(card->pmm, default_pmm, 8);
+    card->system_code = NFC110_SIM_CARD_SYSTEM_CODE;
+    card->battery = NFC110_SIM_CARD_DEFAULT_BATTERY;
+    card->version = NFC110_SIM_CARD_DEFAULT_VERSION;
+    card->display_usec = NFC110_SIM_CARD_DEFAULT_DISPLAY_USEC;
+    card->status = NFC110_SIM_CARD_STS_RESET;
+
+    ICSLOG_FUNC_END;
+}
+
+/**
+ * This function makes the response of the card to Polling.
+ *
+ * \param  card                   [IN] The card.
+ * \param  now                    [IN] The simulated time. (us)
+ * \param  system_code            [IN] The system code. (0xff is wildcard)
+ * \param  request_code           [IN] The request code.
+ * \param  response              [OUT] The response. (01 IDm PMm ...)
+ * \param  response_len          [OUT] The length of the response.
+ *
+ * \return TRUE if the card answers.
+ */
+BOOL nfc110_sim_card_polling(
+    nfc110_sim_card_t* card,
+    UINT64 now,
+    UINT16 system_code,
+    UINT8 request_code,
+    UINT8* response,
+    UINT32* response_len)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_card_polling"
+    ICSLOG_FUNC_BEGIN;
+
+    if (!card->present) {
+        return FALSE;
+    }
+    if ((((system_code >> 8) & 0xff) != 0xff) &&
+        (((system_code >> 8) & 0xff) != ((card->system_code >> 8) & 0xff))) {
+        return FALSE;
+    }
+    if (((system_code & 0xff) != 0xff) &&
+        ((system_code & 0xff) != (card->system_code & 0xff))) {
+        return FALSE;
+    }
+    nfc110_sim_card_update(card, now);
+
+    response[0] = (NFC110_SIM_CARD_CMD_POLLING + 1);
+    utl_memcpy(response + 1, card->idm, 8);
+    utl_memcpy(response + 9, card->pmm, 8);
+    *response_len = 17;
+    if (request_code == 0x01) {
+        response[17] = (UINT8)((card->system_code >> 8) & 0xff);
+        response[18] = (UINT8)((card->system_code >> 0) & 0xff);
+        *response_len = 19;
+    } else if (request_code == 0x02) {
+        response[17] = 0x00;
+        response[18] = 0x83; /* 212 kbps, 424 kbps, fixed */
+        *response_len = 19;
+    }
+
+    ICSLOG_FUNC_END;
+    return TRUE;
+}
+
+/**
+ * This function processes a FeliCa command by the card.
+ *
+ * \param  card                   [IN] The card.
+ * \param  now                    [IN] The simulated time. (us)
+ * \param  command                [IN] The command. (code IDm ...)
+ * \param  command_len            [IN] The length of the command.
+ * \param  response              [OUT] The response. (code IDm ...)
+ * \param  response_len          [OUT] The length of the response.
+ * \param  card_usec             [OUT] The maximum response time. (us)
+ *
+ * \retval ICS_ERROR_SUCCESS           The card answers.
+ * \retval ICS_ERROR_TIMEOUT           The card does not answer.
+ */
+UINT32 nfc110_sim_card_command(
+    nfc110_sim_card_t* card,
+    UINT64 now,
+    const UINT8* command,
+    UINT32 command_len,
+    UINT8* response,
+    UINT32* response_len,
+    UINT32* card_usec)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_card_command"
+    UINT8 block_numbers[FELICA_CC_READ_WE_NUM_OF_BLOCKS_MAX];
+    UINT32 max_num_of_blocks;
+    UINT32 num_of_services;
+    UINT32 num_of_blocks;
+    UINT32 pos;
+    UINT32 i;
+    UINT8 sf2;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLOG_DUMP(command, command_len);
+
+    if ((command_len < 9) ||
+        (utl_memcmp(command + 1, card->idm, 8) != 0)) {
+        return ICS_ERROR_TIMEOUT;
+    }
+    if (command[0] == NFC110_SIM_CARD_CMD_READ_WE) {
+        max_num_of_blocks = FELICA_CC_READ_WE_NUM_OF_BLOCKS_MAX;
+    } else if (command[0] == NFC110_SIM_CARD_CMD_WRITE_WE) {
+        max_num_of_blocks = FELICA_CC_WRITE_WE_NUM_OF_BLOCKS_MAX;
+    } else {
+        /* unsupported commands are ignored */
+        return ICS_ERROR_TIMEOUT;
+    }
+    nfc110_sim_card_update(card, now);
+
+    response[0] = (UINT8)(command[0] + 1);
+    utl_memcpy(response + 1, card->idm, 8);
+    response[9] = 0x00;
+    response[10] = 0x00;
+    *response_len = 11;
+
+    /* service code list */
+    sf2 = 0x00;
+    num_of_blocks = 0;
+    pos = 9;
+    num_of_services = ((command_len > pos) ? command[pos] : 0);
+    pos++;
+    if ((num_of_services < FELICA_CC_READ_WE_NUM_OF_SERVICES_MIN) ||
+        (num_of_services > FELICA_CC_READ_WE_NUM_OF_SERVICES_MAX) ||
+        (command_len < (pos + (2 * num_of_services)))) {
+        sf2 = NFC110_SIM_CARD_SF2_ILLEGAL_NUM_OF_SERVICES;
+    } else {
+        for (i = 0; i < num_of_services; i++) {
+            if ((command[pos] != (NFC110_SIM_CARD_SERVICE_CODE & 0xff)) ||
+                (command[pos + 1] !=
+                 ((NFC110_SIM_CARD_SERVICE_CODE >> 8) & 0xff))) {
+                sf2 = NFC110_SIM_CARD_SF2_ILLEGAL_SERVICE_CODE;
+            }
+            pos += 2;
+        }
+    }
+
+    /* block list */
+    if (sf2 == 0x00) {
+        sf2 = nfc110_sim_card_parse_block_list(command, command_len, pos,
+                                               max_num_of_blocks,
+                                               &num_of_blocks,
+                                               block_numbers, &pos);
+    }
+    for (i = 0; (sf2 == 0x00) && (i < num_of_blocks); i++) {
+        if (block_numbers[i] >= NFC110_SIM_CARD_NUM_OF_BLOCKS) {
+            sf2 = NFC110_SIM_CARD_SF2_ILLEGAL_BLOCK_NUMBER;
+        }
+    }
+    if ((sf2 == 0x00) &&
+        (command[0] == NFC110_SIM_CARD_CMD_WRITE_WE) &&
+        (command_len != (pos + (NFC110_SIM_CARD_BLOCK_LEN * num_of_blocks)))) {
+        sf2 = NFC110_SIM_CARD_SF2_ILLEGAL_BLOCK_LIST;
+    }
+
+    if (command[0] == NFC110_SIM_CARD_CMD_READ_WE) {
+        *card_usec = (FELICA_CC_CALC_TIMEOUT_0_1MS(
+                          card->pmm[FELICA_CC_PMM_READ_WITHOUT_ENCRYPTION],
+                          num_of_blocks) * 100);
+    } else {
+        *card_usec = (FELICA_CC_CALC_TIMEOUT_0_1MS(
+                          card->pmm[FELICA_CC_PMM_WRITE_WITHOUT_ENCRYPTION],
+                          num_of_blocks) * 100);
+    }
+
+    if (sf2 != 0x00) {
+        response[9] = 0xff;
+        response[10] = sf2;
+        ICSLOG_DBG_HEX8(sf2);
+        return ICS_ERROR_SUCCESS;
+    }
+
+    if (command[0] == NFC110_SIM_CARD_CMD_READ_WE) {
+        response[11] = (UINT8)num_of_blocks;
+        for (i = 0; i < num_of_blocks; i++) {
+            nfc110_sim_card_read_block(
+                card, block_numbers[i],
+                response + 12 + (i * NFC110_SIM_CARD_BLOCK_LEN));
+        }
+        *response_len = (12 + (num_of_blocks * NFC110_SIM_CARD_BLOCK_LEN));
+    } else {
+        for (i = 0; i < num_of_blocks; i++) {
+            utl_memcpy(card->blocks[block_numbers[i]],
+                       command + pos + (i * NFC110_SIM_CARD_BLOCK_LEN),
+                       NFC110_SIM_CARD_BLOCK_LEN);
+        }
+        for (i = 0; i < num_of_blocks; i++) {
+            if (block_numbers[i] == 0) {
+                nfc110_sim_card_write_header(card, now, card->blocks[0]);
+            }
+        }
+    }
+
+    ICSLOG_DUMP(response, *response_len);
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/* ------------------------
+ * Internal
+ * ------------------------ */
+
+/**
+ * This function parses the block list of Read/Write Without Encryption.
+ *
+ * \param  command                [IN] The command.
+ * \param  command_len            [IN] The length of the command.
+ * \param  pos                    [IN] The position of the number of blocks.
+ * \param  max_num_of_blocks      [IN] The maximum number of blocks.
+ * \param  num_of_blocks         [OUT] The number of blocks.
+ * \param  block_numbers         [OUT] The block numbers.
+ * \param  end_pos               [OUT] The position after the block list.
+ *
+ * \return Status flag 2 of the card. (0x00 if no error)
+ */
+static UINT8 nfc110_sim_card_parse_block_list(
+    const UINT8* command,
+    UINT32 command_len,
+    UINT32 pos,
+    UINT32 max_num_of_blocks,
+    UINT32* num_of_blocks,
+    UINT8* block_numbers,
+    UINT32* end_pos)
+{
+    UINT32 n;
+    UINT32 i;
+
+    if (command_len <= pos) {
+        return NFC110_SIM_CARD_SF2_ILLEGAL_NUM_OF_BLOCKS;
+    }
+    n = command[pos++];
+    if ((n == 0) || (n > max_num_of_blocks)) {
+        return NFC110_SIM_CARD_SF2_ILLEGAL_NUM_OF_BLOCKS;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (command_len < (pos + 2)) {
+            return NFC110_SIM_CARD_SF2_ILLEGAL_BLOCK_LIST;
+        }
+        if ((command[pos] & 0x70) != 0) {
+            /* access mode must be 0 */
+            return NFC110_SIM_CARD_SF2_ILLEGAL_BLOCK_LIST;
+        }
+        if ((command[pos] & 0x80) != 0) {
+            block_numbers[i] = command[pos + 1];
+            pos += 2;
+        } else {
+            if ((command_len < (pos + 3)) || (command[pos + 2] != 0)) {
+                return NFC110_SIM_CARD_SF2_ILLEGAL_BLOCK_NUMBER;
+            }
+            block_numbers[i] = command[pos + 1];
+            pos += 3;
+        }
+    }
+
+    *num_of_blocks = n;
+    *end_pos = pos;
+
+    return 0x00;
+}
+
+/**
+ * This function completes the display refresh if the time has come.
+ *
+ * \param  card                   [IN] The card.
+ * \param  now                    [IN] The simulated time. (us)
+ */
+static void nfc110_sim_card_update(
+    nfc110_sim_card_t* card,
+    UINT64 now)
+{
+    if ((card->status == NFC110_SIM_CARD_STS_IN_PROGRESS) &&
+        (now >= card->busy_until)) {
+        card->status = NFC110_SIM_CARD_STS_COMPLETE;
+    }
+}
+
+/**
+ * This function reads a block of the card.
+ * The block 0 is the status of SmartTag,
+ * and the others are the data for DATA_READ.
+ *
+ * \param  card                   [IN] The card.
+ * \param  block_number           [IN] The block number.
+ * \param  data                  [OUT] The block data.
+ */
+static void nfc110_sim_card_read_block(
+    nfc110_sim_card_t* card,
+    UINT8 block_number,
+    UINT8* data)
+{
+    UINT32 offset;
+
+    utl_memset(data, 0, NFC110_SIM_CARD_BLOCK_LEN);
+    if (block_number == 0) {
+        data[0] = card->func;
+        data[1] = card->fsum;
+        data[2] = card->fnum;
+        data[3] = card->status;
+        data[4] = card->seq;
+        data[5] = card->battery;
+        data[15] = card->version;
+    } else if (card->func == NFC110_SIM_CARD_FUNC_DATA_READ) {
+        offset = ((UINT32)(block_number - 1) * NFC110_SIM_CARD_BLOCK_LEN);
+        utl_memcpy(data, card->user_data + offset, NFC110_SIM_CARD_BLOCK_LEN);
+    } else {
+        utl_memcpy(data, card->blocks[block_number],
+                   NFC110_SIM_CARD_BLOCK_LEN);
+    }
+}
+
+/**
+ * This function processes the header (block 0) written by the host.
+ *
+ * \param  card                   [IN] The card.
+ * \param  now                    [IN] The simulated time. (us)
+ * \param  header                 [IN] The header.
+ *                                     (func fSum fNum len seq sec[3] param[8])
+ */
+static void nfc110_sim_card_write_header(
+    nfc110_sim_card_t* card,
+    UINT64 now,
+    const UINT8* header)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "nfc110_sim_card_write_header"
+    UINT8 func = header[0];
+    UINT8 fsum = header[1];
+    UINT8 fnum = header[2];
+    UINT32 len = header[3];
+    UINT8 codec = header[8 + 3];
+    UINT32 offset;
+    UINT32 i;
+    UINT32 rc;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLOG_DUMP(header, NFC110_SIM_CARD_BLOCK_LEN);
+
+    card->seq = header[4];
+    if ((func == NFC110_SIM_CARD_FUNC_CHECK_STATUS) ||
+        (card->status == NFC110_SIM_CARD_STS_IN_PROGRESS)) {
+        return;
+    }
+
+    if ((func != NFC110_SIM_CARD_FUNC_SHOW_DISPLAY) &&
+        (func != NFC110_SIM_CARD_FUNC_CLEAR_DISPLAY) &&
+        (func != NFC110_SIM_CARD_FUNC_SHOW_DISPLAY2) &&
+        (func != NFC110_SIM_CARD_FUNC_DATA_WRITE) &&
+        (func != NFC110_SIM_CARD_FUNC_SAVE_LAYOUT) &&
+        (func != NFC110_SIM_CARD_FUNC_DATA_READ) &&
+        ((func & 0xf0) != NFC110_SIM_CARD_FUNC_DEMO)) {
+        card->status = NFC110_SIM_CARD_STS_UNDEFINED_FUNCTION;
+        return;
+    }
+    if (NFC110_SIM_CARD_IS_27INCH(card) &&
+        ((header[5] != '0') || (header[6] != '0') || (header[7] != '0'))) {
+        card->status = NFC110_SIM_CARD_STS_PARAMETER_ERROR;
+        return;
+    }
+    if ((fsum == 0) || (fsum > NFC110_SIM_CARD_MAX_FRAMES) ||
+        (fnum == 0) || (fnum > fsum)) {
+        card->status = NFC110_SIM_CARD_STS_SIZE_ERROR;
+        return;
+    }
+    if (len > NFC110_SIM_CARD_FRAME_DATA_LEN) {
+        card->status = NFC110_SIM_CARD_STS_LENGTH_ERROR;
+        return;
+    }
+    if ((func == NFC110_SIM_CARD_FUNC_SHOW_DISPLAY2) &&
+        (card->version < NFC110_SIM_CARD_SHOW_DISPLAY2_VERSION)) {
+        card->status = NFC110_SIM_CARD_STS_UNDEFINED_FUNCTION;
+        return;
+    }
+    if ((func == NFC110_SIM_CARD_FUNC_SHOW_DISPLAY2) &&
+        (header[8 + 2] >= NFC110_SIM_CARD_MAX_FRAMES)) {
+        card->status = NFC110_SIM_CARD_STS_PARAMETER_ERROR;
+        return;
+    }
+    if ((func == NFC110_SIM_CARD_FUNC_SHOW_DISPLAY) &&
+        (codec != EPAPER_CODEC_RAW) &&
+        ((card->version < NFC110_SIM_CARD_CODEC_VERSION) ||
+         (codec > EPAPER_CODEC_XOR_PACKBITS))) {
+        card->status = NFC110_SIM_CARD_STS_PARAMETER_ERROR;
+        return;
+    }
+    if (fnum == 1) {
+        card->data_len = 0;
+        if (func == NFC110_SIM_CARD_FUNC_SHOW_DISPLAY2) {
+            /* the frames update the shown image */
+            utl_memcpy(card->data, card->display, sizeof(card->display));
+            card->data_len = sizeof(card->display);
+        }
+    } else if ((card->func != func) || (card->fsum != fsum) ||
+               (fnum > (card->fnum + 1))) {
+        /* a frame is missing (a frame may be sent again) */
+        card->status = NFC110_SIM_CARD_STS_ADDRESS_ERROR;
+        return;
+    }
+
+    card->func = func;
+    card->fsum = fsum;
+    card->fnum = fnum;
+    if (func == NFC110_SIM_CARD_FUNC_SHOW_DISPLAY2) {
+        /* the parameter 2 is the position of the frame in the image */
+        offset = ((UINT32)header[8 + 2] * NFC110_SIM_CARD_FRAME_DATA_LEN);
+    } else {
+        offset = ((UINT32)(fnum - 1) * NFC110_SIM_CARD_FRAME_DATA_LEN);
+    }
+    for (i = 0; i < len; i++) {
+        card->data[offset + i] =
+            card->blocks[1 + (i / NFC110_SIM_CARD_BLOCK_LEN)]
+                        [i % NFC110_SIM_CARD_BLOCK_LEN];
+    }
+    if (card->data_len < (offset + len)) {
+        card->data_len = (offset + len);
+    }
+
+    if (fnum < fsum) {
+        card->status = NFC110_SIM_CARD_STS_WAIT_COMMAND;
+        return;
+    }
+
+    if ((func == NFC110_SIM_CARD_FUNC_SHOW_DISPLAY) &&
+        (codec != EPAPER_CODEC_RAW)) {
+        /* the image is updated in place */
+        rc = epaper_decode(codec, card->data, card->data_len, card->display,
+                           card->display, NFC110_SIM_CARD_IMAGE_LEN(card));
+        if (rc != ICS_ERROR_SUCCESS) {
+            card->status = NFC110_SIM_CARD_STS_DATA_ERROR;
+            return;
+        }
+    } else if ((func == NFC110_SIM_CARD_FUNC_SHOW_DISPLAY) ||
+               (func == NFC110_SIM_CARD_FUNC_SHOW_DISPLAY2)) {
+        utl_memcpy(card->display, card->data, card->data_len);
+    } else if (func == NFC110_SIM_CARD_FUNC_CLEAR_DISPLAY) {
+        utl_memset(card->display, 0, sizeof(card->display));
+    }
+
+    switch (func) {
+    case NFC110_SIM_CARD_FUNC_DATA_WRITE:
+        card->user_data_len = card->data_len;
+        if (card->user_data_len > sizeof(card->user_data)) {
+            card->user_data_len = sizeof(card->user_data);
+        }
+        utl_memcpy(card->user_data, card->data, card->user_data_len);
+        card->status = NFC110_SIM_CARD_STS_COMPLETE;
+        break;
+    case NFC110_SIM_CARD_FUNC_SAVE_LAYOUT:
+    case NFC110_SIM_CARD_FUNC_DATA_READ:
+        card->status = NFC110_SIM_CARD_STS_COMPLETE;
+        break;
+    default:
+        /* refresh the e-paper display */
+        card->num_of_refreshes++;
+        card->busy_until = (now + card->display_usec);
+        card->status = NFC110_SIM_CARD_STS_IN_PROGRESS;
+        break;
+    }
+    ICSLOG_DBG_HEX8(card->status);
+
+    ICSLOG_FUNC_END;
+}
@@ -0,0 +1,321 @@
+/**
+ * \brief    E-paper Rendering (compression of packed frames)
+ * \date     2026/10/17
+ * \author   Copyright 2013 Sony Corporation
+ */
+
+/*
+ * A frame is compressed with PackBits: a control byte n of 0 to 127 is
+ * followed by n + 1 literal bytes, and n of 129 to 255 by a byte which
+ * is repeated 257 - n times (128 is skipped). The delta codec packs the
+ * XOR of the frame and the image which is shown, so the unchanged
+ * parts become runs of zero.
+ */
+
+#undef ICSLOG_MODULE
+#define ICSLOG_MODULE "EPC"
+
+#include "ics_types.h"
+#include "ics_error.h"
+#include "icslib_chk.h"
+#include "icslog.h"
+#include "utl.h"
+
+#include "epaper.h"
+
+/* --------------------------------
+ * Constant
+ * -------------------------------- */
+
+#define EPAPER_CODEC_MAX_COUNT                  128
+#define EPAPER_CODEC_MIN_RUN                    3
+
+/* --------------------------------
+ * Prototype Declaration
+ * -------------------------------- */
+
+static UINT32 epaper_codec_put_literal(
+    const UINT8* frame,
+    const UINT8* base,
+    UINT32 pos,
+    UINT32 len,
+    UINT8* data,
+    UINT32 max_data_len,
+    UINT32* data_len);
+
+/* --------------------------------
+ * Function
+ * -------------------------------- */
+
+/* ------------------------
+ * Internal
+ * ------------------------ */
+
+/*
+ * A byte to be compressed: the byte of the frame, or its difference
+ * from the base.
+ */
+#define EPAPER_CODEC_BYTE(frame, base, pos) \
+    (((base) == NULL) ? (frame)[pos] : (UINT8)((frame)[pos] ^ (base)[pos]))
+
+/**
+ * This function puts literal bytes in pieces of up to 128 bytes.
+ *
+ * \param  frame                  [IN] The frame.
+ * \param  base                   [IN] The base of the delta. (or NULL)
+ * \param  pos                    [IN] The position of the first byte.
+ * \param  len                    [IN] The number of bytes.
+ * \param  data                  [OUT] The compressed data.
+ * \param  max_data_len           [IN] The length of the buffer of data.
+ * \param  data_len           [IN/OUT] The length of the compressed data.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_BUF_OVERFLOW      The buffer of data is short.
+ */
+static UINT32 epaper_codec_put_literal(
+    const UINT8* frame,
+    const UINT8* base,
+    UINT32 pos,
+    UINT32 len,
+    UINT8* data,
+    UINT32 max_data_len,
+    UINT32* data_len)
+{
+    UINT32 n;
+    UINT32 i;
+    UINT32 out = *data_len;
+
+    while (len > 0) {
+        n = ((len < EPAPER_CODEC_MAX_COUNT) ? len : EPAPER_CODEC_MAX_COUNT);
+        if ((max_data_len - out) < (1 + n)) {
+            return ICS_ERROR_BUF_OVERFLOW;
+        }
+        data[out++] = (UINT8)(n - 1);
+        for (i = 0; i < n; i++) {
+            data[out++] = EPAPER_CODEC_BYTE(frame, base, pos + i);
+        }
+        pos += n;
+        len -= n;
+    }
+    *data_len = out;
+
+    return ICS_ERROR_SUCCESS;
+}
+
+/* ------------------------
+ * Exported
+ * ------------------------ */
+
+/**
+ * This function compresses a frame.
+ *
+ * The compression stops with ICS_ERROR_BUF_OVERFLOW as soon as the data
+ * exceed max_data_len, so a caller can pass the length which is worth
+ * sending. EPAPER_MAX_ENCODED_LEN(frame_len) is always enough.
+ *
+ * \param  codec                  [IN] EPAPER_CODEC_*.
+ * \param  frame                  [IN] The frame.
+ * \param  base                   [IN] The frame which is shown.
+ *                                     (EPAPER_CODEC_XOR_PACKBITS only)
+ * \param  frame_len              [IN] The length of the frame.
+ * \param  data                  [OUT] The compressed data.
+ * \param  max_data_len           [IN] The length of the buffer of data.
+ * \param  data_len              [OUT] The length of the compressed data.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_BUF_OVERFLOW      The buffer of data is short.
+ */
+UINT32 epaper_encode(
+    UINT32 codec,
+    const UINT8* frame,
+    const UINT8* base,
+    UINT32 frame_len,
+    UINT8* data,
+    UINT32 max_data_len,
+    UINT32* data_len)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "epaper_encode"
+    UINT32 rc;
+    UINT32 pos;
+    UINT32 run;
+    UINT32 literal;
+    UINT32 out;
+    UINT8 value;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_LE(codec, EPAPER_CODEC_XOR_PACKBITS,
+                     ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(frame, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(data, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(data_len, NULL, ICS_ERROR_INVALID_PARAM);
+    if (codec == EPAPER_CODEC_XOR_PACKBITS) {
+        ICSLIB_CHKARG_NE(base, NULL, ICS_ERROR_INVALID_PARAM);
+    } else {
+        base = NULL;
+    }
+
+    ICSLOG_DBG_UINT(codec);
+    ICSLOG_DBG_UINT(frame_len);
+
+    if (codec == EPAPER_CODEC_RAW) {
+        if (max_data_len < frame_len) {
+            ICSLOG_ERR_STR(ICS_ERROR_BUF_OVERFLOW, "Buffer of data is short.");
+            return ICS_ERROR_BUF_OVERFLOW;
+        }
+        utl_memcpy(data, frame, frame_len);
+        *data_len = frame_len;
+
+        ICSLOG_FUNC_END;
+        return ICS_ERROR_SUCCESS;
+    }
+
+    out = 0;
+    literal = 0;
+    pos = 0;
+    while (pos < frame_len) {
+        value = EPAPER_CODEC_BYTE(frame, base, pos);
+        run = 1;
+        while (((pos + run) < frame_len) &&
+               (run < EPAPER_CODEC_MAX_COUNT) &&
+               (EPAPER_CODEC_BYTE(frame, base, pos + run) == value)) {
+            run++;
+        }
+        if (run < EPAPER_CODEC_MIN_RUN) {
+            /* too short to be a run */
+            pos += run;
+            continue;
+        }
+
+        rc = epaper_codec_put_literal(frame, base, literal, (pos - literal),
+                                      data, max_data_len, &out);
+        if (rc != ICS_ERROR_SUCCESS) {
+            ICSLOG_DBG_UINT(pos);
+            return rc;
+        }
+        if ((max_data_len - out) < 2) {
+            ICSLOG_DBG_UINT(pos);
+            return ICS_ERROR_BUF_OVERFLOW;
+        }
+        data[out++] = (UINT8)(257 - run);
+        data[out++] = value;
+        pos += run;
+        literal = pos;
+    }
+    rc = epaper_codec_put_literal(frame, base, literal, (pos - literal),
+                                  data, max_data_len, &out);
+    if (rc != ICS_ERROR_SUCCESS) {
+        ICSLOG_DBG_UINT(pos);
+        return rc;
+    }
+    *data_len = out;
+
+    ICSLOG_DBG_UINT(*data_len);
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function decompresses a frame.
+ *
+ * For EPAPER_CODEC_XOR_PACKBITS, the base may be the frame itself, so
+ * the shown image can be updated in place.
+ *
+ * \param  codec                  [IN] EPAPER_CODEC_*.
+ * \param  data                   [IN] The compressed data.
+ * \param  data_len               [IN] The length of the compressed data.
+ * \param  base                   [IN] The frame which is shown.
+ *                                     (EPAPER_CODEC_XOR_PACKBITS only)
+ * \param  frame                 [OUT] The frame.
+ * \param  frame_len              [IN] The length of the frame.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_INVALID_DATA      The data is not a frame.
+ */
+UINT32 epaper_decode(
+    UINT32 codec,
+    const UINT8* data,
+    UINT32 data_len,
+    const UINT8* base,
+    UINT8* frame,
+    UINT32 frame_len)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "epaper_decode"
+    UINT32 in;
+    UINT32 out;
+    UINT32 n;
+    UINT32 i;
+    UINT8 control;
+    UINT8 value;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_LE(codec, EPAPER_CODEC_XOR_PACKBITS,
+                     ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(data, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(frame, NULL, ICS_ERROR_INVALID_PARAM);
+    if (codec == EPAPER_CODEC_XOR_PACKBITS) {
+        ICSLIB_CHKARG_NE(base, NULL, ICS_ERROR_INVALID_PARAM);
+    } else {
+        base = NULL;
+    }
+
+    ICSLOG_DBG_UINT(codec);
+    ICSLOG_DBG_UINT(data_len);
+
+    if (codec == EPAPER_CODEC_RAW) {
+        if (data_len != frame_len) {
+            ICSLOG_ERR_STR(ICS_ERROR_INVALID_DATA, "Invalid length.");
+            return ICS_ERROR_INVALID_DATA;
+        }
+        utl_memcpy(frame, data, frame_len);
+
+        ICSLOG_FUNC_END;
+        return ICS_ERROR_SUCCESS;
+    }
+
+    in = 0;
+    out = 0;
+    while (in < data_len) {
+        control = data[in++];
+        if (control < EPAPER_CODEC_MAX_COUNT) {
+            n = ((UINT32)control + 1);
+            if (((data_len - in) < n) || ((frame_len - out) < n)) {
+                ICSLOG_ERR_STR(ICS_ERROR_INVALID_DATA, "Literal overruns.");
+                return ICS_ERROR_INVALID_DATA;
+            }
+            for (i = 0; i < n; i++) {
+                value = data[in++];
+                frame[out] = ((base == NULL) ? value :
+                              (UINT8)(value ^ base[out]));
+                out++;
+            }
+        } else if (control > EPAPER_CODEC_MAX_COUNT) {
+            n = (257 - (UINT32)control);
+            if ((in == data_len) || ((frame_len - out) < n)) {
+                ICSLOG_ERR_STR(ICS_ERROR_INVALID_DATA, "Run overruns.");
+                return ICS_ERROR_INVALID_DATA;
+            }
+            value = data[in++];
+            if (base == NULL) {
+                utl_memset(frame + out, value, n);
+                out += n;
+            } else {
+                for (i = 0; i < n; i++) {
+                    frame[out] = (UINT8)(value ^ base[out]);
+                    out++;
+                }
+            }
+        }
+    }
+    if (out != frame_len) {
+        ICSLOG_ERR_STR(ICS_ERROR_INVALID_DATA, "Frame is short.");
+        return ICS_ERROR_INVALID_DATA;
+    }
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
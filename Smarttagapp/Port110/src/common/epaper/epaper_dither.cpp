@@ -0,0 +1,580 @@
+/**
+ * \brief    E-paper Rendering (dithering to packed 1-bpp rows)
+ * \date     2026/10/17
+ * \author   Copyright 2013 Sony Corporation
+ */
+
+/*
+ * Error diffusion keeps integer error sums, times the divisor of the
+ * kernel, in two rolling INT16 rows: this row and the next one. The
+ * errors for the pixels to the right ride in registers, and those for
+ * the second next row are summed in a window of registers and stored
+ * into this row right behind the pixel being consumed. A pixel is
+ * written straight into the packed output (1 is black).
+ */
+
+#undef ICSLOG_MODULE
+#define ICSLOG_MODULE "EPD"
+
+#include <stddef.h>
+
+#include "ics_types.h"
+#include "ics_error.h"
+#include "icslib_chk.h"
+#include "icslog.h"
+#include "utl.h"
+
+#include "epaper.h"
+#include "epaper_internal.h"
+
+/* --------------------------------
+ * Constant
+ * -------------------------------- */
+
+#define EPAPER_THRESHOLD                        128
+#define EPAPER_BAYER_LEN                        8
+#define EPAPER_BLUE_NOISE_LEN                   32
+
+/* --------------------------------
+ * Struct Declaration
+ * -------------------------------- */
+
+namespace {
+
+/*
+ * Weights of the kernels: R1 and R2 for the pixels to the right, B for
+ * the next row and C for the second next row, from x - 2 to x + 2.
+ */
+template <UINT32 DITHER>
+struct epaper_kernel_t;
+
+template <>
+struct epaper_kernel_t<EPAPER_DITHER_FLOYD_STEINBERG> {
+    enum {
+        DIVISOR = 16,
+        R1 = 7, R2 = 0,
+        B_2 = 0, B_1 = 3, B0 = 5, B1 = 1, B2 = 0,
+        C_2 = 0, C_1 = 0, C0 = 0, C1 = 0, C2 = 0
+    };
+};
+
+template <>
+struct epaper_kernel_t<EPAPER_DITHER_JJN> {
+    enum {
+        DIVISOR = 48,
+        R1 = 7, R2 = 5,
+        B_2 = 3, B_1 = 5, B0 = 7, B1 = 5, B2 = 3,
+        C_2 = 1, C_1 = 3, C0 = 5, C1 = 3, C2 = 1
+    };
+};
+
+/* diffuses 6/8 of the error only, which keeps the highlights clean */
+template <>
+struct epaper_kernel_t<EPAPER_DITHER_ATKINSON> {
+    enum {
+        DIVISOR = 8,
+        R1 = 1, R2 = 1,
+        B_2 = 0, B_1 = 1, B0 = 1, B1 = 1, B2 = 0,
+        C_2 = 0, C_1 = 0, C0 = 1, C1 = 0, C2 = 0
+    };
+};
+
+} /* namespace */
+
+/* --------------------------------
+ * Variable
+ * -------------------------------- */
+
+/* thresholds of the ordered dithering, centered in the gray range of
+   each rank: 0 is always black and 255 always white */
+static const UINT8 s_epaper_bayer[EPAPER_BAYER_LEN * EPAPER_BAYER_LEN] = {
+      2, 129,  34, 161,  10, 137,  42, 169,
+    193,  66, 225,  98, 201,  74, 233, 106,
+     50, 177,  18, 145,  58, 185,  26, 153,
+    241, 114, 209,  82, 249, 122, 217,  90,
+     14, 141,  46, 173,   6, 133,  38, 165,
+    205,  78, 237, 110, 197,  70, 229, 102,
+     62, 189,  30, 157,  54, 181,  22, 149,
+    253, 126, 221,  94, 245, 118, 213,  86
+};
+
+/* void-and-cluster, Gaussian sigma 1.5, toroidal */
+static const UINT8 s_epaper_blue_noise[
+    EPAPER_BLUE_NOISE_LEN * EPAPER_BLUE_NOISE_LEN] = {
+    211, 144, 219, 169, 246, 142, 176, 239,
+    118, 162,  10, 251,  34, 195,  65, 243,
+    172,  52, 187,  33,  88, 201, 137,  24,
+    168, 146, 208,  41, 153, 229, 137,   3,
+    104,  29, 125,  87,  38, 110, 214,  74,
+     27, 201,  59, 145,  76, 167,  19, 141,
+     83,   5, 236, 148,  57, 245, 106, 222,
+     47,  90,  21, 175, 112,  31, 182,  63,
+    251, 185,  70, 227, 197,  14, 154,  51,
+    132, 221, 104, 180, 121, 230,  98, 199,
+    220, 120,  99, 216, 175,  16, 155,  66,
+    186, 124, 225,  69, 240,  81, 217, 122,
+     49, 158,  19, 150,  56, 179,  91, 250,
+    185,  80,  40, 239,  14,  49, 156,  34,
+     58, 166,  22,  68, 124,  43, 214,  97,
+    252,  15, 141, 199,   7, 135, 166,  16,
+    231, 203, 106, 244, 133, 208, 119,  23,
+    162,   2, 149, 195,  89, 215, 116, 241,
+    186, 136, 251, 200,  89, 184, 134,  30,
+    165,  59,  86, 159, 105,  54, 194,  94,
+     74, 130,  42,  88,   6,  77,  44, 219,
+    106, 235, 128,  65, 171, 138,  73,   8,
+    105,  80,  45, 144,   1, 231,  73, 204,
+    113, 192, 230,  29, 210, 243,  34, 146,
+    175,  23, 193, 216, 173, 240, 147, 191,
+     58,  87, 208,  32, 254,  20, 206, 160,
+    233,  27, 171, 207, 108, 157,  50, 239,
+      7, 150,  45, 122, 174,  85, 117, 212,
+    254,  67, 111, 142,  57, 100,  29, 126,
+    177,  16, 157, 113,  54,  94, 184,  46,
+    124, 218,  97,  61, 244,  25, 120, 176,
+     82, 102, 248,  72,  17, 155,  60,   2,
+     94, 161, 225,  15, 165, 228, 199,  71,
+    249,  46, 223, 195, 147, 228, 117,  68,
+    147, 187,  12, 133, 179,  77, 198, 143,
+     35, 207, 181, 132, 215, 188, 227, 140,
+    202,  30, 128,  83,  47, 119,   8,  90,
+    163, 137,  99,  70,  28, 174,   3, 244,
+     35,  82, 237,  47, 217, 100,  10, 221,
+     63, 156,  12,  52,  93,  31, 112,  44,
+    236,  62, 192, 248, 178, 205, 151, 232,
+     36, 189,  12, 240, 129,  79, 197, 103,
+    211, 167, 112, 149,  31, 163, 249, 129,
+     95, 237, 112, 224, 144, 246,  77, 168,
+     15, 107, 145,  38, 100,  67,  21, 114,
+    213,  61, 111, 165, 205,  37, 157, 134,
+     16,  56, 196,  70, 204, 116,  55,  39,
+    177,  24, 191,  69, 164,   6, 186, 131,
+     87, 207, 172,   5, 224, 135, 242, 167,
+     80, 133, 226,  49,  90, 246,  60, 222,
+     92, 252, 130,   6, 232,  86, 188, 143,
+    212,  83, 136,  42, 210, 121,  55, 220,
+     23, 240,  71, 114, 190,  86,  55,  32,
+    200,   5, 151, 185,  17, 118, 181,  26,
+    150,  41, 176, 101, 157,  21, 241,  72,
+      2, 159, 253,  96,  23, 236, 102, 155,
+    180,  53, 139, 162,  42, 212, 148, 178,
+     95, 253,  38, 104, 233, 140,  78, 204,
+    111, 234,  79, 218,  48, 126, 168, 107,
+    229,  51, 118, 202, 173,  75, 194,  39,
+    123,  99, 228,  25, 248, 103,  18, 233,
+    117,  68, 210, 166,  57, 216,   4, 160,
+     63, 188,  13, 141, 195,  64, 206,  39,
+    131, 189,  28,  62, 147,  11, 137, 250,
+    202,  10, 173,  81, 126, 185,  73, 138,
+     48, 182, 128,  84,  28, 175,  99, 247,
+     35, 123, 170,  32, 249,  96,  11, 221,
+     88, 171, 238, 109, 207, 225,  91,  57,
+     78, 219, 146,  48, 204,   2, 160, 207,
+     25, 224,   9, 148, 241, 117,  45, 143,
+    214,  92, 230,  72, 114, 162, 182, 143,
+     67,  19, 154,  84,  44, 121,  26, 164,
+    115,  35, 184, 106, 227,  61,  98, 243,
+     80, 155, 103, 196,  64, 209, 183,  75,
+     17, 198,  47, 136, 205,  25,  53, 245,
+    105, 226, 197,   4, 243, 151, 190, 231,
+    139,  65, 254,  20, 134, 174,  40, 122,
+    187,  53, 232,  36,  91,  13, 131, 234,
+    165, 109, 154,   1, 236,  88, 122, 194,
+     38, 125,  58, 135, 178,  69, 101,   7,
+    170, 210,  93, 159,  76, 237, 199, 145,
+     12, 110, 171, 136, 247, 159, 100,  33,
+     58, 254,  82, 190,  65, 158, 217,   9,
+     81, 169, 211,  95,  33, 217,  49, 242,
+     21, 120,  43, 193,   7, 108,  30,  70,
+    250, 203,  24,  76, 186,  50, 215, 196,
+    127, 181,  26, 223, 112,  33, 138, 179,
+    238, 149,  18, 252, 116, 160, 201,  84,
+    187,  59, 234, 130, 214, 152, 223,  91,
+    158,  60, 125, 220,   3, 114,  80, 152,
+     11,  97, 143,  50, 170, 246,  96,  52,
+    111,  71,  45, 190,  79,  13, 128, 145,
+    219, 105, 167,  28,  85,  54, 119, 180,
+     40, 228,  98, 153, 175, 239,  31, 225,
+     67, 235, 203, 121,   8,  75, 189,  22,
+    201, 229, 141, 172, 226,  62, 238,  40,
+      1, 148,  71, 247, 182, 206,  17, 241,
+    138,   9, 192,  43,  66, 139, 202, 120,
+    163,  36,  79, 178, 213, 146, 223, 129,
+    158,   3,  92, 123,  27, 109, 177,  95,
+    242, 191,  20, 125, 102,  39, 161,  73,
+    109, 213,  83, 252, 108,  16,  89,  50,
+    188, 110, 249,  19, 101,  55,  34,  87,
+    250,  41, 212,  56, 198, 153, 208,  74,
+    115,  52, 220, 154,  64, 232, 133, 198,
+     53, 168,  26, 183, 150, 224, 170, 242,
+      5, 151,  62, 127, 161, 239, 180, 118,
+     66, 169, 132, 231,  82,   9,  44, 134,
+     27, 172,  89, 200,   6, 176,  85,  14,
+    245, 144, 119,  61, 209,  36,  74, 135,
+     96, 200, 218,  32, 193,  72,  10, 218,
+    196,  98,  18, 179, 113, 251, 163, 216,
+     69, 237, 139,  43, 253, 116, 215, 104,
+     37, 222,  92,   1, 130, 102, 194,  24,
+    233,  46,  85, 142, 234,  93, 152,  29,
+    140,  54, 238,  37, 142,  59,  90, 189,
+    152,  11, 110,  78, 161,  30,  60, 153,
+    173,  68, 192, 235, 164, 245,  56, 177,
+    115, 156, 181,  20, 113,  48, 174, 247,
+    108, 211, 156,  78, 203, 222,  22, 123,
+     41, 227, 183, 205, 131, 230, 193, 127,
+    209,  22, 140,  48,  81,  15, 149, 221,
+     77,  13, 253,  64, 206, 226, 126,  42,
+     84,   4, 184, 127,  14, 169, 107, 244,
+    166,  93,  51,  18,  66,  97,   4,  46,
+     86, 229, 101, 183, 124, 213, 107,  37,
+    129, 209, 103, 132, 164,   8,  75, 191,
+    235, 115,  63, 248,  94,  51, 197,  76
+};
+
+/* --------------------------------
+ * Function
+ * -------------------------------- */
+
+/* ------------------------
+ * Internal
+ * ------------------------ */
+
+namespace {
+
+/* divides an error sum by the divisor, rounding to nearest */
+template <INT32 DIVISOR>
+inline INT32 epaper_dither_error(
+    INT32 sum)
+{
+    /* an offset keeps the division unsigned (|sum| < 256 * DIVISOR) */
+    return ((INT32)((UINT32)(sum + (DIVISOR / 2) + (256 * DIVISOR)) /
+                    DIVISOR) - 256);
+}
+
+/* appends a pixel to the packed row */
+inline void epaper_dither_put(
+    UINT8* bits,
+    UINT32 x,
+    UINT32* acc,
+    UINT32 black)
+{
+    *acc = ((*acc << 1) | black);
+    if ((x & 7) == 7) {
+        bits[x >> 3] = (UINT8)*acc;
+    }
+}
+
+/* flushes the last byte of a row which is not a multiple of 8 */
+inline void epaper_dither_flush(
+    UINT8* bits,
+    UINT32 width,
+    UINT32 acc)
+{
+    if ((width & 7) != 0) {
+        bits[width >> 3] = (UINT8)(acc << (8 - (width & 7)));
+    }
+}
+
+template <UINT32 DITHER>
+void epaper_dither_diffuse(
+    epaper_dither_work_t* work,
+    const UINT8* gray,
+    UINT8* bits)
+{
+    typedef epaper_kernel_t<DITHER> k;
+    UINT32 x;
+    UINT32 width;
+    UINT32 acc;
+    UINT32 black;
+    INT32 v;
+    INT32 e;
+    INT32 r1;
+    INT32 r2;
+    INT32 s0;
+    INT32 s1;
+    INT32 s2;
+    INT32 s3;
+    INT16* cur;
+    INT16* next;
+
+    width = work->width;
+    cur = (work->error[0] + EPAPER_DITHER_MARGIN);
+    next = (work->error[1] + EPAPER_DITHER_MARGIN);
+    acc = 0;
+    r1 = 0;
+    r2 = 0;
+    s0 = 0;
+    s1 = 0;
+    s2 = 0;
+    s3 = 0;
+
+    for (x = 0; x < width; x++) {
+        v = ((INT32)gray[x] +
+             epaper_dither_error<k::DIVISOR>((INT32)cur[x] + r1));
+        black = ((v < EPAPER_THRESHOLD) ? 1 : 0);
+        e = (black ? v : (v - 255));
+        epaper_dither_put(bits, x, &acc, black);
+
+        /* the pixels to the right */
+        r1 = (r2 + (k::R1 * e));
+        r2 = (k::R2 * e);
+
+        /* the next row */
+        if (k::B_2 != 0) {
+            next[(INT32)x - 2] = (INT16)(next[(INT32)x - 2] + (k::B_2 * e));
+        }
+        if (k::B_1 != 0) {
+            next[(INT32)x - 1] = (INT16)(next[(INT32)x - 1] + (k::B_1 * e));
+        }
+        if (k::B0 != 0) {
+            next[x + 0] = (INT16)(next[x + 0] + (k::B0 * e));
+        }
+        if (k::B1 != 0) {
+            next[x + 1] = (INT16)(next[x + 1] + (k::B1 * e));
+        }
+        if (k::B2 != 0) {
+            next[x + 2] = (INT16)(next[x + 2] + (k::B2 * e));
+        }
+
+        /* the second next row, x - 2 to x + 2, of which x - 2 is done */
+        s0 += (k::C_2 * e);
+        cur[(INT32)x - 2] = (INT16)s0;
+        s0 = (s1 + (k::C_1 * e));
+        s1 = (s2 + (k::C0 * e));
+        s2 = (s3 + (k::C1 * e));
+        s3 = (k::C2 * e);
+    }
+    epaper_dither_flush(bits, width, acc);
+
+    /* this row turns into the next one */
+    cur[(INT32)width - 2] = (INT16)s0;
+    cur[(INT32)width - 1] = (INT16)s1;
+    cur[-2] = 0;
+    cur[-1] = 0;
+    cur[width + 0] = 0;
+    cur[width + 1] = 0;
+    work->error[0] = (next - EPAPER_DITHER_MARGIN);
+    work->error[1] = (cur - EPAPER_DITHER_MARGIN);
+}
+
+template <UINT32 LEN>
+void epaper_dither_ordered(
+    const UINT8* table,
+    UINT32 width,
+    const UINT8* gray,
+    UINT32 y,
+    UINT8* bits)
+{
+    UINT32 x;
+    UINT32 acc;
+    const UINT8* t;
+
+    t = (table + ((y % LEN) * LEN));
+    acc = 0;
+    for (x = 0; x < width; x++) {
+        epaper_dither_put(bits, x, &acc,
+                          ((gray[x] < t[x % LEN]) ? 1 : 0));
+    }
+    epaper_dither_flush(bits, width, acc);
+}
+
+void epaper_dither_threshold(
+    UINT32 width,
+    const UINT8* gray,
+    UINT8* bits)
+{
+    UINT32 x;
+    UINT32 acc;
+
+    acc = 0;
+    for (x = 0; x < width; x++) {
+        epaper_dither_put(bits, x, &acc,
+                          ((gray[x] < EPAPER_THRESHOLD) ? 1 : 0));
+    }
+    epaper_dither_flush(bits, width, acc);
+}
+
+} /* namespace */
+
+/**
+ * This function prepares the dithering of rows.
+ *
+ * \param  work                  [OUT] The work area.
+ * \param  dither                 [IN] EPAPER_DITHER_*.
+ * \param  width                  [IN] The width of a row.
+ * \param  rows                   [IN] The error rows.
+ *                                     (EPAPER_DITHER_NUM_OF_ROWS *
+ *                                      EPAPER_DITHER_ROW_LEN(width))
+ */
+void epaper_dither_setup(
+    epaper_dither_work_t* work,
+    UINT32 dither,
+    UINT32 width,
+    INT16* rows)
+{
+    UINT32 i;
+
+    work->dither = dither;
+    work->width = width;
+    for (i = 0; i < EPAPER_DITHER_NUM_OF_ROWS; i++) {
+        work->error[i] = (rows + (i * EPAPER_DITHER_ROW_LEN(width)));
+    }
+    utl_memset(rows, 0, (EPAPER_DITHER_NUM_OF_ROWS *
+                         EPAPER_DITHER_ROW_LEN(width) * sizeof(INT16)));
+}
+
+/**
+ * This function dithers a row and packs it. (MSB first, 1 is black)
+ *
+ * \param  work               [IN/OUT] The work area.
+ * \param  gray                   [IN] The row. (8-bit gray)
+ * \param  y                      [IN] The row number.
+ * \param  bits                  [OUT] The packed row.
+ */
+void epaper_dither_row(
+    epaper_dither_work_t* work,
+    const UINT8* gray,
+    UINT32 y,
+    UINT8* bits)
+{
+    switch (work->dither) {
+    case EPAPER_DITHER_JJN:
+        epaper_dither_diffuse<EPAPER_DITHER_JJN>(work, gray, bits);
+        break;
+    case EPAPER_DITHER_FLOYD_STEINBERG:
+        epaper_dither_diffuse<EPAPER_DITHER_FLOYD_STEINBERG>(work, gray,
+                                                             bits);
+        break;
+    case EPAPER_DITHER_ATKINSON:
+        epaper_dither_diffuse<EPAPER_DITHER_ATKINSON>(work, gray, bits);
+        break;
+    case EPAPER_DITHER_BAYER:
+        epaper_dither_ordered<EPAPER_BAYER_LEN>(
+            s_epaper_bayer, work->width, gray, y, bits);
+        break;
+    case EPAPER_DITHER_BLUE_NOISE:
+        epaper_dither_ordered<EPAPER_BLUE_NOISE_LEN>(
+            s_epaper_blue_noise, work->width, gray, y, bits);
+        break;
+    default:
+        epaper_dither_threshold(work->width, gray, bits);
+        break;
+    }
+}
+
+/* ------------------------
+ * Exported
+ * ------------------------ */
+
+/**
+ * This function returns the length of the scratch epaper_dither() needs.
+ *
+ * \param  width                  [IN] The width of the image.
+ * \param  scratch_len           [OUT] The length of the scratch.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ */
+UINT32 epaper_get_dither_scratch_len(
+    UINT32 width,
+    UINT32* scratch_len)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "epaper_get_dither_scratch_len"
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_IN_RANGE(width, 1, EPAPER_MAX_SOURCE_LEN,
+                           ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(scratch_len, NULL, ICS_ERROR_INVALID_PARAM);
+
+    /* the scratch may start at an odd address */
+    *scratch_len = ((EPAPER_DITHER_NUM_OF_ROWS *
+                     EPAPER_DITHER_ROW_LEN(width) * sizeof(INT16)) +
+                    (sizeof(INT16) - 1));
+
+    ICSLOG_DBG_UINT(*scratch_len);
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function dithers an 8-bit gray image into packed 1-bpp rows.
+ *
+ * A row of bits takes (width + 7) / 8 bytes, MSB first, where 1 is black.
+ *
+ * \param  gray                   [IN] The image.
+ * \param  width                  [IN] The width of the image.
+ * \param  height                 [IN] The height of the image.
+ * \param  stride                 [IN] Bytes from a row of the image to the
+ *                                     next.
+ * \param  dither                 [IN] EPAPER_DITHER_*.
+ * \param  scratch                [IN] The scratch.
+ * \param  scratch_len            [IN] The length of the scratch.
+ *                                     (see epaper_get_dither_scratch_len())
+ * \param  bits                  [OUT] The packed rows.
+ * \param  bits_len               [IN] The length of the buffer of bits.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_NO_RESOURCES      The scratch is short.
+ * \retval ICS_ERROR_BUF_OVERFLOW      The buffer of bits is short.
+ */
+UINT32 epaper_dither(
+    const UINT8* gray,
+    UINT32 width,
+    UINT32 height,
+    UINT32 stride,
+    UINT32 dither,
+    void* scratch,
+    UINT32 scratch_len,
+    UINT8* bits,
+    UINT32 bits_len)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "epaper_dither"
+    UINT32 y;
+    UINT32 offset;
+    UINT32 row_len;
+    epaper_dither_work_t work;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(gray, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_IN_RANGE(width, 1, EPAPER_MAX_SOURCE_LEN,
+                           ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_IN_RANGE(height, 1, EPAPER_MAX_SOURCE_LEN,
+                           ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_BE(stride, width, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_LE(dither, EPAPER_DITHER_BLUE_NOISE,
+                     ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(scratch, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(bits, NULL, ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_UINT(width);
+    ICSLOG_DBG_UINT(height);
+    ICSLOG_DBG_UINT(dither);
+
+    row_len = ((width + 7) / 8);
+    if (bits_len < (row_len * height)) {
+        ICSLOG_ERR_STR(ICS_ERROR_BUF_OVERFLOW, "Buffer of bits is short.");
+        return ICS_ERROR_BUF_OVERFLOW;
+    }
+    offset = (UINT32)((size_t)scratch & (sizeof(INT16) - 1));
+    if (scratch_len < (offset + (EPAPER_DITHER_NUM_OF_ROWS *
+                                 EPAPER_DITHER_ROW_LEN(width) *
+                                 sizeof(INT16)))) {
+        ICSLOG_ERR_STR(ICS_ERROR_NO_RESOURCES, "Scratch is short.");
+        return ICS_ERROR_NO_RESOURCES;
+    }
+
+    epaper_dither_setup(
+        &work, dither, width,
+        reinterpret_cast<INT16*>(static_cast<UINT8*>(scratch) + offset));
+    for (y = 0; y < height; y++) {
+        epaper_dither_row(&work, (gray + (y * stride)), y,
+                          (bits + (y * row_len)));
+    }
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
@@ -0,0 +1,538 @@
+/**
+ * \brief    E-paper Rendering (source image to packed 1-bpp panel frame)
+ * \date     2026/10/17
+ * \author   Copyright 2013 Sony Corporation
+ */
+
+/*
+ * A frame is rendered in one pass over the source rows:
+ *
+ *   source row -> luminance and horizontal area average (one row)
+ *              -> vertical area average (one accumulator row)
+ *              -> tone, dithering and packing of a panel row
+ *
+ * Nothing but a few rows lives in the scratch of the caller, so no
+ * intermediate image is made and nothing is allocated.
+ */
+
+#undef ICSLOG_MODULE
+#define ICSLOG_MODULE "EPR"
+
+#include <stddef.h>
+
+#include "ics_types.h"
+#include "ics_error.h"
+#include "icslib_chk.h"
+#include "icslog.h"
+#include "utl.h"
+
+#include "epaper.h"
+#include "epaper_internal.h"
+
+/* --------------------------------
+ * Constant
+ * -------------------------------- */
+
+#define EPAPER_ARENA_ALIGN                      8
+#define EPAPER_LUMA_R                           19595 /* 0.299 * 65536 */
+#define EPAPER_LUMA_G                           38470 /* 0.587 * 65536 */
+#define EPAPER_LUMA_B                           7471  /* 0.114 * 65536 */
+#define EPAPER_GRAY_MAX_8_8                     (255 << 8)
+
+namespace {
+
+/* --------------------------------
+ * Struct Declaration
+ * -------------------------------- */
+
+/* a bump allocator over the scratch of the caller */
+class epaper_arena_t {
+public:
+    epaper_arena_t(void* buf, UINT32 len)
+        : m_buf(static_cast<UINT8*>(buf)), m_len(len), m_used(0) {}
+
+    /* returns NULL when the scratch is short (or only measured) */
+    template <typename T>
+    T* alloc(UINT32 n) {
+        UINT32 pos;
+        pos = (m_used + (EPAPER_ARENA_ALIGN - 1)) &
+            ~(UINT32)(EPAPER_ARENA_ALIGN - 1);
+        m_used = (pos + (n * (UINT32)sizeof(T)));
+        if ((m_buf == NULL) || (m_used > m_len)) {
+            return NULL;
+        }
+        return reinterpret_cast<T*>(m_buf + pos);
+    }
+
+    UINT32 used(void) const { return m_used; }
+
+private:
+    UINT8* m_buf;
+    UINT32 m_len;
+    UINT32 m_used;
+};
+
+/*
+ * Area averaging along an axis. A source pixel is dst_len units long
+ * and an output pixel src_len units, so every weight is an integer and
+ * the weights of an output pixel sum up to src_len.
+ */
+typedef struct epaper_axis_t {
+    UINT32* first;              /* [dst_len] the first source pixel */
+    UINT16* count;              /* [dst_len] the number of source pixels */
+    UINT16* weight;             /* [src_len + dst_len] */
+    UINT32 src_len;
+    UINT32 dst_len;
+} epaper_axis_t;
+
+typedef struct epaper_work_t {
+    epaper_axis_t x;
+    epaper_axis_t y;
+    UINT32* hrow;               /* [width] a source row averaged (8.8) */
+    UINT32 hrow_y;              /* the source row in hrow */
+    UINT32* vacc;               /* [width] the vertical accumulator */
+    UINT8* gray;                /* [width] a panel row */
+    INT16* error;               /* the error rows of the dithering */
+    epaper_dither_work_t dither;
+} epaper_work_t;
+
+/* --------------------------------
+ * Prototype Declaration
+ * -------------------------------- */
+
+static BOOL epaper_allocate(
+    epaper_arena_t& arena,
+    epaper_work_t* work,
+    UINT32 width,
+    UINT32 height,
+    UINT32 src_width,
+    UINT32 src_height);
+static void epaper_setup_axis(
+    epaper_axis_t* axis);
+static void epaper_average_row(
+    const epaper_image_t* image,
+    const epaper_rect_t* rect,
+    epaper_work_t* work,
+    UINT32 sy);
+
+/* --------------------------------
+ * Function
+ * -------------------------------- */
+
+/* ------------------------
+ * Internal
+ * ------------------------ */
+
+/**
+ * This function lays out the work area in the arena.
+ *
+ * \param  arena              [IN/OUT] The arena.
+ * \param  work                  [OUT] The work area.
+ * \param  width                  [IN] The width of the panel.
+ * \param  height                 [IN] The height of the panel.
+ * \param  src_width              [IN] The width of the source rectangle.
+ * \param  src_height             [IN] The height of the source rectangle.
+ *
+ * \retval TRUE                        The arena is large enough.
+ * \retval FALSE                       The arena is short.
+ */
+static BOOL epaper_allocate(
+    epaper_arena_t& arena,
+    epaper_work_t* work,
+    UINT32 width,
+    UINT32 height,
+    UINT32 src_width,
+    UINT32 src_height)
+{
+    work->x.first = arena.alloc<UINT32>(width);
+    work->x.count = arena.alloc<UINT16>(width);
+    work->x.weight = arena.alloc<UINT16>(src_width + width);
+    work->x.src_len = src_width;
+    work->x.dst_len = width;
+    work->y.first = arena.alloc<UINT32>(height);
+    work->y.count = arena.alloc<UINT16>(height);
+    work->y.weight = arena.alloc<UINT16>(src_height + height);
+    work->y.src_len = src_height;
+    work->y.dst_len = height;
+    work->hrow = arena.alloc<UINT32>(width);
+    work->vacc = arena.alloc<UINT32>(width);
+    work->gray = arena.alloc<UINT8>(width);
+    work->error = arena.alloc<INT16>(EPAPER_DITHER_NUM_OF_ROWS *
+                                     EPAPER_DITHER_ROW_LEN(width));
+
+    return ((work->x.first != NULL) && (work->x.count != NULL) &&
+            (work->x.weight != NULL) && (work->y.first != NULL) &&
+            (work->y.count != NULL) && (work->y.weight != NULL) &&
+            (work->hrow != NULL) && (work->vacc != NULL) &&
+            (work->gray != NULL) && (work->error != NULL));
+}
+
+/**
+ * This function calculates the weights of an axis.
+ *
+ * \param  axis               [IN/OUT] The axis. (src_len and dst_len set)
+ */
+static void epaper_setup_axis(
+    epaper_axis_t* axis)
+{
+    UINT32 d;
+    UINT32 s;
+    UINT32 lo;
+    UINT32 hi;
+    UINT32 s_lo;
+    UINT32 s_hi;
+    UINT32 n;
+
+    n = 0;
+    for (d = 0; d < axis->dst_len; d++) {
+        lo = (d * axis->src_len);
+        hi = (lo + axis->src_len);
+        axis->first[d] = (lo / axis->dst_len);
+        axis->count[d] = 0;
+        for (s = axis->first[d]; (s * axis->dst_len) < hi; s++) {
+            s_lo = (s * axis->dst_len);
+            s_hi = (s_lo + axis->dst_len);
+            axis->weight[n++] = (UINT16)(((s_hi < hi) ? s_hi : hi) -
+                                         ((s_lo > lo) ? s_lo : lo));
+            axis->count[d]++;
+        }
+    }
+}
+
+/* the luminance of a pixel (8.8) */
+template <UINT32 FORMAT>
+inline UINT32 epaper_luma(
+    const UINT8* p)
+{
+    switch (FORMAT) {
+    case EPAPER_FORMAT_RGBA8888:
+        return (((EPAPER_LUMA_R * p[0]) + (EPAPER_LUMA_G * p[1]) +
+                 (EPAPER_LUMA_B * p[2]) + 0x80) >> 8);
+    case EPAPER_FORMAT_BGRA8888:
+        return (((EPAPER_LUMA_R * p[2]) + (EPAPER_LUMA_G * p[1]) +
+                 (EPAPER_LUMA_B * p[0]) + 0x80) >> 8);
+    default:
+        return ((UINT32)p[0] << 8);
+    }
+}
+
+/* averages a source row horizontally into hrow */
+template <UINT32 FORMAT, UINT32 BPP>
+void epaper_average_row_format(
+    const UINT8* src,
+    const epaper_axis_t* axis,
+    UINT32* hrow)
+{
+    UINT32 d;
+    UINT32 k;
+    UINT32 sum;
+    const UINT8* p;
+    const UINT16* w;
+
+    w = axis->weight;
+    for (d = 0; d < axis->dst_len; d++) {
+        p = (src + (axis->first[d] * BPP));
+        sum = 0;
+        for (k = 0; k < axis->count[d]; k++) {
+            sum += (w[k] * epaper_luma<FORMAT>(p));
+            p += BPP;
+        }
+        w += axis->count[d];
+        hrow[d] = ((sum + (axis->src_len / 2)) / axis->src_len);
+    }
+}
+
+/**
+ * This function averages a source row horizontally.
+ *
+ * \param  image                  [IN] The source image.
+ * \param  rect                   [IN] The source rectangle.
+ * \param  work               [IN/OUT] The work area.
+ * \param  sy                     [IN] The row in the rectangle.
+ */
+static void epaper_average_row(
+    const epaper_image_t* image,
+    const epaper_rect_t* rect,
+    epaper_work_t* work,
+    UINT32 sy)
+{
+    const UINT8* src;
+
+    src = (image->pixels + ((rect->y + sy) * image->stride));
+    switch (image->format) {
+    case EPAPER_FORMAT_RGBA8888:
+        epaper_average_row_format<EPAPER_FORMAT_RGBA8888, 4>(
+            (src + (rect->x * 4)), &work->x, work->hrow);
+        break;
+    case EPAPER_FORMAT_BGRA8888:
+        epaper_average_row_format<EPAPER_FORMAT_BGRA8888, 4>(
+            (src + (rect->x * 4)), &work->x, work->hrow);
+        break;
+    default:
+        epaper_average_row_format<EPAPER_FORMAT_GRAY8, 1>(
+            (src + rect->x), &work->x, work->hrow);
+        break;
+    }
+    work->hrow_y = sy;
+}
+
+} /* namespace */
+
+/* ------------------------
+ * Exported
+ * ------------------------ */
+
+/**
+ * This function returns the size of a panel.
+ *
+ * \param  panel                  [IN] EPAPER_PANEL_*.
+ * \param  width                 [OUT] The width. (pixels)
+ * \param  height                [OUT] The height. (pixels)
+ * \param  frame_len             [OUT] The length of a packed frame.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ */
+UINT32 epaper_get_panel_size(
+    UINT32 panel,
+    UINT32* width,
+    UINT32* height,
+    UINT32* frame_len)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "epaper_get_panel_size"
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(width, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(height, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(frame_len, NULL, ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_UINT(panel);
+
+    switch (panel) {
+    case EPAPER_PANEL_20INCH:
+        *width = EPAPER_PANEL_20INCH_WIDTH;
+        *height = EPAPER_PANEL_20INCH_HEIGHT;
+        break;
+    case EPAPER_PANEL_27INCH:
+        *width = EPAPER_PANEL_27INCH_WIDTH;
+        *height = EPAPER_PANEL_27INCH_HEIGHT;
+        break;
+    default:
+        ICSLOG_ERR_STR(ICS_ERROR_INVALID_PARAM, "Unknown panel.");
+        return ICS_ERROR_INVALID_PARAM;
+    }
+    *frame_len = ((*width * *height) / 8);
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function returns the length of the scratch epaper_render() needs.
+ *
+ * \param  panel                  [IN] EPAPER_PANEL_*.
+ * \param  rect                   [IN] The source rectangle.
+ * \param  scratch_len           [OUT] The length of the scratch.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ */
+UINT32 epaper_get_scratch_len(
+    UINT32 panel,
+    const epaper_rect_t* rect,
+    UINT32* scratch_len)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "epaper_get_scratch_len"
+    UINT32 rc;
+    UINT32 width;
+    UINT32 height;
+    UINT32 frame_len;
+    epaper_work_t work;
+    epaper_arena_t arena(NULL, 0);
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(rect, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_IN_RANGE(rect->width, 1, EPAPER_MAX_SOURCE_LEN,
+                           ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_IN_RANGE(rect->height, 1, EPAPER_MAX_SOURCE_LEN,
+                           ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(scratch_len, NULL, ICS_ERROR_INVALID_PARAM);
+
+    rc = epaper_get_panel_size(panel, &width, &height, &frame_len);
+    if (rc != ICS_ERROR_SUCCESS) {
+        ICSLOG_ERR_STR(rc, "epaper_get_panel_size()");
+        return rc;
+    }
+
+    epaper_allocate(arena, &work, width, height, rect->width, rect->height);
+
+    /* the scratch may start anywhere */
+    *scratch_len = (arena.used() + (EPAPER_ARENA_ALIGN - 1));
+
+    ICSLOG_DBG_UINT(*scratch_len);
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function renders a rectangle of an image to a packed frame.
+ *
+ * The rectangle is scaled to the whole panel by area averaging, the
+ * luminance is scaled by the tone, and the result is dithered into
+ * rows of 1-bpp pixels, MSB first, where 1 is black.
+ *
+ * \param  image                  [IN] The source image.
+ * \param  rect                   [IN] The source rectangle. (NULL: whole)
+ * \param  panel                  [IN] EPAPER_PANEL_*.
+ * \param  option                 [IN] The tone and the dithering.
+ * \param  scratch                [IN] The scratch.
+ * \param  scratch_len            [IN] The length of the scratch.
+ *                                     (see epaper_get_scratch_len())
+ * \param  frame                 [OUT] The packed frame.
+ * \param  frame_len              [IN] The length of the frame buffer.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_NO_RESOURCES      The scratch is short.
+ * \retval ICS_ERROR_BUF_OVERFLOW      The frame buffer is short.
+ */
+UINT32 epaper_render(
+    const epaper_image_t* image,
+    const epaper_rect_t* rect,
+    UINT32 panel,
+    const epaper_option_t* option,
+    void* scratch,
+    UINT32 scratch_len,
+    UINT8* frame,
+    UINT32 frame_len)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "epaper_render"
+    UINT32 rc;
+    UINT32 x;
+    UINT32 y;
+    UINT32 k;
+    UINT32 sy;
+    UINT32 w;
+    UINT32 sum;
+    UINT32 width;
+    UINT32 height;
+    UINT32 needed_len;
+    UINT32 bpp;
+    const UINT16* weight;
+    epaper_rect_t whole;
+    epaper_work_t work;
+    epaper_arena_t arena(scratch, scratch_len);
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(image, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(image->pixels, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_IN_RANGE(image->width, 1, EPAPER_MAX_SOURCE_LEN,
+                           ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_IN_RANGE(image->height, 1, EPAPER_MAX_SOURCE_LEN,
+                           ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_LE(image->format, EPAPER_FORMAT_BGRA8888,
+                     ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(option, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_LE(option->tone, 255, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_LE(option->dither, EPAPER_DITHER_BLUE_NOISE,
+                     ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(scratch, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(frame, NULL, ICS_ERROR_INVALID_PARAM);
+
+    bpp = ((image->format == EPAPER_FORMAT_GRAY8) ? 1 : 4);
+    ICSLIB_CHKARG_BE(image->stride, (image->width * bpp),
+                     ICS_ERROR_INVALID_PARAM);
+
+    if (rect == NULL) {
+        whole.x = 0;
+        whole.y = 0;
+        whole.width = image->width;
+        whole.height = image->height;
+        rect = &whole;
+    }
+    ICSLIB_CHKARG_IN_RANGE(rect->width, 1, image->width,
+                           ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_IN_RANGE(rect->height, 1, image->height,
+                           ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_LE(rect->x, (image->width - rect->width),
+                     ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_LE(rect->y, (image->height - rect->height),
+                     ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_UINT(image->width);
+    ICSLOG_DBG_UINT(image->height);
+    ICSLOG_DBG_UINT(image->format);
+    ICSLOG_DBG_UINT(panel);
+    ICSLOG_DBG_UINT(option->tone);
+    ICSLOG_DBG_UINT(option->dither);
+
+    rc = epaper_get_panel_size(panel, &width, &height, &needed_len);
+    if (rc != ICS_ERROR_SUCCESS) {
+        ICSLOG_ERR_STR(rc, "epaper_get_panel_size()");
+        return rc;
+    }
+    if (frame_len < needed_len) {
+        ICSLOG_ERR_STR(ICS_ERROR_BUF_OVERFLOW, "Frame buffer is short.");
+        return ICS_ERROR_BUF_OVERFLOW;
+    }
+
+    /* the arena packs from an aligned address of the scratch */
+    k = (UINT32)((EPAPER_ARENA_ALIGN -
+                  ((size_t)scratch & (EPAPER_ARENA_ALIGN - 1))) &
+                 (EPAPER_ARENA_ALIGN - 1));
+    if (scratch_len < k) {
+        ICSLOG_ERR_STR(ICS_ERROR_NO_RESOURCES, "Scratch is short.");
+        return ICS_ERROR_NO_RESOURCES;
+    }
+    arena = epaper_arena_t((static_cast<UINT8*>(scratch) + k),
+                           (scratch_len - k));
+    if (!epaper_allocate(arena, &work, width, height,
+                         rect->width, rect->height)) {
+        ICSLOG_ERR_STR(ICS_ERROR_NO_RESOURCES, "Scratch is short.");
+        return ICS_ERROR_NO_RESOURCES;
+    }
+    epaper_setup_axis(&work.x);
+    epaper_setup_axis(&work.y);
+    epaper_dither_setup(&work.dither, option->dither, width, work.error);
+    work.hrow_y = rect->height; /* none */
+
+    weight = work.y.weight;
+    for (y = 0; y < height; y++) {
+        /* vertical area average; a source row is averaged only once */
+        for (k = 0; k < work.y.count[y]; k++) {
+            sy = (work.y.first[y] + k);
+            if (sy != work.hrow_y) {
+                epaper_average_row(image, rect, &work, sy);
+            }
+            w = weight[k];
+            if (k == 0) {
+                for (x = 0; x < width; x++) {
+                    work.vacc[x] = (w * work.hrow[x]);
+                }
+            } else {
+                for (x = 0; x < width; x++) {
+                    work.vacc[x] += (w * work.hrow[x]);
+                }
+            }
+        }
+        weight += work.y.count[y];
+
+        /* tone */
+        for (x = 0; x < width; x++) {
+            sum = ((work.vacc[x] + (rect->height / 2)) / rect->height);
+            work.gray[x] = (UINT8)(((sum * option->tone) +
+                                    (EPAPER_GRAY_MAX_8_8 / 2)) /
+                                   EPAPER_GRAY_MAX_8_8);
+        }
+
+        epaper_dither_row(&work.dither, work.gray, y,
+                          (frame + (y * (width / 8))));
+    }
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
@@ -41,6 +41,20 @@ static UINT32 felica_cc_thru_polling(
     felica_card_t* card,
     felica_card_option_t* card_option,
     UINT32 timeout);
+static UINT32 felica_cc_batch_add(
+    felica_cc_batch_t* batch,
+    const felica_card_t* card,
+    UINT8 command,
+    UINT16 service_code,
+    UINT16 block_number,
+    UINT8* read_block_data,
+    const UINT8* write_block_data);
+static BOOL felica_cc_batch_fits(
+    const felica_cc_batch_t* batch,
+    const felica_card_t* card,
+    UINT8 command,
+    UINT16 service_code,
+    UINT16 block_number);
 
 /* --------------------------------
  * Macro
@@ -430,9 +444,10 @@ UINT32 felica_cc_read_without_encryption(
     utl_memcpy(buf + command_len, block_list, (p - block_list));
     command_len += (p - block_list);
 
-    /* send the command and receive a response */
+    /* send the command and receive a response of the expected size */
     rc = devf->thru_func(devf->dev, buf, command_len,
-                         sizeof(buf), buf, &response_len,
+                         (1 + 8 + 3 + (16 * num_of_blocks)), buf,
+                         &response_len,
                          timeout);
     if (rc != ICS_ERROR_SUCCESS) {
         ICSLOG_ERR_STR(rc, "thru_func()");
@@ -572,9 +587,9 @@ UINT32 felica_cc_write_without_encryption(
     utl_memcpy(buf + command_len, block_data, 16 * num_of_blocks);
     command_len += (16 * num_of_blocks);
 
-    /* send the command and receive a response */
+    /* send the command and receive a response of the expected size */
     rc = devf->thru_func(devf->dev, buf, command_len,
-                         sizeof(buf), buf, &response_len,
+                         (1 + 8 + 2), buf, &response_len,
                          timeout);
     if (rc != ICS_ERROR_SUCCESS) {
         ICSLOG_ERR_STR(rc, "thru_func()");
@@ -703,6 +718,241 @@ UINT32 felica_cc_request_system_code(
     return ICS_ERROR_SUCCESS;
 }
 
+/**
+ * This function initializes a batch of Read/Write Without Encryption.
+ *
+ * Blocks queued with felica_cc_batch_read() and felica_cc_batch_write()
+ * are coalesced into as few commands as the limits of the commands
+ * allow. A command is sent when the next block does not fit in it,
+ * when the card or the kind of command changes, and on
+ * felica_cc_batch_flush().
+ *
+ * \param  batch                 [OUT] The batch to initialize.
+ * \param  devf                   [IN] My device.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid argument.
+ */
+UINT32 felica_cc_batch_initialize(
+    felica_cc_batch_t* batch,
+    const felica_cc_devf_t* devf)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "felica_cc_batch_initialize"
+    ICSLOG_FUNC_BEGIN;
+
+    /* check the parameters */
+    ICSLIB_CHKARG_NE(batch, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(devf, NULL, ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_PTR(batch);
+    ICSLOG_DBG_PTR(devf);
+
+    utl_memset(batch, 0, sizeof(*batch));
+    batch->devf = devf;
+    batch->command = FELICA_CC_BATCH_NONE;
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function queues a block to read.
+ *
+ * The block data is stored in block_data when the command including the
+ * block is sent, so block_data must be valid until the batch is flushed.
+ *
+ * \param  batch                  [IN] The batch.
+ * \param  card                   [IN] The card to communicate.
+ * \param  service_code           [IN] The service code of the block.
+ * \param  block_number           [IN] The block number.
+ * \param  block_data            [OUT] The buffer for the block data.
+ *                                     (16 bytes)
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid argument.
+ * \retval ICS_ERROR_TIMEOUT           No response to the queued blocks.
+ * \retval ICS_ERROR_IO                Other driver error.
+ * \retval ICS_ERROR_DEVICE            Error at device.
+ * \retval ICS_ERROR_FRAME_CRC         CRC error.
+ * \retval ICS_ERROR_INVALID_RESPONSE  Received an invalid response packet.
+ * \retval ICS_ERROR_STATUS_FLAG1      Status flag1 is not 0.
+ */
+UINT32 felica_cc_batch_read(
+    felica_cc_batch_t* batch,
+    const felica_card_t* card,
+    UINT16 service_code,
+    UINT16 block_number,
+    UINT8* block_data)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "felica_cc_batch_read"
+    UINT32 rc;
+    ICSLOG_FUNC_BEGIN;
+
+    /* check the parameters */
+    ICSLIB_CHKARG_NE(batch, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(card, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(block_data, NULL, ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_HEX(service_code);
+    ICSLOG_DBG_UINT(block_number);
+
+    rc = felica_cc_batch_add(batch, card, FELICA_CC_BATCH_READ,
+                             service_code, block_number, block_data, NULL);
+    if (rc != ICS_ERROR_SUCCESS) {
+        ICSLOG_ERR_STR(rc, "felica_cc_batch_add()");
+        return rc;
+    }
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function queues a block to write.
+ *
+ * The block data is copied into the batch.
+ *
+ * \param  batch                  [IN] The batch.
+ * \param  card                   [IN] The card to communicate.
+ * \param  service_code           [IN] The service code of the block.
+ * \param  block_number           [IN] The block number.
+ * \param  block_data             [IN] The block data to write. (16 bytes)
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid argument.
+ * \retval ICS_ERROR_TIMEOUT           No response to the queued blocks.
+ * \retval ICS_ERROR_IO                Other driver error.
+ * \retval ICS_ERROR_DEVICE            Error at device.
+ * \retval ICS_ERROR_FRAME_CRC         CRC error.
+ * \retval ICS_ERROR_INVALID_RESPONSE  Received an invalid response packet.
+ * \retval ICS_ERROR_STATUS_FLAG1      Status flag1 is not 0.
+ */
+UINT32 felica_cc_batch_write(
+    felica_cc_batch_t* batch,
+    const felica_card_t* card,
+    UINT16 service_code,
+    UINT16 block_number,
+    const UINT8* block_data)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "felica_cc_batch_write"
+    UINT32 rc;
+    ICSLOG_FUNC_BEGIN;
+
+    /* check the parameters */
+    ICSLIB_CHKARG_NE(batch, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(card, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(block_data, NULL, ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_HEX(service_code);
+    ICSLOG_DBG_UINT(block_number);
+
+    rc = felica_cc_batch_add(batch, card, FELICA_CC_BATCH_WRITE,
+                             service_code, block_number, NULL, block_data);
+    if (rc != ICS_ERROR_SUCCESS) {
+        ICSLOG_ERR_STR(rc, "felica_cc_batch_add()");
+        return rc;
+    }
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function sends the queued blocks.
+ *
+ * The time-out period is calculated from PMm of the card.
+ * The queued blocks are discarded even if the command fails.
+ *
+ * \param  batch                  [IN] The batch.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid argument.
+ * \retval ICS_ERROR_TIMEOUT           No response.
+ * \retval ICS_ERROR_IO                Other driver error.
+ * \retval ICS_ERROR_DEVICE            Error at device.
+ * \retval ICS_ERROR_FRAME_CRC         CRC error.
+ * \retval ICS_ERROR_INVALID_RESPONSE  Received an invalid response packet.
+ * \retval ICS_ERROR_STATUS_FLAG1      Status flag1 is not 0.
+ */
+UINT32 felica_cc_batch_flush(
+    felica_cc_batch_t* batch)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "felica_cc_batch_flush"
+    UINT32 rc;
+    UINT32 i;
+    UINT32 timeout;
+    ICSLOG_FUNC_BEGIN;
+
+    /* check the parameters */
+    ICSLIB_CHKARG_NE(batch, NULL, ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_PTR(batch);
+    ICSLOG_DBG_UINT(batch->num_of_blocks);
+
+    if (batch->num_of_blocks == 0) {
+        ICSLOG_FUNC_END;
+        return ICS_ERROR_SUCCESS;
+    }
+
+    if (batch->command == FELICA_CC_BATCH_READ) {
+        timeout = FELICA_CC_CALC_TIMEOUT(
+            batch->card.pmm[FELICA_CC_PMM_READ_WITHOUT_ENCRYPTION],
+            batch->num_of_blocks);
+        ICSLOG_DBG_UINT(timeout);
+        rc = felica_cc_read_without_encryption(batch->devf,
+                                               &batch->card,
+                                               batch->num_of_services,
+                                               batch->service_code_list,
+                                               batch->num_of_blocks,
+                                               batch->block_list,
+                                               batch->block_data,
+                                               &batch->status_flag1,
+                                               &batch->status_flag2,
+                                               timeout);
+        if (rc == ICS_ERROR_SUCCESS) {
+            for (i = 0; i < batch->num_of_blocks; i++) {
+                utl_memcpy(batch->read_block_data[i],
+                           batch->block_data + (16 * i), 16);
+            }
+        }
+    } else {
+        timeout = FELICA_CC_CALC_TIMEOUT(
+            batch->card.pmm[FELICA_CC_PMM_WRITE_WITHOUT_ENCRYPTION],
+            batch->num_of_blocks);
+        ICSLOG_DBG_UINT(timeout);
+        rc = felica_cc_write_without_encryption(batch->devf,
+                                                &batch->card,
+                                                batch->num_of_services,
+                                                batch->service_code_list,
+                                                batch->num_of_blocks,
+                                                batch->block_list,
+                                                batch->block_data,
+                                                &batch->status_flag1,
+                                                &batch->status_flag2,
+                                                timeout);
+    }
+    batch->num_of_commands++;
+    batch->num_of_sent_blocks += batch->num_of_blocks;
+
+    /* clear the queue */
+    batch->command = FELICA_CC_BATCH_NONE;
+    batch->num_of_services = 0;
+    batch->num_of_blocks = 0;
+    batch->block_list_len = 0;
+
+    if (rc != ICS_ERROR_SUCCESS) {
+        ICSLOG_ERR_STR(rc, "failure in sending the queued blocks");
+        return rc;
+    }
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
 /* ------------------------
  * Internal
  * ------------------------ */
@@ -778,3 +1028,177 @@ static UINT32 felica_cc_thru_polling(
     ICSLOG_FUNC_END;
     return ICS_ERROR_SUCCESS;
 }
+
+/**
+ * This function queues a block, sending the queued blocks first
+ * if the block does not fit in the same command.
+ *
+ * \param  batch                  [IN] The batch.
+ * \param  card                   [IN] The card to communicate.
+ * \param  command                [IN] FELICA_CC_BATCH_READ or WRITE.
+ * \param  service_code           [IN] The service code of the block.
+ * \param  block_number           [IN] The block number.
+ * \param  read_block_data        [IN] The buffer for the read block data.
+ * \param  write_block_data       [IN] The block data to write.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval (others)                    Error of felica_cc_batch_flush().
+ */
+static UINT32 felica_cc_batch_add(
+    felica_cc_batch_t* batch,
+    const felica_card_t* card,
+    UINT8 command,
+    UINT16 service_code,
+    UINT16 block_number,
+    UINT8* read_block_data,
+    const UINT8* write_block_data)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "felica_cc_batch_add"
+    UINT32 rc;
+    UINT8 i;
+    UINT8 service_index;
+    UINT8* p;
+    ICSLOG_FUNC_BEGIN;
+
+    if (!felica_cc_batch_fits(batch, card, command,
+                              service_code, block_number)) {
+        rc = felica_cc_batch_flush(batch);
+        if (rc != ICS_ERROR_SUCCESS) {
+            ICSLOG_ERR_STR(rc, "felica_cc_batch_flush()");
+            return rc;
+        }
+    }
+
+    if (batch->num_of_blocks == 0) {
+        batch->command = command;
+        utl_memcpy(&batch->card, card, sizeof(batch->card));
+    }
+
+    /* add the service code */
+    for (i = 0; i < batch->num_of_services; i++) {
+        if (batch->service_code_list[i] == service_code) {
+            break;
+        }
+    }
+    if (i == batch->num_of_services) {
+        batch->service_code_list[i] = service_code;
+        batch->num_of_services++;
+    }
+    service_index = i;
+
+    /* add the block list element */
+    p = batch->block_list + batch->block_list_len;
+    if (block_number <= 0xff) {
+        p[0] = (UINT8)(0x80 | service_index);
+        p[1] = (UINT8)block_number;
+        batch->block_list_len += 2;
+    } else {
+        p[0] = service_index;
+        p[1] = (UINT8)((block_number >> 0) & 0xff);
+        p[2] = (UINT8)((block_number >> 8) & 0xff);
+        batch->block_list_len += 3;
+    }
+
+    if (command == FELICA_CC_BATCH_READ) {
+        batch->read_block_data[batch->num_of_blocks] = read_block_data;
+    } else {
+        utl_memcpy(batch->block_data + (16 * batch->num_of_blocks),
+                   write_block_data, 16);
+    }
+    batch->num_of_blocks++;
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function checks whether a block fits in the queued command.
+ *
+ * \param  batch                  [IN] The batch.
+ * \param  card                   [IN] The card to communicate.
+ * \param  command                [IN] FELICA_CC_BATCH_READ or WRITE.
+ * \param  service_code           [IN] The service code of the block.
+ * \param  block_number           [IN] The block number.
+ *
+ * \retval TRUE                        The block fits.
+ * \retval FALSE                       The queued blocks must be sent first.
+ */
+static BOOL felica_cc_batch_fits(
+    const felica_cc_batch_t* batch,
+    const felica_card_t* card,
+    UINT8 command,
+    UINT16 service_code,
+    UINT16 block_number)
+{
+    UINT32 i;
+    UINT32 num_of_services;
+    UINT32 element_len;
+    UINT32 command_len;
+    UINT32 response_len;
+    const UINT8* p;
+
+    if (batch->num_of_blocks == 0) {
+        return TRUE;
+    }
+    if ((batch->command != command) ||
+        (utl_memcmp(batch->card.idm, card->idm, 8) != 0)) {
+        return FALSE;
+    }
+
+    num_of_services = batch->num_of_services;
+    for (i = 0; i < batch->num_of_services; i++) {
+        if (batch->service_code_list[i] == service_code) {
+            break;
+        }
+    }
+    if (i == batch->num_of_services) {
+        num_of_services++;
+    }
+    element_len = ((block_number <= 0xff) ? 2 : 3);
+
+    if (command == FELICA_CC_BATCH_READ) {
+        if ((batch->num_of_blocks >= FELICA_CC_READ_WE_NUM_OF_BLOCKS_MAX) ||
+            (num_of_services > FELICA_CC_READ_WE_NUM_OF_SERVICES_MAX)) {
+            return FALSE;
+        }
+        response_len = (1 + 8 + 3 + (16 * (batch->num_of_blocks + 1)));
+    } else {
+        if ((batch->num_of_blocks >= FELICA_CC_WRITE_WE_NUM_OF_BLOCKS_MAX) ||
+            (num_of_services > FELICA_CC_WRITE_WE_NUM_OF_SERVICES_MAX)) {
+            return FALSE;
+        }
+        response_len = (1 + 8 + 2);
+
+        /* a block must not be written twice in a command */
+        if (i < batch->num_of_services) {
+            p = batch->block_list;
+            while (p < (batch->block_list + batch->block_list_len)) {
+                if (*p & 0x80) {
+                    if (((p[0] & 0x0f) == i) && (p[1] == block_number)) {
+                        return FALSE;
+                    }
+                    p += 2;
+                } else {
+                    if (((p[0] & 0x0f) == i) &&
+                        ((p[1] | (p[2] << 8)) == block_number)) {
+                        return FALSE;
+                    }
+                    p += 3;
+                }
+            }
+        }
+    }
+
+    command_len = (1 + 8 + 1 + (2 * num_of_services) + 1 +
+                   batch->block_list_len + element_len);
+    if (command == FELICA_CC_BATCH_WRITE) {
+        command_len += (16 * (batch->num_of_blocks + 1));
+    }
+    if ((command_len > FELICA_CC_MAX_COMMAND_LEN) ||
+        (response_len > FELICA_CC_MAX_RESPONSE_LEN)) {
+        return FALSE;
+    }
+
+    return TRUE;
+}
@@ -7,6 +7,8 @@
 #undef ICSLOG_MODULE
 #define ICSLOG_MODULE "fcg"
 
+#include <pthread.h>
+
 #include "ics_types.h"
 #include "ics_error.h"
 #include "icslib_chk.h"
@@ -30,6 +32,42 @@
 #define FELICA_CC_STUB_NFC110_RBT       NFC110_RBT_INITIATOR_ISO18092_212K
 #define FELICA_CC_STUB_NFC110_SPEED     NFC110_RF_INITIATOR_ISO18092_212K
 
+/* per-card time-out model */
+#define FELICA_CC_STUB_NFC110_MAX_DEVICES               8
+#define FELICA_CC_STUB_NFC110_MAX_CARDS                 8     /* per device */
+#define FELICA_CC_STUB_NFC110_MIN_MARGIN                10    /* ms */
+#define FELICA_CC_STUB_NFC110_MAX_BACKOFF               3
+
+/* --------------------------------
+ * Struct Declaration
+ * -------------------------------- */
+
+/* smoothed latency in us (srtt: x8, rttvar: x4) */
+typedef struct felica_cc_stub_nfc110_rtt_t {
+    UINT32 srtt;
+    UINT32 rttvar;
+    UINT32 num_of_samples;
+} felica_cc_stub_nfc110_rtt_t;
+
+typedef struct felica_cc_stub_nfc110_card_t {
+    UINT8 idm[8];
+    UINT8 pmm[8];
+    BOOL has_pmm;
+    UINT32 last_used;
+    felica_cc_stub_nfc110_rtt_t ack_rtt;      /* command -> ACK */
+    felica_cc_stub_nfc110_rtt_t response_rtt; /* ACK -> response */
+    UINT32 rf_backoff;
+    UINT32 link_backoff;
+} felica_cc_stub_nfc110_card_t;
+
+/* the models of the cards of a device (NULL: unused) */
+typedef struct felica_cc_stub_nfc110_device_t {
+    ICS_HW_DEVICE* nfc110;
+    UINT32 last_used;
+    UINT32 use_count;
+    felica_cc_stub_nfc110_card_t cards[FELICA_CC_STUB_NFC110_MAX_CARDS];
+} felica_cc_stub_nfc110_device_t;
+
 /* --------------------------------
  * Prototype Declaration
  * -------------------------------- */
@@ -55,6 +93,22 @@ static UINT32 felica_cc_stub_nfc110_setup_initiator(
     ICS_HW_DEVICE* nfc110,
     UINT32 max_num_of_cards);
 
+static felica_cc_stub_nfc110_device_t* felica_cc_stub_nfc110_find_device(
+    ICS_HW_DEVICE* nfc110);
+static felica_cc_stub_nfc110_card_t* felica_cc_stub_nfc110_find_card(
+    ICS_HW_DEVICE* nfc110,
+    const UINT8 idm[8]);
+static UINT32 felica_cc_stub_nfc110_pmm_timeout(
+    const felica_cc_stub_nfc110_card_t* card,
+    const UINT8* command,
+    UINT32 command_len);
+static UINT32 felica_cc_stub_nfc110_xfer_time(
+    UINT32 speed,
+    UINT32 nbytes);
+static void felica_cc_stub_nfc110_update_rtt(
+    felica_cc_stub_nfc110_rtt_t* rtt,
+    UINT32 sample);
+
 /* --------------------------------
  * Macro
  * -------------------------------- */
@@ -65,6 +119,22 @@ static UINT32 felica_cc_stub_nfc110_setup_initiator(
 #define FELICA_CC_STUB_T_DELAY      FELICA_CC_STUB_UNIT_MS(512 * 64)
 #define FELICA_CC_STUB_T_TIMESLOT   FELICA_CC_STUB_UNIT_MS(256 * 64)
 
+/* the time-out of a smoothed latency (ms) */
+#define FELICA_CC_STUB_RTO(rtt) \
+    (((((rtt).srtt >> 3) + (rtt).rttvar) + 999) / 1000)
+
+/* --------------------------------
+ * Variable
+ * -------------------------------- */
+
+static felica_cc_stub_nfc110_device_t
+    s_felica_cc_stub_nfc110_devices[FELICA_CC_STUB_NFC110_MAX_DEVICES];
+static UINT32 s_felica_cc_stub_nfc110_device_use_count;
+
+/* the models are shared by the devices used on different threads */
+static pthread_mutex_t s_felica_cc_stub_nfc110_mutex =
+    PTHREAD_MUTEX_INITIALIZER;
+
 /* --------------------------------
  * Function
  * -------------------------------- */
@@ -97,6 +167,11 @@ UINT32 felica_cc_stub_nfc110_initialize(
     ICSLOG_DBG_PTR(devf);
     ICSLOG_DBG_PTR(nfc110_dev);
 
+    /* the models of the cards of the device are kept over reopens */
+    pthread_mutex_lock(&s_felica_cc_stub_nfc110_mutex);
+    felica_cc_stub_nfc110_find_device(nfc110_dev);
+    pthread_mutex_unlock(&s_felica_cc_stub_nfc110_mutex);
+
     /* initialize the members */
     devf->dev = nfc110_dev;
     devf->polling_func = felica_cc_stub_nfc110_polling;
@@ -148,6 +223,7 @@ static UINT32 felica_cc_stub_nfc110_polling(
     UINT32 rest_len;
     UINT32 pos;
     UINT32 n;
+    felica_cc_stub_nfc110_card_t* card;
     ICSLOG_FUNC_BEGIN;
 
     /* check the parameters */
@@ -225,6 +301,13 @@ static UINT32 felica_cc_stub_nfc110_polling(
         utl_memcpy(cards[n].idm, (felica_response + pos +  2), 8);
         utl_memcpy(cards[n].pmm, (felica_response + pos + 10), 8);
 
+        /* remember PMm for the time-out of the following commands */
+        pthread_mutex_lock(&s_felica_cc_stub_nfc110_mutex);
+        card = felica_cc_stub_nfc110_find_card(nfc110, cards[n].idm);
+        utl_memcpy(card->pmm, cards[n].pmm, 8);
+        card->has_pmm = TRUE;
+        pthread_mutex_unlock(&s_felica_cc_stub_nfc110_mutex);
+
         if ((felica_response[pos] == 20) && (card_options != NULL)) {
             card_options[n].option_len = 2;
             utl_memcpy(card_options[n].option,
@@ -253,6 +336,13 @@ static UINT32 felica_cc_stub_nfc110_polling(
 /**
  * This function sends the FeliCa card command and receives a response.
  *
+ * The time-outs are derived from a per-card model:
+ * the RF time-out is calculated from PMm of the card (never longer than
+ * the time-out of the caller), and the time-out of the driver adds the
+ * transfer time of the actual packet sizes and the latencies to the ACK
+ * and to the response learned from the previous commands.
+ * Time-outs back off exponentially and are reset by a successful command.
+ *
  * \param  dev                    [IN] My ICS device.
  * \param  command                [IN] The card command to send.
  * \param  command_len            [IN] The length of the card command.
@@ -284,10 +374,20 @@ static UINT32 felica_cc_stub_nfc110_thru(
 #define ICSLOG_FUNC "felica_cc_stub_nfc110_thru"
     UINT32 rc;
     ICS_HW_DEVICE* nfc110;
+    felica_cc_stub_nfc110_card_t* card;
+    felica_cc_stub_nfc110_card_t model;
+    BOOL has_model;
     UINT32 speed;
     UINT32 nbits;
     UINT32 add_time;
+    UINT32 learned_time;
+    UINT32 rf_timeout;
+    UINT32 pmm_timeout;
     UINT32 driver_timeout;
+    UINT32 time0;
+    UINT32 ack_time;
+    UINT32 end_time;
+    UINT32 sample;
     ICSLOG_FUNC_BEGIN;
 
     /* check the parameter */
@@ -338,21 +438,94 @@ static UINT32 felica_cc_stub_nfc110_thru(
     /* extra timeout for period in the controller and NFC Port-110 */
     add_time += FELICA_CC_STUB_NFC110_ADD_TIMEOUT;
 
-    if ((0xffffffff - add_time) >= timeout) {
-        driver_timeout = (timeout + add_time);
+    /*
+     * the time-outs of the card, from a copy of its model: the entry may
+     * be evicted by another thread during the command
+     */
+    rf_timeout = timeout;
+    has_model = (command_len >= (1 + 8));
+    if (has_model) {
+        pthread_mutex_lock(&s_felica_cc_stub_nfc110_mutex);
+        model = *felica_cc_stub_nfc110_find_card(nfc110, command + 1);
+        pthread_mutex_unlock(&s_felica_cc_stub_nfc110_mutex);
+
+        pmm_timeout = felica_cc_stub_nfc110_pmm_timeout(&model,
+                                                        command,
+                                                        command_len);
+        if (pmm_timeout != 0) {
+            pmm_timeout <<= model.rf_backoff;
+            if (pmm_timeout < rf_timeout) {
+                rf_timeout = pmm_timeout;
+            }
+        }
+
+        if ((model.ack_rtt.num_of_samples > 0) &&
+            (model.response_rtt.num_of_samples > 0)) {
+            /* the actual packet sizes and the learned latencies */
+            learned_time =
+                (felica_cc_stub_nfc110_xfer_time(speed, (15 + command_len) +
+                                                 6 +
+                                                 (14 + max_response_len)) +
+                 FELICA_CC_STUB_RTO(model.ack_rtt) +
+                 FELICA_CC_STUB_RTO(model.response_rtt) +
+                 FELICA_CC_STUB_NFC110_MIN_MARGIN);
+            learned_time <<= model.link_backoff;
+            if (learned_time < add_time) {
+                add_time = learned_time;
+            }
+        }
+    }
+    ICSLOG_DBG_UINT(rf_timeout);
+    ICSLOG_DBG_UINT(add_time);
+
+    if ((0xffffffff - add_time) >= rf_timeout) {
+        driver_timeout = (rf_timeout + add_time);
     } else {
         driver_timeout = 0xffffffff;
     }
 
     /* transceive the command */
+    time0 = (UINT32)utl_get_time_usec();
     rc = nfc110_felica_command(nfc110,
                                command,
                                command_len,
                                max_response_len,
                                response,
                                response_len,
-                               timeout,
+                               rf_timeout,
                                driver_timeout);
+    end_time = (UINT32)utl_get_time_usec();
+    if (has_model) {
+        /* update the entry found again (a new one if it was evicted) */
+        pthread_mutex_lock(&s_felica_cc_stub_nfc110_mutex);
+        card = felica_cc_stub_nfc110_find_card(nfc110, command + 1);
+        if (rc == ICS_ERROR_SUCCESS) {
+            /* learn the latencies (us) */
+            nfc110_get_ack_time_usec(nfc110, &ack_time);
+            if (((ack_time - time0) <= (end_time - time0))) {
+                sample = (ack_time - time0);
+                felica_cc_stub_nfc110_update_rtt(&card->ack_rtt, sample);
+                sample = (end_time - ack_time);
+                felica_cc_stub_nfc110_update_rtt(&card->response_rtt,
+                                                 sample);
+            }
+            card->rf_backoff = 0;
+            card->link_backoff = 0;
+        } else if (rc == ICS_ERROR_TIMEOUT) {
+            if ((end_time - time0) >= ((UINT64)driver_timeout * 1000)) {
+                /* no response from NFC Port-110 */
+                if (card->link_backoff < FELICA_CC_STUB_NFC110_MAX_BACKOFF) {
+                    card->link_backoff++;
+                }
+            } else {
+                /* no response from the card */
+                if (card->rf_backoff < FELICA_CC_STUB_NFC110_MAX_BACKOFF) {
+                    card->rf_backoff++;
+                }
+            }
+        }
+        pthread_mutex_unlock(&s_felica_cc_stub_nfc110_mutex);
+    }
     if (rc != ICS_ERROR_SUCCESS) {
         ICSLOG_ERR_STR(rc, "nfc110_felica_command()");
         return rc;
@@ -390,40 +563,224 @@ static UINT32 felica_cc_stub_nfc110_setup_initiator(
 
     ICSLOG_DBG_UINT(max_num_of_cards);
 
-    if (NFC110_LAST_MODE(nfc110) != NFC110_MODE_INITIATOR_TYPEF) {
-        /* make and send an InSetRF command for NFC Port-110 */
-        rc = nfc110_set_rf_speed(
-            nfc110,
-            FELICA_CC_STUB_NFC110_RBT,
-            FELICA_CC_STUB_NFC110_SPEED,
-            FELICA_CC_STUB_NFC110_RBT,
-            FELICA_CC_STUB_NFC110_SPEED,
-            FELICA_CC_STUB_NFC110_IN_SET_RF_TIMEOUT);
-        if (rc != ICS_ERROR_SUCCESS) {
-            ICSLOG_ERR_STR(rc, "nfc110_set_rf_speed()");
-            return rc;
+    /*
+     * The driver keeps the settings of the device, and sends only the
+     * settings which differ: nothing while the mode and the number of
+     * cards are the same. If the driver has no free slot to keep the
+     * settings, they are sent only when the mode changes.
+     */
+    if ((NFC110_LAST_MODE(nfc110) == NFC110_MODE_INITIATOR_TYPEF) &&
+        !nfc110_has_protocol_shadow(nfc110)) {
+        ICSLOG_DBG_PRINT(("The protocol settings are not shadowed.\n"));
+        ICSLOG_FUNC_END;
+        return ICS_ERROR_SUCCESS;
+    }
+
+    /* make and send an InSetRF command for NFC Port-110 */
+    rc = nfc110_update_rf_speed(
+        nfc110,
+        FELICA_CC_STUB_NFC110_RBT,
+        FELICA_CC_STUB_NFC110_SPEED,
+        FELICA_CC_STUB_NFC110_RBT,
+        FELICA_CC_STUB_NFC110_SPEED,
+        FELICA_CC_STUB_NFC110_IN_SET_RF_TIMEOUT);
+    if (rc != ICS_ERROR_SUCCESS) {
+        ICSLOG_ERR_STR(rc, "nfc110_update_rf_speed()");
+        return rc;
+    }
+
+    /* send an InSetProtocol command for NFC Port-110 */
+    setting_len = sizeof(nfc110_felica_default_protocol);
+    utl_memcpy(setting, nfc110_felica_default_protocol, setting_len);
+    if (max_num_of_cards > 1) {
+        setting[7] = 0x01; /* Multi card = on */
+    } else {
+        setting[7] = 0x00; /* Multi card = off */
+    }
+
+    rc = nfc110_update_protocol(
+        nfc110, setting, setting_len,
+        FELICA_CC_STUB_NFC110_IN_SET_PROTOCOL_TIMEOUT);
+    if (rc != ICS_ERROR_SUCCESS) {
+        ICSLOG_ERR_STR(rc, "nfc110_update_protocol()");
+        return rc;
+    }
+    NFC110_SET_LAST_MODE(nfc110, NFC110_MODE_INITIATOR_TYPEF);
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function finds the models of the cards of a device, reusing
+ * the least recently used device for a new device.
+ * (Call with s_felica_cc_stub_nfc110_mutex locked.)
+ *
+ * \param  nfc110                 [IN] NFC Port-110 device.
+ *
+ * \return The models of the cards of the device.
+ */
+static felica_cc_stub_nfc110_device_t* felica_cc_stub_nfc110_find_device(
+    ICS_HW_DEVICE* nfc110)
+{
+    UINT32 i;
+    felica_cc_stub_nfc110_device_t* device;
+    felica_cc_stub_nfc110_device_t* lru;
+
+    s_felica_cc_stub_nfc110_device_use_count++;
+
+    lru = &s_felica_cc_stub_nfc110_devices[0];
+    for (i = 0; i < FELICA_CC_STUB_NFC110_MAX_DEVICES; i++) {
+        device = &s_felica_cc_stub_nfc110_devices[i];
+        if (device->nfc110 == nfc110) {
+            device->last_used = s_felica_cc_stub_nfc110_device_use_count;
+            return device;
+        }
+        if (device->last_used < lru->last_used) {
+            lru = device;
         }
+    }
+
+    utl_memset(lru, 0, sizeof(*lru));
+    lru->nfc110 = nfc110;
+    lru->last_used = s_felica_cc_stub_nfc110_device_use_count;
 
-        /* send an InSetProtocol command for NFC Port-110 */
-        setting_len = sizeof(nfc110_felica_default_protocol);
-        utl_memcpy(setting, nfc110_felica_default_protocol, setting_len);
-        if (max_num_of_cards > 1) {
-            setting[7] = 0x01; /* Multi card = on */
-        } else {
-            setting[7] = 0x00; /* Multi card = off */
+    return lru;
+}
+
+/**
+ * This function finds the time-out model of a card of a device,
+ * reusing the least recently used entry of the device for a new card.
+ * (The cards of the other devices are never evicted. Call with
+ * s_felica_cc_stub_nfc110_mutex locked, and do not keep the entry after
+ * unlocking it.)
+ *
+ * \param  nfc110                 [IN] NFC Port-110 device.
+ * \param  idm                    [IN] IDm of the card.
+ *
+ * \return The time-out model of the card.
+ */
+static felica_cc_stub_nfc110_card_t* felica_cc_stub_nfc110_find_card(
+    ICS_HW_DEVICE* nfc110,
+    const UINT8 idm[8])
+{
+    UINT32 i;
+    felica_cc_stub_nfc110_device_t* device;
+    felica_cc_stub_nfc110_card_t* card;
+    felica_cc_stub_nfc110_card_t* lru;
+
+    device = felica_cc_stub_nfc110_find_device(nfc110);
+    device->use_count++;
+
+    lru = &device->cards[0];
+    for (i = 0; i < FELICA_CC_STUB_NFC110_MAX_CARDS; i++) {
+        card = &device->cards[i];
+        if (utl_memcmp(card->idm, idm, 8) == 0) {
+            card->last_used = device->use_count;
+            return card;
+        }
+        if (card->last_used < lru->last_used) {
+            lru = card;
         }
+    }
 
-        rc = nfc110_set_protocol(
-            nfc110, setting, setting_len,
-            FELICA_CC_STUB_NFC110_IN_SET_PROTOCOL_TIMEOUT);
+    utl_memset(lru, 0, sizeof(*lru));
+    utl_memcpy(lru->idm, idm, 8);
+    lru->last_used = device->use_count;
 
-        if (rc != ICS_ERROR_SUCCESS) {
-            ICSLOG_ERR_STR(rc, "nfc110_set_protocol()");
-            return rc;
+    return lru;
+}
+
+/**
+ * This function calculates the RF time-out of a command from PMm.
+ *
+ * \param  card                   [IN] The time-out model of the card.
+ * \param  command                [IN] The card command.
+ * \param  command_len            [IN] The length of the card command.
+ *
+ * \return The time-out (ms), or 0 if unknown.
+ */
+static UINT32 felica_cc_stub_nfc110_pmm_timeout(
+    const felica_cc_stub_nfc110_card_t* card,
+    const UINT8* command,
+    UINT32 command_len)
+{
+    UINT32 pos;
+    UINT8 pmm;
+
+    if (!card->has_pmm) {
+        return 0;
+    }
+
+    switch (command[0]) {
+    case 0x02: /* Request Service */
+        pmm = card->pmm[FELICA_CC_PMM_REQUEST_SERVICE];
+        return FELICA_CC_CALC_TIMEOUT(pmm, (command_len > 9) ?
+                                      command[9] : 1);
+    case 0x04: /* Request Response */
+        pmm = card->pmm[FELICA_CC_PMM_REQUEST_RESPONSE];
+        return FELICA_CC_CALC_TIMEOUT(pmm, 0);
+    case 0x06: /* Read Without Encryption */
+    case 0x08: /* Write Without Encryption */
+        /* the number of blocks follows the service code list */
+        if (command_len <= 9) {
+            return 0;
+        }
+        pos = (10 + (2 * command[9]));
+        if (pos >= command_len) {
+            return 0;
         }
-        NFC110_SET_LAST_MODE(nfc110, NFC110_MODE_INITIATOR_TYPEF);
+        pmm = card->pmm[(command[0] == 0x06) ?
+                        FELICA_CC_PMM_READ_WITHOUT_ENCRYPTION :
+                        FELICA_CC_PMM_WRITE_WITHOUT_ENCRYPTION];
+        return FELICA_CC_CALC_TIMEOUT(pmm, command[pos]);
+    case 0x0c: /* Request System Code */
+        pmm = card->pmm[FELICA_CC_PMM_REQUEST_SYSTEM_CODE];
+        return FELICA_CC_CALC_TIMEOUT(pmm, 0);
+    default:
+        return 0;
     }
+}
 
-    ICSLOG_FUNC_END;
-    return ICS_ERROR_SUCCESS;
+/**
+ * This function calculates the time to transfer packets
+ * between the controller and NFC Port-110.
+ *
+ * \param  speed                  [IN] The speed. (bps)
+ * \param  nbytes                 [IN] The number of bytes.
+ *
+ * \return The time. (ms)
+ */
+static UINT32 felica_cc_stub_nfc110_xfer_time(
+    UINT32 speed,
+    UINT32 nbytes)
+{
+    return ((((nbytes * 10) * 1000) + (speed - 1)) / speed);
+}
+
+/**
+ * This function updates a smoothed latency with a sample.
+ *
+ * \param  rtt                    [IN] The smoothed latency.
+ * \param  sample                 [IN] The sampled latency. (us)
+ */
+static void felica_cc_stub_nfc110_update_rtt(
+    felica_cc_stub_nfc110_rtt_t* rtt,
+    UINT32 sample)
+{
+    INT32 delta;
+
+    if (rtt->num_of_samples == 0) {
+        rtt->srtt = (sample << 3);
+        rtt->rttvar = (sample << 1);
+    } else {
+        delta = (INT32)sample - (INT32)(rtt->srtt >> 3);
+        rtt->srtt = (UINT32)((INT32)rtt->srtt + delta);
+        if (delta < 0) {
+            delta = -delta;
+        }
+        rtt->rttvar = (UINT32)((INT32)rtt->rttvar +
+                               (delta - (INT32)(rtt->rttvar >> 2)));
+    }
+    rtt->num_of_samples++;
 }
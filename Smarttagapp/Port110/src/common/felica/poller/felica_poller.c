@@ -0,0 +1,456 @@
+/**
+ * \brief    the continuous polling of FeliCa cards
+ * \date     2026/10/17
+ * \author   Copyright 2013 Sony Corporation
+ */
+
+/*
+ * The poller keeps the set of the cards in the field and reports its
+ * changes as touch and release events, one polling at a time. The RF
+ * is left on while cards are present, so the first command to a touched
+ * card needs neither a new field nor a new initiator setup.
+ *
+ * Without cards, the interval starts at min_interval and is doubled up
+ * to max_interval, and the RF is turned off after idle_timeout. A card
+ * is released after max_misses pollings which do not detect it; the
+ * pollings which wait for a missed card use min_interval.
+ *
+ * felica_poller_poll() does not sleep, so the caller can schedule the
+ * pollings between its other commands (e.g. on a serial queue).
+ * felica_poller_run() is a blocking loop for a dedicated thread.
+ */
+
+#undef ICSLOG_MODULE
+#define ICSLOG_MODULE "FPL"
+
+#include "ics_types.h"
+#include "ics_error.h"
+#include "icslib_chk.h"
+#include "icslog.h"
+#include "icstrace.h"
+#include "utl.h"
+#include "felica_cc.h"
+
+#include "felica_poller.h"
+
+/* --------------------------------
+ * Prototype Declaration
+ * -------------------------------- */
+
+static UINT32 felica_poller_find(
+    const felica_card_t* cards,
+    UINT32 num_of_cards,
+    const felica_card_t* card);
+static void felica_poller_release(
+    felica_poller_t* poller,
+    UINT32 index);
+static UINT32 felica_poller_rf_off(
+    felica_poller_t* poller,
+    UINT32 timeout);
+
+/* --------------------------------
+ * Function
+ * -------------------------------- */
+
+/* ------------------------
+ * Exported
+ * ------------------------ */
+
+/**
+ * This function returns the default configuration.
+ *
+ * \param  config                [OUT] The configuration.
+ */
+void felica_poller_get_default_config(
+    felica_poller_config_t* config)
+{
+    config->present_interval = FELICA_POLLER_DEFAULT_PRESENT_INTERVAL;
+    config->min_interval = FELICA_POLLER_DEFAULT_MIN_INTERVAL;
+    config->max_interval = FELICA_POLLER_DEFAULT_MAX_INTERVAL;
+    config->idle_timeout = FELICA_POLLER_DEFAULT_IDLE_TIMEOUT;
+    config->max_misses = FELICA_POLLER_DEFAULT_MAX_MISSES;
+}
+
+/**
+ * This function initializes a poller. No cards are present, and the RF
+ * is regarded as on until the first idle_timeout.
+ *
+ * \param  poller                [OUT] The poller.
+ * \param  devf                   [IN] The device to poll.
+ * \param  drv_func               [IN] The driver of the device. (rf_off)
+ * \param  dev                    [IN] The device of the driver.
+ * \param  polling_param          [IN] The parameters of the Polling.
+ * \param  max_num_of_cards       [IN] The cards to detect per polling.
+ * \param  config                 [IN] The configuration. (NULL: default)
+ * \param  callback               [IN] The callback of the events. (NULL: none)
+ * \param  callback_arg           [IN] The argument of the callback.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ */
+UINT32 felica_poller_initialize(
+    felica_poller_t* poller,
+    const felica_cc_devf_t* devf,
+    const icsdrv_basic_func_t* drv_func,
+    ICS_HW_DEVICE* dev,
+    const UINT8 polling_param[4],
+    UINT32 max_num_of_cards,
+    const felica_poller_config_t* config,
+    felica_poller_callback_t callback,
+    void* callback_arg)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "felica_poller_initialize"
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(poller, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(devf, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(drv_func, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(dev, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(polling_param, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_IN_RANGE(max_num_of_cards, 1, FELICA_POLLER_MAX_CARDS,
+                           ICS_ERROR_INVALID_PARAM);
+    if (config != NULL) {
+        ICSLIB_CHKARG_BE(config->min_interval, 1, ICS_ERROR_INVALID_PARAM);
+        ICSLIB_CHKARG_BE(config->max_interval, config->min_interval,
+                         ICS_ERROR_INVALID_PARAM);
+        ICSLIB_CHKARG_BE(config->max_misses, 1, ICS_ERROR_INVALID_PARAM);
+    }
+
+    ICSLOG_DUMP(polling_param, 4);
+    ICSLOG_DBG_UINT(max_num_of_cards);
+
+    utl_memset(poller, 0, sizeof(*poller));
+    poller->devf = devf;
+    poller->drv_func = drv_func;
+    poller->dev = dev;
+    utl_memcpy(poller->polling_param, polling_param,
+               sizeof(poller->polling_param));
+    poller->max_num_of_cards = max_num_of_cards;
+    if (config != NULL) {
+        poller->config = *config;
+    } else {
+        felica_poller_get_default_config(&poller->config);
+    }
+    poller->callback = callback;
+    poller->callback_arg = callback_arg;
+
+    poller->interval = poller->config.min_interval;
+    poller->idle_time0 = utl_get_time_msec();
+    poller->is_rf_on = TRUE;
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function polls once, and calls the callback for each released
+ * card and then for each touched card. (The callback must not call the
+ * functions of the poller.)
+ *
+ * \param  poller                 [IN] The poller.
+ * \param  timeout                [IN] Time-out period of the commands.
+ * \param  interval              [OUT] ms until the next polling.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error. (with or without cards)
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_IO                Other driver error.
+ * \retval ICS_ERROR_DEVICE            Error at device.
+ */
+UINT32 felica_poller_poll(
+    felica_poller_t* poller,
+    UINT32 timeout,
+    UINT32* interval)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "felica_poller_poll"
+    UINT32 rc;
+    UINT32 num_of_polled_cards;
+    felica_card_t polled_cards[FELICA_POLLER_MAX_CARDS];
+    felica_card_option_t card_options[FELICA_POLLER_MAX_CARDS];
+    UINT32 num_of_cards0;
+    BOOL is_missed;
+    UINT32 current_time;
+    UINT32 i;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(poller, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(interval, NULL, ICS_ERROR_INVALID_PARAM);
+
+    ICSTRACE(ICSTRACE_EVENT_FUNC_BEGIN, ICSTRACE_TAG_POLLING,
+             poller->num_of_cards);
+
+    num_of_polled_cards = 0;
+    rc = felica_cc_polling_multiple(poller->devf,
+                                    poller->polling_param,
+                                    poller->max_num_of_cards,
+                                    &num_of_polled_cards,
+                                    polled_cards,
+                                    card_options,
+                                    timeout);
+    if (rc == ICS_ERROR_BUF_OVERFLOW) {
+        /* the other cards are detected by the next pollings */
+        rc = ICS_ERROR_SUCCESS;
+    } else if (rc == ICS_ERROR_TIMEOUT) {
+        num_of_polled_cards = 0;
+        rc = ICS_ERROR_SUCCESS;
+    }
+    ICSTRACE(ICSTRACE_EVENT_FUNC_END, ICSTRACE_TAG_POLLING, rc);
+    poller->is_rf_on = TRUE;
+    if (rc != ICS_ERROR_SUCCESS) {
+        /* the cards are kept for the polling after the recovery */
+        ICSLOG_ERR_STR(rc, "felica_cc_polling_multiple()");
+        return rc;
+    }
+    poller->num_of_pollings++;
+    ICSLOG_DBG_UINT(num_of_polled_cards);
+
+    /* release the cards which are missed too many times */
+    num_of_cards0 = poller->num_of_cards;
+    is_missed = FALSE;
+    i = 0;
+    while (i < poller->num_of_cards) {
+        if (felica_poller_find(polled_cards, num_of_polled_cards,
+                               &poller->cards[i]) < num_of_polled_cards) {
+            poller->misses[i] = 0;
+        } else if (++poller->misses[i] >= poller->config.max_misses) {
+            felica_poller_release(poller, i);
+            continue;
+        } else {
+            is_missed = TRUE;
+        }
+        i++;
+    }
+
+    /* touch the new cards */
+    for (i = 0; i < num_of_polled_cards; i++) {
+        if ((felica_poller_find(poller->cards, poller->num_of_cards,
+                                &polled_cards[i]) < poller->num_of_cards) ||
+            (poller->num_of_cards == FELICA_POLLER_MAX_CARDS)) {
+            continue;
+        }
+        poller->cards[poller->num_of_cards] = polled_cards[i];
+        poller->misses[poller->num_of_cards] = 0;
+        poller->num_of_cards++;
+        ICSLOG_DBG_PRINT(("touched: %02x%02x%02x%02x%02x%02x%02x%02x\n",
+                          polled_cards[i].idm[0], polled_cards[i].idm[1],
+                          polled_cards[i].idm[2], polled_cards[i].idm[3],
+                          polled_cards[i].idm[4], polled_cards[i].idm[5],
+                          polled_cards[i].idm[6], polled_cards[i].idm[7]));
+        if (poller->callback != NULL) {
+            (*poller->callback)(poller->callback_arg,
+                                FELICA_POLLER_EVENT_TOUCH,
+                                &polled_cards[i]);
+        }
+    }
+
+    /* the next polling */
+    current_time = utl_get_time_msec();
+    if (is_missed) {
+        poller->idle_time0 = current_time;
+        poller->interval = poller->config.min_interval;
+    } else if (poller->num_of_cards > 0) {
+        poller->idle_time0 = current_time;
+        poller->interval = poller->config.present_interval;
+    } else if (num_of_cards0 > 0) {
+        poller->interval = poller->config.min_interval;
+    } else if (poller->interval < (poller->config.max_interval / 2)) {
+        poller->interval *= 2;
+    } else {
+        poller->interval = poller->config.max_interval;
+    }
+
+    if ((poller->num_of_cards == 0) &&
+        ((UINT32)(current_time - poller->idle_time0) >=
+         poller->config.idle_timeout)) {
+        rc = felica_poller_rf_off(poller, timeout);
+    }
+
+    *interval = poller->interval;
+    ICSLOG_DBG_UINT(*interval);
+
+    ICSLOG_FUNC_END;
+    return rc;
+}
+
+/**
+ * This function polls until *is_stopped is set (checked after each
+ * polling and its interval), and then stops the poller.
+ *
+ * \param  poller                 [IN] The poller.
+ * \param  is_stopped             [IN] The flag to stop.
+ * \param  timeout                [IN] Time-out period of the commands.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_IO                Other driver error.
+ * \retval ICS_ERROR_DEVICE            Error at device.
+ */
+UINT32 felica_poller_run(
+    felica_poller_t* poller,
+    volatile BOOL* is_stopped,
+    UINT32 timeout)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "felica_poller_run"
+    UINT32 rc;
+    UINT32 interval;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(poller, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(is_stopped, NULL, ICS_ERROR_INVALID_PARAM);
+
+    while (!*is_stopped) {
+        rc = felica_poller_poll(poller, timeout, &interval);
+        if (rc != ICS_ERROR_SUCCESS) {
+            ICSLOG_ERR_STR(rc, "felica_poller_poll()");
+            return rc;
+        }
+        rc = utl_msleep(interval);
+        if (rc != ICS_ERROR_SUCCESS) {
+            ICSLOG_ERR_STR(rc, "utl_msleep()");
+            return rc;
+        }
+    }
+
+    rc = felica_poller_stop(poller, timeout);
+    if (rc != ICS_ERROR_SUCCESS) {
+        ICSLOG_ERR_STR(rc, "felica_poller_stop()");
+        return rc;
+    }
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function releases all the present cards (calling the callback),
+ * and turns the RF off.
+ *
+ * \param  poller                 [IN] The poller.
+ * \param  timeout                [IN] Time-out period of RF off.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_IO                Other driver error.
+ * \retval ICS_ERROR_DEVICE            Error at device.
+ */
+UINT32 felica_poller_stop(
+    felica_poller_t* poller,
+    UINT32 timeout)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "felica_poller_stop"
+    UINT32 rc;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(poller, NULL, ICS_ERROR_INVALID_PARAM);
+
+    while (poller->num_of_cards > 0) {
+        felica_poller_release(poller, 0);
+    }
+    poller->interval = poller->config.min_interval;
+
+    rc = felica_poller_rf_off(poller, timeout);
+    if (rc != ICS_ERROR_SUCCESS) {
+        ICSLOG_ERR_STR(rc, "felica_poller_rf_off()");
+        return rc;
+    }
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/* ------------------------
+ * Internal
+ * ------------------------ */
+
+/**
+ * This function finds a card by the IDm.
+ *
+ * \param  cards                  [IN] The cards.
+ * \param  num_of_cards           [IN] The number of the cards.
+ * \param  card                   [IN] The card to find.
+ *
+ * \return The index of the card. (num_of_cards: not found)
+ */
+static UINT32 felica_poller_find(
+    const felica_card_t* cards,
+    UINT32 num_of_cards,
+    const felica_card_t* card)
+{
+    UINT32 i;
+
+    for (i = 0; i < num_of_cards; i++) {
+        if (utl_memcmp(cards[i].idm, card->idm, sizeof(card->idm)) == 0) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/**
+ * This function removes a present card, keeping the order of the others,
+ * and calls the callback.
+ *
+ * \param  poller                 [IN] The poller.
+ * \param  index                  [IN] The index of the card.
+ */
+static void felica_poller_release(
+    felica_poller_t* poller,
+    UINT32 index)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "felica_poller_release"
+    felica_card_t card;
+    UINT32 i;
+
+    card = poller->cards[index];
+    for (i = (index + 1); i < poller->num_of_cards; i++) {
+        poller->cards[i - 1] = poller->cards[i];
+        poller->misses[i - 1] = poller->misses[i];
+    }
+    poller->num_of_cards--;
+
+    ICSLOG_DBG_PRINT(("released: %02x%02x%02x%02x%02x%02x%02x%02x\n",
+                      card.idm[0], card.idm[1], card.idm[2], card.idm[3],
+                      card.idm[4], card.idm[5], card.idm[6], card.idm[7]));
+    if (poller->callback != NULL) {
+        (*poller->callback)(poller->callback_arg,
+                            FELICA_POLLER_EVENT_RELEASE, &card);
+    }
+}
+
+/**
+ * This function turns the RF off if it is on.
+ *
+ * \param  poller                 [IN] The poller.
+ * \param  timeout                [IN] Time-out period.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_IO                Other driver error.
+ * \retval ICS_ERROR_DEVICE            Error at device.
+ */
+static UINT32 felica_poller_rf_off(
+    felica_poller_t* poller,
+    UINT32 timeout)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "felica_poller_rf_off"
+    UINT32 rc;
+
+    if (!poller->is_rf_on || (poller->drv_func->rf_off == NULL)) {
+        return ICS_ERROR_SUCCESS;
+    }
+
+    rc = poller->drv_func->rf_off(poller->dev, timeout);
+    if (rc != ICS_ERROR_SUCCESS) {
+        ICSLOG_ERR_STR(rc, "rf_off()");
+        return rc;
+    }
+    poller->is_rf_on = FALSE;
+    poller->num_of_rf_offs++;
+
+    return ICS_ERROR_SUCCESS;
+}
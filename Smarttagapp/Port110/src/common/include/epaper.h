@@ -0,0 +1,135 @@
+/**
+ * \brief    a header file for the e-paper rendering module
+ * \date     2026/10/17
+ * \author   Copyright 2013 Sony Corporation
+ */
+
+#include "ics_types.h"
+
+#ifndef EPAPER_H_
+#define EPAPER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Constant
+ */
+
+/* panels */
+#define EPAPER_PANEL_20INCH                     0
+#define EPAPER_PANEL_27INCH                     1
+
+#define EPAPER_PANEL_20INCH_WIDTH               200
+#define EPAPER_PANEL_20INCH_HEIGHT              96
+#define EPAPER_PANEL_27INCH_WIDTH               264
+#define EPAPER_PANEL_27INCH_HEIGHT              176
+#define EPAPER_MAX_FRAME_LEN \
+    ((EPAPER_PANEL_27INCH_WIDTH * EPAPER_PANEL_27INCH_HEIGHT) / 8)
+
+/* pixel formats of the source image */
+#define EPAPER_FORMAT_GRAY8                     0
+#define EPAPER_FORMAT_RGBA8888                  1 /* R, G, B, A (or X) */
+#define EPAPER_FORMAT_BGRA8888                  2 /* B, G, R, A (or X) */
+
+#define EPAPER_MAX_SOURCE_LEN                   0xffff /* width, height */
+
+/* dithering */
+#define EPAPER_DITHER_NONE                      0 /* threshold at 128 */
+#define EPAPER_DITHER_JJN                       1 /* Jarvis, Judice, Ninke */
+#define EPAPER_DITHER_FLOYD_STEINBERG           2
+#define EPAPER_DITHER_ATKINSON                  3
+#define EPAPER_DITHER_BAYER                     4 /* ordered, 8x8 */
+#define EPAPER_DITHER_BLUE_NOISE                5 /* ordered, 32x32 */
+
+/* tone: the luminance is scaled by tone / 255 */
+#define EPAPER_TONE_IDENTITY                    255
+#define EPAPER_TONE_PHOTO                       191 /* 0.75 */
+
+/* compression of frames (see epaper_encode()) */
+#define EPAPER_CODEC_RAW                        0
+#define EPAPER_CODEC_PACKBITS                   1
+#define EPAPER_CODEC_XOR_PACKBITS               2 /* delta from the shown */
+#define EPAPER_MAX_ENCODED_LEN(len)             ((len) + (((len) + 127) / 128))
+
+/*
+ * Type and structure
+ */
+
+typedef struct epaper_image_t {
+    const UINT8* pixels;        /* the first pixel of the top row */
+    UINT32 width;
+    UINT32 height;
+    UINT32 stride;              /* bytes from a row to the next */
+    UINT32 format;              /* EPAPER_FORMAT_* */
+} epaper_image_t;
+
+typedef struct epaper_rect_t {
+    UINT32 x;
+    UINT32 y;
+    UINT32 width;
+    UINT32 height;
+} epaper_rect_t;
+
+typedef struct epaper_option_t {
+    UINT32 tone;                /* 0 to 255 */
+    UINT32 dither;              /* EPAPER_DITHER_* */
+} epaper_option_t;
+
+/*
+ * Prototype declaration
+ */
+
+UINT32 epaper_get_panel_size(
+    UINT32 panel,
+    UINT32* width,
+    UINT32* height,
+    UINT32* frame_len);
+UINT32 epaper_get_scratch_len(
+    UINT32 panel,
+    const epaper_rect_t* rect,
+    UINT32* scratch_len);
+UINT32 epaper_render(
+    const epaper_image_t* image,
+    const epaper_rect_t* rect,
+    UINT32 panel,
+    const epaper_option_t* option,
+    void* scratch,
+    UINT32 scratch_len,
+    UINT8* frame,
+    UINT32 frame_len);
+UINT32 epaper_get_dither_scratch_len(
+    UINT32 width,
+    UINT32* scratch_len);
+UINT32 epaper_dither(
+    const UINT8* gray,
+    UINT32 width,
+    UINT32 height,
+    UINT32 stride,
+    UINT32 dither,
+    void* scratch,
+    UINT32 scratch_len,
+    UINT8* bits,
+    UINT32 bits_len);
+UINT32 epaper_encode(
+    UINT32 codec,
+    const UINT8* frame,
+    const UINT8* base,
+    UINT32 frame_len,
+    UINT8* data,
+    UINT32 max_data_len,
+    UINT32* data_len);
+UINT32 epaper_decode(
+    UINT32 codec,
+    const UINT8* data,
+    UINT32 data_len,
+    const UINT8* base,
+    UINT8* frame,
+    UINT32 frame_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !EPAPER_H_ */
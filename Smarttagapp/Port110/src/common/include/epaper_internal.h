@@ -0,0 +1,57 @@
+/**
+ * \brief    a header file for the e-paper rendering module (internal)
+ * \date     2026/10/17
+ * \author   Copyright 2013 Sony Corporation
+ */
+
+#include "ics_types.h"
+
+#ifndef EPAPER_INTERNAL_H_
+#define EPAPER_INTERNAL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Constant
+ */
+
+/* error diffusion reaches two pixels to the left and right */
+#define EPAPER_DITHER_MARGIN                    2
+#define EPAPER_DITHER_ROW_LEN(width) \
+    (EPAPER_DITHER_MARGIN + (width) + EPAPER_DITHER_MARGIN)
+#define EPAPER_DITHER_NUM_OF_ROWS               2
+
+/*
+ * Type and structure
+ */
+
+typedef struct epaper_dither_work_t {
+    UINT32 dither;
+    UINT32 width;
+    /* error sums (times the divisor of the kernel) of this row and the
+       next one; this row takes the second next one as it is consumed */
+    INT16* error[EPAPER_DITHER_NUM_OF_ROWS];
+} epaper_dither_work_t;
+
+/*
+ * Prototype declaration
+ */
+
+void epaper_dither_setup(
+    epaper_dither_work_t* work,
+    UINT32 dither,
+    UINT32 width,
+    INT16* rows);
+void epaper_dither_row(
+    epaper_dither_work_t* work,
+    const UINT8* gray,
+    UINT32 y,
+    UINT8* bits);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !EPAPER_INTERNAL_H_ */
@@ -37,6 +37,31 @@ extern "C" {
 #define FELICA_CC_PMM_WRITE_WITHOUT_ENCRYPTION          6
 #define FELICA_CC_PMM_REQUEST_SYSTEM_CODE               3
 
+#define FELICA_CC_BATCH_NONE                            0
+#define FELICA_CC_BATCH_READ                            1
+#define FELICA_CC_BATCH_WRITE                           2
+
+/*
+ * Type and structure
+ */
+
+typedef struct felica_cc_batch_t {
+    const felica_cc_devf_t* devf;
+    felica_card_t card;
+    UINT8 command;              /* FELICA_CC_BATCH_* of the queued blocks */
+    UINT8 num_of_services;
+    UINT16 service_code_list[FELICA_CC_READ_WE_NUM_OF_SERVICES_MAX];
+    UINT8 num_of_blocks;
+    UINT32 block_list_len;
+    UINT8 block_list[3 * FELICA_CC_READ_WE_NUM_OF_BLOCKS_MAX];
+    UINT8 block_data[16 * FELICA_CC_READ_WE_NUM_OF_BLOCKS_MAX];
+    UINT8* read_block_data[FELICA_CC_READ_WE_NUM_OF_BLOCKS_MAX];
+    UINT8 status_flag1;         /* of the last command */
+    UINT8 status_flag2;         /* of the last command */
+    UINT32 num_of_commands;     /* sent commands */
+    UINT32 num_of_sent_blocks;  /* blocks in the sent commands */
+} felica_cc_batch_t;
+
 /*
  * Prototype declaration
  */
@@ -98,6 +123,24 @@ UINT32 felica_cc_request_system_code(
     UINT8* system_code_list,
     UINT32 timeout);
 
+UINT32 felica_cc_batch_initialize(
+    felica_cc_batch_t* batch,
+    const felica_cc_devf_t* devf);
+UINT32 felica_cc_batch_read(
+    felica_cc_batch_t* batch,
+    const felica_card_t* card,
+    UINT16 service_code,
+    UINT16 block_number,
+    UINT8* block_data);
+UINT32 felica_cc_batch_write(
+    felica_cc_batch_t* batch,
+    const felica_card_t* card,
+    UINT16 service_code,
+    UINT16 block_number,
+    const UINT8* block_data);
+UINT32 felica_cc_batch_flush(
+    felica_cc_batch_t* batch);
+
 /*
  * Macros to calculate timeouts from PMm
  */
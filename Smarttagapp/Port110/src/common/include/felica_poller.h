@@ -0,0 +1,113 @@
+/**
+ * \brief    the header file for the continuous polling of FeliCa cards
+ * \date     2026/10/17
+ * \author   Copyright 2013 Sony Corporation
+ */
+
+#include "ics_types.h"
+#include "ics_hwdev.h"
+#include "icsdrv.h"
+#include "felica_card.h"
+#include "felica_cc_stub.h"
+
+#ifndef FELICA_POLLER_H_
+#define FELICA_POLLER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Constant
+ */
+
+#define FELICA_POLLER_MAX_CARDS                 4
+
+/* events */
+#define FELICA_POLLER_EVENT_TOUCH               1
+#define FELICA_POLLER_EVENT_RELEASE             2
+
+/* default configuration */
+#define FELICA_POLLER_DEFAULT_PRESENT_INTERVAL  250  /* ms */
+#define FELICA_POLLER_DEFAULT_MIN_INTERVAL      50   /* ms */
+#define FELICA_POLLER_DEFAULT_MAX_INTERVAL      400  /* ms */
+#define FELICA_POLLER_DEFAULT_IDLE_TIMEOUT      3000 /* ms */
+#define FELICA_POLLER_DEFAULT_MAX_MISSES        2
+
+/*
+ * Type and structure
+ */
+
+/* called in felica_poller_poll() and felica_poller_stop() */
+typedef void (*felica_poller_callback_t)(
+    void* arg,
+    UINT32 event,
+    const felica_card_t* card);
+
+typedef struct felica_poller_config_t {
+    UINT32 present_interval;    /* ms between pollings while cards are
+                                   present */
+    UINT32 min_interval;        /* ms after the last card is released,
+                                   doubled each polling without cards */
+    UINT32 max_interval;        /* ms: the limit of the doubling */
+    UINT32 idle_timeout;        /* ms without cards before the RF is
+                                   turned off */
+    UINT32 max_misses;          /* pollings which miss a card before
+                                   it is released */
+} felica_poller_config_t;
+
+typedef struct felica_poller_t {
+    const felica_cc_devf_t* devf;
+    const icsdrv_basic_func_t* drv_func;
+    ICS_HW_DEVICE* dev;
+    UINT8 polling_param[4];
+    UINT32 max_num_of_cards;
+    felica_poller_config_t config;
+    felica_poller_callback_t callback;
+    void* callback_arg;
+
+    /* the present cards, in the order of the touches */
+    UINT32 num_of_cards;
+    felica_card_t cards[FELICA_POLLER_MAX_CARDS];
+    UINT32 misses[FELICA_POLLER_MAX_CARDS];
+
+    UINT32 interval;            /* ms until the next polling */
+    UINT32 idle_time0;          /* ms: the last polling with cards */
+    BOOL is_rf_on;
+    UINT32 num_of_pollings;
+    UINT32 num_of_rf_offs;
+} felica_poller_t;
+
+/*
+ * Prototype declaration
+ */
+
+void felica_poller_get_default_config(
+    felica_poller_config_t* config);
+UINT32 felica_poller_initialize(
+    felica_poller_t* poller,
+    const felica_cc_devf_t* devf,
+    const icsdrv_basic_func_t* drv_func,
+    ICS_HW_DEVICE* dev,
+    const UINT8 polling_param[4],
+    UINT32 max_num_of_cards,
+    const felica_poller_config_t* config,
+    felica_poller_callback_t callback,
+    void* callback_arg);
+UINT32 felica_poller_poll(
+    felica_poller_t* poller,
+    UINT32 timeout,
+    UINT32* interval);
+UINT32 felica_poller_run(
+    felica_poller_t* poller,
+    volatile BOOL* is_stopped,
+    UINT32 timeout);
+UINT32 felica_poller_stop(
+    felica_poller_t* poller,
+    UINT32 timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !FELICA_POLLER_H_ */
@@ -6,6 +6,7 @@
 
 #include "ics_types.h"
 #include "ics_hwdev.h"
+#include "utl.h"
 
 #ifndef ICSDRV_H_
 #define ICSDRV_H_
@@ -113,6 +114,18 @@ typedef UINT32 (*icsdrv_raw_read_func_t)(
     UINT32* read_len,
     UINT32 time0,
     UINT32 timeout);
+typedef UINT32 (*icsdrv_raw_write_until_func_t)(
+    ICS_HANDLE handle,
+    const UINT8* data,
+    UINT32 data_len,
+    const utl_deadline_t* deadline);
+typedef UINT32 (*icsdrv_raw_read_until_func_t)(
+    ICS_HANDLE handle,
+    UINT32 min_read_len,
+    UINT32 max_read_len,
+    UINT8* data,
+    UINT32* read_len,
+    const utl_deadline_t* deadline);
 typedef UINT32 (*icsdrv_raw_set_speed_func_t)(
     ICS_HANDLE handle,
     UINT32 speed);
@@ -132,6 +145,9 @@ typedef struct icsdrv_raw_func_t {
     icsdrv_raw_drain_tx_queue_func_t drain_tx_queue;
     UINT32                           attr;
     void*                            ext;
+    /* write and read with a deadline (or NULL) */
+    icsdrv_raw_write_until_func_t    write_until;
+    icsdrv_raw_read_until_func_t     read_until;
 } icsdrv_raw_func_t;
 
 #ifdef __cplusplus
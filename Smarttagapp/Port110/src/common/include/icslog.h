@@ -32,16 +32,67 @@ extern "C" {
 #define ICSLOG_INFO    7
 #define ICSLOG_DEBUG   8
 
+/*
+ * Runtime levels of the modules
+ *
+ * ICSLOG_LEVEL is the ceiling at compile time: the logs above it are
+ * compiled out. Below it, each module (ICSLOG_MODULE) has a level which
+ * can be changed at runtime with icslog_set_level(). The levels are
+ * checked before the arguments are evaluated.
+ *
+ * The modules are hashed into ICSLOG_MAX_MODULES slots by the first
+ * three characters of the name, so modules of the same slot share the
+ * level.
+ */
+
+#define ICSLOG_MAX_MODULES      128
+
+#define ICSLOG_MODULE_SLOT(module) \
+    ((((((UINT32)(UINT8)(module)[0] * 131) + \
+        (UINT8)(module)[1]) * 131) + \
+      (UINT8)(module)[2]) & (ICSLOG_MAX_MODULES - 1))
+
+extern volatile UINT8 g_icslog_levels[ICSLOG_MAX_MODULES];
+
+/*
+ * The sink of the dumps: it receives the bytes as they are, and formats
+ * them only if it needs.
+ */
+typedef void (*icslog_dump_sink_t)(
+    const char* module,
+    const char* func,
+    const char* name,
+    const UINT8* data,
+    UINT32 len);
+
+void icslog_set_level(
+    const char* module,
+    UINT32 level);
+UINT32 icslog_get_level(
+    const char* module);
+void icslog_set_dump_sink(
+    icslog_dump_sink_t sink);
+void icslog_dump(
+    const char* module,
+    const char* func,
+    const char* name,
+    const void* data,
+    UINT32 len);
+
 /*
  * Macros
  */
 
 #ifdef ICSLOG_LEVEL
 
+#define ICSLOG_IS_ENABLED(level) \
+    (((level) <= ICSLOG_LEVEL) && \
+     ((level) <= g_icslog_levels[ICSLOG_MODULE_SLOT(ICSLOG_MODULE)]))
+
 #ifndef ICSLOG
 #define ICSLOG(level, arg) \
     do { \
-        if ((level) <= ICSLOG_LEVEL) { \
+        if (ICSLOG_IS_ENABLED(level)) { \
             ICSLOG_PRINTF arg; \
         } \
     } while (0)
@@ -74,7 +125,7 @@ extern "C" {
     } while(0)
 #define ICSLOG_DBG_PRINT_ARG(fmt, ...) \
     do { \
-        if (ICSLOG_DEBUG <= ICSLOG_LEVEL) { \
+        if (ICSLOG_IS_ENABLED(ICSLOG_DEBUG)) { \
             ICSLOG_PRINTF ("D:%s:%011lu:%s: " fmt, ICSLOG_MODULE, \
             (unsigned long)utl_get_time_msec(), ICSLOG_FUNC, ##__VA_ARGS__); \
         } \
@@ -149,25 +200,9 @@ extern "C" {
 #if ICSLOG_LEVEL >= ICSLOG_DEBUG
 #define ICSLOG_DUMP(data, len) \
     do { \
-        const UINT8* log_data = (const UINT8*)(data); \
-        UINT log_len = (UINT)(len); \
-        UINT log_i; \
-        for (log_i = 0; \
-             (log_i < log_len) && (log_i < (UINT)ICSLOG_MAX_DUMP_LEN); \
-             log_i++) { \
-            if ((log_i % 8) == 0) { \
-                ICSLOG(ICSLOG_DEBUG, ("D:%s:%011lu:%s:DUMP:%s:", \
-                                      ICSLOG_MODULE, \
-                                      (unsigned long)utl_get_time_msec(), \
-                                      ICSLOG_FUNC, # data)); \
-            } \
-            ICSLOG(ICSLOG_DEBUG, (" %02x", *(log_data + log_i))); \
-            if ((log_i % 8) == 7) { \
-                ICSLOG(ICSLOG_DEBUG, ("\n")); \
-            } \
-        } \
-        if ((log_i % 8) != 0) { \
-            ICSLOG(ICSLOG_DEBUG, ("\n")); \
+        if (ICSLOG_IS_ENABLED(ICSLOG_DEBUG)) { \
+            icslog_dump(ICSLOG_MODULE, ICSLOG_FUNC, # data, \
+                        (data), (UINT32)(len)); \
         } \
     } while (0)
 #else
@@ -177,6 +212,7 @@ extern "C" {
 
 #else /* ICSLOG_LEVEL */
 
+#define ICSLOG_IS_ENABLED(level)        0
 #define ICSLOG(level, arg)
 #define ICSLOG_ERR_STR(error, str)
 #define ICSLOG_ERR_PRINT(error, arg)
@@ -0,0 +1,114 @@
+/**
+ * \brief    the header file for ICS trace facilities
+ * \date     2026/10/17
+ * \author   Copyright 2013 Sony Corporation
+ */
+
+#include "ics_types.h"
+
+#ifndef ICSTRACE_H_
+#define ICSTRACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Constant
+ */
+
+/* the rings: one per thread, each keeps the latest events */
+#define ICSTRACE_MAX_THREADS            8
+#define ICSTRACE_RING_LEN               1024 /* power of 2 */
+
+/* events */
+#define ICSTRACE_EVENT_CMD_BEGIN        1  /* tag: command code, value: length */
+#define ICSTRACE_EVENT_CMD_END          2  /* tag: command code, value: error */
+#define ICSTRACE_EVENT_ACK              3  /* tag: command code */
+#define ICSTRACE_EVENT_BLE_TX           4  /* value: bytes */
+#define ICSTRACE_EVENT_BLE_RX           5  /* value: bytes */
+#define ICSTRACE_EVENT_RETRY            6  /* tag: ICSTRACE_TAG_*, value: count */
+#define ICSTRACE_EVENT_CANCEL           7  /* tag: ICSTRACE_TAG_* */
+#define ICSTRACE_EVENT_FUNC_BEGIN       8  /* tag: ICSTRACE_TAG_*, value: arg */
+#define ICSTRACE_EVENT_FUNC_END         9  /* tag: ICSTRACE_TAG_*, value: error */
+
+/* tags: the kind in the upper byte, the detail in the lower byte */
+#define ICSTRACE_TAG_NFC110             0x0100 /* | Port-110 command code */
+#define ICSTRACE_TAG_WWE                0x0200 /* | SmartTag function */
+#define ICSTRACE_TAG_RWE                0x0300 /* | SmartTag function */
+#define ICSTRACE_TAG_POLLING            0x0400
+#define ICSTRACE_TAG_PIPELINE           0x0500
+#define ICSTRACE_TAG_SESSION            0x0600 /* | reader */
+
+/* the file written by icstrace_get_file_header() and the events */
+#define ICSTRACE_FILE_MAGIC             "ICST"
+#define ICSTRACE_FILE_VERSION           1
+
+/*
+ * Type and structure
+ */
+
+typedef struct icstrace_event_t {
+    UINT64 time_usec;
+    UINT8 type;                 /* ICSTRACE_EVENT_* */
+    UINT8 thread;               /* the index of the ring */
+    UINT16 tag;
+    UINT32 value;
+} icstrace_event_t;
+
+typedef struct icstrace_file_header_t {
+    UINT8 magic[4];             /* ICSTRACE_FILE_MAGIC */
+    UINT32 version;             /* ICSTRACE_FILE_VERSION */
+    UINT32 num_of_events;       /* followed by the events */
+    UINT32 num_of_dropped;      /* events of threads without a ring */
+} icstrace_file_header_t;
+
+/*
+ * Macros
+ *
+ * The events are recorded only if ICSTRACE_ENABLE is defined,
+ * otherwise the macros are compiled out.
+ */
+
+#ifdef ICSTRACE_ENABLE
+
+#define ICSTRACE(type, tag, value) \
+    do { \
+        if (g_icstrace_is_started) { \
+            icstrace_record((UINT8)(type), (UINT16)(tag), (UINT32)(value)); \
+        } \
+    } while (0)
+
+#else /* ICSTRACE_ENABLE */
+
+#define ICSTRACE(type, tag, value)
+
+#endif /* ICSTRACE_ENABLE */
+
+/*
+ * Prototype declaration
+ */
+
+extern volatile BOOL g_icstrace_is_started;
+
+UINT32 icstrace_start(
+    UINT64 (*clock_usec)(void));
+void icstrace_stop(void);
+void icstrace_clear(void);
+void icstrace_record(
+    UINT8 type,
+    UINT16 tag,
+    UINT32 value);
+UINT32 icstrace_snapshot(
+    icstrace_event_t* events,
+    UINT32 max_events,
+    UINT32* num_events);
+void icstrace_get_file_header(
+    UINT32 num_events,
+    icstrace_file_header_t* header);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !ICSTRACE_H_ */
@@ -283,6 +283,9 @@ UINT32 nfc110_close(
 UINT32 nfc110_initialize_device(
     ICS_HW_DEVICE* nfc110,
     UINT32 timeout);
+UINT32 nfc110_resume_device(
+    ICS_HW_DEVICE* nfc110,
+    UINT32 timeout);
 
 /* check the device is alive */
 UINT32 nfc110_ping(
@@ -370,6 +373,22 @@ UINT32 nfc110_set_protocol(
     UINT32 setting_len,
     UINT32 timeout);
 
+/* set the rf speed and the rf protocol setting data which differ */
+UINT32 nfc110_update_rf_speed(
+    ICS_HW_DEVICE* nfc110,
+    UINT8 tx_rbt,
+    UINT8 tx_speed,
+    UINT8 rx_rbt,
+    UINT8 rx_speed,
+    UINT32 timeout);
+UINT32 nfc110_update_protocol(
+    ICS_HW_DEVICE* nfc110,
+    const UINT8* setting,
+    UINT32 setting_len,
+    UINT32 timeout);
+BOOL nfc110_has_protocol_shadow(
+    ICS_HW_DEVICE* nfc110);
+
 /* get the rf protocol setting data of the device */
 UINT32 nfc110_get_protocol(
     ICS_HW_DEVICE* nfc110,
@@ -387,6 +406,9 @@ UINT32 nfc110_clear_rx_queue(
 UINT32 nfc110_get_ack_time(
     ICS_HW_DEVICE* nfc110,
     UINT32* ack_time);
+UINT32 nfc110_get_ack_time_usec(
+    ICS_HW_DEVICE* nfc110,
+    UINT32* ack_time_usec);
 
 /* get version information */
 UINT32 nfc110_get_version_information(
@@ -454,6 +476,14 @@ UINT32 nfc110_reset_device(
     UINT8 option,
     UINT32 timeout);
 
+/* check a frame received from the device */
+UINT32 nfc110_check_frame(
+    const UINT8* frame,
+    UINT32 frame_len,
+    UINT32* needed_len,
+    UINT32* response_pos,
+    UINT32* response_len);
+
 /* ext driver */
 
 typedef UINT32 (*nfc110_raw_get_attribute_func_t)(
@@ -27,6 +27,7 @@ UINT32 nfc110_ble_open(
 
 #define nfc110_ble_close                        nfc110_close
 #define nfc110_ble_initialize_device            nfc110_initialize_device
+#define nfc110_ble_resume_device                nfc110_resume_device
 #define nfc110_ble_get_firmware_version         nfc110_get_firmware_version
 #define nfc110_ble_ping                         nfc110_ping
 #define nfc110_ble_reset                        nfc110_reset
@@ -40,8 +41,12 @@ UINT32 nfc110_ble_open(
 #define nfc110_ble_get_protocol                 nfc110_get_protocol
 #define nfc110_ble_set_protocol                 nfc110_set_protocol
 #define nfc110_ble_set_rf_speed                 nfc110_set_rf_speed
+#define nfc110_ble_update_protocol              nfc110_update_protocol
+#define nfc110_ble_update_rf_speed              nfc110_update_rf_speed
+#define nfc110_ble_has_protocol_shadow          nfc110_has_protocol_shadow
 #define nfc110_ble_claer_rx_queue               nfc110_clear_rx_queue
 #define nfc110_ble_get_ack_time                 nfc110_get_ack_time
+#define nfc110_ble_get_ack_time_usec            nfc110_get_ack_time_usec
 #define nfc110_ble_get_version_information      nfc110_get_version_information
 #define nfc110_ble_get_battery_information      nfc110_get_battery_information
 #define nfc110_ble_set_alarm                    nfc110_set_alarm
@@ -93,6 +98,18 @@ UINT32 nfc110_ble_raw_read(
     UINT32* read_len,
     UINT32 time0,
     UINT32 timeout);
+UINT32 nfc110_ble_raw_write_until(
+    ICS_HANDLE handle,
+    const UINT8* data,
+    UINT32 data_len,
+    const utl_deadline_t* deadline);
+UINT32 nfc110_ble_raw_read_until(
+    ICS_HANDLE handle,
+    UINT32 min_read_len,
+    UINT32 max_read_len,
+    UINT8* data,
+    UINT32* read_len,
+    const utl_deadline_t* deadline);
 UINT32 nfc110_ble_raw_clear_rx_queue(
     ICS_HANDLE handle);
 UINT32 nfc110_ble_raw_drain_tx_queue(
@@ -116,6 +133,8 @@ UINT32 nfc110_ble_raw_set_cb_parameter(
     INT32 rssi,
     UINT32 readch_timeout,
     UINT32 notifych_timeout);
+UINT32 nfc110_ble_raw_set_max_connections(
+    UINT32 max_connections);
 UINT32 nfc110_ble_raw_get_attribute(
     ICS_HANDLE handle,
     void* arg);
@@ -138,6 +157,8 @@ static const icsdrv_raw_func_t nfc110_ble_raw_func = {
     nfc110_ble_raw_drain_tx_queue,
     0,
     (void*)&nfc110_raw_ext_func,
+    nfc110_ble_raw_write_until,
+    nfc110_ble_raw_read_until,
 };
 
 #ifdef __cplusplus
@@ -0,0 +1,280 @@
+/**
+ * \brief    a header file for the simulated NFC Port-110 module
+ * \date     2026/10/17
+ * \author   Copyright 2013 Sony Corporation
+ */
+
+#include "ics_types.h"
+#include "ics_hwdev.h"
+#include "icsdrv.h"
+#include "nfc110.h"
+
+#ifndef NFC110_SIM_H_
+#define NFC110_SIM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Constant
+ */
+
+#define NFC110_SIM_MAX_CARDS                    4
+#define NFC110_SIM_FRAME_BUF_LEN                (8 + 2 + NFC110_MAX_TRANSMIT_DATA_LEN + 8)
+#define NFC110_SIM_RX_BUF_LEN                   (4 * NFC110_SIM_FRAME_BUF_LEN)
+#define NFC110_SIM_RX_MAX_PACKETS               256
+
+#define NFC110_SIM_DEFAULT_MTU                  20    /* ATT payload */
+#define NFC110_SIM_DEFAULT_LL_DATA_LEN          27    /* 251: with DLE */
+#define NFC110_SIM_DEFAULT_TX_PACKET_USEC       30000 /* write with response */
+#define NFC110_SIM_DEFAULT_TX_CREDITS            4     /* without response */
+#define NFC110_SIM_DEFAULT_TX_PDUS_PER_EVENT     4
+#define NFC110_SIM_DEFAULT_RX_PACKET_USEC       7500  /* notification */
+#define NFC110_SIM_DEFAULT_RX_PDUS_PER_EVENT     4
+#define NFC110_SIM_DEFAULT_COMMAND_USEC         1000
+#define NFC110_SIM_DEFAULT_CARD_TIME_PERCENT    50
+#define NFC110_SIM_DEFAULT_FIRMWARE_VERSION     0x0113
+
+/* the L2CAP header and the ATT header in front of a packet */
+#define NFC110_SIM_ATT_HEADER_LEN               7
+
+/* SmartTag card */
+#define NFC110_SIM_CARD_SYSTEM_CODE             0xfee1
+#define NFC110_SIM_CARD_SERVICE_CODE            0x0009
+#define NFC110_SIM_CARD_NUM_OF_BLOCKS           12
+#define NFC110_SIM_CARD_BLOCK_LEN               16
+#define NFC110_SIM_CARD_FRAME_DATA_LEN \
+    ((NFC110_SIM_CARD_NUM_OF_BLOCKS - 1) * NFC110_SIM_CARD_BLOCK_LEN)
+#define NFC110_SIM_CARD_MAX_FRAMES              33
+#define NFC110_SIM_CARD_MAX_DATA_LEN \
+    (NFC110_SIM_CARD_MAX_FRAMES * NFC110_SIM_CARD_FRAME_DATA_LEN)
+#define NFC110_SIM_CARD_DEFAULT_DISPLAY_USEC    1500000
+#define NFC110_SIM_CARD_DEFAULT_BATTERY         0x00
+#define NFC110_SIM_CARD_DEFAULT_VERSION         0x01
+#define NFC110_SIM_CARD_SHOW_DISPLAY2_VERSION   0x02 /* partial update */
+#define NFC110_SIM_CARD_CODEC_VERSION           0x03 /* compressed image */
+
+/* SmartTag functions */
+#define NFC110_SIM_CARD_FUNC_CHECK_STATUS       0xd0
+#define NFC110_SIM_CARD_FUNC_SHOW_DISPLAY       0xa0
+#define NFC110_SIM_CARD_FUNC_CLEAR_DISPLAY      0xa1
+#define NFC110_SIM_CARD_FUNC_SHOW_DISPLAY2      0xa2
+#define NFC110_SIM_CARD_FUNC_DATA_WRITE         0xb0
+#define NFC110_SIM_CARD_FUNC_SAVE_LAYOUT        0xb2
+#define NFC110_SIM_CARD_FUNC_DATA_READ          0xc0
+#define NFC110_SIM_CARD_FUNC_DEMO               0x30
+
+/* SmartTag status */
+#define NFC110_SIM_CARD_STS_RESET               0x00
+#define NFC110_SIM_CARD_STS_COMPLETE            0xf0
+#define NFC110_SIM_CARD_STS_WAIT_COMMAND        0xf1
+#define NFC110_SIM_CARD_STS_IN_PROGRESS         0xf2
+#define NFC110_SIM_CARD_STS_ADDRESS_ERROR       0xf3
+#define NFC110_SIM_CARD_STS_LENGTH_ERROR        0xf4
+#define NFC110_SIM_CARD_STS_SIZE_ERROR          0xf6
+#define NFC110_SIM_CARD_STS_UNDEFINED_FUNCTION  0xf7
+#define NFC110_SIM_CARD_STS_PARAMETER_ERROR     0xf8
+#define NFC110_SIM_CARD_STS_DATA_ERROR          0xff
+
+/*
+ * Type and structure
+ */
+
+typedef struct nfc110_sim_config_t {
+    UINT32 mtu;                 /* bytes per BLE packet (ATT MTU - 3) */
+    UINT32 ll_data_len;         /* bytes per link layer PDU; a packet is
+                                   sent in one or more PDUs */
+    UINT32 tx_packet_usec;      /* time to write a packet to the device
+                                   (two connection intervals) */
+    UINT32 tx_credits;          /* packets written without response before
+                                   a write with response (0: always with) */
+    UINT32 tx_pdus_per_event;   /* PDUs without response per
+                                   connection event */
+    UINT32 rx_packet_usec;      /* time to notify a packet to the host
+                                   (a connection interval) */
+    UINT32 rx_pdus_per_event;   /* PDUs of notifications per
+                                   connection event */
+    UINT32 command_usec;        /* firmware time per command */
+    UINT32 card_time_percent;   /* card response time / PMm maximum */
+    UINT32 rf_error_per_mille;  /* dropped RF exchanges per 1000 */
+    UINT32 seed;                /* seed of the time slots and errors */
+    BOOL realtime;              /* sleep for the simulated time */
+} nfc110_sim_config_t;
+
+typedef struct nfc110_sim_stat_t {
+    UINT64 time_usec;           /* simulated time */
+    UINT32 num_of_frames;
+    UINT32 num_of_acks;
+    UINT32 num_of_invalid_frames;
+    UINT32 num_of_tx_packets;
+    UINT32 num_of_rx_packets;
+    UINT32 num_of_tx_bytes;
+    UINT32 num_of_tx_pdus;
+    UINT32 num_of_tx_intervals; /* connection intervals spent on writes */
+    UINT32 num_of_rx_bytes;
+    UINT32 num_of_rx_pdus;
+    UINT32 num_of_rx_intervals; /* connection intervals spent on notifies */
+    UINT32 num_of_in_set_rf;
+    UINT32 num_of_in_set_protocol;
+    UINT32 num_of_switch_rf;
+    UINT32 num_of_in_comm_rf;
+    UINT32 num_of_rf_timeouts;
+    UINT32 num_of_read_timeouts;
+} nfc110_sim_stat_t;
+
+typedef struct nfc110_sim_card_t {
+    BOOL present;
+    UINT8 idm[8];
+    UINT8 pmm[8];
+    UINT16 system_code;
+    UINT8 battery;
+    UINT8 version;
+    UINT32 display_usec;
+
+    /* SmartTag state */
+    UINT8 status;
+    UINT8 func;
+    UINT8 fsum;
+    UINT8 fnum;
+    UINT8 seq;
+    UINT64 busy_until;
+    UINT8 blocks[NFC110_SIM_CARD_NUM_OF_BLOCKS][NFC110_SIM_CARD_BLOCK_LEN];
+    UINT8 data[NFC110_SIM_CARD_MAX_DATA_LEN];
+    UINT32 data_len;
+    UINT8 display[NFC110_SIM_CARD_MAX_DATA_LEN]; /* the shown image */
+    UINT8 user_data[NFC110_SIM_CARD_FRAME_DATA_LEN];
+    UINT32 user_data_len;
+    UINT32 num_of_refreshes;
+} nfc110_sim_card_t;
+
+/*
+ * Prototype declaration
+ */
+
+/* driver functions */
+UINT32 nfc110_sim_open(
+    ICS_HW_DEVICE* nfc110,
+    const char* port_name);
+
+static const icsdrv_basic_func_t nfc110_sim_basic_func = {
+    "nfc110_sim",
+    nfc110_sim_open,
+    nfc110_close,
+    nfc110_initialize_device,
+    nfc110_ping,
+    nfc110_reset,
+    nfc110_execute_command,
+    nfc110_cancel_command,
+    nfc110_felica_command,
+    NFC110_MAX_FELICA_COMMAND_LEN,
+    NFC110_MAX_FELICA_RESPONSE_LEN,
+    nfc110_rf_off,
+    nfc110_rf_on,
+    NULL, /* set dev speed */
+    NULL, /* set speed */
+    0,
+    NULL,
+};
+
+/* raw functions */
+UINT32 nfc110_sim_raw_open(
+    ICS_HANDLE* handle,
+    const char* port_name);
+UINT32 nfc110_sim_raw_close(
+    ICS_HANDLE handle);
+UINT32 nfc110_sim_raw_write(
+    ICS_HANDLE handle,
+    const UINT8* data,
+    UINT32 data_len,
+    UINT32 time0,
+    UINT32 timeout);
+UINT32 nfc110_sim_raw_read(
+    ICS_HANDLE handle,
+    UINT32 min_read_len,
+    UINT32 max_read_len,
+    UINT8* data,
+    UINT32* read_len,
+    UINT32 time0,
+    UINT32 timeout);
+UINT32 nfc110_sim_raw_write_until(
+    ICS_HANDLE handle,
+    const UINT8* data,
+    UINT32 data_len,
+    const utl_deadline_t* deadline);
+UINT32 nfc110_sim_raw_read_until(
+    ICS_HANDLE handle,
+    UINT32 min_read_len,
+    UINT32 max_read_len,
+    UINT8* data,
+    UINT32* read_len,
+    const utl_deadline_t* deadline);
+UINT32 nfc110_sim_raw_clear_rx_queue(
+    ICS_HANDLE handle);
+UINT32 nfc110_sim_raw_drain_tx_queue(
+    ICS_HANDLE handle);
+UINT32 nfc110_sim_raw_get_attribute(
+    ICS_HANDLE handle,
+    void* arg);
+
+static const nfc110_raw_ext_func_t nfc110_sim_raw_ext_func = {
+    nfc110_sim_raw_get_attribute,
+    NULL,
+    NULL,
+    NULL,
+};
+
+static const icsdrv_raw_func_t nfc110_sim_raw_func = {
+    "nfc110_sim",
+    nfc110_sim_raw_open,
+    nfc110_sim_raw_close,
+    nfc110_sim_raw_write,
+    nfc110_sim_raw_read,
+    NULL,
+    nfc110_sim_raw_clear_rx_queue,
+    nfc110_sim_raw_drain_tx_queue,
+    0,
+    (void*)&nfc110_sim_raw_ext_func,
+    nfc110_sim_raw_write_until,
+    nfc110_sim_raw_read_until,
+};
+
+/* simulator control */
+void nfc110_sim_get_default_config(
+    nfc110_sim_config_t* config);
+UINT32 nfc110_sim_set_config(
+    const nfc110_sim_config_t* config);
+nfc110_sim_card_t* nfc110_sim_get_card(
+    UINT32 index);
+UINT32 nfc110_sim_get_stat(
+    nfc110_sim_stat_t* stat);
+void nfc110_sim_clear_stat(void);
+UINT64 nfc110_sim_get_time_usec(void);
+void nfc110_sim_wait(
+    UINT64 usec);
+
+/* card functions */
+void nfc110_sim_card_initialize(
+    nfc110_sim_card_t* card,
+    const UINT8 idm[8]);
+BOOL nfc110_sim_card_polling(
+    nfc110_sim_card_t* card,
+    UINT64 now,
+    UINT16 system_code,
+    UINT8 request_code,
+    UINT8* response,
+    UINT32* response_len);
+UINT32 nfc110_sim_card_command(
+    nfc110_sim_card_t* card,
+    UINT64 now,
+    const UINT8* command,
+    UINT32 command_len,
+    UINT8* response,
+    UINT32* response_len,
+    UINT32* card_usec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !NFC110_SIM_H_ */
@@ -0,0 +1,109 @@
+/**
+ * \brief    the header file for the cache of the SmartTag metadata
+ * \date     2026/10/17
+ * \author   Copyright 2013 Sony Corporation
+ */
+
+#include <pthread.h>
+
+#include "ics_types.h"
+
+#ifndef SMARTTAG_CACHE_H_
+#define SMARTTAG_CACHE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Constant
+ */
+
+#define SMARTTAG_CACHE_IDM_LEN          8
+#define SMARTTAG_CACHE_MAX_ENTRIES      256 /* power of 2 */
+#define SMARTTAG_CACHE_MAX_PROBES       8
+#define SMARTTAG_CACHE_MAX_BATTERIES    8
+#define SMARTTAG_CACHE_MAX_LAYOUTS      32
+
+/* the hash of no frame */
+#define SMARTTAG_CACHE_NO_HASH          0
+
+/* the file */
+#define SMARTTAG_CACHE_FILE_MAGIC       "STCA"
+#define SMARTTAG_CACHE_FILE_VERSION     1
+
+/*
+ * Type and structure
+ */
+
+typedef struct smarttag_cache_entry_t {
+    UINT8 idm[SMARTTAG_CACHE_IDM_LEN];  /* all 0: empty */
+    UINT8 type;                 /* given by the caller */
+    UINT8 version;
+    UINT8 status;               /* of the last status check */
+    UINT8 num_of_batteries;
+    UINT8 batteries[SMARTTAG_CACHE_MAX_BATTERIES]; /* the latest first */
+    UINT32 frame_hash;          /* the shown frame */
+    UINT32 layouts;             /* bit n: layout n is registered */
+    UINT32 layout_hashes[SMARTTAG_CACHE_MAX_LAYOUTS];
+    UINT64 status_time;         /* the last status check (s, UTC) */
+    UINT64 write_time;          /* the last write after it (0: none) */
+    UINT64 touch_time;          /* the last update (for eviction) */
+} smarttag_cache_entry_t;
+
+typedef struct smarttag_cache_file_t {
+    UINT8 magic[4];             /* SMARTTAG_CACHE_FILE_MAGIC */
+    UINT32 version;             /* SMARTTAG_CACHE_FILE_VERSION */
+    UINT32 num_of_entries;      /* SMARTTAG_CACHE_MAX_ENTRIES */
+    UINT32 entry_len;           /* sizeof(smarttag_cache_entry_t) */
+    smarttag_cache_entry_t entries[SMARTTAG_CACHE_MAX_ENTRIES];
+} smarttag_cache_file_t;
+
+typedef struct smarttag_cache_t {
+    int fd;
+    smarttag_cache_file_t* file;
+    pthread_mutex_t mutex;
+} smarttag_cache_t;
+
+/*
+ * Prototype declaration
+ */
+
+UINT32 smarttag_cache_open(
+    smarttag_cache_t* cache,
+    const char* path);
+UINT32 smarttag_cache_close(
+    smarttag_cache_t* cache);
+UINT32 smarttag_cache_get(
+    smarttag_cache_t* cache,
+    const UINT8* idm,
+    smarttag_cache_entry_t* entry);
+UINT32 smarttag_cache_set_status(
+    smarttag_cache_t* cache,
+    const UINT8* idm,
+    UINT8 type,
+    UINT8 status,
+    UINT8 battery,
+    UINT8 version);
+UINT32 smarttag_cache_set_written(
+    smarttag_cache_t* cache,
+    const UINT8* idm,
+    UINT32 frame_hash);
+UINT32 smarttag_cache_set_layout(
+    smarttag_cache_t* cache,
+    const UINT8* idm,
+    UINT32 layout);
+UINT32 smarttag_cache_remove(
+    smarttag_cache_t* cache,
+    const UINT8* idm);
+UINT32 smarttag_cache_hash(
+    const UINT8* data,
+    UINT32 len);
+INT32 smarttag_cache_get_battery_trend(
+    const smarttag_cache_entry_t* entry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !SMARTTAG_CACHE_H_ */
@@ -18,13 +18,35 @@ extern "C" {
 void utl_srand(UINT32 seed);
 UINT32 utl_rand(void);
 
+#define UTL_NSEC_PER_USEC 1000ULL
+#define UTL_NSEC_PER_MSEC 1000000ULL
+
+/* a point of time on the monotonic clock of utl_get_time_nsec() */
+typedef struct utl_deadline_t {
+    UINT64 time_nsec;
+} utl_deadline_t;
+
+UINT64 utl_get_time_nsec(void);
 UINT32 utl_get_time_msec(void);
+UINT64 utl_get_time_usec(void);
 
 UINT32 utl_get_rest_timeout(
     UINT32 time0,
     UINT32 timeout,
     UINT32* current_time);
 
+void utl_deadline_set(
+    utl_deadline_t* deadline,
+    UINT64 timeout_nsec);
+void utl_deadline_set_msec(
+    utl_deadline_t* deadline,
+    UINT32 time0,
+    UINT32 timeout);
+UINT64 utl_deadline_get_rest_nsec(
+    const utl_deadline_t* deadline);
+UINT32 utl_deadline_get_rest_msec(
+    const utl_deadline_t* deadline);
+
 UINT32 utl_msleep(UINT32 msec);
 
 /* ANSI C library */
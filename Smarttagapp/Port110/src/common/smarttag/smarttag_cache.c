@@ -0,0 +1,553 @@
+/**
+ * \brief    the cache of the SmartTag metadata
+ * \date     2026/10/17
+ * \author   Copyright 2013 Sony Corporation
+ */
+
+/*
+ * The metadata of the SmartTags (the type, the firmware version, the
+ * batteries, the status, the shown frame and the registered layouts)
+ * are kept per IDm in a file which is mapped into memory, so they
+ * survive the restarts of the application.
+ *
+ * The entries are a hash table of fixed size: an IDm is looked up in
+ * SMARTTAG_CACHE_MAX_PROBES entries from its slot, and the least
+ * recently updated one of them is evicted for a new IDm. An update is
+ * written back asynchronously; the cache is a hint only, so an entry
+ * which was torn by a crash at worst costs a redundant round trip.
+ */
+
+#undef ICSLOG_MODULE
+#define ICSLOG_MODULE "STC"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "ics_types.h"
+#include "ics_error.h"
+#include "icslib_chk.h"
+#include "icslog.h"
+#include "utl.h"
+
+#include "smarttag_cache.h"
+
+/* --------------------------------
+ * Constant
+ * -------------------------------- */
+
+#define SMARTTAG_CACHE_ENTRY_MASK       (SMARTTAG_CACHE_MAX_ENTRIES - 1)
+
+/* FNV-1a (32 bits) */
+#define SMARTTAG_CACHE_FNV_OFFSET       2166136261U
+#define SMARTTAG_CACHE_FNV_PRIME        16777619U
+
+/* --------------------------------
+ * Prototype Declaration
+ * -------------------------------- */
+
+static smarttag_cache_entry_t* smarttag_cache_find(
+    smarttag_cache_t* cache,
+    const UINT8* idm,
+    BOOL create);
+static void smarttag_cache_sync(
+    const smarttag_cache_entry_t* entry);
+static BOOL smarttag_cache_is_valid_idm(
+    const UINT8* idm);
+
+/* --------------------------------
+ * Function
+ * -------------------------------- */
+
+/* ------------------------
+ * Exported
+ * ------------------------ */
+
+/**
+ * This function opens the cache file, or creates it if it does not
+ * exist or is of another version.
+ *
+ * \param  cache                 [OUT] The cache.
+ * \param  path                   [IN] The path of the file.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_IO                Failed to open the file.
+ * \retval ICS_ERROR_NO_RESOURCES      Failed to map the file.
+ */
+UINT32 smarttag_cache_open(
+    smarttag_cache_t* cache,
+    const char* path)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "smarttag_cache_open"
+    smarttag_cache_file_t* file;
+    struct stat st;
+    int fd;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(cache, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(path, NULL, ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_STR(path);
+
+    fd = open(path, (O_RDWR | O_CREAT), 0644);
+    if (fd < 0) {
+        ICSLOG_ERR_STR(ICS_ERROR_IO, "open()");
+        return ICS_ERROR_IO;
+    }
+    if ((fstat(fd, &st) != 0) ||
+        ((st.st_size != (off_t)sizeof(*file)) &&
+         ((ftruncate(fd, 0) != 0) ||
+          (ftruncate(fd, (off_t)sizeof(*file)) != 0)))) {
+        ICSLOG_ERR_STR(ICS_ERROR_IO, "ftruncate()");
+        close(fd);
+        return ICS_ERROR_IO;
+    }
+
+    file = (smarttag_cache_file_t*)mmap(NULL, sizeof(*file),
+                                        (PROT_READ | PROT_WRITE),
+                                        MAP_SHARED, fd, 0);
+    if (file == (smarttag_cache_file_t*)MAP_FAILED) {
+        ICSLOG_ERR_STR(ICS_ERROR_NO_RESOURCES, "mmap()");
+        close(fd);
+        return ICS_ERROR_NO_RESOURCES;
+    }
+
+    if ((utl_memcmp(file->magic, SMARTTAG_CACHE_FILE_MAGIC,
+                    sizeof(file->magic)) != 0) ||
+        (file->version != SMARTTAG_CACHE_FILE_VERSION) ||
+        (file->num_of_entries != SMARTTAG_CACHE_MAX_ENTRIES) ||
+        (file->entry_len != sizeof(smarttag_cache_entry_t))) {
+        ICSLOG_DBG_PRINT(("create the entries\n"));
+        utl_memset(file, 0, sizeof(*file));
+        utl_memcpy(file->magic, SMARTTAG_CACHE_FILE_MAGIC,
+                   sizeof(file->magic));
+        file->version = SMARTTAG_CACHE_FILE_VERSION;
+        file->num_of_entries = SMARTTAG_CACHE_MAX_ENTRIES;
+        file->entry_len = sizeof(smarttag_cache_entry_t);
+        msync(file, sizeof(*file), MS_SYNC);
+    }
+
+    cache->fd = fd;
+    cache->file = file;
+    pthread_mutex_init(&cache->mutex, NULL);
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function writes back and closes the cache file.
+ *
+ * \param  cache                  [IN] The cache.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_NOT_OPENED        Not opened.
+ */
+UINT32 smarttag_cache_close(
+    smarttag_cache_t* cache)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "smarttag_cache_close"
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(cache, NULL, ICS_ERROR_INVALID_PARAM);
+    if (cache->file == NULL) {
+        ICSLOG_ERR_STR(ICS_ERROR_NOT_OPENED, "not opened");
+        return ICS_ERROR_NOT_OPENED;
+    }
+
+    msync(cache->file, sizeof(*cache->file), MS_SYNC);
+    munmap(cache->file, sizeof(*cache->file));
+    close(cache->fd);
+    pthread_mutex_destroy(&cache->mutex);
+    cache->file = NULL;
+    cache->fd = -1;
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function copies the entry of an IDm.
+ *
+ * \param  cache                  [IN] The cache.
+ * \param  idm                    [IN] The IDm. (8 bytes)
+ * \param  entry                 [OUT] The entry.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_NOT_EXIST         No entry of the IDm.
+ */
+UINT32 smarttag_cache_get(
+    smarttag_cache_t* cache,
+    const UINT8* idm,
+    smarttag_cache_entry_t* entry)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "smarttag_cache_get"
+    const smarttag_cache_entry_t* found;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(cache, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(cache->file, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(idm, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_EQ(smarttag_cache_is_valid_idm(idm), TRUE,
+                     ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(entry, NULL, ICS_ERROR_INVALID_PARAM);
+
+    pthread_mutex_lock(&cache->mutex);
+    found = smarttag_cache_find(cache, idm, FALSE);
+    if (found != NULL) {
+        *entry = *found;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+
+    if (found == NULL) {
+        ICSLOG_FUNC_END;
+        return ICS_ERROR_NOT_EXIST;
+    }
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function records the result of a status check. The battery is
+ * added to the history.
+ *
+ * \param  cache                  [IN] The cache.
+ * \param  idm                    [IN] The IDm. (8 bytes)
+ * \param  type                   [IN] The type of the SmartTag.
+ * \param  status                 [IN] The status. (header block [3])
+ * \param  battery                [IN] The battery. (header block [5])
+ * \param  version                [IN] The version. (header block [15])
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ */
+UINT32 smarttag_cache_set_status(
+    smarttag_cache_t* cache,
+    const UINT8* idm,
+    UINT8 type,
+    UINT8 status,
+    UINT8 battery,
+    UINT8 version)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "smarttag_cache_set_status"
+    smarttag_cache_entry_t* entry;
+    UINT32 i;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(cache, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(cache->file, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(idm, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_EQ(smarttag_cache_is_valid_idm(idm), TRUE,
+                     ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_HEX8(status);
+    ICSLOG_DBG_HEX8(battery);
+    ICSLOG_DBG_HEX8(version);
+
+    pthread_mutex_lock(&cache->mutex);
+    entry = smarttag_cache_find(cache, idm, TRUE);
+
+    entry->type = type;
+    entry->status = status;
+    entry->version = version;
+    for (i = (SMARTTAG_CACHE_MAX_BATTERIES - 1); i > 0; i--) {
+        entry->batteries[i] = entry->batteries[i - 1];
+    }
+    entry->batteries[0] = battery;
+    if (entry->num_of_batteries < SMARTTAG_CACHE_MAX_BATTERIES) {
+        entry->num_of_batteries++;
+    }
+    entry->status_time = (UINT64)time(NULL);
+    entry->write_time = 0;
+    entry->touch_time = entry->status_time;
+
+    smarttag_cache_sync(entry);
+    pthread_mutex_unlock(&cache->mutex);
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function records a write which changed the display. The status
+ * of the last check is outdated until the SmartTag completes the write.
+ *
+ * \param  cache                  [IN] The cache.
+ * \param  idm                    [IN] The IDm. (8 bytes)
+ * \param  frame_hash             [IN] smarttag_cache_hash() of the shown
+ *                                     frame. (SMARTTAG_CACHE_NO_HASH:
+ *                                     unknown)
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ */
+UINT32 smarttag_cache_set_written(
+    smarttag_cache_t* cache,
+    const UINT8* idm,
+    UINT32 frame_hash)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "smarttag_cache_set_written"
+    smarttag_cache_entry_t* entry;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(cache, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(cache->file, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(idm, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_EQ(smarttag_cache_is_valid_idm(idm), TRUE,
+                     ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_HEX(frame_hash);
+
+    pthread_mutex_lock(&cache->mutex);
+    entry = smarttag_cache_find(cache, idm, TRUE);
+
+    entry->frame_hash = frame_hash;
+    entry->write_time = (UINT64)time(NULL);
+    entry->touch_time = entry->write_time;
+
+    smarttag_cache_sync(entry);
+    pthread_mutex_unlock(&cache->mutex);
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function records that the shown frame was registered as a
+ * layout. Registering is a write, too.
+ *
+ * \param  cache                  [IN] The cache.
+ * \param  idm                    [IN] The IDm. (8 bytes)
+ * \param  layout                 [IN] The number of the layout.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ */
+UINT32 smarttag_cache_set_layout(
+    smarttag_cache_t* cache,
+    const UINT8* idm,
+    UINT32 layout)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "smarttag_cache_set_layout"
+    smarttag_cache_entry_t* entry;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(cache, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(cache->file, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(idm, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_EQ(smarttag_cache_is_valid_idm(idm), TRUE,
+                     ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_LE(layout, (SMARTTAG_CACHE_MAX_LAYOUTS - 1),
+                     ICS_ERROR_INVALID_PARAM);
+
+    ICSLOG_DBG_UINT(layout);
+
+    pthread_mutex_lock(&cache->mutex);
+    entry = smarttag_cache_find(cache, idm, TRUE);
+
+    entry->layouts |= (1U << layout);
+    entry->layout_hashes[layout] = entry->frame_hash;
+    entry->write_time = (UINT64)time(NULL);
+    entry->touch_time = entry->write_time;
+
+    smarttag_cache_sync(entry);
+    pthread_mutex_unlock(&cache->mutex);
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function removes the entry of an IDm, e.g. when the SmartTag
+ * answered otherwise than cached.
+ *
+ * \param  cache                  [IN] The cache.
+ * \param  idm                    [IN] The IDm. (8 bytes)
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_NOT_EXIST         No entry of the IDm.
+ */
+UINT32 smarttag_cache_remove(
+    smarttag_cache_t* cache,
+    const UINT8* idm)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "smarttag_cache_remove"
+    smarttag_cache_entry_t* entry;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(cache, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(cache->file, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(idm, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_EQ(smarttag_cache_is_valid_idm(idm), TRUE,
+                     ICS_ERROR_INVALID_PARAM);
+
+    pthread_mutex_lock(&cache->mutex);
+    entry = smarttag_cache_find(cache, idm, FALSE);
+    if (entry != NULL) {
+        utl_memset(entry, 0, sizeof(*entry));
+        smarttag_cache_sync(entry);
+    }
+    pthread_mutex_unlock(&cache->mutex);
+
+    if (entry == NULL) {
+        ICSLOG_FUNC_END;
+        return ICS_ERROR_NOT_EXIST;
+    }
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function returns the hash (FNV-1a) of a frame.
+ *
+ * \param  data                   [IN] The frame.
+ * \param  len                    [IN] The length of the frame.
+ *
+ * \return The hash. (never SMARTTAG_CACHE_NO_HASH)
+ */
+UINT32 smarttag_cache_hash(
+    const UINT8* data,
+    UINT32 len)
+{
+    UINT32 hash;
+    UINT32 i;
+
+    hash = SMARTTAG_CACHE_FNV_OFFSET;
+    for (i = 0; i < len; i++) {
+        hash = ((hash ^ data[i]) * SMARTTAG_CACHE_FNV_PRIME);
+    }
+    if (hash == SMARTTAG_CACHE_NO_HASH) {
+        hash = 1;
+    }
+
+    return hash;
+}
+
+/**
+ * This function returns the trend of the batteries: the latest minus
+ * the oldest in the history. (The battery grows as it runs down.)
+ *
+ * \param  entry                  [IN] The entry.
+ *
+ * \return The trend. (positive: running down)
+ */
+INT32 smarttag_cache_get_battery_trend(
+    const smarttag_cache_entry_t* entry)
+{
+    if (entry->num_of_batteries == 0) {
+        return 0;
+    }
+
+    return ((INT32)entry->batteries[0] -
+            (INT32)entry->batteries[entry->num_of_batteries - 1]);
+}
+
+/* ------------------------
+ * Internal
+ * ------------------------ */
+
+/**
+ * This function looks up the entry of an IDm. (Call with the mutex.)
+ *
+ * \param  cache                  [IN] The cache.
+ * \param  idm                    [IN] The IDm. (8 bytes)
+ * \param  create                 [IN] TRUE: create the entry if none.
+ *
+ * \return The entry. (NULL: none)
+ */
+static smarttag_cache_entry_t* smarttag_cache_find(
+    smarttag_cache_t* cache,
+    const UINT8* idm,
+    BOOL create)
+{
+    smarttag_cache_entry_t* entry;
+    smarttag_cache_entry_t* empty;
+    smarttag_cache_entry_t* oldest;
+    UINT32 slot;
+    UINT32 i;
+
+    slot = smarttag_cache_hash(idm, SMARTTAG_CACHE_IDM_LEN);
+    empty = NULL;
+    oldest = NULL;
+    for (i = 0; i < SMARTTAG_CACHE_MAX_PROBES; i++) {
+        entry = &cache->file->entries[(slot + i) & SMARTTAG_CACHE_ENTRY_MASK];
+        if (utl_memcmp(entry->idm, idm, SMARTTAG_CACHE_IDM_LEN) == 0) {
+            return entry;
+        }
+        if (!smarttag_cache_is_valid_idm(entry->idm)) {
+            if (empty == NULL) {
+                empty = entry;
+            }
+        } else if ((oldest == NULL) ||
+                   (entry->touch_time < oldest->touch_time)) {
+            oldest = entry;
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+
+    entry = ((empty != NULL) ? empty : oldest);
+    ICSLOG_DBG_PRINT(("%s entry %u\n",
+                      ((empty != NULL) ? "new" : "evict"),
+                      (UINT32)(entry - cache->file->entries)));
+    utl_memset(entry, 0, sizeof(*entry));
+    utl_memcpy(entry->idm, idm, SMARTTAG_CACHE_IDM_LEN);
+
+    return entry;
+}
+
+/**
+ * This function writes back the pages of an entry asynchronously.
+ *
+ * \param  entry                  [IN] The entry.
+ */
+static void smarttag_cache_sync(
+    const smarttag_cache_entry_t* entry)
+{
+    unsigned long page_len;
+    unsigned long begin;
+    unsigned long end;
+
+    page_len = (unsigned long)sysconf(_SC_PAGESIZE);
+    begin = ((unsigned long)entry & ~(page_len - 1));
+    end = (unsigned long)(entry + 1);
+    msync((void*)begin, (size_t)(end - begin), MS_ASYNC);
+}
+
+/**
+ * This function checks an IDm. (All 0 marks an empty entry.)
+ *
+ * \param  idm                    [IN] The IDm. (8 bytes)
+ *
+ * \return TRUE if the IDm is not all 0.
+ */
+static BOOL smarttag_cache_is_valid_idm(
+    const UINT8* idm)
+{
+    UINT32 i;
+
+    for (i = 0; i < SMARTTAG_CACHE_IDM_LEN; i++) {
+        if (idm[i] != 0) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
@@ -0,0 +1,180 @@
+/**
+ * \brief    ICS log facilities
+ * \date     2026/10/17
+ * \author   Copyright 2013 Sony Corporation
+ */
+
+/*
+ * The runtime levels of the modules, and the dumps. A dump is handed to
+ * the sink as raw bytes; the default sink formats a line of eight bytes
+ * at a time with ICSLOG_PRINTF.
+ */
+
+#undef ICSLOG_MODULE
+#define ICSLOG_MODULE "ULG"
+
+#include "ics_types.h"
+#include "icslog.h"
+
+/* --------------------------------
+ * Constant
+ * -------------------------------- */
+
+/* the level of the modules until icslog_set_level() */
+#ifndef ICSLOG_DEFAULT_LEVEL
+#define ICSLOG_DEFAULT_LEVEL            ICSLOG_DEBUG
+#endif
+
+#define ICSLOG_MAX_DUMP_LINE_LEN        8
+
+/* --------------------------------
+ * Prototype Declaration
+ * -------------------------------- */
+
+static void icslog_print_dump(
+    const char* module,
+    const char* func,
+    const char* name,
+    const UINT8* data,
+    UINT32 len);
+
+/* --------------------------------
+ * Global Variable
+ * -------------------------------- */
+
+volatile UINT8 g_icslog_levels[ICSLOG_MAX_MODULES] = {
+    [0 ... (ICSLOG_MAX_MODULES - 1)] = ICSLOG_DEFAULT_LEVEL,
+};
+
+static icslog_dump_sink_t s_icslog_dump_sink = icslog_print_dump;
+
+/* --------------------------------
+ * Function
+ * -------------------------------- */
+
+/* ------------------------
+ * Exported
+ * ------------------------ */
+
+/**
+ * This function sets the level of a module. The logs above the level
+ * are skipped without evaluating their arguments.
+ *
+ * \param  module                 [IN] ICSLOG_MODULE of the module.
+ *                                     (NULL: all the modules)
+ * \param  level                  [IN] ICSLOG_EMERG to ICSLOG_DEBUG.
+ *                                     (0: no logs)
+ */
+void icslog_set_level(
+    const char* module,
+    UINT32 level)
+{
+    UINT32 i;
+
+    if (level > ICSLOG_DEBUG) {
+        level = ICSLOG_DEBUG;
+    }
+
+    if (module == NULL) {
+        for (i = 0; i < ICSLOG_MAX_MODULES; i++) {
+            g_icslog_levels[i] = (UINT8)level;
+        }
+    } else if ((module[0] != '\0') && (module[1] != '\0')) {
+        g_icslog_levels[ICSLOG_MODULE_SLOT(module)] = (UINT8)level;
+    }
+}
+
+/**
+ * This function returns the level of a module.
+ *
+ * \param  module                 [IN] ICSLOG_MODULE of the module.
+ *
+ * \return The level.
+ */
+UINT32 icslog_get_level(
+    const char* module)
+{
+    if ((module == NULL) || (module[0] == '\0') || (module[1] == '\0')) {
+        return ICSLOG_DEFAULT_LEVEL;
+    }
+
+    return g_icslog_levels[ICSLOG_MODULE_SLOT(module)];
+}
+
+/**
+ * This function replaces the sink of the dumps.
+ *
+ * \param  sink                   [IN] The sink. (NULL: ICSLOG_PRINTF)
+ */
+void icslog_set_dump_sink(
+    icslog_dump_sink_t sink)
+{
+    s_icslog_dump_sink = ((sink != NULL) ? sink : icslog_print_dump);
+}
+
+/**
+ * This function passes a dump to the sink. (Use ICSLOG_DUMP() which
+ * checks the level first.)
+ *
+ * \param  module                 [IN] ICSLOG_MODULE.
+ * \param  func                   [IN] ICSLOG_FUNC.
+ * \param  name                   [IN] The name of the data.
+ * \param  data                   [IN] The data.
+ * \param  len                    [IN] The length of the data.
+ */
+void icslog_dump(
+    const char* module,
+    const char* func,
+    const char* name,
+    const void* data,
+    UINT32 len)
+{
+    if (len > ICSLOG_MAX_DUMP_LEN) {
+        len = ICSLOG_MAX_DUMP_LEN;
+    }
+    (*s_icslog_dump_sink)(module, func, name, (const UINT8*)data, len);
+}
+
+/* ------------------------
+ * Internal
+ * ------------------------ */
+
+/**
+ * This function prints a dump with ICSLOG_PRINTF, a line at a time.
+ *
+ * \param  module                 [IN] ICSLOG_MODULE.
+ * \param  func                   [IN] ICSLOG_FUNC.
+ * \param  name                   [IN] The name of the data.
+ * \param  data                   [IN] The data.
+ * \param  len                    [IN] The length of the data.
+ */
+static void icslog_print_dump(
+    const char* module,
+    const char* func,
+    const char* name,
+    const UINT8* data,
+    UINT32 len)
+{
+    static const char hex[] = "0123456789abcdef";
+    char line[(ICSLOG_MAX_DUMP_LINE_LEN * 3) + 1];
+    UINT32 pos;
+    UINT32 n;
+    UINT32 i;
+
+    for (pos = 0; pos < len; pos += n) {
+        n = (len - pos);
+        if (n > ICSLOG_MAX_DUMP_LINE_LEN) {
+            n = ICSLOG_MAX_DUMP_LINE_LEN;
+        }
+        for (i = 0; i < n; i++) {
+            line[(i * 3) + 0] = ' ';
+            line[(i * 3) + 1] = hex[data[pos + i] >> 4];
+            line[(i * 3) + 2] = hex[data[pos + i] & 0x0f];
+        }
+        line[n * 3] = '\0';
+
+        ICSLOG_PRINTF("D:%s:%011lu:%s:DUMP:%s:%s\n",
+                      module, (unsigned long)utl_get_time_msec(),
+                      func, name, line);
+    }
+}
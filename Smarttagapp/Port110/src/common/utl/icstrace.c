@@ -0,0 +1,358 @@
+/**
+ * \brief    ICS trace facilities
+ * \date     2026/10/17
+ * \author   Copyright 2013 Sony Corporation
+ */
+
+/*
+ * Each thread records fixed-size events into a ring of its own, so
+ * recording takes neither a lock nor a system call. The writer fills a
+ * slot and then publishes it by advancing the head; a reader copies the
+ * published events and afterwards drops the ones which the writer may
+ * have overwritten meanwhile.
+ *
+ * The rings are assigned to the threads on their first event and are
+ * given back when the threads exit. The events of the threads beyond
+ * ICSTRACE_MAX_THREADS are counted as dropped.
+ */
+
+#undef ICSLOG_MODULE
+#define ICSLOG_MODULE "UTR"
+
+#include <pthread.h>
+
+#include "ics_types.h"
+#include "ics_error.h"
+#include "icslib_chk.h"
+#include "icslog.h"
+#include "utl.h"
+
+#include "icstrace.h"
+
+/* --------------------------------
+ * Constant
+ * -------------------------------- */
+
+#define ICSTRACE_RING_MASK              (ICSTRACE_RING_LEN - 1)
+
+/* --------------------------------
+ * Struct Declaration
+ * -------------------------------- */
+
+typedef struct icstrace_ring_t {
+    volatile UINT32 is_owned;
+    volatile UINT32 head;       /* the number of published events */
+    volatile UINT32 tail;       /* the first event after icstrace_clear() */
+    icstrace_event_t events[ICSTRACE_RING_LEN];
+} icstrace_ring_t;
+
+/* --------------------------------
+ * Prototype Declaration
+ * -------------------------------- */
+
+static void icstrace_initialize_once(void);
+static void icstrace_release_ring(void* ring);
+static icstrace_ring_t* icstrace_get_ring(void);
+
+/* --------------------------------
+ * Global Variable
+ * -------------------------------- */
+
+volatile BOOL g_icstrace_is_started = FALSE;
+
+static icstrace_ring_t s_icstrace_rings[ICSTRACE_MAX_THREADS];
+static volatile UINT32 s_icstrace_num_of_dropped;
+static UINT64 (*s_icstrace_clock_usec)(void) = utl_get_time_usec;
+static pthread_once_t s_icstrace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t s_icstrace_key;
+
+/* a thread which found no ring (not dereferenced) */
+static UINT8 s_icstrace_no_ring;
+
+/* --------------------------------
+ * Function
+ * -------------------------------- */
+
+/* ------------------------
+ * Exported
+ * ------------------------ */
+
+/**
+ * This function starts recording.
+ *
+ * \param  clock_usec             [IN] The clock of the events. (us)
+ *                                     (NULL: utl_get_time_usec())
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_NO_RESOURCES      No key for the threads.
+ */
+UINT32 icstrace_start(
+    UINT64 (*clock_usec)(void))
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "icstrace_start"
+    ICSLOG_FUNC_BEGIN;
+
+    pthread_once(&s_icstrace_once, icstrace_initialize_once);
+    if (s_icstrace_key == (pthread_key_t)-1) {
+        ICSLOG_ERR_STR(ICS_ERROR_NO_RESOURCES, "pthread_key_create()");
+        return ICS_ERROR_NO_RESOURCES;
+    }
+
+    s_icstrace_clock_usec =
+        ((clock_usec != NULL) ? clock_usec : utl_get_time_usec);
+    __sync_synchronize();
+    g_icstrace_is_started = TRUE;
+
+    ICSLOG_FUNC_END;
+    return ICS_ERROR_SUCCESS;
+}
+
+/**
+ * This function stops recording. The recorded events are kept.
+ */
+void icstrace_stop(void)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "icstrace_stop"
+    ICSLOG_FUNC_BEGIN;
+
+    g_icstrace_is_started = FALSE;
+    __sync_synchronize();
+
+    ICSLOG_FUNC_END;
+}
+
+/**
+ * This function discards the recorded events.
+ */
+void icstrace_clear(void)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "icstrace_clear"
+    UINT32 i;
+    ICSLOG_FUNC_BEGIN;
+
+    for (i = 0; i < ICSTRACE_MAX_THREADS; i++) {
+        s_icstrace_rings[i].tail = s_icstrace_rings[i].head;
+    }
+    s_icstrace_num_of_dropped = 0;
+    __sync_synchronize();
+
+    ICSLOG_FUNC_END;
+}
+
+/**
+ * This function records an event in the ring of the calling thread.
+ * (Use ICSTRACE() which is compiled out without ICSTRACE_ENABLE.)
+ *
+ * \param  type                   [IN] ICSTRACE_EVENT_*.
+ * \param  tag                    [IN] The tag of the event.
+ * \param  value                  [IN] The value of the event.
+ */
+void icstrace_record(
+    UINT8 type,
+    UINT16 tag,
+    UINT32 value)
+{
+    icstrace_ring_t* ring;
+    icstrace_event_t* event;
+    UINT32 head;
+
+    ring = icstrace_get_ring();
+    if (ring == NULL) {
+        __sync_fetch_and_add(&s_icstrace_num_of_dropped, 1);
+        return;
+    }
+
+    head = ring->head;
+    event = &ring->events[head & ICSTRACE_RING_MASK];
+    event->time_usec = (*s_icstrace_clock_usec)();
+    event->type = type;
+    event->thread = (UINT8)(ring - s_icstrace_rings);
+    event->tag = tag;
+    event->value = value;
+
+    /* publish the event */
+    __sync_synchronize();
+    ring->head = (head + 1);
+}
+
+/**
+ * This function copies the recorded events in order of time.
+ * The recording may continue meanwhile.
+ *
+ * \param  events                [OUT] The events.
+ * \param  max_events             [IN] The number of the events.
+ *                                     (ICSTRACE_MAX_THREADS *
+ *                                      ICSTRACE_RING_LEN is enough)
+ * \param  num_events            [OUT] The number of the copied events.
+ *
+ * \retval ICS_ERROR_SUCCESS           No error.
+ * \retval ICS_ERROR_INVALID_PARAM     Invalid parameter.
+ * \retval ICS_ERROR_BUF_OVERFLOW      The events are short.
+ *                                     (the oldest ones are copied)
+ */
+UINT32 icstrace_snapshot(
+    icstrace_event_t* events,
+    UINT32 max_events,
+    UINT32* num_events)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "icstrace_snapshot"
+    UINT32 rc;
+    UINT32 begin[ICSTRACE_MAX_THREADS];
+    UINT32 end[ICSTRACE_MAX_THREADS];
+    UINT32 pos[ICSTRACE_MAX_THREADS];
+    UINT32 nskip[ICSTRACE_MAX_THREADS];
+    const icstrace_event_t* event;
+    UINT32 head;
+    UINT32 n;
+    UINT32 i;
+    UINT32 j;
+    UINT32 min;
+    ICSLOG_FUNC_BEGIN;
+
+    ICSLIB_CHKARG_NE(events, NULL, ICS_ERROR_INVALID_PARAM);
+    ICSLIB_CHKARG_NE(num_events, NULL, ICS_ERROR_INVALID_PARAM);
+
+    /* the published events */
+    __sync_synchronize();
+    for (i = 0; i < ICSTRACE_MAX_THREADS; i++) {
+        end[i] = s_icstrace_rings[i].head;
+        begin[i] = s_icstrace_rings[i].tail;
+        if ((end[i] - begin[i]) > ICSTRACE_RING_LEN) {
+            begin[i] = (end[i] - ICSTRACE_RING_LEN);
+        }
+        pos[i] = begin[i];
+    }
+
+    /* merge the rings, each in order of time */
+    rc = ICS_ERROR_SUCCESS;
+    n = 0;
+    for (;;) {
+        min = ICSTRACE_MAX_THREADS;
+        for (i = 0; i < ICSTRACE_MAX_THREADS; i++) {
+            if ((pos[i] != end[i]) &&
+                ((min == ICSTRACE_MAX_THREADS) ||
+                 (s_icstrace_rings[i].events[pos[i] & ICSTRACE_RING_MASK]
+                  .time_usec <
+                  s_icstrace_rings[min].events[pos[min] & ICSTRACE_RING_MASK]
+                  .time_usec))) {
+                min = i;
+            }
+        }
+        if (min == ICSTRACE_MAX_THREADS) {
+            break;
+        }
+        if (n == max_events) {
+            rc = ICS_ERROR_BUF_OVERFLOW;
+            break;
+        }
+        event = &s_icstrace_rings[min].events[pos[min] & ICSTRACE_RING_MASK];
+        events[n] = *event;
+        events[n].thread = (UINT8)min;
+        n++;
+        pos[min]++;
+    }
+
+    /* drop the events which may have been overwritten while copying */
+    __sync_synchronize();
+    for (i = 0; i < ICSTRACE_MAX_THREADS; i++) {
+        head = s_icstrace_rings[i].head;
+        nskip[i] = 0;
+        if ((head - begin[i]) >= ICSTRACE_RING_LEN) {
+            nskip[i] = ((head - begin[i]) - ICSTRACE_RING_LEN + 1);
+        }
+    }
+    j = 0;
+    for (i = 0; i < n; i++) {
+        if (nskip[events[i].thread] > 0) {
+            nskip[events[i].thread]--;
+            continue;
+        }
+        events[j++] = events[i];
+    }
+    *num_events = j;
+
+    ICSLOG_DBG_UINT(*num_events);
+
+    ICSLOG_FUNC_END;
+    return rc;
+}
+
+/**
+ * This function makes the header of a trace file, which is followed by
+ * the events of icstrace_snapshot().
+ *
+ * \param  num_events             [IN] The number of the events.
+ * \param  header                [OUT] The header.
+ */
+void icstrace_get_file_header(
+    UINT32 num_events,
+    icstrace_file_header_t* header)
+{
+    utl_memset(header, 0, sizeof(*header));
+    utl_memcpy(header->magic, ICSTRACE_FILE_MAGIC, sizeof(header->magic));
+    header->version = ICSTRACE_FILE_VERSION;
+    header->num_of_events = num_events;
+    header->num_of_dropped = s_icstrace_num_of_dropped;
+}
+
+/* ------------------------
+ * Internal
+ * ------------------------ */
+
+/**
+ * This function creates the key of the rings of the threads.
+ */
+static void icstrace_initialize_once(void)
+{
+    if (pthread_key_create(&s_icstrace_key, icstrace_release_ring) != 0) {
+        s_icstrace_key = (pthread_key_t)-1;
+    }
+}
+
+/**
+ * This function gives back the ring of an exiting thread.
+ * The events are kept until the next owner overwrites them.
+ *
+ * \param  ring                   [IN] The ring.
+ */
+static void icstrace_release_ring(void* ring)
+{
+    if (ring == &s_icstrace_no_ring) {
+        return;
+    }
+    __sync_synchronize();
+    ((icstrace_ring_t*)ring)->is_owned = FALSE;
+}
+
+/**
+ * This function returns the ring of the calling thread.
+ *
+ * \return The ring. (NULL: no free ring)
+ */
+static icstrace_ring_t* icstrace_get_ring(void)
+{
+    void* ring;
+    UINT32 i;
+
+    ring = pthread_getspecific(s_icstrace_key);
+    if (ring == NULL) {
+        ring = &s_icstrace_no_ring;
+        for (i = 0; i < ICSTRACE_MAX_THREADS; i++) {
+            if (__sync_bool_compare_and_swap(
+                    &s_icstrace_rings[i].is_owned, FALSE, TRUE)) {
+                ring = &s_icstrace_rings[i];
+                break;
+            }
+        }
+        pthread_setspecific(s_icstrace_key, ring);
+    }
+    if (ring == &s_icstrace_no_ring) {
+        return NULL;
+    }
+
+    return (icstrace_ring_t*)ring;
+}
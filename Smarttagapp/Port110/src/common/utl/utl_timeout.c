@@ -48,3 +48,85 @@ UINT32 utl_get_rest_timeout(
     ICSLOG_FUNC_END;
     return rest_timeout;
 }
+
+/**
+ * This function sets a deadline after a time-out from now.
+ *
+ * \param  deadline              [OUT] The deadline.
+ * \param  timeout_nsec           [IN] Time-out. (ns)
+ */
+void utl_deadline_set(
+    utl_deadline_t* deadline,
+    UINT64 timeout_nsec)
+{
+    deadline->time_nsec = (utl_get_time_nsec() + timeout_nsec);
+}
+
+/**
+ * This function sets a deadline from the base time and the time-out
+ * of the millisecond APIs.
+ *
+ * \param  deadline              [OUT] The deadline.
+ * \param  time0                  [IN] The base time for time-out. (ms)
+ * \param  timeout                [IN] Time-out. (ms)
+ */
+void utl_deadline_set_msec(
+    utl_deadline_t* deadline,
+    UINT32 time0,
+    UINT32 timeout)
+{
+    UINT64 now;
+    UINT32 period;
+
+    now = utl_get_time_nsec();
+    period = ((UINT32)(now / UTL_NSEC_PER_MSEC) - time0);
+    if (period >= timeout) {
+        deadline->time_nsec = now;
+    } else {
+        deadline->time_nsec = (now + ((UINT64)(timeout - period) *
+                                      UTL_NSEC_PER_MSEC));
+    }
+}
+
+/**
+ * This function returns the rest of time until a deadline.
+ *
+ * \param  deadline               [IN] The deadline.
+ *
+ * \return The rest of time. (ns, 0: expired)
+ */
+UINT64 utl_deadline_get_rest_nsec(
+    const utl_deadline_t* deadline)
+{
+    UINT64 now;
+
+    now = utl_get_time_nsec();
+    if (now >= deadline->time_nsec) {
+        return 0;
+    }
+
+    return (deadline->time_nsec - now);
+}
+
+/**
+ * This function returns the rest of time until a deadline for the APIs
+ * in millisecond. A rest shorter than a millisecond is rounded up, so it
+ * does not expire early.
+ *
+ * \param  deadline               [IN] The deadline.
+ *
+ * \return The rest of time. (ms, 0: expired)
+ */
+UINT32 utl_deadline_get_rest_msec(
+    const utl_deadline_t* deadline)
+{
+    UINT64 rest;
+
+    rest = utl_deadline_get_rest_nsec(deadline);
+    rest = ((rest + UTL_NSEC_PER_MSEC - 1) / UTL_NSEC_PER_MSEC);
+    if (rest > 0xffffffffUL) {
+        rest = 0xffffffffUL;
+    }
+
+    return (UINT32)rest;
+}
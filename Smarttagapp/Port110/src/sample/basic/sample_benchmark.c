@@ -0,0 +1,950 @@
+/*
+ * Copyright 2013 Sony Corporation
+ */
+
+/*
+ * Throughput benchmark of the FeliCa command path
+ * (felica_cc -> felica_cc_stub_nfc110 -> nfc110 -> simulated Port-110).
+ *
+ * All times are measured on the clock of the simulator, so the results
+ * are reproducible for the same options.
+ *
+ * usage: sample_benchmark [-n iterations] [-m mtu] [-d ll_data_len]
+ *                         [-t tx_packet_us] [-r rx_packet_us]
+ *                         [-e rf_errors_per_mille] [-c tx_credits]
+ *                         [-s seed] [-T trace_file] [-L log_level] [-M]
+ *
+ * TXCI/fr is the connection intervals spent on writing a frame;
+ * -c 0 writes every packet with response.
+ *
+ * -M runs write_we_12 (a 254-byte command frame) over the MTUs from the
+ * default ATT_MTU to the longest, with and without the data length
+ * extension (-d 251), instead of the scenarios. fr/CI is the frames per
+ * connection interval of the writes and the notifications.
+ *
+ * -T records the events of the run in trace_file on the simulated clock
+ * (build with ICSTRACE_ENABLE), to be converted by sample_trace_dump.
+ *
+ * -L sets the runtime level of all the modules (build with ICSLOG_LEVEL;
+ * -L 0 measures the cost of the logs which are compiled in but off).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "felica_card.h"
+#include "felica_cc.h"
+#include "felica_cc_stub.h"
+#include "felica_poller.h"
+#include "stub/felica_cc_stub_nfc110.h"
+
+#include "ics_types.h"
+#include "ics_error.h"
+#include "ics_hwdev.h"
+#include "icsdrv.h"
+#include "utl.h"
+#include "icslog.h"
+#include "icstrace.h"
+#include "epaper.h"
+#include "nfc110_sim.h"
+
+#ifndef DEFAULT_TIMEOUT
+#define DEFAULT_TIMEOUT 400 /* ms */
+#endif
+#ifndef DEFAULT_ITERATIONS
+#define DEFAULT_ITERATIONS 1000
+#endif
+#ifndef DEFAULT_COMMAND_MAX_RETRY_TIMES
+#define DEFAULT_COMMAND_MAX_RETRY_TIMES 2
+#endif
+#define MAX_ITERATIONS 100000
+
+#define SMARTTAG_SYSTEM_CODE 0xfee1
+#define SMARTTAG_SERVICE_CODE 0x0009
+#define SMARTTAG_MAX_BLOCKS 12
+#define SMARTTAG_CHUNK_LEN 176
+#define SMARTTAG_20INCH_CHUNKS 14
+#define SMARTTAG_27INCH_CHUNKS 33
+#define SMARTTAG_STATUS_POLL_INTERVAL 100 /* ms */
+
+typedef struct benchmark_t {
+    const char* name;
+    UINT32 (*run)(UINT32 i, UINT32* nbytes);
+    UINT32 iterations;
+} benchmark_t;
+
+static ICS_HW_DEVICE s_dev;
+static felica_cc_devf_t s_devf;
+static felica_card_t s_card;
+static felica_poller_t s_poller;
+static UINT32 s_iterations = DEFAULT_ITERATIONS;
+static UINT32 s_latency[MAX_ITERATIONS];
+static UINT8 s_seq = 1;
+static UINT8 s_image[SMARTTAG_27INCH_CHUNKS * SMARTTAG_CHUNK_LEN];
+static icstrace_event_t s_trace[ICSTRACE_MAX_THREADS * ICSTRACE_RING_LEN];
+
+/*
+ * allocation counter (glibc only)
+ */
+
+static unsigned long s_num_of_allocs;
+
+#if defined(__GLIBC__)
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size)
+{
+    s_num_of_allocs++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size)
+{
+    s_num_of_allocs++;
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    s_num_of_allocs++;
+    return __libc_realloc(ptr, size);
+}
+#define ALLOCS_ARE_COUNTED 1
+#else
+#define ALLOCS_ARE_COUNTED 0
+#endif
+
+/*
+ * SmartTag commands
+ */
+
+static void make_block_list(
+    UINT8 num_of_blocks,
+    UINT8* block_list)
+{
+    UINT8 i;
+
+    for (i = 0; i < num_of_blocks; i++) {
+        block_list[(i * 2) + 0] = 0x80;
+        block_list[(i * 2) + 1] = i;
+    }
+}
+
+static UINT32 write_blocks(
+    const UINT8* block_data,
+    UINT8 num_of_blocks)
+{
+    UINT32 rc;
+    UINT32 nretries;
+    UINT16 service_code = SMARTTAG_SERVICE_CODE;
+    UINT8 block_list[SMARTTAG_MAX_BLOCKS * 2];
+    UINT8 status_flag1;
+    UINT8 status_flag2;
+
+    make_block_list(num_of_blocks, block_list);
+    ICSTRACE(ICSTRACE_EVENT_FUNC_BEGIN, ICSTRACE_TAG_WWE | block_data[0],
+             block_data[2]);
+    for (nretries = 0; nretries <= DEFAULT_COMMAND_MAX_RETRY_TIMES;
+         nretries++) {
+        if (nretries > 0) {
+            ICSTRACE(ICSTRACE_EVENT_RETRY, ICSTRACE_TAG_WWE | block_data[0],
+                     nretries);
+        }
+        rc = felica_cc_write_without_encryption(&s_devf, &s_card,
+                                                1, &service_code,
+                                                num_of_blocks, block_list,
+                                                block_data,
+                                                &status_flag1, &status_flag2,
+                                                DEFAULT_TIMEOUT);
+        if (rc != ICS_ERROR_TIMEOUT) {
+            break;
+        }
+    }
+    ICSTRACE(ICSTRACE_EVENT_FUNC_END, ICSTRACE_TAG_WWE | block_data[0], rc);
+
+    return rc;
+}
+
+static UINT32 read_blocks(
+    UINT8* block_data,
+    UINT8 num_of_blocks)
+{
+    UINT32 rc;
+    UINT32 nretries;
+    UINT16 service_code = SMARTTAG_SERVICE_CODE;
+    UINT8 block_list[SMARTTAG_MAX_BLOCKS * 2];
+    UINT8 status_flag1;
+    UINT8 status_flag2;
+
+    make_block_list(num_of_blocks, block_list);
+    ICSTRACE(ICSTRACE_EVENT_FUNC_BEGIN, ICSTRACE_TAG_RWE, num_of_blocks);
+    for (nretries = 0; nretries <= DEFAULT_COMMAND_MAX_RETRY_TIMES;
+         nretries++) {
+        if (nretries > 0) {
+            ICSTRACE(ICSTRACE_EVENT_RETRY, ICSTRACE_TAG_RWE, nretries);
+        }
+        rc = felica_cc_read_without_encryption(&s_devf, &s_card,
+                                               1, &service_code,
+                                               num_of_blocks, block_list,
+                                               block_data,
+                                               &status_flag1, &status_flag2,
+                                               DEFAULT_TIMEOUT);
+        if (rc != ICS_ERROR_TIMEOUT) {
+            break;
+        }
+    }
+    ICSTRACE(ICSTRACE_EVENT_FUNC_END, ICSTRACE_TAG_RWE, rc);
+
+    return rc;
+}
+
+static void make_header(
+    UINT8* header,
+    UINT8 func,
+    UINT8 fsum,
+    UINT8 fnum,
+    UINT8 data_len,
+    const UINT8* param)
+{
+    utl_memset(header, 0, 16);
+    header[0] = func;
+    header[1] = fsum;
+    header[2] = fnum;
+    header[3] = data_len;
+    if (func != NFC110_SIM_CARD_FUNC_CHECK_STATUS) {
+        header[4] = s_seq;
+        s_seq = (UINT8)((s_seq % 255) + 1);
+        header[5] = '0';
+        header[6] = '0';
+        header[7] = '0';
+    }
+    if (param != NULL) {
+        utl_memcpy(header + 8, param, 8);
+    }
+}
+
+static UINT32 check_status(
+    UINT8* status)
+{
+    UINT32 rc;
+    UINT8 block_data[SMARTTAG_MAX_BLOCKS * 16];
+
+    make_header(block_data, NFC110_SIM_CARD_FUNC_CHECK_STATUS, 1, 1, 0, NULL);
+    rc = write_blocks(block_data, 1);
+    if (rc != ICS_ERROR_SUCCESS) {
+        return rc;
+    }
+    rc = read_blocks(block_data, 2);
+    if (rc != ICS_ERROR_SUCCESS) {
+        return rc;
+    }
+    *status = block_data[3];
+
+    return ICS_ERROR_SUCCESS;
+}
+
+static UINT32 wait_display(void)
+{
+    UINT32 rc;
+    UINT8 status;
+
+    /* wait for the display refresh */
+    do {
+        rc = check_status(&status);
+        if (rc != ICS_ERROR_SUCCESS) {
+            return rc;
+        }
+        if (status == NFC110_SIM_CARD_STS_IN_PROGRESS) {
+            /* the host waits between the status checks */
+            nfc110_sim_wait(SMARTTAG_STATUS_POLL_INTERVAL * 1000);
+        }
+    } while (status == NFC110_SIM_CARD_STS_IN_PROGRESS);
+    if (status != NFC110_SIM_CARD_STS_COMPLETE) {
+        return ICS_ERROR_INVALID_RESPONSE;
+    }
+
+    return ICS_ERROR_SUCCESS;
+}
+
+static UINT32 show_image(
+    UINT32 num_of_chunks,
+    UINT32 num_of_updates,
+    UINT32* nbytes)
+{
+    UINT32 rc;
+    UINT32 i;
+    UINT32 pos;
+    UINT8 func;
+    UINT8 status;
+    UINT8 block_data[SMARTTAG_MAX_BLOCKS * 16];
+    UINT8 param[8] = { 0x01, 0x01, 0x00, 0x00, 0x19, 0x00, 0x00, 0x03 };
+
+    if (num_of_chunks == SMARTTAG_27INCH_CHUNKS) {
+        param[4] = 0x21;
+    }
+    /* less chunks than the image update the shown image partially */
+    func = ((num_of_updates < num_of_chunks) ?
+            NFC110_SIM_CARD_FUNC_SHOW_DISPLAY2 :
+            NFC110_SIM_CARD_FUNC_SHOW_DISPLAY);
+
+    rc = check_status(&status);
+    if (rc != ICS_ERROR_SUCCESS) {
+        return rc;
+    }
+
+    *nbytes = 0;
+    for (i = 0; i < num_of_updates; i++) {
+        pos = ((i * num_of_chunks) / num_of_updates);
+        param[2] = (UINT8)pos;
+        make_header(block_data, func,
+                    (UINT8)num_of_updates, (UINT8)(i + 1),
+                    SMARTTAG_CHUNK_LEN, param);
+        utl_memset(block_data + 16, (UINT8)(s_seq + pos), SMARTTAG_CHUNK_LEN);
+        utl_memcpy(s_image + (pos * SMARTTAG_CHUNK_LEN), block_data + 16,
+                   SMARTTAG_CHUNK_LEN);
+        rc = write_blocks(block_data, SMARTTAG_MAX_BLOCKS);
+        if (rc != ICS_ERROR_SUCCESS) {
+            return rc;
+        }
+        *nbytes += SMARTTAG_CHUNK_LEN;
+    }
+
+    rc = wait_display();
+    if (rc != ICS_ERROR_SUCCESS) {
+        return rc;
+    }
+
+    /* the card shows the chunks sent so far */
+    if (utl_memcmp(nfc110_sim_get_card(0)->display, s_image,
+                   (num_of_chunks * SMARTTAG_CHUNK_LEN)) != 0) {
+        return ICS_ERROR_INVALID_RESPONSE;
+    }
+
+    return ICS_ERROR_SUCCESS;
+}
+
+/* a 2.7 inch price label: a frame, text lines and a price of i */
+static void make_label(
+    UINT8* frame,
+    UINT32 i)
+{
+    UINT32 x;
+    UINT32 y;
+    UINT32 row_len = (EPAPER_PANEL_27INCH_WIDTH / 8);
+    UINT32 seed = 1;
+
+    utl_memset(frame, 0, (row_len * EPAPER_PANEL_27INCH_HEIGHT));
+    for (y = 0; y < EPAPER_PANEL_27INCH_HEIGHT; y++) {
+        frame[(y * row_len)] |= 0xc0;
+        frame[(y * row_len) + row_len - 1] |= 0x03;
+        if ((y < 2) || (y >= (EPAPER_PANEL_27INCH_HEIGHT - 2))) {
+            utl_memset(frame + (y * row_len), 0xff, row_len);
+        }
+        if (((y % 24) < 8) || ((y % 24) >= 18)) {
+            continue;
+        }
+        for (x = 2; x < (row_len - 2); x++) {
+            seed = ((seed * 1103515245) + 12345);
+            if ((y >= 120) && (x >= 20) && (x < 30)) {
+                /* the price */
+                frame[(y * row_len) + x] = (UINT8)(((x * 7) + i) * 37);
+            } else if ((x < 24) || (((seed >> 16) & 3) == 0)) {
+                frame[(y * row_len) + x] = (UINT8)(seed >> 24);
+            }
+        }
+    }
+}
+
+static UINT32 show_label(
+    UINT32 codec,
+    UINT32 i,
+    UINT32* nbytes)
+{
+    UINT32 rc;
+    UINT32 pos;
+    UINT32 len;
+    UINT32 data_len;
+    UINT32 num_of_chunks;
+    UINT8 status;
+    UINT8 block_data[SMARTTAG_MAX_BLOCKS * 16];
+    UINT8 param[8] = { 0x01, 0x01, 0x00, 0x00, 0x21, 0x00, 0x00, 0x03 };
+    UINT8 frame[EPAPER_MAX_FRAME_LEN];
+    UINT8 data[EPAPER_MAX_ENCODED_LEN(EPAPER_MAX_FRAME_LEN)];
+
+    make_label(frame, i);
+    rc = epaper_encode(codec, frame, s_image, EPAPER_MAX_FRAME_LEN,
+                       data, sizeof(data), &data_len);
+    if (rc != ICS_ERROR_SUCCESS) {
+        return rc;
+    }
+    num_of_chunks = ((data_len + SMARTTAG_CHUNK_LEN - 1) / SMARTTAG_CHUNK_LEN);
+    if (num_of_chunks > SMARTTAG_27INCH_CHUNKS) {
+        return ICS_ERROR_BUF_OVERFLOW;
+    }
+    param[3] = (UINT8)codec;
+
+    rc = check_status(&status);
+    if (rc != ICS_ERROR_SUCCESS) {
+        return rc;
+    }
+
+    *nbytes = 0;
+    for (pos = 0; pos < data_len; pos += len) {
+        len = (((data_len - pos) < SMARTTAG_CHUNK_LEN) ?
+               (data_len - pos) : SMARTTAG_CHUNK_LEN);
+        make_header(block_data, NFC110_SIM_CARD_FUNC_SHOW_DISPLAY,
+                    (UINT8)num_of_chunks,
+                    (UINT8)((pos / SMARTTAG_CHUNK_LEN) + 1),
+                    (UINT8)len, param);
+        utl_memcpy(block_data + 16, data + pos, len);
+        /* only the blocks with data are written */
+        rc = write_blocks(block_data, (1 + ((len + 15) / 16)));
+        if (rc != ICS_ERROR_SUCCESS) {
+            return rc;
+        }
+        *nbytes += len;
+    }
+
+    rc = wait_display();
+    if (rc != ICS_ERROR_SUCCESS) {
+        return rc;
+    }
+
+    /* the card shows the label */
+    if (utl_memcmp(nfc110_sim_get_card(0)->display, frame,
+                   EPAPER_MAX_FRAME_LEN) != 0) {
+        return ICS_ERROR_INVALID_RESPONSE;
+    }
+    utl_memcpy(s_image, frame, EPAPER_MAX_FRAME_LEN);
+
+    return ICS_ERROR_SUCCESS;
+}
+
+/*
+ * scenarios
+ */
+
+static UINT32 run_polling(UINT32 i, UINT32* nbytes)
+{
+    UINT32 rc;
+    felica_card_option_t card_option;
+    UINT8 polling_param[4] = {
+        (UINT8)((SMARTTAG_SYSTEM_CODE >> 8) & 0xff),
+        (UINT8)((SMARTTAG_SYSTEM_CODE >> 0) & 0xff),
+        0x00, 0x00
+    };
+    (void)i;
+
+    rc = felica_cc_polling(&s_devf, polling_param, &s_card, &card_option,
+                           DEFAULT_TIMEOUT);
+    *nbytes = 16;
+
+    return rc;
+}
+
+/* the polling of the application: RF is turned off after each polling */
+static UINT32 run_polling_rf_off(UINT32 i, UINT32* nbytes)
+{
+    UINT32 rc;
+
+    rc = run_polling(i, nbytes);
+    if (rc == ICS_ERROR_SUCCESS) {
+        rc = nfc110_rf_off(&s_dev, DEFAULT_TIMEOUT);
+    }
+
+    return rc;
+}
+
+/* the polling after a reset of the driver (the recovery from errors) */
+static UINT32 run_polling_reset(UINT32 i, UINT32* nbytes)
+{
+    UINT32 rc;
+
+    rc = nfc110_reset(&s_dev, DEFAULT_TIMEOUT);
+    if (rc == ICS_ERROR_SUCCESS) {
+        rc = run_polling(i, nbytes);
+    }
+
+    return rc;
+}
+
+/* the polling of felica_poller: RF is kept on while the card is present */
+static UINT32 run_polling_poller(UINT32 i, UINT32* nbytes)
+{
+    UINT32 rc;
+    UINT32 interval;
+    UINT8 polling_param[4] = {
+        (UINT8)((SMARTTAG_SYSTEM_CODE >> 8) & 0xff),
+        (UINT8)((SMARTTAG_SYSTEM_CODE >> 0) & 0xff),
+        0x00, 0x00
+    };
+
+    if (i == 0) {
+        rc = felica_poller_initialize(&s_poller, &s_devf,
+                                      &nfc110_sim_basic_func, &s_dev,
+                                      polling_param, 1, NULL, NULL, NULL);
+        if (rc != ICS_ERROR_SUCCESS) {
+            return rc;
+        }
+    }
+
+    rc = felica_poller_poll(&s_poller, DEFAULT_TIMEOUT, &interval);
+    *nbytes = 16;
+    if ((rc == ICS_ERROR_SUCCESS) && (s_poller.num_of_cards == 0)) {
+        rc = ICS_ERROR_TIMEOUT;
+    }
+
+    return rc;
+}
+
+static UINT32 run_read_status(UINT32 i, UINT32* nbytes)
+{
+    UINT8 block_data[16 * 2];
+    (void)i;
+
+    *nbytes = sizeof(block_data);
+    return read_blocks(block_data, 2);
+}
+
+static UINT32 run_read_12_blocks(UINT32 i, UINT32* nbytes)
+{
+    UINT8 block_data[16 * SMARTTAG_MAX_BLOCKS];
+    (void)i;
+
+    *nbytes = sizeof(block_data);
+    return read_blocks(block_data, SMARTTAG_MAX_BLOCKS);
+}
+
+static UINT32 run_read_12_blocks_batched(UINT32 i, UINT32* nbytes)
+{
+    UINT32 rc;
+    UINT16 j;
+    felica_cc_batch_t batch;
+    UINT8 block_data[16 * SMARTTAG_MAX_BLOCKS];
+    (void)i;
+
+    /* queued one by one, sent as one command with a PMm time-out */
+    felica_cc_batch_initialize(&batch, &s_devf);
+    for (j = 0; j < SMARTTAG_MAX_BLOCKS; j++) {
+        rc = felica_cc_batch_read(&batch, &s_card, SMARTTAG_SERVICE_CODE,
+                                  j, block_data + (16 * j));
+        if (rc != ICS_ERROR_SUCCESS) {
+            return rc;
+        }
+    }
+    *nbytes = sizeof(block_data);
+
+    return felica_cc_batch_flush(&batch);
+}
+
+static UINT32 run_write_12_blocks(UINT32 i, UINT32* nbytes)
+{
+    UINT8 block_data[16 * SMARTTAG_MAX_BLOCKS];
+
+    /* one chunk of a transfer which is never completed */
+    make_header(block_data, NFC110_SIM_CARD_FUNC_SHOW_DISPLAY,
+                SMARTTAG_27INCH_CHUNKS, 1, SMARTTAG_CHUNK_LEN, NULL);
+    utl_memset(block_data + 16, (UINT8)i, SMARTTAG_CHUNK_LEN);
+    *nbytes = sizeof(block_data);
+
+    return write_blocks(block_data, SMARTTAG_MAX_BLOCKS);
+}
+
+static UINT32 run_check_status(UINT32 i, UINT32* nbytes)
+{
+    UINT8 status;
+    (void)i;
+
+    *nbytes = (16 * 3);
+    return check_status(&status);
+}
+
+static UINT32 run_show_image_20inch(UINT32 i, UINT32* nbytes)
+{
+    (void)i;
+    return show_image(SMARTTAG_20INCH_CHUNKS, SMARTTAG_20INCH_CHUNKS, nbytes);
+}
+
+static UINT32 run_show_image_27inch(UINT32 i, UINT32* nbytes)
+{
+    (void)i;
+    return show_image(SMARTTAG_27INCH_CHUNKS, SMARTTAG_27INCH_CHUNKS, nbytes);
+}
+
+/* a tenth of the image is changed */
+static UINT32 run_update_image_20inch(UINT32 i, UINT32* nbytes)
+{
+    (void)i;
+    return show_image(SMARTTAG_20INCH_CHUNKS,
+                      ((SMARTTAG_20INCH_CHUNKS + 9) / 10), nbytes);
+}
+
+static UINT32 run_update_image_27inch(UINT32 i, UINT32* nbytes)
+{
+    (void)i;
+    return show_image(SMARTTAG_27INCH_CHUNKS,
+                      ((SMARTTAG_27INCH_CHUNKS + 9) / 10), nbytes);
+}
+
+static UINT32 run_show_label_raw(UINT32 i, UINT32* nbytes)
+{
+    return show_label(EPAPER_CODEC_RAW, i, nbytes);
+}
+
+static UINT32 run_show_label_packbits(UINT32 i, UINT32* nbytes)
+{
+    return show_label(EPAPER_CODEC_PACKBITS, i, nbytes);
+}
+
+/* the price is changed from the last label */
+static UINT32 run_show_label_delta(UINT32 i, UINT32* nbytes)
+{
+    return show_label(EPAPER_CODEC_XOR_PACKBITS, i, nbytes);
+}
+
+/*
+ * measurement
+ */
+
+static int compare_uint32(const void* a, const void* b)
+{
+    UINT32 x = *(const UINT32*)a;
+    UINT32 y = *(const UINT32*)b;
+
+    return ((x > y) - (x < y));
+}
+
+static double host_time_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((ts.tv_sec * 1e6) + (ts.tv_nsec / 1e3));
+}
+
+static int run_benchmark(const benchmark_t* benchmark)
+{
+    UINT32 rc;
+    UINT32 i;
+    UINT32 nbytes;
+    UINT32 nerrors;
+    UINT64 total_bytes;
+    UINT64 t0;
+    UINT64 start;
+    UINT64 elapsed;
+    unsigned long allocs0;
+    double host0;
+    double host;
+    double sec;
+    nfc110_sim_stat_t stat;
+
+    nfc110_sim_clear_stat();
+    nerrors = 0;
+    total_bytes = 0;
+    allocs0 = s_num_of_allocs;
+    host0 = host_time_usec();
+    start = nfc110_sim_get_time_usec();
+    for (i = 0; i < benchmark->iterations; i++) {
+        t0 = nfc110_sim_get_time_usec();
+        nbytes = 0;
+        rc = benchmark->run(i, &nbytes);
+        if (rc != ICS_ERROR_SUCCESS) {
+            nerrors++;
+        } else {
+            total_bytes += nbytes;
+        }
+        s_latency[i] = (UINT32)(nfc110_sim_get_time_usec() - t0);
+    }
+    elapsed = (nfc110_sim_get_time_usec() - start);
+    host = (host_time_usec() - host0);
+    nfc110_sim_get_stat(&stat);
+
+    qsort(s_latency, benchmark->iterations, sizeof(s_latency[0]),
+          compare_uint32);
+    sec = ((elapsed > 0) ? (elapsed / 1e6) : 1e-6);
+
+    printf("%-18s %6u %5u %7.2f %8.1f %7.2f %9.0f %9.2f %9.2f ",
+           benchmark->name,
+           benchmark->iterations,
+           nerrors,
+           (double)stat.num_of_frames / benchmark->iterations,
+           stat.num_of_frames / sec,
+           ((stat.num_of_frames > 0) ?
+            ((double)stat.num_of_tx_intervals / stat.num_of_frames) : 0),
+           total_bytes / sec,
+           s_latency[(benchmark->iterations * 50) / 100] / 1e3,
+           s_latency[(benchmark->iterations * 99) / 100] / 1e3);
+    if (ALLOCS_ARE_COUNTED) {
+        printf("%9.2f ", (double)(s_num_of_allocs - allocs0) /
+               benchmark->iterations);
+    } else {
+        printf("%9s ", "n/a");
+    }
+    printf("%9.2f\n", host / benchmark->iterations);
+
+    return 0;
+}
+
+static int run_mtu_sweep(const nfc110_sim_config_t* base)
+{
+    static const UINT32 mtus[] = { 20, 64, 128, 185, 244, 509 };
+    static const UINT32 ll_data_lens[] = { 27, 251 };
+    UINT32 rc;
+    UINT32 i;
+    UINT32 j;
+    UINT32 k;
+    UINT32 nbytes;
+    UINT32 nerrors;
+    UINT32 nintervals;
+    UINT64 start;
+    double sec;
+    nfc110_sim_config_t config;
+    nfc110_sim_stat_t stat;
+
+    printf("%-18s %7s %5s %5s %7s %7s %7s %7s %7s %8s\n",
+           "scenario", "ll_data", "mtu", "errs", "PDU/pkt", "pkt/fr",
+           "PDU/fr", "CI/fr", "fr/CI", "RT/s");
+    for (j = 0; j < (sizeof(ll_data_lens) / sizeof(ll_data_lens[0])); j++) {
+        for (k = 0; k < (sizeof(mtus) / sizeof(mtus[0])); k++) {
+            config = *base;
+            config.ll_data_len = ll_data_lens[j];
+            config.mtu = mtus[k];
+            rc = nfc110_sim_set_config(&config);
+            if (rc != ICS_ERROR_SUCCESS) {
+                fprintf(stderr, "failure in nfc110_sim_set_config():%u\n",
+                        rc);
+                return 1;
+            }
+
+            nfc110_sim_clear_stat();
+            nerrors = 0;
+            start = nfc110_sim_get_time_usec();
+            for (i = 0; i < s_iterations; i++) {
+                rc = run_write_12_blocks(i, &nbytes);
+                if (rc != ICS_ERROR_SUCCESS) {
+                    nerrors++;
+                }
+            }
+            sec = ((nfc110_sim_get_time_usec() - start) / 1e6);
+            nfc110_sim_get_stat(&stat);
+            if ((stat.num_of_frames == 0) || (stat.num_of_tx_packets == 0)) {
+                continue;
+            }
+            nintervals = (stat.num_of_tx_intervals +
+                          stat.num_of_rx_intervals);
+
+            printf("%-18s %7u %5u %5u %7.2f %7.2f %7.2f %7.2f %7.3f %8.1f\n",
+                   "write_we_12",
+                   config.ll_data_len,
+                   config.mtu,
+                   nerrors,
+                   (double)stat.num_of_tx_pdus / stat.num_of_tx_packets,
+                   (double)stat.num_of_tx_packets / stat.num_of_frames,
+                   (double)stat.num_of_tx_pdus / stat.num_of_frames,
+                   (double)nintervals / stat.num_of_frames,
+                   (double)stat.num_of_frames / nintervals,
+                   ((sec > 0) ? (stat.num_of_frames / sec) : 0));
+        }
+    }
+
+    return nfc110_sim_set_config(base);
+}
+
+static int save_trace(const char* path)
+{
+    UINT32 rc;
+    UINT32 num_events;
+    icstrace_file_header_t header;
+    FILE* fp;
+
+    rc = icstrace_snapshot(s_trace, (sizeof(s_trace) / sizeof(s_trace[0])),
+                           &num_events);
+    if (rc != ICS_ERROR_SUCCESS) {
+        fprintf(stderr, "failure in icstrace_snapshot():%u\n", rc);
+        return 1;
+    }
+    icstrace_get_file_header(num_events, &header);
+
+    fp = fopen(path, "wb");
+    if (fp == NULL) {
+        perror(path);
+        return 1;
+    }
+    if ((fwrite(&header, sizeof(header), 1, fp) != 1) ||
+        (fwrite(s_trace, sizeof(s_trace[0]), num_events, fp) != num_events)) {
+        perror(path);
+        fclose(fp);
+        return 1;
+    }
+    fclose(fp);
+    printf("trace: %u events (%u dropped) in %s\n",
+           num_events, header.num_of_dropped, path);
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    UINT32 rc;
+    UINT32 i;
+    int opt;
+    const char* trace_path = NULL;
+    BOOL mtu_sweep = FALSE;
+    nfc110_sim_config_t config;
+    felica_card_option_t card_option;
+    UINT8 polling_param[4] = {
+        (UINT8)((SMARTTAG_SYSTEM_CODE >> 8) & 0xff),
+        (UINT8)((SMARTTAG_SYSTEM_CODE >> 0) & 0xff),
+        0x00, 0x00
+    };
+    benchmark_t benchmarks[] = {
+        { "polling",          run_polling,           0 },
+        { "polling_rf_off",   run_polling_rf_off,    0 },
+        { "polling_reset",    run_polling_reset,     0 },
+        { "polling_poller",   run_polling_poller,    0 },
+        { "read_we_2",        run_read_status,       0 },
+        { "read_we_12",       run_read_12_blocks,    0 },
+        { "read_we_12_batch", run_read_12_blocks_batched, 0 },
+        { "write_we_12",      run_write_12_blocks,   0 },
+        { "check_status",     run_check_status,      0 },
+        { "show_image_2.0in", run_show_image_20inch, 0 },
+        { "show_image_2.7in", run_show_image_27inch, 0 },
+        { "update_image_2.0in", run_update_image_20inch, 0 },
+        { "update_image_2.7in", run_update_image_27inch, 0 },
+        { "label_raw_2.7in",  run_show_label_raw,    0 },
+        { "label_pack_2.7in", run_show_label_packbits, 0 },
+        { "label_delta_2.7in", run_show_label_delta, 0 },
+    };
+
+    nfc110_sim_get_default_config(&config);
+    while ((opt = getopt(argc, argv, "n:m:d:t:r:e:c:s:T:L:M")) != -1) {
+        switch (opt) {
+        case 'n':
+            s_iterations = (UINT32)strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            config.mtu = (UINT32)strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            config.ll_data_len = (UINT32)strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            config.tx_packet_usec = (UINT32)strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            config.rx_packet_usec = (UINT32)strtoul(optarg, NULL, 0);
+            break;
+        case 'e':
+            config.rf_error_per_mille = (UINT32)strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            config.tx_credits = (UINT32)strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            config.seed = (UINT32)strtoul(optarg, NULL, 0);
+            break;
+        case 'T':
+            trace_path = optarg;
+            break;
+        case 'L':
+            icslog_set_level(NULL, (UINT32)strtoul(optarg, NULL, 0));
+            break;
+        case 'M':
+            mtu_sweep = TRUE;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n iterations] [-m mtu] "
+                    "[-d ll_data_len] [-t tx_packet_us] [-r rx_packet_us] "
+                    "[-e rf_errors_per_mille] [-c tx_credits] "
+                    "[-s seed] [-T trace_file] [-L log_level] [-M]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if ((s_iterations == 0) || (s_iterations > MAX_ITERATIONS)) {
+        fprintf(stderr, "invalid iterations: %u\n", s_iterations);
+        return 1;
+    }
+    rc = nfc110_sim_set_config(&config);
+    if (rc != ICS_ERROR_SUCCESS) {
+        fprintf(stderr, "failure in nfc110_sim_set_config():%u\n", rc);
+        return 1;
+    }
+#ifndef ICSTRACE_ENABLE
+    if (trace_path != NULL) {
+        fprintf(stderr, "warning: built without ICSTRACE_ENABLE, "
+                "the trace is empty\n");
+    }
+#endif
+    if (trace_path != NULL) {
+        rc = icstrace_start(nfc110_sim_get_time_usec);
+        if (rc != ICS_ERROR_SUCCESS) {
+            fprintf(stderr, "failure in icstrace_start():%u\n", rc);
+            return 1;
+        }
+    }
+    /* the card supports the partial update and the compression */
+    nfc110_sim_get_card(0)->version = NFC110_SIM_CARD_CODEC_VERSION;
+
+    rc = nfc110_sim_open(&s_dev, "sim");
+    if (rc != ICS_ERROR_SUCCESS) {
+        fprintf(stderr, "failure in nfc110_sim_open():%u\n", rc);
+        return 1;
+    }
+    rc = nfc110_initialize_device(&s_dev, DEFAULT_TIMEOUT);
+    if (rc == ICS_ERROR_SUCCESS) {
+        rc = felica_cc_stub_nfc110_initialize(&s_devf, &s_dev);
+    }
+    if (rc == ICS_ERROR_SUCCESS) {
+        rc = felica_cc_polling(&s_devf, polling_param, &s_card, &card_option,
+                               DEFAULT_TIMEOUT);
+    }
+    if (rc != ICS_ERROR_SUCCESS) {
+        fprintf(stderr, "failure in initialization:%u\n", rc);
+        nfc110_close(&s_dev);
+        return 1;
+    }
+
+    printf("mtu=%u ll_data=%u tx_packet=%uus rx_packet=%uus "
+           "rf_errors=%u/1000 tx_credits=%u seed=%u\n",
+           config.mtu, config.ll_data_len, config.tx_packet_usec,
+           config.rx_packet_usec, config.rf_error_per_mille,
+           config.tx_credits, config.seed);
+    if (mtu_sweep) {
+        rc = run_mtu_sweep(&config);
+        nfc110_rf_off(&s_dev, DEFAULT_TIMEOUT);
+        nfc110_close(&s_dev);
+        return ((rc == ICS_ERROR_SUCCESS) ? 0 : 1);
+    }
+    printf("%-18s %6s %5s %7s %8s %7s %9s %9s %9s %9s %9s\n",
+           "scenario", "ops", "errs", "RT/op", "RT/s", "TXCI/fr", "B/s",
+           "p50(ms)", "p99(ms)", "allocs/op", "host(us)");
+    for (i = 0; i < (sizeof(benchmarks) / sizeof(benchmarks[0])); i++) {
+        benchmarks[i].iterations = s_iterations;
+        if (benchmarks[i].run == run_show_image_20inch ||
+            benchmarks[i].run == run_show_image_27inch ||
+            benchmarks[i].run == run_update_image_20inch ||
+            benchmarks[i].run == run_update_image_27inch ||
+            benchmarks[i].run == run_show_label_raw ||
+            benchmarks[i].run == run_show_label_packbits ||
+            benchmarks[i].run == run_show_label_delta) {
+            /* a refresh takes seconds of the simulated time */
+            benchmarks[i].iterations = ((s_iterations + 99) / 100);
+        }
+        run_benchmark(&benchmarks[i]);
+    }
+
+    nfc110_rf_off(&s_dev, DEFAULT_TIMEOUT);
+    nfc110_close(&s_dev);
+
+    if (trace_path != NULL) {
+        icstrace_stop();
+        return save_trace(trace_path);
+    }
+
+    return 0;
+}
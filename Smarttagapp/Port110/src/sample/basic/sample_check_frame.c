@@ -0,0 +1,270 @@
+/*
+ * Copyright 2013 Sony Corporation
+ */
+
+/*
+ * Micro-benchmark of the frame validation of NFC Port-110
+ * (nfc110_check_frame() against a byte-by-byte reference).
+ *
+ * Every frame is also checked by the reference, and corrupted copies
+ * of it must be rejected by both, so a run verifies the results too.
+ * Build with -DNFC110_USE_SCALAR_CHECKSUM to measure the scalar
+ * fallback of the driver.
+ *
+ * usage: sample_check_frame [-n iterations] [-s seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ics_types.h"
+#include "ics_error.h"
+#include "utl.h"
+#include "nfc110.h"
+
+#ifndef DEFAULT_ITERATIONS
+#define DEFAULT_ITERATIONS 200000
+#endif
+#define NUM_OF_FRAMES 64
+#define MAX_FRAME_LEN (8 + 3 + NFC110_MAX_RECEIVE_DATA_LEN + 2)
+
+static UINT32 s_iterations = DEFAULT_ITERATIONS;
+static UINT8 s_frames[NUM_OF_FRAMES][MAX_FRAME_LEN];
+static volatile UINT32 s_sink;
+
+/*
+ * frames
+ */
+
+static UINT32 make_frame(
+    UINT8* frame,
+    UINT32 payload_len)
+{
+    UINT32 i;
+    UINT32 pos;
+    UINT8 sum;
+
+    frame[0] = 0x00;
+    frame[1] = 0x00;
+    frame[2] = 0xff;
+    if (payload_len < 0xff) {
+        frame[3] = (UINT8)payload_len;
+        frame[4] = (UINT8)-frame[3];
+        pos = 5;
+    } else {
+        frame[3] = 0xff;
+        frame[4] = 0xff;
+        frame[5] = (UINT8)((payload_len >> 0) & 0xff);
+        frame[6] = (UINT8)((payload_len >> 8) & 0xff);
+        frame[7] = (UINT8)-(frame[5] + frame[6]);
+        pos = 8;
+    }
+
+    sum = 0;
+    for (i = 0; i < payload_len; i++) {
+        frame[pos + i] = (UINT8)rand();
+        sum += frame[pos + i];
+    }
+    frame[pos + payload_len + 0] = (UINT8)-sum;
+    frame[pos + payload_len + 1] = 0x00;
+
+    return (pos + payload_len + 2);
+}
+
+/* the checks as nfc110 did them before, one byte at a time */
+static UINT32 check_frame_reference(
+    const UINT8* frame,
+    UINT32 frame_len)
+{
+    UINT32 i;
+    UINT32 pos;
+    UINT32 len;
+    UINT8 sum;
+
+    if ((frame_len < 6) ||
+        (utl_memcmp(frame, "\x00\x00\xff", 3) != 0)) {
+        return ICS_ERROR_INVALID_RESPONSE;
+    }
+    if ((frame[3] == 0xff) && (frame[4] == 0xff)) {
+        if ((frame_len < 9) ||
+            (((frame[5] + frame[6] + frame[7]) & 0xff) != 0)) {
+            return ICS_ERROR_INVALID_RESPONSE;
+        }
+        pos = 8;
+        len = (((UINT32)frame[5] << 0) | ((UINT32)frame[6] << 8));
+    } else {
+        if (((frame[3] + frame[4]) & 0xff) != 0) {
+            return ICS_ERROR_INVALID_RESPONSE;
+        }
+        pos = 5;
+        len = frame[3];
+    }
+    if (frame_len < (pos + len + 2)) {
+        return ICS_ERROR_INVALID_RESPONSE;
+    }
+
+    sum = 0;
+    for (i = 0; i < len; i++) {
+        sum += frame[pos + i];
+    }
+    if ((frame[pos + len] != (UINT8)-sum) ||
+        (frame[pos + len + 1] != 0x00)) {
+        return ICS_ERROR_INVALID_RESPONSE;
+    }
+
+    return ICS_ERROR_SUCCESS;
+}
+
+static UINT32 check_frame(
+    const UINT8* frame,
+    UINT32 frame_len)
+{
+    UINT32 rc;
+    UINT32 needed_len;
+    UINT32 response_pos;
+    UINT32 response_len;
+
+    rc = nfc110_check_frame(frame, frame_len, &needed_len,
+                            &response_pos, &response_len);
+    if ((rc == ICS_ERROR_SUCCESS) && (needed_len > frame_len)) {
+        rc = ICS_ERROR_INVALID_RESPONSE;
+    }
+
+    return rc;
+}
+
+/*
+ * measurement
+ */
+
+static double host_time_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((ts.tv_sec * 1e6) + (ts.tv_nsec / 1e3));
+}
+
+static int verify(
+    UINT32 payload_len)
+{
+    UINT32 i;
+    UINT32 k;
+    UINT32 frame_len;
+    UINT8 saved;
+
+    for (i = 0; i < NUM_OF_FRAMES; i++) {
+        frame_len = make_frame(s_frames[i], payload_len);
+        if ((check_frame(s_frames[i], frame_len) != ICS_ERROR_SUCCESS) ||
+            (check_frame_reference(s_frames[i], frame_len) !=
+             ICS_ERROR_SUCCESS)) {
+            fprintf(stderr, "valid frame rejected: len=%u\n", payload_len);
+            return -1;
+        }
+
+        /* a changed byte anywhere in the frame is detected */
+        k = ((UINT32)rand() % frame_len);
+        saved = s_frames[i][k];
+        s_frames[i][k] ^= (UINT8)(1 + ((UINT32)rand() % 0xff));
+        if ((check_frame(s_frames[i], frame_len) == ICS_ERROR_SUCCESS) !=
+            (check_frame_reference(s_frames[i], frame_len) ==
+             ICS_ERROR_SUCCESS)) {
+            fprintf(stderr, "results differ: len=%u pos=%u\n",
+                    payload_len, k);
+            return -1;
+        }
+        s_frames[i][k] = saved;
+
+        /* a truncated frame is not complete */
+        if (check_frame(s_frames[i], (frame_len - 1)) ==
+            ICS_ERROR_SUCCESS) {
+            fprintf(stderr, "truncated frame accepted: len=%u\n",
+                    payload_len);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void run_benchmark(
+    UINT32 payload_len)
+{
+    UINT32 i;
+    UINT32 frame_len;
+    double host0;
+    double driver_usec;
+    double reference_usec;
+
+    frame_len = make_frame(s_frames[0], payload_len);
+    for (i = 1; i < NUM_OF_FRAMES; i++) {
+        make_frame(s_frames[i], payload_len);
+    }
+
+    host0 = host_time_usec();
+    for (i = 0; i < s_iterations; i++) {
+        s_sink += check_frame(s_frames[i % NUM_OF_FRAMES], frame_len);
+    }
+    driver_usec = (host_time_usec() - host0);
+
+    host0 = host_time_usec();
+    for (i = 0; i < s_iterations; i++) {
+        s_sink += check_frame_reference(s_frames[i % NUM_OF_FRAMES],
+                                        frame_len);
+    }
+    reference_usec = (host_time_usec() - host0);
+
+    printf("%8u %10.1f %10.1f %9.0f %9.0f %7.2f\n",
+           frame_len,
+           (driver_usec * 1e3) / s_iterations,
+           (reference_usec * 1e3) / s_iterations,
+           ((double)frame_len * s_iterations) / driver_usec,
+           ((double)frame_len * s_iterations) / reference_usec,
+           ((driver_usec > 0) ? (reference_usec / driver_usec) : 0));
+}
+
+int main(int argc, char* argv[])
+{
+    UINT32 i;
+    int opt;
+    unsigned int seed = 1;
+    const UINT32 payload_lens[] = {
+        2, 16, 64, 254, 256, 512, NFC110_MAX_RECEIVE_DATA_LEN + 3
+    };
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+        case 'n':
+            s_iterations = (UINT32)strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = (unsigned int)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n iterations] [-s seed]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (s_iterations == 0) {
+        fprintf(stderr, "invalid iterations: %u\n", s_iterations);
+        return 1;
+    }
+    srand(seed);
+
+    for (i = 0; i < (sizeof(payload_lens) / sizeof(payload_lens[0])); i++) {
+        if (verify(payload_lens[i]) != 0) {
+            return 1;
+        }
+    }
+
+    printf("%8s %10s %10s %9s %9s %7s\n",
+           "frame", "ns/frame", "ref(ns)", "MB/s", "ref(MB/s)", "speedup");
+    for (i = 0; i < (sizeof(payload_lens) / sizeof(payload_lens[0])); i++) {
+        run_benchmark(payload_lens[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,490 @@
+/*
+ * Copyright 2013 Sony Corporation
+ */
+
+/*
+ * Verification and micro-benchmark of the dithering of e-paper frames
+ * (epaper_dither() against the DITHERING() routine the application used
+ * before, on RGBA in double, followed by its packing of the G channel).
+ *
+ * Error diffusion is checked bit for bit against a whole-image integer
+ * reference of the same kernels, and every kernel has to reproduce the
+ * share of black pixels of a flat gray.
+ *
+ * usage: sample_dither [-n iterations] [-s seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ics_types.h"
+#include "ics_error.h"
+#include "epaper.h"
+
+#ifndef DEFAULT_ITERATIONS
+#define DEFAULT_ITERATIONS 20
+#endif
+#define MAX_WIDTH 2048
+#define MAX_HEIGHT 1536
+
+static UINT32 s_iterations = DEFAULT_ITERATIONS;
+static volatile UINT32 s_sink;
+
+static const struct {
+    UINT32 dither;
+    const char* name;
+    /* weights from x - 2 to x + 2 of this row and the two below */
+    INT32 divisor;
+    INT32 weight[3][5];
+} s_kernels[] = {
+    {EPAPER_DITHER_NONE, "none", 0, {{0}}},
+    {EPAPER_DITHER_FLOYD_STEINBERG, "fs", 16,
+     {{0, 0, 0, 7, 0}, {0, 3, 5, 1, 0}, {0, 0, 0, 0, 0}}},
+    {EPAPER_DITHER_JJN, "jjn", 48,
+     {{0, 0, 0, 7, 5}, {3, 5, 7, 5, 3}, {1, 3, 5, 3, 1}}},
+    {EPAPER_DITHER_ATKINSON, "atkinson", 8,
+     {{0, 0, 0, 1, 1}, {0, 1, 1, 1, 0}, {0, 0, 1, 0, 0}}},
+    {EPAPER_DITHER_BAYER, "bayer", 0, {{0}}},
+    {EPAPER_DITHER_BLUE_NOISE, "bluenoise", 0, {{0}}},
+};
+#define NUM_OF_KERNELS (sizeof(s_kernels) / sizeof(s_kernels[0]))
+
+/*
+ * images
+ */
+
+static void make_image(
+    UINT8* gray,
+    UINT32 width,
+    UINT32 height)
+{
+    UINT32 x;
+    UINT32 y;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            gray[(y * width) + x] =
+                (UINT8)((((x * 255) / width) + ((y * 64) / height) +
+                         (rand() & 0x1f)) & 0xff);
+        }
+    }
+}
+
+/*
+ * DITHERING() and the packing of Adapter, as the application did them
+ */
+
+static void legacy_dithering(
+    char* imageData,
+    int width,
+    int height,
+    int widthStep,
+    int nChannels)
+{
+    double e;
+    (void)width;
+    for(int j = 0;j<height;j++)
+    {
+        for(int i = 0;i<widthStep;i++)
+        {
+            if( (unsigned char)(imageData[j*widthStep + i]) > (unsigned char)(127))
+            {
+                e = double(imageData[j*widthStep + i] - char (255));
+                imageData[j*widthStep + i] = char (255);
+            }else
+            {
+                e = double(imageData[j*widthStep + i]);
+                imageData[j*widthStep + i] = char (0);
+            }
+            if ( i < widthStep - 1)
+            {
+                imageData[j*widthStep + i+nChannels] += char(double(e)*(7/48.0));
+            }
+            if ( i < (widthStep*2) - 1)
+            {
+                imageData[j*widthStep + i+(nChannels * 2)] += char(double(e)*(5/48.0));
+            }
+            if ( j < height - 1)
+            {
+                imageData[(j+1)*widthStep + i] += char(double(e)*(7/48.0));
+                if(i-(nChannels * 2) > 0)
+                {
+                    imageData[(j+1)*widthStep + i-(nChannels * 2)] += char(double(e)*(3/48.0));
+                }
+                if(i-nChannels > 0)
+                {
+                    imageData[(j+1)*widthStep + i-nChannels] += char(double(e)*(5/48.0));
+                }
+                if ( i+nChannels < widthStep)
+                {
+                    imageData[(j+1)*widthStep + i+nChannels] += char(double(e)*(5/48.0));
+                }
+                if ( i < (widthStep*2) - 1)
+                {
+                    imageData[(j+1)*widthStep + i+(nChannels * 2)] += char(double(e)*(7/48.0));
+                }
+            }
+            if ( j < height - 2)
+            {
+                imageData[(j+2)*widthStep + i] += char(double(e)*(5/48.0));
+                if(i-(nChannels * 2) > 0)
+                {
+                    imageData[(j+2)*widthStep + i-(nChannels * 2)] += char(double(e)*(1/48.0));
+                }
+                if(i-nChannels > 0)
+                {
+                    imageData[(j+2)*widthStep + i-nChannels] += char(double(e)*(3/48.0));
+                }
+                if ( i+nChannels < widthStep)
+                {
+                    imageData[(j+2)*widthStep + i+nChannels] += char(double(e)*(3/48.0));
+                }
+                if ( i < (widthStep*2) - 1)
+                {
+                    imageData[(j+2)*widthStep + i+(nChannels * 2)] += char(double(e)*(1/48.0));
+                }
+            }
+        }
+    }
+}
+
+static void legacy_render(
+    const UINT8* gray,
+    UINT32 width,
+    UINT32 height,
+    char* rgba,
+    UINT8* bits)
+{
+    UINT32 i;
+    UINT32 k;
+    UINT8 dot;
+
+    /* the gray image as the RGBA IplImage; the extra rows absorb the
+       writes of DITHERING() past the end of the image */
+    for (i = 0; i < (width * height); i++) {
+        memset(&rgba[i * 4], gray[i], 4);
+    }
+    legacy_dithering(rgba, (int)width, (int)height, (int)(width * 4), 4);
+
+    for (i = 0; i < ((width * height) / 8); i++) {
+        dot = 0;
+        for (k = 0; k < 8; k++) {
+            if ((UINT8)rgba[(((i * 8) + k) * 4) + 1] < 128) {
+                dot |= (UINT8)(1 << (7 - k));
+            }
+        }
+        bits[i] = dot;
+    }
+}
+
+/*
+ * reference: the whole error image in INT32
+ */
+
+static void reference_diffuse(
+    UINT32 kernel,
+    const UINT8* gray,
+    UINT32 width,
+    UINT32 height,
+    INT32* error,
+    UINT8* bits)
+{
+    UINT32 x;
+    UINT32 y;
+    UINT32 row_len;
+    INT32 i;
+    INT32 j;
+    INT32 v;
+    INT32 e;
+    INT32 d;
+    INT32 sum;
+
+    d = s_kernels[kernel].divisor;
+    row_len = ((width + 7) / 8);
+    memset(error, 0, (width * height * sizeof(INT32)));
+    memset(bits, 0, (row_len * height));
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            sum = error[(y * width) + x];
+            v = (INT32)gray[(y * width) + x] +
+                (INT32)floor((sum + (d / 2)) / (double)d);
+            if (v < 128) {
+                bits[(y * row_len) + (x / 8)] |= (UINT8)(0x80 >> (x % 8));
+                e = v;
+            } else {
+                e = (v - 255);
+            }
+            for (j = 0; j < 3; j++) {
+                for (i = -2; i <= 2; i++) {
+                    if ((((INT32)x + i) < 0) ||
+                        (((INT32)x + i) >= (INT32)width) ||
+                        ((y + j) >= height)) {
+                        continue;
+                    }
+                    error[((y + j) * width) + x + i] +=
+                        (s_kernels[kernel].weight[j][i + 2] * e);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * verification
+ */
+
+static UINT32 dither(
+    const UINT8* gray,
+    UINT32 width,
+    UINT32 height,
+    UINT32 kernel,
+    UINT8* bits)
+{
+    UINT32 rc;
+    UINT32 scratch_len;
+    void* scratch;
+
+    rc = epaper_get_dither_scratch_len(width, &scratch_len);
+    if (rc != ICS_ERROR_SUCCESS) {
+        return rc;
+    }
+    scratch = malloc(scratch_len);
+    if (scratch == NULL) {
+        return ICS_ERROR_NO_RESOURCES;
+    }
+    rc = epaper_dither(gray, width, height, width, s_kernels[kernel].dither,
+                       scratch, scratch_len, bits,
+                       (((width + 7) / 8) * height));
+    free(scratch);
+
+    return rc;
+}
+
+static UINT32 count_black(
+    const UINT8* bits,
+    UINT32 len)
+{
+    UINT32 i;
+    UINT32 n;
+
+    n = 0;
+    for (i = 0; i < len; i++) {
+        n += (UINT32)__builtin_popcount(bits[i]);
+    }
+
+    return n;
+}
+
+static int verify_reference(
+    UINT8* gray,
+    UINT8* bits,
+    UINT8* expected,
+    INT32* error)
+{
+    /* widths which are not a multiple of 8 too */
+    static const UINT32 sizes[][2] = {
+        {264, 176}, {200, 96}, {203, 37}, {1, 5}, {5, 1}
+    };
+    UINT32 i;
+    UINT32 k;
+    UINT32 rc;
+    UINT32 width;
+    UINT32 height;
+
+    for (i = 0; i < (sizeof(sizes) / sizeof(sizes[0])); i++) {
+        width = sizes[i][0];
+        height = sizes[i][1];
+        make_image(gray, width, height);
+        for (k = 0; k < NUM_OF_KERNELS; k++) {
+            if (s_kernels[k].divisor == 0) {
+                continue;
+            }
+            rc = dither(gray, width, height, k, bits);
+            if (rc != ICS_ERROR_SUCCESS) {
+                fprintf(stderr, "epaper_dither() failed: %u\n", rc);
+                return -1;
+            }
+            reference_diffuse(k, gray, width, height, error, expected);
+            if (memcmp(bits, expected,
+                       (((width + 7) / 8) * height)) != 0) {
+                fprintf(stderr, "%s: %ux%u differs from the reference\n",
+                        s_kernels[k].name, width, height);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int verify_density(
+    UINT8* gray,
+    UINT8* bits)
+{
+    UINT32 k;
+    UINT32 level;
+    UINT32 rc;
+    UINT32 black;
+    UINT32 expected;
+    UINT32 tolerance;
+    const UINT32 width = 256;
+    const UINT32 height = 256;
+
+    for (k = 0; k < NUM_OF_KERNELS; k++) {
+        if (s_kernels[k].dither == EPAPER_DITHER_NONE) {
+            continue;
+        }
+        for (level = 0; level <= 255; level += 5) {
+            memset(gray, (int)level, (width * height));
+            rc = dither(gray, width, height, k, bits);
+            if (rc != ICS_ERROR_SUCCESS) {
+                fprintf(stderr, "epaper_dither() failed: %u\n", rc);
+                return -1;
+            }
+            black = count_black(bits, ((width * height) / 8));
+            expected = (((255 - level) * width * height) / 255);
+
+            /* Atkinson drops 2/8 of the error, which clips the tones */
+            tolerance = ((width * height) / 100);
+            if (s_kernels[k].dither == EPAPER_DITHER_ATKINSON) {
+                tolerance = ((width * height) / 8);
+            }
+            if (((level == 0) && (black != (width * height))) ||
+                ((level == 255) && (black != 0)) ||
+                (((black > expected) ? (black - expected) :
+                  (expected - black)) > tolerance)) {
+                fprintf(stderr, "%s: level %u has %u black pixel(s), "
+                        "not %u\n", s_kernels[k].name, level, black,
+                        expected);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * measurement
+ */
+
+static double host_time_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((ts.tv_sec * 1e6) + (ts.tv_nsec / 1e3));
+}
+
+static void run_benchmark(
+    UINT8* gray,
+    UINT8* bits,
+    char* rgba,
+    UINT32 width,
+    UINT32 height)
+{
+    UINT32 k;
+    UINT32 n;
+    UINT32 scratch_len;
+    UINT32 num_of_pixels;
+    double host0;
+    double usec;
+    double legacy_usec;
+    void* scratch;
+
+    num_of_pixels = (width * height);
+    make_image(gray, width, height);
+    epaper_get_dither_scratch_len(width, &scratch_len);
+    scratch = malloc(scratch_len);
+
+    host0 = host_time_usec();
+    for (n = 0; n < s_iterations; n++) {
+        legacy_render(gray, width, height, rgba, bits);
+        s_sink += bits[n % (num_of_pixels / 8)];
+    }
+    legacy_usec = (host_time_usec() - host0);
+    printf("%4ux%-4u %-10s %9.2f %9.1f %7s\n", width, height, "legacy",
+           ((legacy_usec * 1e3) / s_iterations) / num_of_pixels,
+           ((double)num_of_pixels * s_iterations) / legacy_usec, "1.00");
+
+    for (k = 0; k < NUM_OF_KERNELS; k++) {
+        host0 = host_time_usec();
+        for (n = 0; n < s_iterations; n++) {
+            epaper_dither(gray, width, height, width, s_kernels[k].dither,
+                          scratch, scratch_len, bits, (num_of_pixels / 8));
+            s_sink += bits[n % (num_of_pixels / 8)];
+        }
+        usec = (host_time_usec() - host0);
+        printf("%4ux%-4u %-10s %9.2f %9.1f %7.2f\n", width, height,
+               s_kernels[k].name,
+               ((usec * 1e3) / s_iterations) / num_of_pixels,
+               ((double)num_of_pixels * s_iterations) / usec,
+               ((usec > 0) ? (legacy_usec / usec) : 0));
+    }
+    free(scratch);
+}
+
+int main(int argc, char* argv[])
+{
+    int opt;
+    int ret;
+    unsigned int seed = 1;
+    UINT8* gray;
+    UINT8* bits;
+    UINT8* expected;
+    INT32* error;
+    char* rgba;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+        case 'n':
+            s_iterations = (UINT32)strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = (unsigned int)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n iterations] [-s seed]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (s_iterations == 0) {
+        fprintf(stderr, "invalid iterations: %u\n", s_iterations);
+        return 1;
+    }
+    srand(seed);
+
+    gray = (UINT8*)malloc(MAX_WIDTH * MAX_HEIGHT);
+    bits = (UINT8*)malloc(MAX_WIDTH * MAX_HEIGHT / 8);
+    expected = (UINT8*)malloc(MAX_WIDTH * MAX_HEIGHT / 8);
+    error = (INT32*)malloc(MAX_WIDTH * MAX_HEIGHT * sizeof(INT32));
+    rgba = (char*)malloc((MAX_WIDTH * (MAX_HEIGHT + 2) * 4) + 8);
+    if ((gray == NULL) || (bits == NULL) || (expected == NULL) ||
+        (error == NULL) || (rgba == NULL)) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    ret = 1;
+    if ((verify_reference(gray, bits, expected, error) == 0) &&
+        (verify_density(gray, bits) == 0)) {
+        printf("%-9s %-10s %9s %9s %7s\n",
+               "image", "dither", "ns/pixel", "Mpixel/s", "speedup");
+        run_benchmark(gray, bits, rgba, 264, 176);
+        run_benchmark(gray, bits, rgba, MAX_WIDTH, MAX_HEIGHT);
+        ret = 0;
+    }
+
+    free(gray);
+    free(bits);
+    free(expected);
+    free(error);
+    free(rgba);
+
+    return ret;
+}
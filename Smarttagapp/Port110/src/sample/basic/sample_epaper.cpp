@@ -0,0 +1,566 @@
+/*
+ * Copyright 2013 Sony Corporation
+ */
+
+/*
+ * Verification and micro-benchmark of the e-paper rendering
+ * (epaper_render() against a pass-per-step reference in floating point,
+ * which is how the application prepared a photo before).
+ *
+ * usage: sample_epaper [-n iterations] [-s seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ics_types.h"
+#include "ics_error.h"
+#include "epaper.h"
+
+#ifndef DEFAULT_ITERATIONS
+#define DEFAULT_ITERATIONS 20
+#endif
+#define PHOTO_WIDTH 2448
+#define PHOTO_HEIGHT 3264
+
+static UINT32 s_iterations = DEFAULT_ITERATIONS;
+static volatile UINT32 s_sink;
+
+/* the crops of the application: (x, y, w, h) of a scaled photo */
+static const struct {
+    UINT32 panel;
+    double scaled_width;
+    double scaled_height;
+    double x;
+    double y;
+    const char* name;
+} s_layouts[] = {
+    {EPAPER_PANEL_20INCH, 212, 284, 6, 52, "2.0in"},
+    {EPAPER_PANEL_27INCH, 276, 369, 6, 46, "2.7in"},
+};
+
+/*
+ * images
+ */
+
+static UINT8* make_photo(
+    UINT32 width,
+    UINT32 height)
+{
+    UINT32 x;
+    UINT32 y;
+    UINT8* pixels;
+    UINT8* p;
+
+    pixels = (UINT8*)malloc(width * height * 4);
+    if (pixels == NULL) {
+        return NULL;
+    }
+    p = pixels;
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            /* gradients, a disc and some noise */
+            double dx = ((double)x - (width / 2.0));
+            double dy = ((double)y - (height / 3.0));
+            UINT32 in_disc = (((dx * dx) + (dy * dy)) <
+                              ((width / 4.0) * (width / 4.0)));
+            p[0] = (UINT8)(((x * 255) / width) ^ (in_disc ? 0x80 : 0));
+            p[1] = (UINT8)((y * 255) / height);
+            p[2] = (UINT8)((rand() & 0x3f) + (in_disc ? 0xc0 : 0x20));
+            p[3] = 0xff;
+            p += 4;
+        }
+    }
+
+    return pixels;
+}
+
+static void layout_rect(
+    UINT32 index,
+    UINT32 width,
+    UINT32 height,
+    UINT32 panel_width,
+    UINT32 panel_height,
+    epaper_rect_t* rect)
+{
+    double sx = (width / s_layouts[index].scaled_width);
+    double sy = (height / s_layouts[index].scaled_height);
+
+    rect->x = (UINT32)((s_layouts[index].x * sx) + 0.5);
+    rect->y = (UINT32)((s_layouts[index].y * sy) + 0.5);
+    rect->width = (UINT32)((panel_width * sx) + 0.5);
+    rect->height = (UINT32)((panel_height * sy) + 0.5);
+}
+
+/*
+ * reference: one full pass per step, in double
+ */
+
+typedef struct reference_t {
+    double* luma;               /* the whole source */
+    double* crop;               /* the rectangle */
+    double* scaled;             /* the panel */
+    UINT8* gray;                /* the panel */
+} reference_t;
+
+static void reference_render(
+    const epaper_image_t* image,
+    const epaper_rect_t* rect,
+    UINT32 width,
+    UINT32 height,
+    const epaper_option_t* option,
+    reference_t* ref,
+    UINT8* frame)
+{
+    UINT32 x;
+    UINT32 y;
+    UINT32 i;
+    UINT32 j;
+    const UINT8* p;
+
+    /* luminance */
+    for (y = 0; y < image->height; y++) {
+        p = (image->pixels + (y * image->stride));
+        for (x = 0; x < image->width; x++) {
+            ref->luma[(y * image->width) + x] =
+                ((0.299 * p[0]) + (0.587 * p[1]) + (0.114 * p[2]));
+            p += 4;
+        }
+    }
+
+    /* crop */
+    for (y = 0; y < rect->height; y++) {
+        for (x = 0; x < rect->width; x++) {
+            ref->crop[(y * rect->width) + x] =
+                ref->luma[((rect->y + y) * image->width) + rect->x + x];
+        }
+    }
+
+    /* area average */
+    for (y = 0; y < height; y++) {
+        double y0 = (((double)y * rect->height) / height);
+        double y1 = (((double)(y + 1) * rect->height) / height);
+        for (x = 0; x < width; x++) {
+            double x0 = (((double)x * rect->width) / width);
+            double x1 = (((double)(x + 1) * rect->width) / width);
+            double sum = 0;
+            for (j = (UINT32)y0; j < y1; j++) {
+                double wy = (((j + 1 < y1) ? (j + 1) : y1) -
+                             ((j > y0) ? j : y0));
+                for (i = (UINT32)x0; i < x1; i++) {
+                    double wx = (((i + 1 < x1) ? (i + 1) : x1) -
+                                 ((i > x0) ? i : x0));
+                    sum += (wx * wy * ref->crop[(j * rect->width) + i]);
+                }
+            }
+            ref->scaled[(y * width) + x] =
+                (sum / ((x1 - x0) * (y1 - y0)));
+        }
+    }
+
+    /* tone */
+    for (i = 0; i < (width * height); i++) {
+        ref->gray[i] = (UINT8)floor(((ref->scaled[i] * option->tone) /
+                                     255.0) + 0.5);
+    }
+
+    /* threshold and pack */
+    memset(frame, 0, ((width * height) / 8));
+    for (i = 0; i < (width * height); i++) {
+        if (ref->gray[i] < 128) {
+            frame[i / 8] |= (UINT8)(0x80 >> (i % 8));
+        }
+    }
+}
+
+/*
+ * verification
+ */
+
+static UINT32 render(
+    const epaper_image_t* image,
+    const epaper_rect_t* rect,
+    UINT32 panel,
+    UINT32 tone,
+    UINT32 dither,
+    UINT8* frame)
+{
+    UINT32 rc;
+    UINT32 scratch_len;
+    epaper_option_t option;
+    epaper_rect_t whole;
+    void* scratch;
+
+    if (rect == NULL) {
+        whole.x = 0;
+        whole.y = 0;
+        whole.width = image->width;
+        whole.height = image->height;
+    }
+    rc = epaper_get_scratch_len(panel, ((rect != NULL) ? rect : &whole),
+                                &scratch_len);
+    if (rc != ICS_ERROR_SUCCESS) {
+        return rc;
+    }
+    scratch = malloc(scratch_len);
+    if (scratch == NULL) {
+        return ICS_ERROR_NO_RESOURCES;
+    }
+    option.tone = tone;
+    option.dither = dither;
+    rc = epaper_render(image, rect, panel, &option, scratch, scratch_len,
+                       frame, EPAPER_MAX_FRAME_LEN);
+    free(scratch);
+
+    return rc;
+}
+
+static UINT32 count_black(
+    const UINT8* frame,
+    UINT32 frame_len)
+{
+    UINT32 i;
+    UINT32 n;
+
+    n = 0;
+    for (i = 0; i < frame_len; i++) {
+        n += (UINT32)__builtin_popcount(frame[i]);
+    }
+
+    return n;
+}
+
+static int verify_reference(
+    const epaper_image_t* photo)
+{
+    UINT32 i;
+    UINT32 k;
+    UINT32 rc;
+    UINT32 width;
+    UINT32 height;
+    UINT32 frame_len;
+    UINT32 num_of_differences;
+    epaper_rect_t rect;
+    epaper_option_t option;
+    reference_t ref;
+    UINT8 frame[EPAPER_MAX_FRAME_LEN];
+    UINT8 expected[EPAPER_MAX_FRAME_LEN];
+
+    option.tone = EPAPER_TONE_PHOTO;
+    option.dither = EPAPER_DITHER_NONE;
+
+    ref.luma = (double*)malloc(photo->width * photo->height * sizeof(double));
+    ref.crop = (double*)malloc(photo->width * photo->height * sizeof(double));
+    ref.scaled = (double*)malloc(EPAPER_MAX_FRAME_LEN * 8 * sizeof(double));
+    ref.gray = (UINT8*)malloc(EPAPER_MAX_FRAME_LEN * 8);
+    if ((ref.luma == NULL) || (ref.crop == NULL) ||
+        (ref.scaled == NULL) || (ref.gray == NULL)) {
+        fprintf(stderr, "out of memory\n");
+        return -1;
+    }
+
+    for (i = 0; i < (sizeof(s_layouts) / sizeof(s_layouts[0])); i++) {
+        epaper_get_panel_size(s_layouts[i].panel, &width, &height,
+                              &frame_len);
+        layout_rect(i, photo->width, photo->height, width, height, &rect);
+
+        rc = render(photo, &rect, s_layouts[i].panel, option.tone,
+                    option.dither, frame);
+        if (rc != ICS_ERROR_SUCCESS) {
+            fprintf(stderr, "epaper_render() failed: %u\n", rc);
+            return -1;
+        }
+        reference_render(photo, &rect, width, height, &option, &ref,
+                         expected);
+
+        /* only a gray level right at the threshold may round the other way */
+        num_of_differences = 0;
+        for (k = 0; k < (width * height); k++) {
+            UINT32 bit = (0x80U >> (k % 8));
+            if ((frame[k / 8] & bit) != (expected[k / 8] & bit)) {
+                if ((ref.gray[k] < 127) || (ref.gray[k] > 128)) {
+                    fprintf(stderr, "%s: pixel (%u, %u) differs: gray=%u\n",
+                            s_layouts[i].name, (k % width), (k / width),
+                            ref.gray[k]);
+                    return -1;
+                }
+                num_of_differences++;
+            }
+        }
+        printf("%s: %ux%u from (%u, %u, %u, %u), "
+               "%u pixel(s) at the threshold differ\n",
+               s_layouts[i].name, width, height,
+               rect.x, rect.y, rect.width, rect.height,
+               num_of_differences);
+    }
+
+    free(ref.luma);
+    free(ref.crop);
+    free(ref.scaled);
+    free(ref.gray);
+
+    return 0;
+}
+
+static int verify_identity(void)
+{
+    UINT32 k;
+    UINT32 rc;
+    epaper_image_t image;
+    UINT8 pixels[EPAPER_PANEL_27INCH_WIDTH * EPAPER_PANEL_27INCH_HEIGHT];
+    UINT8 frame[EPAPER_MAX_FRAME_LEN];
+
+    /* a black and white image of the panel size is packed as it is */
+    for (k = 0; k < sizeof(pixels); k++) {
+        pixels[k] = ((rand() & 1) ? 0xff : 0x00);
+    }
+    image.pixels = pixels;
+    image.width = EPAPER_PANEL_27INCH_WIDTH;
+    image.height = EPAPER_PANEL_27INCH_HEIGHT;
+    image.stride = EPAPER_PANEL_27INCH_WIDTH;
+    image.format = EPAPER_FORMAT_GRAY8;
+
+    rc = render(&image, NULL, EPAPER_PANEL_27INCH, EPAPER_TONE_IDENTITY,
+                EPAPER_DITHER_JJN, frame);
+    if (rc != ICS_ERROR_SUCCESS) {
+        fprintf(stderr, "epaper_render() failed: %u\n", rc);
+        return -1;
+    }
+    for (k = 0; k < sizeof(pixels); k++) {
+        if (((frame[k / 8] >> (7 - (k % 8))) & 1) != (pixels[k] == 0)) {
+            fprintf(stderr, "identity: pixel %u differs\n", k);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int verify_dither(void)
+{
+    UINT32 level;
+    UINT32 rc;
+    UINT32 black;
+    UINT32 expected;
+    epaper_image_t image;
+    UINT8 pixels[64 * 64];
+    UINT8 frame[EPAPER_MAX_FRAME_LEN];
+    const UINT32 num_of_pixels =
+        (EPAPER_PANEL_20INCH_WIDTH * EPAPER_PANEL_20INCH_HEIGHT);
+
+    /* a flat gray is dithered into the same share of black pixels */
+    for (level = 0; level <= 255; level += 15) {
+        memset(pixels, (int)level, sizeof(pixels));
+        image.pixels = pixels;
+        image.width = 64;
+        image.height = 64;
+        image.stride = 64;
+        image.format = EPAPER_FORMAT_GRAY8;
+        rc = render(&image, NULL, EPAPER_PANEL_20INCH, EPAPER_TONE_IDENTITY,
+                    EPAPER_DITHER_JJN, frame);
+        if (rc != ICS_ERROR_SUCCESS) {
+            fprintf(stderr, "epaper_render() failed: %u\n", rc);
+            return -1;
+        }
+        black = count_black(frame, (num_of_pixels / 8));
+        expected = (((255 - level) * num_of_pixels) / 255);
+        if (((black > expected) ? (black - expected) : (expected - black)) >
+            (num_of_pixels / 100)) {
+            fprintf(stderr, "dither: level %u has %u black pixel(s), "
+                    "not %u\n", level, black, expected);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int verify_errors(
+    const epaper_image_t* photo)
+{
+    UINT32 scratch_len;
+    epaper_rect_t rect;
+    epaper_option_t option;
+    UINT8 frame[EPAPER_MAX_FRAME_LEN];
+    UINT8* scratch;
+
+    rect.x = 0;
+    rect.y = 0;
+    rect.width = photo->width;
+    rect.height = photo->height;
+    option.tone = EPAPER_TONE_IDENTITY;
+    option.dither = EPAPER_DITHER_JJN;
+    epaper_get_scratch_len(EPAPER_PANEL_27INCH, &rect, &scratch_len);
+    scratch = (UINT8*)malloc(scratch_len + 1);
+    if (scratch == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return -1;
+    }
+
+    /* a short scratch, a short frame and a rectangle out of the image */
+    if ((epaper_render(photo, &rect, EPAPER_PANEL_27INCH, &option,
+                       (scratch + 1), (scratch_len - 8), frame,
+                       sizeof(frame)) != ICS_ERROR_NO_RESOURCES) ||
+        (epaper_render(photo, &rect, EPAPER_PANEL_27INCH, &option,
+                       scratch, scratch_len, frame,
+                       (sizeof(frame) - 1)) != ICS_ERROR_BUF_OVERFLOW)) {
+        fprintf(stderr, "errors: short buffers accepted\n");
+        free(scratch);
+        return -1;
+    }
+    rect.x = 1;
+    if (epaper_render(photo, &rect, EPAPER_PANEL_27INCH, &option,
+                      scratch, scratch_len, frame,
+                      sizeof(frame)) != ICS_ERROR_INVALID_PARAM) {
+        fprintf(stderr, "errors: rectangle out of the image accepted\n");
+        free(scratch);
+        return -1;
+    }
+
+    /* any alignment of the scratch will do */
+    rect.x = 0;
+    if (epaper_render(photo, &rect, EPAPER_PANEL_27INCH, &option,
+                      (scratch + 1), scratch_len, frame,
+                      sizeof(frame)) != ICS_ERROR_SUCCESS) {
+        fprintf(stderr, "errors: unaligned scratch rejected\n");
+        free(scratch);
+        return -1;
+    }
+    free(scratch);
+
+    return 0;
+}
+
+/*
+ * measurement
+ */
+
+static double host_time_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((ts.tv_sec * 1e6) + (ts.tv_nsec / 1e3));
+}
+
+static void run_benchmark(
+    const epaper_image_t* photo)
+{
+    UINT32 i;
+    UINT32 n;
+    UINT32 width;
+    UINT32 height;
+    UINT32 frame_len;
+    UINT32 scratch_len;
+    double host0;
+    double render_usec;
+    double reference_usec;
+    epaper_rect_t rect;
+    epaper_option_t option;
+    reference_t ref;
+    void* scratch;
+    UINT8 frame[EPAPER_MAX_FRAME_LEN];
+
+    option.tone = EPAPER_TONE_PHOTO;
+    option.dither = EPAPER_DITHER_JJN;
+    ref.luma = (double*)malloc(photo->width * photo->height * sizeof(double));
+    ref.crop = (double*)malloc(photo->width * photo->height * sizeof(double));
+    ref.scaled = (double*)malloc(EPAPER_MAX_FRAME_LEN * 8 * sizeof(double));
+    ref.gray = (UINT8*)malloc(EPAPER_MAX_FRAME_LEN * 8);
+
+    printf("%-6s %12s %10s %10s %12s %7s\n",
+           "panel", "scratch(B)", "ms/frame", "ref(ms)", "frames/s",
+           "speedup");
+    for (i = 0; i < (sizeof(s_layouts) / sizeof(s_layouts[0])); i++) {
+        epaper_get_panel_size(s_layouts[i].panel, &width, &height,
+                              &frame_len);
+        layout_rect(i, photo->width, photo->height, width, height, &rect);
+        epaper_get_scratch_len(s_layouts[i].panel, &rect, &scratch_len);
+        scratch = malloc(scratch_len);
+
+        host0 = host_time_usec();
+        for (n = 0; n < s_iterations; n++) {
+            epaper_render(photo, &rect, s_layouts[i].panel, &option,
+                          scratch, scratch_len, frame, sizeof(frame));
+            s_sink += frame[n % frame_len];
+        }
+        render_usec = (host_time_usec() - host0);
+
+        host0 = host_time_usec();
+        for (n = 0; n < s_iterations; n++) {
+            reference_render(photo, &rect, width, height, &option, &ref,
+                             frame);
+            s_sink += frame[n % frame_len];
+        }
+        reference_usec = (host_time_usec() - host0);
+
+        printf("%-6s %12u %10.2f %10.2f %12.1f %7.2f\n",
+               s_layouts[i].name, scratch_len,
+               (render_usec / 1e3) / s_iterations,
+               (reference_usec / 1e3) / s_iterations,
+               (s_iterations * 1e6) / render_usec,
+               ((render_usec > 0) ? (reference_usec / render_usec) : 0));
+        free(scratch);
+    }
+
+    free(ref.luma);
+    free(ref.crop);
+    free(ref.scaled);
+    free(ref.gray);
+}
+
+int main(int argc, char* argv[])
+{
+    int opt;
+    unsigned int seed = 1;
+    epaper_image_t photo;
+    UINT8* pixels;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+        case 'n':
+            s_iterations = (UINT32)strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = (unsigned int)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n iterations] [-s seed]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (s_iterations == 0) {
+        fprintf(stderr, "invalid iterations: %u\n", s_iterations);
+        return 1;
+    }
+    srand(seed);
+
+    pixels = make_photo(PHOTO_WIDTH, PHOTO_HEIGHT);
+    if (pixels == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    photo.pixels = pixels;
+    photo.width = PHOTO_WIDTH;
+    photo.height = PHOTO_HEIGHT;
+    photo.stride = (PHOTO_WIDTH * 4);
+    photo.format = EPAPER_FORMAT_RGBA8888;
+
+    if ((verify_reference(&photo) != 0) ||
+        (verify_identity() != 0) ||
+        (verify_dither() != 0) ||
+        (verify_errors(&photo) != 0)) {
+        free(pixels);
+        return 1;
+    }
+
+    run_benchmark(&photo);
+    free(pixels);
+
+    return 0;
+}
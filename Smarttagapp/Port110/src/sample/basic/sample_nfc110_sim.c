@@ -0,0 +1,13 @@
+/*
+ * Copyright 2006,2007,2008,2011 Sony Corporation
+ */
+
+#include <nfc110_sim.h>
+#include <felica_cc.h>
+#include <stub/felica_cc_stub_nfc110.h>
+
+const icsdrv_basic_func_t* g_drv_func = &nfc110_sim_basic_func;
+
+UINT32 (*g_felica_cc_stub_initialize_func)(
+    felica_cc_devf_t* devf,
+    ICS_HW_DEVICE* dev) = felica_cc_stub_nfc110_initialize;
@@ -0,0 +1,341 @@
+/*
+ * Copyright 2013 Sony Corporation
+ */
+
+/*
+ * Converts a trace file of icstrace (e.g. sample_benchmark -T) into
+ * Chrome trace JSON (chrome://tracing, Perfetto), and prints the latency
+ * histograms of the commands, the ACKs and the SmartTag functions.
+ *
+ * usage: sample_trace_dump trace_file [json_file]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ics_types.h"
+#include "ics_error.h"
+#include "icstrace.h"
+
+#define MAX_DEPTH 16
+#define MAX_LATENCIES 64
+#define NUM_OF_BUCKETS 32 /* [2^(k-1), 2^k) us */
+
+/* a begin which waits for its end */
+typedef struct open_event_t {
+    UINT16 tag;
+    UINT64 time_usec;
+} open_event_t;
+
+typedef struct latency_t {
+    const char* kind;
+    UINT16 tag;
+    UINT32 count;
+    UINT64 total_usec;
+    UINT64 min_usec;
+    UINT64 max_usec;
+    UINT32 buckets[NUM_OF_BUCKETS];
+} latency_t;
+
+static open_event_t s_open[ICSTRACE_MAX_THREADS][MAX_DEPTH];
+static UINT32 s_depth[ICSTRACE_MAX_THREADS];
+static latency_t s_latencies[MAX_LATENCIES];
+static UINT32 s_num_of_latencies;
+
+static const char* event_name(
+    UINT8 type,
+    UINT16 tag,
+    char* buf,
+    size_t buf_len)
+{
+    switch (type) {
+    case ICSTRACE_EVENT_BLE_TX:
+        return "ble_tx";
+    case ICSTRACE_EVENT_BLE_RX:
+        return "ble_rx";
+    default:
+        break;
+    }
+
+    switch (tag & 0xff00) {
+    case ICSTRACE_TAG_NFC110:
+        snprintf(buf, buf_len, "nfc110 %02x", (tag & 0xff));
+        break;
+    case ICSTRACE_TAG_WWE:
+        snprintf(buf, buf_len, "WWE %02x", (tag & 0xff));
+        break;
+    case ICSTRACE_TAG_RWE:
+        snprintf(buf, buf_len, "RWE");
+        break;
+    case ICSTRACE_TAG_POLLING:
+        snprintf(buf, buf_len, "polling");
+        break;
+    case ICSTRACE_TAG_PIPELINE:
+        snprintf(buf, buf_len, "pipeline");
+        break;
+    case ICSTRACE_TAG_SESSION:
+        snprintf(buf, buf_len, "session %u", (tag & 0xff));
+        break;
+    default:
+        snprintf(buf, buf_len, "%04x", tag);
+        break;
+    }
+    if (type == ICSTRACE_EVENT_ACK) {
+        strncat(buf, " ack", (buf_len - strlen(buf) - 1));
+    } else if (type == ICSTRACE_EVENT_RETRY) {
+        strncat(buf, " retry", (buf_len - strlen(buf) - 1));
+    } else if (type == ICSTRACE_EVENT_CANCEL) {
+        strncat(buf, " cancel", (buf_len - strlen(buf) - 1));
+    }
+
+    return buf;
+}
+
+static void add_latency(
+    const char* kind,
+    UINT16 tag,
+    UINT64 usec)
+{
+    latency_t* latency;
+    UINT32 i;
+    UINT32 k;
+
+    for (i = 0; i < s_num_of_latencies; i++) {
+        if ((s_latencies[i].kind == kind) && (s_latencies[i].tag == tag)) {
+            break;
+        }
+    }
+    if (i == s_num_of_latencies) {
+        if (s_num_of_latencies == MAX_LATENCIES) {
+            return;
+        }
+        s_num_of_latencies++;
+        memset(&s_latencies[i], 0, sizeof(s_latencies[i]));
+        s_latencies[i].kind = kind;
+        s_latencies[i].tag = tag;
+        s_latencies[i].min_usec = usec;
+    }
+    latency = &s_latencies[i];
+
+    for (k = 0; ((k + 1) < NUM_OF_BUCKETS) && ((usec >> k) > 0); k++) {
+    }
+    latency->buckets[k]++;
+    latency->count++;
+    latency->total_usec += usec;
+    if (usec < latency->min_usec) {
+        latency->min_usec = usec;
+    }
+    if (usec > latency->max_usec) {
+        latency->max_usec = usec;
+    }
+}
+
+/* the upper bound of the bucket which holds the percentile */
+static UINT64 percentile_usec(
+    const latency_t* latency,
+    UINT32 percent)
+{
+    UINT32 n;
+    UINT32 k;
+
+    n = 0;
+    for (k = 0; k < NUM_OF_BUCKETS; k++) {
+        n += latency->buckets[k];
+        if ((n * 100ULL) >= ((UINT64)latency->count * percent)) {
+            break;
+        }
+    }
+    return ((k == 0) ? 0 : ((1ULL << k) - 1));
+}
+
+static void print_latencies(void)
+{
+    const latency_t* latency;
+    char name[32];
+    UINT32 i;
+    UINT32 k;
+    UINT32 peak;
+    UINT32 width;
+
+    for (i = 0; i < s_num_of_latencies; i++) {
+        latency = &s_latencies[i];
+        printf("%s %s: %u, min %llu us, avg %llu us, p50 <%llu us, "
+               "p99 <%llu us, max %llu us\n",
+               latency->kind,
+               event_name(0, latency->tag, name, sizeof(name)),
+               latency->count,
+               (unsigned long long)latency->min_usec,
+               (unsigned long long)(latency->total_usec / latency->count),
+               (unsigned long long)(percentile_usec(latency, 50) + 1),
+               (unsigned long long)(percentile_usec(latency, 99) + 1),
+               (unsigned long long)latency->max_usec);
+
+        peak = 0;
+        for (k = 0; k < NUM_OF_BUCKETS; k++) {
+            if (latency->buckets[k] > peak) {
+                peak = latency->buckets[k];
+            }
+        }
+        for (k = 0; k < NUM_OF_BUCKETS; k++) {
+            if (latency->buckets[k] == 0) {
+                continue;
+            }
+            width = (UINT32)(((UINT64)latency->buckets[k] * 50) / peak);
+            printf("  <%10llu us %7u %.*s\n",
+                   (unsigned long long)(1ULL << k), latency->buckets[k],
+                   (int)((width > 0) ? width : 1),
+                   "##################################################");
+        }
+    }
+}
+
+static void analyze_event(
+    const icstrace_event_t* event)
+{
+    UINT32 thread = event->thread;
+    open_event_t* open;
+
+    switch (event->type) {
+    case ICSTRACE_EVENT_CMD_BEGIN:
+    case ICSTRACE_EVENT_FUNC_BEGIN:
+        if (s_depth[thread] < MAX_DEPTH) {
+            open = &s_open[thread][s_depth[thread]];
+            open->tag = event->tag;
+            open->time_usec = event->time_usec;
+        }
+        s_depth[thread]++;
+        break;
+
+    case ICSTRACE_EVENT_CMD_END:
+    case ICSTRACE_EVENT_FUNC_END:
+        if (s_depth[thread] == 0) {
+            /* the begin was overwritten in the ring */
+            break;
+        }
+        s_depth[thread]--;
+        if (s_depth[thread] < MAX_DEPTH) {
+            open = &s_open[thread][s_depth[thread]];
+            if (open->tag == event->tag) {
+                add_latency(((event->type == ICSTRACE_EVENT_CMD_END) ?
+                             "command" : "function"),
+                            event->tag,
+                            (event->time_usec - open->time_usec));
+            }
+        }
+        break;
+
+    case ICSTRACE_EVENT_ACK:
+        if ((s_depth[thread] > 0) && (s_depth[thread] <= MAX_DEPTH)) {
+            open = &s_open[thread][s_depth[thread] - 1];
+            if (open->tag == event->tag) {
+                add_latency("ack", event->tag,
+                            (event->time_usec - open->time_usec));
+            }
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void write_event(
+    FILE* fp,
+    const icstrace_event_t* event,
+    UINT64 base_usec,
+    BOOL is_first)
+{
+    char name[32];
+
+    fprintf(fp, "%s\n{\"name\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%llu,",
+            (is_first ? "" : ","),
+            event_name(event->type, event->tag, name, sizeof(name)),
+            event->thread,
+            (unsigned long long)(event->time_usec - base_usec));
+
+    switch (event->type) {
+    case ICSTRACE_EVENT_CMD_BEGIN:
+    case ICSTRACE_EVENT_FUNC_BEGIN:
+        fprintf(fp, "\"ph\":\"B\",\"args\":{\"value\":%u}}", event->value);
+        break;
+    case ICSTRACE_EVENT_CMD_END:
+    case ICSTRACE_EVENT_FUNC_END:
+        fprintf(fp, "\"ph\":\"E\",\"args\":{\"error\":%u}}", event->value);
+        break;
+    default:
+        fprintf(fp, "\"ph\":\"i\",\"s\":\"t\",\"args\":{\"value\":%u}}",
+                event->value);
+        break;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    FILE* fp;
+    FILE* out;
+    icstrace_file_header_t header;
+    icstrace_event_t event;
+    UINT64 base_usec;
+    UINT32 i;
+
+    if ((argc < 2) || (argc > 3)) {
+        fprintf(stderr, "usage: %s trace_file [json_file]\n", argv[0]);
+        return 1;
+    }
+
+    fp = fopen(argv[1], "rb");
+    if (fp == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    if ((fread(&header, sizeof(header), 1, fp) != 1) ||
+        (memcmp(header.magic, ICSTRACE_FILE_MAGIC, sizeof(header.magic))
+         != 0) ||
+        (header.version != ICSTRACE_FILE_VERSION)) {
+        fprintf(stderr, "%s: not a trace file\n", argv[1]);
+        fclose(fp);
+        return 1;
+    }
+
+    out = NULL;
+    if (argc == 3) {
+        out = fopen(argv[2], "w");
+        if (out == NULL) {
+            perror(argv[2]);
+            fclose(fp);
+            return 1;
+        }
+        fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    }
+
+    base_usec = 0;
+    for (i = 0; i < header.num_of_events; i++) {
+        if (fread(&event, sizeof(event), 1, fp) != 1) {
+            fprintf(stderr, "%s: truncated at event %u\n", argv[1], i);
+            break;
+        }
+        if (event.thread >= ICSTRACE_MAX_THREADS) {
+            continue;
+        }
+        if (i == 0) {
+            base_usec = event.time_usec;
+        }
+        analyze_event(&event);
+        if (out != NULL) {
+            write_event(out, &event, base_usec, (i == 0));
+        }
+    }
+    fclose(fp);
+
+    if (out != NULL) {
+        fprintf(out, "\n]}\n");
+        fclose(out);
+    }
+
+    printf("%u events (%u dropped)\n",
+           header.num_of_events, header.num_of_dropped);
+    print_latencies();
+
+    return 0;
+}
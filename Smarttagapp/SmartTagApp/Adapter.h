@@ -72,6 +72,13 @@
 #define ADAPTER_EVENT_SHOW_LAYOUT_COMPLETE        @"AdapterEventShowLayoutComplete"
 //スマートタグ　画像の表示
 #define ADAPTER_EVENT_SHOW_IMAGE_COMPLETE         @"AdapterEventShowImageComplete"
+//スマートタグ　セッションのコマンド送信完了 (userInfoのADAPTER_KEY_IDMに対象のIDm)
+#define ADAPTER_EVENT_SESSION_COMMAND_COMPLETE    @"AdapterEventSessionCommandComplete"
+//スマートタグ　セッションのコマンド送信エラー (userInfoのADAPTER_KEY_IDMに対象のIDm)
+#define ADAPTER_EVENT_SESSION_COMMAND_ERROR       @"AdapterEventSessionCommandError"
+
+//イベントのuserInfoに含まれるスマートタグのIDm
+#define ADAPTER_KEY_IDM                           @"IDM"
 
 //バーコードリーダーからバーコードデータ受信
 #define ADAPTER_EVENT_BARCODE_DATA_RECIEVED       @"AdapterEventBarcodeDataRecieved"
@@ -86,6 +93,8 @@
 
 
 
+//セッションのコマンド送信の完了 (success:NOの場合はエラー)
+typedef void (^AdapterCompletion)(BOOL success);
 
 
 @interface Adapter : NSObject
@@ -110,9 +119,21 @@
 + (void) showLayout:(int)layout;
 + (void) saveScreen:(int)layout;
 + (void) showImage:(UIImage *)image;
++ (void) showFrame:(NSData *)frame; //epaper_render()で作成したパネル形式の画像
 + (void) saveURL:(NSString *)url;
 + (void) loadURL;
 
+//RFID (複数タグ)
++ (NSArray *) smartTagIDms;
++ (void) showLayout:(int)layout forIDm:(NSString *)idm;
++ (void) showImage:(UIImage *)image forIDm:(NSString *)idm;
++ (void) showLayout:(int)layout forIDm:(NSString *)idm completion:(AdapterCompletion)completion;
++ (void) showImage:(UIImage *)image forIDm:(NSString *)idm completion:(AdapterCompletion)completion;
+
+//RFID (複数リーダー)
++ (void) openReader:(NSString *)uuid completion:(AdapterCompletion)completion; //追加のリーダーを接続 (uuidが空の場合は接続していないリーダー)
++ (int) numOpenReaders;
+
 // Adapter event methods
 + (void) addObserver:(id)notificationObserver selector:(SEL)notificationSelector name:(NSString*)notificationName;
 + (void) removeObserver:(id)notificationObserver name:(NSString *)notificationName;
@@ -8,15 +8,45 @@
 #import "Port110.h"
 #import "CardCommand.h"
 #import "SmarttagData.h"
+#import "ics_error.h"
+#import "epaper.h"
+#import "icstrace.h"
+#import "smarttag_cache.h"
+
+
+//フィールド内のスマートタグごとのセッション
+@interface SmartTagSession : NSObject
+
+@property (nonatomic, strong) NSString *idm;
+@property (nonatomic, strong) NSData *idmData;
+@property (nonatomic) SmartTagType type;
+@property (nonatomic) BatteryStatus battery;
+@property (nonatomic) SmartTagStatus status;
+@property (nonatomic) BOOL isPresent;
+//送信待ちのコマンド (WWE/RWEのコマンド配列の辞書、画像表示はFRAME)
+@property (nonatomic, strong) NSMutableArray *commandQueue;
+//送信中のパネル形式の画像
+@property (nonatomic, strong) NSData *showingFrame;
+//送信中のコマンドの完了時に呼ぶブロック
+@property (nonatomic, copy) AdapterCompletion completion;
+//コマンドを送信中のリーダーの番号 (送信中でない場合は-1)
+@property (nonatomic) int reader;
+//送信中のコマンドで表示を書き換えるかどうか
+@property (nonatomic) BOOL isWriting;
+//送信後に表示される画像のハッシュ (SMARTTAG_CACHE_NO_HASH:不明)
+@property (nonatomic) UINT32 frameHash;
+
+@end
+
+@implementation SmartTagSession
+@end
+
 
 @implementation Adapter
 
 
 const unsigned char ZERO = 0x00; //
 
-//スマートタグのタッチを検出してから次のポーリングを行うまでの間隔（秒）
-const float S_POLLING_INTERVAL = 0.3f;
-
 //レスポンスがエラーだった場合にスマートタグへコマンドを再送するまでの時間(秒)
 const float S_RETRY_WAIT = 0.05f;
 
@@ -30,13 +60,40 @@ const int S_URL_LENGTH = 32;
 //リトライの最大回数
 const int S_MAX_RETRY = 9;
 
-//ポーリングタイマ
-NSTimer *pollingTimer;
+//パイプライン送信でステータスを確認せずに連続送信するフレーム数
+const int S_PIPELINE_WINDOW = 8;
+
+//画像表示コマンド1つで送信する画像のバイト数
+const int S_FRAME_CHUNK_LENGTH = 176;
+
+//画像の部分書き換え(S_CMD_SHOW_DISPLAY_2)に対応したスマートタグのバージョン
+const unsigned char S_SHOW_DISPLAY_2_VERSION = 0x02;
+
+//画像の部分書き換えを送信するかどうか
+//  パラメータ2のブロックの位置はファームウェアの仕様として未確認のため、既定では使わない(常に全体を送信)
+const bool S_USE_SHOW_DISPLAY_2 = false;
+
+//圧縮した画像(S_CMD_SHOW_DISPLAYのパラメータ3)に対応したスマートタグのバージョン
+const unsigned char S_SHOW_DISPLAY_CODEC_VERSION = 0x03;
+
+//圧縮した画像を送信するかどうか
+//  パラメータ3の圧縮方法はファームウェアの仕様として未確認のため、既定では使わない(常に無圧縮で送信)
+const bool S_USE_SHOW_DISPLAY_CODEC = false;
+
+//スマートタグのメタデータのキャッシュのファイル名 (Cachesディレクトリ)
+NSString * const S_CACHE_FILE_NAME = @"SmartTagCache.dat";
+
+//キャッシュしたステータスを信用する期間(秒) (他の端末からの書き込みに備える)
+const int S_CACHE_STATUS_LIFETIME = 600;
+
+//書き込み後、スマートタグが表示の書き換えを完了するまでの時間(秒)
+const int S_CACHE_WRITE_SETTLE_TIME = 5;
+
 //ポーリングコマンド
 NSMutableData *pollingCommand;
 
-//リトライ用タイマ
-NSTimer *retryTimer;
+//送信中のI/Oの番号 (タイムオーバー後に届いた完了は無視する)
+int ioRequest;
 
 //最終バイトの欠落対策用　強制終了タイマ
 NSTimer *terminateTimer;
@@ -87,8 +144,26 @@ CardResponse *recentCardResponse;
 //リトライ回数
 int numRetry;
 
-//直前のスマートタグIDm
-NSString *tmpIDm;
+//スマートタグのセッション (IDmがキー)
+NSMutableDictionary *smartTagSessions;
+
+//セッションをラウンドロビンで処理する順序 (IDmの配列)
+NSMutableArray *smartTagSessionOrder;
+
+//次に処理するセッションの位置
+int nextSessionIndex;
+
+//セッションのコマンドを送信中のリーダー (リーダーの番号のNSNumber、リーダーごとに1セッションずつ並行して送信する)
+NSMutableSet *busyReaders;
+
+//セッションのコマンドの送信用のキュー (リーダーごとの送信を並行して実行)
+dispatch_queue_t sessionQueue;
+
+//カードコマンドの送信フロー中かどうか
+bool isSendingCommand;
+
+//カードコマンドの送信フローの通信対象のスマートタグのIDm (フローの開始時の通信対象)
+NSData *sendingIDm;
 
 //スマートタグのステータスチェック用コマンド
 CardCommand *checkStatusCommand;
@@ -96,6 +171,33 @@ CardCommand *checkStatusCommand;
 //最初に0x00を送るかどうか
 bool zeroPaddingEnable;
 
+//パイプライン送信用のキュー
+dispatch_queue_t pipelineQueue;
+
+//スマートタグに表示済みのパネル形式の画像 (IDmがキー)
+NSMutableDictionary *shownFrames;
+
+//ステータスチェックで取得したスマートタグのバージョン (IDmがキー)
+NSMutableDictionary *smartTagVersions;
+
+//送信中のパネル形式の画像
+NSData *showingFrame;
+
+//画像の描画と画像表示のコマンド作成用のキュー (メインスレッドを止めない)
+dispatch_queue_t renderQueue;
+
+//スマートタグのメタデータのキャッシュ (IDmごと、アプリの再起動後も残る)
+smarttag_cache_t tagCache;
+
+//キャッシュを開けたかどうか
+bool isTagCacheOpened;
+
+//カードコマンドの送信フローで表示中のレイアウト
+int showingLayout;
+
+//カードコマンドの送信フローで登録中のレイアウト
+int savingLayout;
+
 
 #pragma mark -
 #pragma mark - Singleton
@@ -183,6 +285,11 @@ bool zeroPaddingEnable;
     [[Adapter shared] _showImage:image];
 }
 
++ (void) showFrame:(NSData *)frame
+{
+    [[Adapter shared] _showFrame:frame];
+}
+
 + (void) saveURL:(NSString *)url
 {
     [[Adapter shared] _saveURL:url];
@@ -193,6 +300,47 @@ bool zeroPaddingEnable;
     [[Adapter shared] _loadURL];
 }
 
+//フィールド内のスマートタグのIDm
++ (NSArray *) smartTagIDms
+{
+    return [[Adapter shared] _smartTagIDms];
+}
+
++ (void) showLayout:(int)layout forIDm:(NSString *)idm
+{
+    [[Adapter shared] _showLayout:layout forIDm:idm completion:nil];
+}
+
++ (void) showImage:(UIImage *)image forIDm:(NSString *)idm
+{
+    [[Adapter shared] _showImage:image forIDm:idm completion:nil];
+}
+
++ (void) showLayout:(int)layout forIDm:(NSString *)idm completion:(AdapterCompletion)completion
+{
+    [[Adapter shared] _showLayout:layout forIDm:idm completion:completion];
+}
+
++ (void) showImage:(UIImage *)image forIDm:(NSString *)idm completion:(AdapterCompletion)completion
+{
+    [[Adapter shared] _showImage:image forIDm:idm completion:completion];
+}
+
+//追加のリーダーを接続 (ポーリングとセッションのコマンド送信は接続中のリーダーで並行して行う)
++ (void) openReader:(NSString *)uuid completion:(AdapterCompletion)completion
+{
+    [Port110 openReader:uuid completion:^(int reader) {
+        NSLog(@"Open Reader : %d", reader);
+        if(completion != nil) completion(reader >= 0);
+    }];
+}
+
+//接続中のリーダーの数
++ (int) numOpenReaders
+{
+    return (int)[[Port110 openReaders] count];
+}
+
 + (unsigned char) getResponsStatus
 {
     return [[Adapter shared] _getResponsStatus];
@@ -264,7 +412,19 @@ bool zeroPaddingEnable;
         isPolling = NO;
         isCanceling = NO;
         smartTagCommandSequence = 1;
-        tmpIDm = @"";
+        smartTagSessions = [NSMutableDictionary dictionaryWithCapacity:0];
+        smartTagSessionOrder = [NSMutableArray arrayWithCapacity:0];
+        nextSessionIndex = 0;
+        busyReaders = [NSMutableSet setWithCapacity:PORT110_MAX_READERS];
+        sessionQueue = dispatch_queue_create("SmartTagApp.Adapter.session", DISPATCH_QUEUE_CONCURRENT);
+        isSendingCommand = NO;
+        shownFrames = [NSMutableDictionary dictionaryWithCapacity:0];
+        smartTagVersions = [NSMutableDictionary dictionaryWithCapacity:0];
+        showingFrame = nil;
+        renderQueue = dispatch_queue_create("SmartTagApp.Adapter.render", DISPATCH_QUEUE_SERIAL);
+        NSString *cacheDirectory = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) objectAtIndex:0];
+        NSString *cachePath = [cacheDirectory stringByAppendingPathComponent:S_CACHE_FILE_NAME];
+        isTagCacheOpened = (smarttag_cache_open(&tagCache, [cachePath fileSystemRepresentation]) == ICS_ERROR_SUCCESS);
         checkStatusCommand = [[CardCommand alloc] initWithFunction:S_CMD_CHECK_STATUS
                                                                            fSum:1
                                                                            fNum:1
@@ -281,6 +441,12 @@ bool zeroPaddingEnable;
     [Port110 removeObserver:self];
 }
 
+//メインキューで遅れて実行 (NSTimerと違いランループのモードによらない)
+- (void) _afterDelay:(float)delay perform:(dispatch_block_t)block
+{
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_main_queue(), block);
+}
+
 
 
 #pragma mark -
@@ -484,30 +650,24 @@ bool zeroPaddingEnable;
     int seq = (processingCommand.function == S_CMD_CHECK_STATUS)? 0 : [self _nextSmartTagCommandSequence];
     NSMutableData *cardCommand = [processingCommand commandDataWithCommandCode:S_HEADER_WWE seq:seq];
     
-    //レスポンスがない場合のリトライ用タイマー
-    retryTimer = [NSTimer scheduledTimerWithTimeInterval:S_RETRY_INTERVAL + [processingCommand estimatedWWETime] target:self selector:@selector(_timeoverSendWWE) userInfo:nil repeats:NO];
-    
-    [Port110 addObserver:self selector:@selector(_recieveWWERComplete) name:PORT110_EVENT_RECEIVE_WWER_COMPLETE];
+    //レスポンスがない場合のリトライ
+    int request = ++ioRequest;
+    [self _afterDelay:S_RETRY_INTERVAL + [processingCommand estimatedWWETime] perform:^{
+        if(request == ioRequest) [self _timeoverSendWWE];
+    }];
     
-    NSMutableString *log = [NSMutableString stringWithString:@""];
-    unsigned char *commandCharsForLog = (unsigned char *)[cardCommand bytes];
-    
-    for (int i = 0; i < [cardCommand length]; i++)
-    {
-        unsigned char ch = commandCharsForLog[i];
-        
-        [log appendString:[NSString stringWithFormat:@"%02X ", (int)ch]];
-    }
-    NSLog(@"    Tx : %@", log);
-    [Port110 write:cardCommand];
+    NSLog(@"    Tx : %@", cardCommand);
+    [Port110 write:cardCommand toIDm:sendingIDm queue:dispatch_get_main_queue() completion:^(int result, unsigned char code, NSData *data) {
+        if(request != ioRequest) return;
+        ioRequest++;
+        errorCode = code;
+        [self _recieveWWERComplete];
+    }];
 }
 
 //WWE Resp.受信
 - (void)_recieveWWERComplete
 {
-    [Adapter removeObserver:self name:PORT110_EVENT_RECEIVE_WWER_COMPLETE];
-    if([retryTimer isValid]) [retryTimer invalidate];
-    
     //キャンセル
     if(isCanceling)
     {
@@ -519,7 +679,9 @@ bool zeroPaddingEnable;
     if (errorCode == R_STS_TIME_OVR || errorCode == R_STS_CMD_ERR)
     {
         NSLog(@"  [ERROR WWER] Function:%02X(%d/%d)", processingCommand.function, processingCommand.fNum, processingCommand.fSum);
-        [NSTimer scheduledTimerWithTimeInterval:S_RETRY_WAIT target:self selector:@selector(_retrySendWWE) userInfo:nil repeats:NO];
+        [self _afterDelay:S_RETRY_WAIT perform:^{
+            [self _retrySendWWE];
+        }];
         return;
     }
     //受信成功
@@ -530,8 +692,7 @@ bool zeroPaddingEnable;
 //WWE送信 タイムオーバー
 -(void)_timeoverSendWWE
 {
-    [Adapter removeObserver:self name:PORT110_EVENT_RECEIVE_WWER_COMPLETE];
-    if([retryTimer isValid]) [retryTimer invalidate];
+    ioRequest++;
     [self _retrySendWWE];
 }
 
@@ -552,6 +713,7 @@ bool zeroPaddingEnable;
     {
         //タイムオーバー時、コマンドエラー時はリトライ
         numRetry++;
+        ICSTRACE(ICSTRACE_EVENT_RETRY, ICSTRACE_TAG_WWE | processingCommand.function, numRetry);
         NSLog(@"  [RETRY WWE(%d/%d)] Function:%02X(%d/%d)", numRetry, S_MAX_RETRY, processingCommand.function, processingCommand.fNum, processingCommand.fSum);
         [self _sendWWE:nil];
     }
@@ -585,21 +747,25 @@ bool zeroPaddingEnable;
     
     int block_number = (processingCommand.function == S_CMD_CHECK_STATUS)? 2 : 3;
     
-    //レスポンスがない場合のリトライ用タイマー
-    retryTimer = [NSTimer scheduledTimerWithTimeInterval:S_RETRY_INTERVAL + [processingCommand estimatedRWETime] target:self selector:@selector(_timeoverSendRWE) userInfo:nil repeats:NO];
+    //レスポンスがない場合のリトライ
+    int request = ++ioRequest;
+    [self _afterDelay:S_RETRY_INTERVAL + [processingCommand estimatedRWETime] perform:^{
+        if(request == ioRequest) [self _timeoverSendRWE];
+    }];
     
-    [Port110 addObserver:self selector:@selector(_recieveRWERComplete) name:PORT110_EVENT_SEND_RWE_COMPLETE];
-    
-    [Port110 read:block_number];
+    [Port110 read:block_number fromIDm:sendingIDm queue:dispatch_get_main_queue() completion:^(int result, unsigned char code, NSData *data) {
+        if(request != ioRequest) return;
+        ioRequest++;
+        errorCode = code;
+        [self _recieveRWERComplete:data];
+    }];
 }
 
 //-------------------------------------------------------------------//
 //RWE Resp.受信
-- (void)_recieveRWERComplete
+- (void)_recieveRWERComplete:(NSData *)data
 //-------------------------------------------------------------------//
 {
-    [Adapter removeObserver:self name:PORT110_EVENT_SEND_RWE_COMPLETE];
-    
     //強制終了タイマーが動いている場合はタイマー停止
     if([terminateTimer isValid]) [terminateTimer invalidate];
 
@@ -610,19 +776,11 @@ bool zeroPaddingEnable;
         return;
     }
     
-    recievedRowData = [Port110 getRecievedData];
+    recievedRowData = [NSMutableData dataWithData:data];
 
     [Adapter removeObserver:self name:ADAPTER_EVENT_RECIEVE_DATA_COMPLETE];
-    [retryTimer invalidate];
     
-    //--ログの出力
-    NSMutableString *log = [NSMutableString stringWithString:@""];
-    const unsigned char *logdata = [recievedRowData bytes];
-    for (int i=0; i<[recievedRowData length]; i++) {
-        [log appendString:[NSString stringWithFormat:@"%02X ", logdata[i]]];
-    }
-    NSLog(@"    Rx : %@", log);
-    //--
+    NSLog(@"    Rx : %@", recievedRowData);
 
     recievedData = recievedRowData;
 
@@ -633,7 +791,9 @@ bool zeroPaddingEnable;
     if (errorCode == R_STS_TIME_OVR || errorCode == R_STS_CMD_ERR)
     {
         NSLog(@"  [ERROR RWER] Function:%02X(%d/%d)", processingCommand.function, processingCommand.fNum, processingCommand.fSum);
-        [NSTimer scheduledTimerWithTimeInterval:S_RETRY_WAIT target:self selector:@selector(_retrySendRWE) userInfo:nil repeats:NO];
+        [self _afterDelay:S_RETRY_WAIT perform:^{
+            [self _retrySendRWE];
+        }];
         return;
     }
     
@@ -648,7 +808,7 @@ bool zeroPaddingEnable;
 -(void)_timeoverSendRWE
 {
     [Adapter removeObserver:self name:ADAPTER_EVENT_RECIEVE_DATA_COMPLETE];
-    if([retryTimer isValid]) [retryTimer invalidate];
+    ioRequest++;
     [self _retrySendRWE];
 }
 
@@ -671,6 +831,7 @@ bool zeroPaddingEnable;
     {
         //タイムオーバー時、コマンドエラー時はリトライ
         numRetry++;
+        ICSTRACE(ICSTRACE_EVENT_RETRY, ICSTRACE_TAG_RWE | processingCommand.function, numRetry);
         NSLog(@"  [RETRY RWE(%d/%d)] Function:%02X(%d/%d)", numRetry, S_MAX_RETRY, processingCommand.function, processingCommand.fNum, processingCommand.fSum);
         [self _sendRWE:nil];
     }
@@ -684,12 +845,235 @@ bool zeroPaddingEnable;
 
 
 
-//スマートタグコマンドのシーケンスNo.
+#pragma mark Adapter RFIDReader Command Pipeline
+//**********************
+//複数フレームのWWEをパイプライン送信
+//  ステータスを確認せずに最大S_PIPELINE_WINDOWフレームを連続送信し、
+//  ウィンドウの終わりでのみRWEでスマートタグの状態を確認する。
+//  STS_COMMAND_*エラーの場合は、受け付け済みのフレームの次から再送する。
+//**********************
+- (void) _sendWWEPipeline
+{
+    NSArray *frames = [NSArray arrayWithArray:wweCommandQueue];
+    [wweCommandQueue removeAllObjects];
+    
+    NSLog(@"[START] Pipelined WWE (%d frames, window %d)", (int)[frames count], S_PIPELINE_WINDOW);
+    
+    if(pipelineQueue == nil)
+    {
+        pipelineQueue = dispatch_queue_create("SmartTagApp.Adapter.pipeline", DISPATCH_QUEUE_SERIAL);
+    }
+    
+    dispatch_async(pipelineQueue, ^{
+        ICSTRACE(ICSTRACE_EVENT_FUNC_BEGIN, ICSTRACE_TAG_PIPELINE, [frames count]);
+        BOOL result = [self _runWWEPipeline:frames idm:nil];
+        ICSTRACE(ICSTRACE_EVENT_FUNC_END, ICSTRACE_TAG_PIPELINE, result ? ICS_ERROR_SUCCESS : ICS_ERROR_IO);
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self _sendWWEPipelineComplete:result];
+        });
+    });
+}
+
+//パイプライン送信の本体(パイプライン送信用のキューで実行)
+//  idm : 送信先のスマートタグ (nilの場合は送信フローの通信対象に送信し、進捗を表示する)
+- (BOOL) _runWWEPipeline:(NSArray *)frames idm:(NSData *)idm
+{
+    int numFrames = (int)[frames count];
+    int firstFNum = [(CardCommand *)[frames objectAtIndex:0] fNum];
+    int numAcked = 0; //スマートタグが受け付けたことを確認済みのフレーム数
+    int numSent = 0;  //送信済みのフレーム数
+    int numRetryWindow = 0;
+    NSData *prepared = nil; //作成済みの次のフレームのコマンドデータ
+    
+    while(numAcked < numFrames)
+    {
+        //ウィンドウ内のフレームを連続送信
+        while(numSent < numFrames && numSent - numAcked < S_PIPELINE_WINDOW)
+        {
+            CardCommand *command = (CardCommand *)[frames objectAtIndex:numSent];
+            CardCommand *next = (numSent + 1 < numFrames) ? (CardCommand *)[frames objectAtIndex:numSent + 1] : nil;
+            if(![self _sendWWESync:command prepared:&prepared next:next idm:idm])
+            {
+                return NO;
+            }
+            numSent++;
+            
+            if(idm != nil) continue;
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [SVProgressHUD setStatus:[NSString stringWithFormat:@"%@\n(%d/%d)\n%@", PROGRESS_TEXT_SEND_DATA, [command fNum], [command fSum], PROGRESS_TEXT_TAP_TO_CANCEL ]];
+            });
+        }
+        
+        //ウィンドウの終わりでステータスを確認
+        NSData *headerData = [self _readWWEStatusSync:idm];
+        if(headerData == nil)
+        {
+            return NO;
+        }
+        const unsigned char *header = [headerData bytes];
+        int fNum = header[2];
+        unsigned char status = header[3];
+        CardCommand *lastCommand = (CardCommand *)[frames objectAtIndex:numSent - 1];
+        
+        switch (status)
+        {
+            case STS_WAIT_COMMAND:
+            case STS_IN_PROGRESS:
+            case STS_COMPLETE:
+                if(fNum == [lastCommand fNum])
+                {
+                    //ウィンドウ内のフレームはすべて受け付け済み
+                    numAcked = numSent;
+                    numRetryWindow = 0;
+                    continue;
+                }
+                break;
+                
+            case STS_COMMAND_ADDRESS_ERROR:
+            case STS_COMMAND_LENGTH_ERROR:
+            case STS_COMMAND_SIZE_ERROR:
+                break;
+                
+            default:
+                NSLog(@"  [ERROR PIPELINE] Status:%02X (%d/%d)", status, fNum, [lastCommand fSum]);
+                return NO;
+        }
+        
+        //受け付け済みのフレームの次から再送
+        if(++numRetryWindow > S_MAX_RETRY)
+        {
+            return NO;
+        }
+        ICSTRACE(ICSTRACE_EVENT_RETRY, ICSTRACE_TAG_PIPELINE, numRetryWindow);
+        int numAccepted = fNum - firstFNum + 1;
+        if(numAccepted < numAcked || numAccepted >= numSent)
+        {
+            numAccepted = numAcked;
+        }
+        NSLog(@"  [RETRY PIPELINE(%d/%d)] Status:%02X resend from %d", numRetryWindow, S_MAX_RETRY, status, firstFNum + numAccepted);
+        numAcked = numAccepted;
+        numSent = numAccepted;
+        prepared = nil;
+        [NSThread sleepForTimeInterval:S_RETRY_WAIT];
+    }
+    
+    return YES;
+}
+
+//WWEの同期送信 (FeliCaの通信エラーはその場で再送)
+//  I/Oキューで送信している間に次のフレームのコマンドデータを作成し、preparedに返す
+- (BOOL) _sendWWESync:(CardCommand *)command prepared:(NSData **)prepared next:(CardCommand *)next idm:(NSData *)idm
+{
+    NSData *cardCommand = *prepared;
+    *prepared = nil;
+    
+    for(int retry = 0; retry <= S_MAX_RETRY; retry++)
+    {
+        //キャンセルは送信フロー(idmがnil)のみ
+        if(idm == nil && isCanceling)
+        {
+            return NO;
+        }
+        
+        if(cardCommand == nil)
+        {
+            cardCommand = [self _wweDataOfCommand:command];
+        }
+        
+        __block int result = PORT110_FAILURE;
+        dispatch_semaphore_t done = dispatch_semaphore_create(0);
+        ICSTRACE(ICSTRACE_EVENT_FUNC_BEGIN, ICSTRACE_TAG_WWE | command.function, command.fNum);
+        [Port110 write:cardCommand toIDm:(idm != nil) ? idm : sendingIDm queue:nil completion:^(int writeResult, unsigned char code, NSData *data) {
+            result = writeResult;
+            dispatch_semaphore_signal(done);
+        }];
+        NSData *nextCommand = (next != nil) ? [self _wweDataOfCommand:next] : nil;
+        dispatch_semaphore_wait(done, DISPATCH_TIME_FOREVER);
+        ICSTRACE(ICSTRACE_EVENT_FUNC_END, ICSTRACE_TAG_WWE | command.function, (result == PORT110_SUCCESS) ? ICS_ERROR_SUCCESS : ICS_ERROR_IO);
+        
+        if(result == PORT110_SUCCESS)
+        {
+            *prepared = nextCommand;
+            return YES;
+        }
+        //再送でシーケンスNo.が進むので、作成済みの次のフレームは使わない
+        cardCommand = nil;
+        ICSTRACE(ICSTRACE_EVENT_RETRY, ICSTRACE_TAG_WWE | command.function, retry + 1);
+        NSLog(@"  [RETRY WWE(%d/%d)] Function:%02X(%d/%d)", retry + 1, S_MAX_RETRY, command.function, command.fNum, command.fSum);
+        [NSThread sleepForTimeInterval:S_RETRY_WAIT];
+    }
+    return NO;
+}
+
+//WWEのコマンドデータ (シーケンスNo.を割り当てる)
+- (NSData *) _wweDataOfCommand:(CardCommand *)command
+{
+    int seq = (command.function == S_CMD_CHECK_STATUS)? 0 : [self _nextSmartTagCommandSequence];
+    return [command commandDataWithCommandCode:S_HEADER_WWE seq:seq];
+}
+
+//ヘッダブロックの同期読み出し (失敗した場合はnil)
+- (NSData *) _readWWEStatusSync:(NSData *)idm
+{
+    return [self _readRWESync:1 idm:idm];
+}
+
+//RWEの同期読み出し (FeliCaの通信エラーはその場で再送、失敗した場合はnil)
+- (NSData *) _readRWESync:(int)block_number idm:(NSData *)idm
+{
+    for(int retry = 0; retry <= S_MAX_RETRY; retry++)
+    {
+        if(idm == nil && isCanceling)
+        {
+            return nil;
+        }
+        
+        NSData *data = nil;
+        ICSTRACE(ICSTRACE_EVENT_FUNC_BEGIN, ICSTRACE_TAG_RWE, block_number);
+        int result = [Port110 readSync:block_number fromIDm:(idm != nil) ? idm : sendingIDm data:&data];
+        ICSTRACE(ICSTRACE_EVENT_FUNC_END, ICSTRACE_TAG_RWE, (result == PORT110_SUCCESS) ? ICS_ERROR_SUCCESS : ICS_ERROR_IO);
+        if(result == PORT110_SUCCESS && [data length] >= 16)
+        {
+            return data;
+        }
+        ICSTRACE(ICSTRACE_EVENT_RETRY, ICSTRACE_TAG_RWE, retry + 1);
+        [NSThread sleepForTimeInterval:S_RETRY_WAIT];
+    }
+    return nil;
+}
+
+//パイプライン送信完了
+- (void) _sendWWEPipelineComplete:(BOOL)result
+{
+    if(isCanceling)
+    {
+        [self _commandCancelComplete];
+        return;
+    }
+    
+    if(!result)
+    {
+        NSLog(@"  [ERROR PIPELINE]");
+        [self postNotification:ADAPTER_EVENT_RECIEVE_ERROR];
+        [self _finishSendCardCommandFlow];
+        return;
+    }
+    
+    NSLog(@"  [SUCCESS PIPELINE]");
+    [self _statusCheckWWEComplete];
+}
+
+
+
+//スマートタグコマンドのシーケンスNo. (リーダーごとの送信から並行して呼ばれる)
 - (int) _nextSmartTagCommandSequence
 {
-    int seq = smartTagCommandSequence;
-    smartTagCommandSequence = (smartTagCommandSequence % 255) + 1; //1-255
-    return seq;
+    @synchronized (self)
+    {
+        int seq = smartTagCommandSequence;
+        smartTagCommandSequence = (smartTagCommandSequence % 255) + 1; //1-255
+        return seq;
+    }
 }
 
 
@@ -699,6 +1083,9 @@ bool zeroPaddingEnable;
 //カードコマンドの送信フローを開始(コマンドキューが空の場合はポーリング＆ステータスチェックまで)
 - (void) _startSendCardCommandFlow
 {
+    isSendingCommand = YES;
+    //通信対象を明示して送信する (通信対象がない場合は空のIDmで、どのリーダーにも送信しない)
+    sendingIDm = [NSData dataWithData:[SmarttagData felicaIDmData]];
     
     //エラーの監視
     [Adapter addObserver:self selector:@selector(recieveSmartTagError:) name:ADAPTER_EVENT_RECIEVE_ERROR];
@@ -711,6 +1098,29 @@ bool zeroPaddingEnable;
     
     //ステータスチェック
     [SVProgressHUD setStatus:PROGRESS_TEXT_CHECK_STATUS];
+    [self _checkStatusWhenReaderIsFree];
+}
+
+//リーダーとスマートタグがセッションのコマンドを送信中の場合は、完了を待ってからステータスチェック
+//  (スマートタグとのフレーム番号とステータスのやり取りが混ざらないようにする)
+- (void) _checkStatusWhenReaderIsFree
+{
+    //キャンセル
+    if(isCanceling)
+    {
+        [self _commandCancelComplete];
+        return;
+    }
+    
+    if([self _isSessionSendingToIDm:sendingIDm] ||
+       [busyReaders containsObject:[NSNumber numberWithInt:[Port110 readerOfIDm:sendingIDm]]])
+    {
+        [self _afterDelay:S_RETRY_WAIT perform:^{
+            [self _checkStatusWhenReaderIsFree];
+        }];
+        return;
+    }
+    
     [Adapter addObserver:self selector:@selector(_statusIsCompleteAtStatusCheck) name:ADAPTER_EVENT_CHECK_STATUS_COMPLETE];
     [self _checkStatus];
 }
@@ -726,7 +1136,19 @@ bool zeroPaddingEnable;
     
     [Adapter removeObserver:self name:ADAPTER_EVENT_CHECK_STATUS_COMPLETE];
     
+    //表示を書き換えるので完了するまでキャッシュのステータスは使わない
     if([wweCommandQueue count] > 0)
+    {
+        [self _cacheWrittenFrameHash:SMARTTAG_CACHE_NO_HASH ofIDm:[SmarttagData felicaIDmData]];
+    }
+    
+    if([wweCommandQueue count] > 1)
+    {
+        //複数フレームはパイプライン送信
+        [SVProgressHUD setStatus:[NSString stringWithFormat:@"%@\n%@", PROGRESS_TEXT_SEND_DATA, PROGRESS_TEXT_TAP_TO_CANCEL ]];
+        [self _sendWWEPipeline];
+    }
+    else if([wweCommandQueue count] > 0)
     {
         [SVProgressHUD setStatus:[NSString stringWithFormat:@"%@\n%@", PROGRESS_TEXT_SEND_DATA, PROGRESS_TEXT_TAP_TO_CANCEL ]];
         [Adapter addObserver:self selector:@selector(_statusCheckWWEComplete) name:ADAPTER_EVENT_RECIEVE_WWER_COMPLETE];
@@ -815,6 +1237,10 @@ bool zeroPaddingEnable;
 //カードコマンドの送信フローを終了
 - (void) _finishSendCardCommandFlow
 {
+    isSendingCommand = NO;
+    //送信中のI/Oの完了は無視する
+    ioRequest++;
+    
      [[NSNotificationCenter defaultCenter] removeObserver:self name:SVProgressHUDDidReceiveTouchEventNotification object:nil];
     
     [Adapter removeObserver:self name:ADAPTER_EVENT_RECIEVE_ERROR];
@@ -823,6 +1249,9 @@ bool zeroPaddingEnable;
     [Adapter removeObserver:self name:ADAPTER_EVENT_FELICA_IS_NOT_SMARTTAG];
     
     [self _resetCommandQue];
+    
+    //送信フローの完了を待っていたセッションを開始
+    [self _runNextSessionCommands];
 }
 
 
@@ -831,6 +1260,7 @@ bool zeroPaddingEnable;
 -(void)_commandCancel:(NSNotification *)notification
 {
     [SVProgressHUD setStatus:PROGRESS_TEXT_CANCELING];
+    ICSTRACE(ICSTRACE_EVENT_CANCEL, ICSTRACE_TAG_SESSION, 0);
     isCanceling = YES;
 }
 -(void)_commandCancelComplete
@@ -857,6 +1287,10 @@ bool zeroPaddingEnable;
     }
     if([notification.name isEqual:ADAPTER_EVENT_SMARTTAG_IS_RELEASED])
     {
+        //通信中以外のスマートタグが離れた場合は無視
+        NSString *idm = [notification.userInfo objectForKey:ADAPTER_KEY_IDM];
+        if(idm != nil && ![idm isEqualToString:[SmarttagData felicaIDm]]) return;
+        
         errorString = @"スマートタグが見つかりません";
     }
     if([notification.name isEqual:ADAPTER_EVENT_SMARTTAG_IS_LOW_BATTERY])
@@ -868,6 +1302,12 @@ bool zeroPaddingEnable;
         errorString = @"スマートタグ以外のFelicaです";
     }
     
+    //通信エラーの場合は状態が分からないのでキャッシュから削除
+    if([notification.name isEqual:ADAPTER_EVENT_RECIEVE_ERROR])
+    {
+        [self _removeCacheOfIDm:[SmarttagData felicaIDmData]];
+    }
+    
     NSDictionary *dic = [NSDictionary dictionaryWithObject:errorString forKey:@"ERROR"];
     [self postNotification:ADAPTER_EVENT_ERROR userInfo:dic];
 }
@@ -884,6 +1324,8 @@ bool zeroPaddingEnable;
 
 
 //ポーリングの開始
+//  リーダーごとに連続ポーリングし、スマートタグのタッチとリリースを受け取る
+//  (ポーリングの間隔とRFのオフはリーダーのポーラーが決める)
 -(void)_startPolling
 {
     if(isPolling) return;
@@ -896,8 +1338,18 @@ bool zeroPaddingEnable;
 //    pollingCommand = [NSMutableData data];
 //    [pollingCommand appendBytes:data length:5];
     
-    pollingTimer = [NSTimer scheduledTimerWithTimeInterval:S_POLLING_INTERVAL target:self selector:@selector(_polling) userInfo:nil repeats:YES];
-    [self _polling];
+    [Port110 startPollingWithHandler:^(int event, int reader, NSData *idm) {
+        if(event == PORT110_POLLING_TOUCHED)
+        {
+            if(!isPolling) return;
+            [self _smartTagTouched:idm];
+        }
+        else
+        {
+            //停止時のリリースも反映する
+            [self _smartTagReleased:idm];
+        }
+    }];
 }
 //ポーリングの停止
 -(void)_stopPolling
@@ -907,77 +1359,532 @@ bool zeroPaddingEnable;
     
     NSLog(@"[STOP] Polling.");
     [Adapter removeObserver:self name:ADAPTER_EVENT_RECIEVE_DATA_COMPLETE];
-    if([pollingTimer isValid]) [pollingTimer invalidate];
+    [Port110 stopPolling];
+}
+//スマートタグのタッチ
+- (void) _smartTagTouched:(NSData *)idmData
+{
+    //複数のリーダーが検出したスマートタグは1つにまとめる
+    SmartTagSession *session = [self _sessionOfIDmData:idmData];
+    if(session.isPresent) return;
+    
+    NSLog(@"****************************");
+    NSLog(@"Find New SmartTag");
+    NSLog(@"IDm : %@", session.idm);
+    NSLog(@"****************************");
+    
+    responsStatus = R_CMD_RESPONSE_DATA;
+    session.isPresent = YES;
+    
+    //カードコマンドの送信フロー中以外で、他のスマートタグがなければ通信対象にする
+    if(!isSendingCommand && [[self _smartTagIDms] count] == 1)
+    {
+        [SmarttagData setFelicaIDm:(unsigned char *)[session.idmData bytes]];
+    }
+    
+    //スマートタグがタッチされた
+    NSDictionary *dic = [NSDictionary dictionaryWithObject:session.idm forKey:ADAPTER_KEY_IDM];
+    [self postNotification:ADAPTER_EVENT_SMARTTAG_IS_TOUCHED userInfo:dic];
+    
+    //RFがオンのうちに送信待ちのコマンドを送信する
+    [self _runNextSessionCommands];
 }
-//ポーリングコマンドの送信
-- (void) _polling
+//スマートタグのリリース
+- (void) _smartTagReleased:(NSData *)idmData
 {
-    NSLog(@"  [POLLING]");
+    //他のリーダーが検出中の場合はリリースしない
+    if([Port110 readerOfIDm:idmData] >= 0) return;
+    
+    SmartTagSession *session = [self _sessionOfIDmData:idmData];
+    if(!session.isPresent) return;
+    [self _releaseSession:session];
+    
+    NSArray *idms = [self _smartTagIDms];
+    if([idms count] == 0)
+    {
+        //スマートタグが見つからない
+        responsStatus = R_CMD_RESPONSE_ERROR;
+        errorCode = R_STS_TIME_OVR;
+        [SmarttagData initializeData];
+    }
+    else if(!isSendingCommand)
+    {
+        //残ったスマートタグの先頭を通信対象にする
+        SmartTagSession *first = [smartTagSessions objectForKey:[idms objectAtIndex:0]];
+        [SmarttagData setFelicaIDm:(unsigned char *)[first.idmData bytes]];
+    }
+}
+
 
-    [Port110 addObserver:self selector:@selector(_pollingRecieved) name:PORT110_EVENT_POLLING_COMPLETE];
 
-    [Port110 polling];
+#pragma mark Adapter RFIDReader Session
+//**********************
+//複数のスマートタグのセッション管理
+//  ポーリングで検出したスマートタグごとにセッションを持ち、
+//  送信待ちのコマンドをラウンドロビンで1つずつ送信する。
+//  スマートタグを検出したリーダーごとに1セッションずつ、並行して送信する。
+//**********************
+- (NSArray *) _smartTagIDms
+{
+    NSMutableArray *idms = [NSMutableArray arrayWithCapacity:[smartTagSessionOrder count]];
+    for (NSString *idm in smartTagSessionOrder)
+    {
+        SmartTagSession *session = [smartTagSessions objectForKey:idm];
+        if(session.isPresent) [idms addObject:idm];
+    }
+    return idms;
 }
-//ポーリングレスポンスの受信
-- (void) _pollingRecieved
+
+//スマートタグのセッションがコマンドを送信中かどうか
+- (BOOL) _isSessionSendingToIDm:(NSData *)idmData
 {
-    [Port110 removeObserver:self];
+    for (NSString *idm in smartTagSessionOrder)
+    {
+        SmartTagSession *session = [smartTagSessions objectForKey:idm];
+        if(session.reader >= 0 && [session.idmData isEqualToData:idmData]) return YES;
+    }
+    return NO;
+}
 
-    //スマートタグ検出
-    responsStatus = [Port110 getResponsStatus];
-    if(responsStatus == R_CMD_RESPONSE_DATA)
+//IDmのセッションを取得(なければ作成)
+- (SmartTagSession *) _sessionOfIDmData:(NSData *)idmData
+{
+    const unsigned char *idm = [idmData bytes];
+    NSMutableString *idmString = [NSMutableString stringWithString:@""];
+    for (int i = 0; i < 8; i++)
     {
-        NSLog(@"  [RECV POLLING RESPONSE SUCCESS]");
-        unsigned char *data = (unsigned char *)[[Port110 getRecievedData] bytes];
-        unsigned char idm[8];
-        //IDmの取得
-        for (int i = 0; i < 8; i++) idm[i] = data[i+0];
-        [SmarttagData setFelicaIDm:idm];
-        
-        
-        if(![tmpIDm isEqualToString:[SmarttagData felicaIDm]])
+        [idmString appendString:[NSString stringWithFormat:@"%02X", idm[i]]];
+    }
+    
+    SmartTagSession *session = [smartTagSessions objectForKey:idmString];
+    if(session == nil)
+    {
+        session = [[SmartTagSession alloc] init];
+        session.idm = idmString;
+        session.idmData = idmData;
+        session.type = [SmarttagData typeOfIDm:idm];
+        session.battery = BATTERY_HIGH;
+        session.status = STS_RESET;
+        session.isPresent = NO;
+        session.reader = -1;
+        session.commandQueue = [NSMutableArray arrayWithCapacity:0];
+        //キャッシュ済みのバッテリーとバージョン (ステータスチェック前の画像表示のコマンドの作成に使う)
+        smarttag_cache_entry_t entry;
+        if([self _cacheEntryOfIDm:idmData entry:&entry] && entry.num_of_batteries > 0)
         {
-            NSLog(@"****************************");
-            NSLog(@"Find New SmartTag");
-            NSLog(@"IDm : %@", [SmarttagData felicaIDm]);
-            NSLog(@"****************************");
-            
-            tmpIDm = [SmarttagData felicaIDm];
-            //スマートタグがタッチされた
-            [self postNotification:ADAPTER_EVENT_SMARTTAG_IS_TOUCHED];
+            session.battery = entry.batteries[0];
+            if([smartTagVersions objectForKey:idmString] == nil)
+            {
+                [smartTagVersions setObject:[NSNumber numberWithUnsignedChar:entry.version] forKey:idmString];
+            }
         }
-        //[self _checkStatus];
+        [smartTagSessions setObject:session forKey:idmString];
+        [smartTagSessionOrder addObject:idmString];
     }
-    //エラーor未検出
-    else if(responsStatus == R_CMD_RESPONSE_ERROR)
+    return session;
+}
+
+//IDm文字列のセッションを取得(なければ作成)
+- (SmartTagSession *) _sessionOfIDm:(NSString *)idm
+{
+    if([idm length] != 16) return nil;
+    
+    unsigned char idmBytes[8];
+    for (int i = 0; i < 8; i++)
     {
-        errorCode = [Port110 getErrorCode];
+        unsigned int value;
+        [[NSScanner scannerWithString:[idm substringWithRange:NSMakeRange(i * 2, 2)]] scanHexInt:&value];
+        idmBytes[i] = (unsigned char)value;
+    }
+    return [self _sessionOfIDmData:[NSData dataWithBytes:idmBytes length:8]];
+}
+
+//スマートタグのセッションをリリース
+- (void) _releaseSession:(SmartTagSession *)session
+{
+    NSLog(@"****************************");
+    NSLog(@"SmartTag is Released");
+    NSLog(@"IDm : %@", session.idm);
+    NSLog(@"****************************");
+    
+    session.isPresent = NO;
+    //スマートタグがリリースされた
+    NSDictionary *dic = [NSDictionary dictionaryWithObject:session.idm forKey:ADAPTER_KEY_IDM];
+    [self postNotification:ADAPTER_EVENT_SMARTTAG_IS_RELEASED userInfo:dic];
+}
+
+//セッションの送信待ちコマンドに追加
+- (void) _addSessionCommands:(NSArray *)wweCommands rwe:(NSArray *)rweCommands forIDm:(NSString *)idm completion:(AdapterCompletion)completion
+{
+    [self _addSessionCommands:wweCommands rwe:rweCommands forIDm:idm options:nil completion:completion];
+}
+
+//セッションの送信待ちコマンドに追加 (options : 辞書に追加する項目、レイアウト表示はLAYOUT)
+- (void) _addSessionCommands:(NSArray *)wweCommands rwe:(NSArray *)rweCommands forIDm:(NSString *)idm options:(NSDictionary *)options completion:(AdapterCompletion)completion
+{
+    SmartTagSession *session = [self _sessionOfIDm:idm];
+    if(session == nil)
+    {
+        if(completion != nil) completion(NO);
+        return;
+    }
+    
+    NSMutableDictionary *commands = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                                     wweCommands, @"WWE",
+                                     rweCommands, @"RWE", nil];
+    if(options != nil) [commands addEntriesFromDictionary:options];
+    if(completion != nil) [commands setObject:completion forKey:@"COMPLETION"];
+    [session.commandQueue addObject:commands];
+    [self _runNextSessionCommands];
+}
+
+//セッションの送信待ちに画像表示を追加 (コマンドは送信時に差分から作成)
+//  frameがnilの場合は描画中(RENDERING)とし、FRAMEが設定されるまで送信しない
+- (NSMutableDictionary *) _addSessionFrame:(NSData *)frame forIDm:(NSString *)idm completion:(AdapterCompletion)completion
+{
+    SmartTagSession *session = [self _sessionOfIDm:idm];
+    if(session == nil)
+    {
+        if(completion != nil) completion(NO);
+        return nil;
+    }
+    
+    NSMutableDictionary *commands = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+                                     [NSArray array], @"WWE",
+                                     [NSArray array], @"RWE", nil];
+    if(frame != nil)
+    {
+        [commands setObject:frame forKey:@"FRAME"];
+    }
+    else
+    {
+        [commands setObject:[NSNumber numberWithBool:YES] forKey:@"RENDERING"];
+    }
+    if(completion != nil) [commands setObject:completion forKey:@"COMPLETION"];
+    [session.commandQueue addObject:commands];
+    [self _runNextSessionCommands];
+    return commands;
+}
+
+//次のセッションのコマンドを送信 (ラウンドロビン)
+//  空いているリーダーが検出したセッションをすべて開始する
+- (void) _runNextSessionCommands
+{
+    //カードコマンドの送信フローが通信中のリーダー (送信フロー中でなければ-1)
+    int sendingReader = isSendingCommand ? [Port110 readerOfIDm:sendingIDm] : -1;
+    
+    int numSessions = (int)[smartTagSessionOrder count];
+    int firstIndex = nextSessionIndex;
+    for (int n = 0; n < numSessions; n++)
+    {
+        int index = (firstIndex + n) % numSessions;
+        SmartTagSession *session = [smartTagSessions objectForKey:[smartTagSessionOrder objectAtIndex:index]];
+        if(session.reader >= 0 || !session.isPresent || [session.commandQueue count] == 0) continue;
+        //描画中の画像は描画の完了を待つ
+        if([[session.commandQueue objectAtIndex:0] objectForKey:@"RENDERING"] != nil) continue;
+        //フィールド内にいない場合は次のポーリングを待つ
+        int reader = [Port110 readerOfIDm:session.idmData];
+        if(reader < 0) continue;
+        //リーダーが他のセッションを送信中の場合は完了を待つ
+        NSNumber *readerNumber = [NSNumber numberWithInt:reader];
+        if([busyReaders containsObject:readerNumber]) continue;
+        //カードコマンドの送信フローが通信中のリーダーとスマートタグは完了を待つ
+        if(isSendingCommand && (reader == sendingReader || [session.idmData isEqualToData:sendingIDm])) continue;
         
-        //タイムオーバー時はタグが見つからないと見なす
-        if(errorCode == R_STS_TIME_OVR)
+        nextSessionIndex = (index + 1) % numSessions;
+        [busyReaders addObject:readerNumber];
+        session.reader = reader;
+        
+        NSDictionary *commands = [session.commandQueue objectAtIndex:0];
+        [session.commandQueue removeObjectAtIndex:0];
+        
+        NSArray *wweCommands = [commands objectForKey:@"WWE"];
+        NSArray *rweCommands = [commands objectForKey:@"RWE"];
+        session.showingFrame = [commands objectForKey:@"FRAME"];
+        session.completion = [commands objectForKey:@"COMPLETION"];
+        session.frameHash = SMARTTAG_CACHE_NO_HASH;
+        if(session.showingFrame != nil)
         {
-            NSLog(@"  [RECV POLLING TIMEOUT]");
-            [SmarttagData initializeData];
-            
-            if(![tmpIDm isEqualToString:@""])
+            session.frameHash = smarttag_cache_hash([session.showingFrame bytes], (UINT32)[session.showingFrame length]);
+            if(session.frameHash == [self _cachedFrameHashOfIDm:session.idmData])
             {
-                NSLog(@"****************************");
-                NSLog(@"SmartTag is Released");
-                NSLog(@"****************************");
-                //スマートタグがリリースされた
-                [self postNotification:ADAPTER_EVENT_SMARTTAG_IS_RELEASED];
-                tmpIDm = @"";
+                //表示済み (アプリの再起動前に表示した画像を含む)
+                NSLog(@"Show Frame : not changed (cached)");
+                wweCommands = [NSArray array];
+            }
+            else
+            {
+                //送信中に作成済みのコマンドは、差分の元とバージョンが変わっていなければ使う
+                wweCommands = [self _prefetchedSessionCommands:commands idm:session.idm];
+                if(wweCommands == nil)
+                {
+                    wweCommands = [self _showFrameCommands:session.showingFrame type:session.type idm:session.idm];
+                }
             }
         }
-        //コマンド送信エラー時以外の場合はエラーを出して終了
-        else if(errorCode != R_STS_CMD_ERR)
+        else if([commands objectForKey:@"LAYOUT"] != nil)
         {
-            NSLog(@"  [RECV POLLING RESPONSE ERROR]");
-            [self postNotification:ADAPTER_EVENT_RECIEVE_ERROR];
-            [self _finishSendCardCommandFlow];
+            session.frameHash = [self _cachedHashOfLayout:[[commands objectForKey:@"LAYOUT"] intValue] idm:session.idmData];
+            if(session.frameHash != SMARTTAG_CACHE_NO_HASH && session.frameHash == [self _cachedFrameHashOfIDm:session.idmData])
+            {
+                //表示済みのレイアウト
+                NSLog(@"Show Layout : not changed (cached)");
+                wweCommands = [NSArray array];
+            }
         }
-        //コマンド送信エラーのときはリトライ
+        session.isWriting = ([wweCommands count] > 0);
+        //送信するコマンドがない場合と、キャッシュから待機中と分かる場合はステータスチェックを省く
+        BOOL checkStatus = ([wweCommands count] > 0 || [rweCommands count] > 0) && ![self _isIdleInCache:session.idmData];
+        //表示が変わるので完了するまで表示済みの画像は不明
+        [shownFrames removeObjectForKey:session.idm];
+        
+        NSLog(@"[START] Session Commands IDm : %@ (Reader %d)", session.idm, reader);
+        NSData *idm = session.idmData;
+        dispatch_async(sessionQueue, ^{
+            NSData *header = nil;
+            ICSTRACE(ICSTRACE_EVENT_FUNC_BEGIN, ICSTRACE_TAG_SESSION | reader, [wweCommands count]);
+            BOOL result = [self _runSessionWWE:wweCommands rwe:rweCommands idm:idm checkStatus:checkStatus header:&header];
+            if(!result && !checkStatus)
+            {
+                //キャッシュと状態が異なっていた場合はステータスチェックからやり直す
+                NSLog(@"  [RETRY SESSION] Check Status");
+                result = [self _runSessionWWE:wweCommands rwe:rweCommands idm:idm checkStatus:YES header:&header];
+            }
+            ICSTRACE(ICSTRACE_EVENT_FUNC_END, ICSTRACE_TAG_SESSION | reader, result ? ICS_ERROR_SUCCESS : ICS_ERROR_IO);
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [self _finishSession:session header:header event:result ? ADAPTER_EVENT_SESSION_COMMAND_COMPLETE : ADAPTER_EVENT_SESSION_COMMAND_ERROR];
+            });
+        });
     }
+    [self _prefetchSessionCommands];
+}
+
+//セッションのコマンドを同期送信 (セッションの送信用のキューで実行)
+//  ステータスチェック、WWE(複数フレームはパイプライン送信)、RWEの順に、スマートタグを検出したリーダーで送信する。
+//  checkStatus : NOの場合はステータスチェックを省く
+//  header : 最後に確認したステータスのヘッダブロック (省いた場合はnilのまま)
+- (BOOL) _runSessionWWE:(NSArray *)wweCommands rwe:(NSArray *)rweCommands idm:(NSData *)idm checkStatus:(BOOL)checkStatus header:(NSData **)header
+{
+    //ステータスチェック (処理中の場合は完了を待つ)
+    while(checkStatus)
+    {
+        NSData *prepared = nil;
+        if(![self _sendWWESync:checkStatusCommand prepared:&prepared next:nil idm:idm]) return NO;
+        NSData *status = [self _readRWESync:2 idm:idm];
+        if(status == nil) return NO;
+        *header = status;
+        
+        const unsigned char *headerBlock = [status bytes];
+        if(headerBlock[5] == BATTERY_EMPTY || headerBlock[5] == BATTERY_LOW)
+        {
+            //交換が必要な場合はエラー
+            NSLog(@"  [ERROR SESSION] Low Battery : %02X", headerBlock[5]);
+            return NO;
+        }
+        if(headerBlock[3] == STS_IN_PROGRESS)
+        {
+            [NSThread sleepForTimeInterval:S_RETRY_WAIT];
+            continue;
+        }
+        if(headerBlock[3] != STS_COMPLETE && headerBlock[3] != STS_WAIT_COMMAND)
+        {
+            NSLog(@"  [ERROR SESSION] Status : %02X", headerBlock[3]);
+            return NO;
+        }
+        break;
+    }
+    
+    if([wweCommands count] > 1)
+    {
+        //複数フレームはパイプライン送信
+        if(![self _runWWEPipeline:wweCommands idm:idm]) return NO;
+    }
+    else if([wweCommands count] > 0)
+    {
+        NSData *prepared = nil;
+        if(![self _sendWWESync:[wweCommands objectAtIndex:0] prepared:&prepared next:nil idm:idm]) return NO;
+    }
+    
+    for (CardCommand *command in rweCommands)
+    {
+        int block_number = (command.function == S_CMD_CHECK_STATUS)? 2 : 3;
+        if([self _readRWESync:block_number idm:idm] == nil) return NO;
+    }
+    return YES;
+}
+
+//セッションのコマンド送信終了
+- (void) _finishSession:(SmartTagSession *)session header:(NSData *)header event:(NSString *)event
+{
+    [busyReaders removeObject:[NSNumber numberWithInt:session.reader]];
+    session.reader = -1;
+    
+    //直近のステータスを記録
+    if(header != nil)
+    {
+        const unsigned char *headerBlock = [header bytes];
+        session.status = headerBlock[3];
+        session.battery = (int)headerBlock[5];
+        [smartTagVersions setObject:[NSNumber numberWithUnsignedChar:headerBlock[15]] forKey:session.idm];
+        [self _cacheStatus:header ofIDm:session.idmData];
+    }
+    
+    BOOL success = [event isEqualToString:ADAPTER_EVENT_SESSION_COMMAND_COMPLETE];
+    //失敗した場合は状態が分からないのでキャッシュから削除
+    if(!success)
+    {
+        [self _removeCacheOfIDm:session.idmData];
+    }
+    else if(session.isWriting)
+    {
+        [self _cacheWrittenFrameHash:session.frameHash ofIDm:session.idmData];
+    }
+    session.isWriting = NO;
+    if(session.showingFrame != nil && success)
+    {
+        [self _setShownFrame:session.showingFrame forIDm:session.idm];
+    }
+    session.showingFrame = nil;
+    AdapterCompletion completion = session.completion;
+    session.completion = nil;
+    
+    NSLog(@"[FINISH] Session Commands IDm : %@", session.idm);
+    NSDictionary *dic = [NSDictionary dictionaryWithObject:session.idm forKey:ADAPTER_KEY_IDM];
+    [self postNotification:event userInfo:dic];
+    if(completion != nil) completion(success);
+    
+    //スマートタグの処理を待ってから次のセッションへ
+    [self _afterDelay:S_RETRY_WAIT perform:^{
+        [self _runNextSessionCommands];
+    }];
+}
+
+//送信中に他のセッションの先頭の画像表示のコマンドを作成しておく
+//  作成時の差分の元(BASE)とバージョン(VERSION)を記録し、送信時に変わっていればやり直す
+- (void) _prefetchSessionCommands
+{
+    for (NSString *idm in smartTagSessionOrder)
+    {
+        SmartTagSession *session = [smartTagSessions objectForKey:idm];
+        if(session.reader >= 0 || !session.isPresent || [session.commandQueue count] == 0) continue;
+        
+        NSMutableDictionary *commands = [session.commandQueue objectAtIndex:0];
+        NSData *frame = [commands objectForKey:@"FRAME"];
+        if(frame == nil || [commands objectForKey:@"PREFETCHING"] != nil) continue;
+        if([self _prefetchedSessionCommands:commands idm:idm] != nil) continue;
+        
+        NSData *shownFrame = [shownFrames objectForKey:idm];
+        if([shownFrame length] != [frame length]) shownFrame = nil;
+        NSNumber *version = [NSNumber numberWithUnsignedChar:[[smartTagVersions objectForKey:idm] unsignedCharValue]];
+        SmartTagType type = session.type;
+        [commands setObject:[NSNumber numberWithBool:YES] forKey:@"PREFETCHING"];
+        
+        dispatch_async(renderQueue, ^{
+            NSArray *wweCommands = [self _showFrameCommands:frame type:type shownFrame:shownFrame version:[version unsignedCharValue]];
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [commands removeObjectForKey:@"PREFETCHING"];
+                [commands setObject:wweCommands forKey:@"COMMANDS"];
+                [commands setObject:(shownFrame != nil) ? (id)shownFrame : (id)[NSNull null] forKey:@"BASE"];
+                [commands setObject:version forKey:@"VERSION"];
+            });
+        });
+    }
+}
+
+//作成済みの画像表示のコマンド (差分の元かバージョンが変わった場合はnil)
+- (NSArray *) _prefetchedSessionCommands:(NSDictionary *)commands idm:(NSString *)idm
+{
+    NSArray *wweCommands = [commands objectForKey:@"COMMANDS"];
+    if(wweCommands == nil) return nil;
+    
+    NSData *frame = [commands objectForKey:@"FRAME"];
+    NSData *shownFrame = [shownFrames objectForKey:idm];
+    if([shownFrame length] != [frame length]) shownFrame = nil;
+    id base = (shownFrame != nil) ? (id)shownFrame : (id)[NSNull null];
+    unsigned char version = [[smartTagVersions objectForKey:idm] unsignedCharValue];
+    
+    if(![[commands objectForKey:@"BASE"] isEqual:base]) return nil;
+    if([[commands objectForKey:@"VERSION"] unsignedCharValue] != version) return nil;
+    return wweCommands;
+}
+
+
+
+#pragma mark Adapter SmartTag Cache
+//**********************
+//スマートタグのメタデータのキャッシュ
+//  タッチのたびのステータスチェックと、表示済みの画像の再送を省く
+//**********************
+//IDmのキャッシュのエントリ (なければNO)
+- (BOOL) _cacheEntryOfIDm:(NSData *)idmData entry:(smarttag_cache_entry_t *)entry
+{
+    if(!isTagCacheOpened || [idmData length] != SMARTTAG_CACHE_IDM_LEN) return NO;
+    return smarttag_cache_get(&tagCache, [idmData bytes], entry) == ICS_ERROR_SUCCESS;
+}
+
+//キャッシュからステータスチェックを省けるか
+//  最後のステータスが完了(またはコマンド待ち)で、バッテリーが減っておらず、
+//  その後に書き込んだ場合は書き換えが完了するまでの時間が経っていること
+- (BOOL) _isIdleInCache:(NSData *)idmData
+{
+    smarttag_cache_entry_t entry;
+    if(![self _cacheEntryOfIDm:idmData entry:&entry] || entry.num_of_batteries == 0) return NO;
+    
+    UINT64 now = (UINT64)time(NULL);
+    if(now < entry.status_time || now - entry.status_time > S_CACHE_STATUS_LIFETIME) return NO;
+    if(entry.status != STS_COMPLETE && entry.status != STS_WAIT_COMMAND) return NO;
+    if(entry.batteries[0] >= BATTERY_LOW || smarttag_cache_get_battery_trend(&entry) > 0) return NO;
+    if(entry.write_time != 0 && (now < entry.write_time || now - entry.write_time < S_CACHE_WRITE_SETTLE_TIME)) return NO;
+    return YES;
+}
+
+//表示済みの画像のハッシュ (不明な場合はSMARTTAG_CACHE_NO_HASH)
+- (UINT32) _cachedFrameHashOfIDm:(NSData *)idmData
+{
+    smarttag_cache_entry_t entry;
+    if(![self _cacheEntryOfIDm:idmData entry:&entry]) return SMARTTAG_CACHE_NO_HASH;
+    return entry.frame_hash;
+}
+
+//登録済みのレイアウトの画像のハッシュ (不明な場合はSMARTTAG_CACHE_NO_HASH)
+- (UINT32) _cachedHashOfLayout:(int)layout idm:(NSData *)idmData
+{
+    smarttag_cache_entry_t entry;
+    if(layout < 0 || layout >= SMARTTAG_CACHE_MAX_LAYOUTS) return SMARTTAG_CACHE_NO_HASH;
+    if(![self _cacheEntryOfIDm:idmData entry:&entry]) return SMARTTAG_CACHE_NO_HASH;
+    if((entry.layouts & (1U << layout)) == 0) return SMARTTAG_CACHE_NO_HASH;
+    return entry.layout_hashes[layout];
+}
+
+//ステータスチェックのヘッダブロックを記録
+- (void) _cacheStatus:(NSData *)header ofIDm:(NSData *)idmData
+{
+    if(!isTagCacheOpened || [idmData length] != SMARTTAG_CACHE_IDM_LEN || [header length] < 16) return;
+    const unsigned char *headerBlock = [header bytes];
+    smarttag_cache_set_status(&tagCache, [idmData bytes], (UINT8)[SmarttagData typeOfIDm:[idmData bytes]],
+                              headerBlock[3], headerBlock[5], headerBlock[15]);
+}
+
+//表示を書き換えたことを記録 (frameHash : 書き換え後の画像のハッシュ)
+- (void) _cacheWrittenFrameHash:(UINT32)frameHash ofIDm:(NSData *)idmData
+{
+    if(!isTagCacheOpened || [idmData length] != SMARTTAG_CACHE_IDM_LEN) return;
+    smarttag_cache_set_written(&tagCache, [idmData bytes], frameHash);
+}
+
+//表示中の画像をレイアウトに登録したことを記録
+- (void) _cacheLayout:(int)layout ofIDm:(NSData *)idmData
+{
+    if(!isTagCacheOpened || [idmData length] != SMARTTAG_CACHE_IDM_LEN) return;
+    if(layout < 0 || layout >= SMARTTAG_CACHE_MAX_LAYOUTS) return;
+    smarttag_cache_set_layout(&tagCache, [idmData bytes], (UINT32)layout);
+}
+
+//キャッシュから削除 (状態が分からなくなった場合)
+- (void) _removeCacheOfIDm:(NSData *)idmData
+{
+    if(!isTagCacheOpened || [idmData length] != SMARTTAG_CACHE_IDM_LEN) return;
+    smarttag_cache_remove(&tagCache, [idmData bytes]);
 }
 
 
@@ -988,6 +1895,18 @@ bool zeroPaddingEnable;
 //**********************
 - (void) _checkStatus
 {
+    //キャッシュから待機中と分かる場合は省く
+    NSData *idmData = [SmarttagData felicaIDmData];
+    smarttag_cache_entry_t entry;
+    if([self _isIdleInCache:idmData] && [self _cacheEntryOfIDm:idmData entry:&entry])
+    {
+        NSLog(@"[SKIP] Check Smarttag Status (cached)");
+        [SmarttagData setStatus:entry.status battery:entry.batteries[0] version:entry.version];
+        [smartTagVersions setObject:[NSNumber numberWithUnsignedChar:entry.version] forKey:[SmarttagData felicaIDm]];
+        [self postNotification:ADAPTER_EVENT_CHECK_STATUS_COMPLETE];
+        return;
+    }
+    
     NSLog(@"[START] Check Smarttag Status");
     
     [Adapter addObserver:self selector:@selector(_checkStatusRecieveWWER) name:ADAPTER_EVENT_RECIEVE_WWER_COMPLETE];
@@ -1006,6 +1925,8 @@ bool zeroPaddingEnable;
     [Adapter removeObserver:self name:ADAPTER_EVENT_RECIEVE_RWER_COMPLETE];
     
     [SmarttagData setStatusWithResponse:recentCardResponse];
+    [smartTagVersions setObject:[NSNumber numberWithUnsignedChar:[SmarttagData version]] forKey:[SmarttagData felicaIDm]];
+    [self _cacheStatus:recentCardResponse.headerBlock ofIDm:[SmarttagData felicaIDmData]];
     
     //バッテリーのチェック
     if ([SmarttagData battery] == BATTERY_EMPTY || [SmarttagData battery] == BATTERY_LOW)
@@ -1042,7 +1963,9 @@ bool zeroPaddingEnable;
                 //処理中の場合は再チェック
                 NSLog(@"    * Status : [ IN PROGRESS ]");
                 NSLog(@"    ****************************");
-                [NSTimer scheduledTimerWithTimeInterval:S_RETRY_WAIT target:self selector:@selector(_checkStatus) userInfo:nil repeats:NO];
+                [self _afterDelay:S_RETRY_WAIT perform:^{
+                    [self _checkStatus];
+                }];
                 break;
                 
             default:
@@ -1063,6 +1986,7 @@ bool zeroPaddingEnable;
 - (void) _showDemo:(int)layout
 {
     [self _resetCommandQue];
+    [shownFrames removeObjectForKey:[SmarttagData felicaIDm]];
     
     unsigned char demoImageNumber =S_CMD_SHOW_DEMO_START_POINT + 0x01*layout;
     
@@ -1090,6 +2014,7 @@ bool zeroPaddingEnable;
 - (void) _clearDisplay
 {
     [self _resetCommandQue];
+    [shownFrames removeObjectForKey:[SmarttagData felicaIDm]];
     CardCommand *cardCommand = [[CardCommand alloc] initWithFunction:S_CMD_CLEAR_DISPLAY
                                                                fSum:1
                                                                fNum:1
@@ -1197,28 +2122,45 @@ bool zeroPaddingEnable;
 - (void) _showLayout:(int)layout
 {
     [self _resetCommandQue];
+    [shownFrames removeObjectForKey:[SmarttagData felicaIDm]];
     
     NSLog(@"Show Layout %d", layout);
+    showingLayout = layout;
     
+    [self _addCommandToQueue:[self _showLayoutCommand:layout] code:S_HEADER_WWE];
+    [Adapter addObserver:self selector:@selector(_showLayoutComplete) name:ADAPTER_EVENT_ALL_CARD_COMMAND_COMPLETE];
+    [self _startSendCardCommandFlow];
+}
+//指定したスマートタグに表示
+- (void) _showLayout:(int)layout forIDm:(NSString *)idm completion:(AdapterCompletion)completion
+{
+    NSLog(@"Show Layout %d IDm : %@", layout, idm);
+    
+    NSArray *commands = [NSArray arrayWithObject:[self _showLayoutCommand:layout]];
+    NSDictionary *options = [NSDictionary dictionaryWithObject:[NSNumber numberWithInt:layout] forKey:@"LAYOUT"];
+    [self _addSessionCommands:commands rwe:[NSArray array] forIDm:idm options:options completion:completion];
+}
+
+- (CardCommand *) _showLayoutCommand:(int)layout
+{
     unsigned char parameter[8] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x01 };
     
     parameter[6] = layout;
     
-    CardCommand *cardCommand = [[CardCommand alloc] initWithFunction:S_CMD_SHOW_DISPLAY
-                                                        fSum:1
-                                                        fNum:1
-                                                        data:nil
-                                                  dataLength:0
-                                                   parameter:parameter];
-    [self _addCommandToQueue:cardCommand code:S_HEADER_WWE];
-    [Adapter addObserver:self selector:@selector(_showLayoutComplete) name:ADAPTER_EVENT_ALL_CARD_COMMAND_COMPLETE];
-    [self _startSendCardCommandFlow];
+    return [[CardCommand alloc] initWithFunction:S_CMD_SHOW_DISPLAY
+                                            fSum:1
+                                            fNum:1
+                                            data:nil
+                                      dataLength:0
+                                       parameter:parameter];
 }
 //完了
 - (void) _showLayoutComplete
 {
     NSLog(@"Show Layout Complete");
     [Adapter removeObserver:self name:ADAPTER_EVENT_ALL_CARD_COMMAND_COMPLETE];
+    NSData *idmData = [SmarttagData felicaIDmData];
+    [self _cacheWrittenFrameHash:[self _cachedHashOfLayout:showingLayout idm:idmData] ofIDm:idmData];
     [self postNotification:ADAPTER_EVENT_SHOW_LAYOUT_COMPLETE];
 }
 
@@ -1234,6 +2176,7 @@ bool zeroPaddingEnable;
     unsigned char parameter[8] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
     
     parameter[0] = layout;
+    savingLayout = layout;
     
     CardCommand *cardCommand = [[CardCommand alloc] initWithFunction:S_CMD_SAVE_LAYOUT
                                                         fSum:1
@@ -1249,6 +2192,7 @@ bool zeroPaddingEnable;
 - (void) _saveScreenComplete
 {
     [Adapter removeObserver:self name:ADAPTER_EVENT_ALL_CARD_COMMAND_COMPLETE];
+    [self _cacheLayout:savingLayout ofIDm:[SmarttagData felicaIDmData]];
     [self postNotification:ADAPTER_EVENT_SAVE_LAYOUT_COMPLETE];
 }
 
@@ -1258,71 +2202,306 @@ bool zeroPaddingEnable;
 //スマートタグに画像を表示
 //**********************
 - (void) _showImage:(UIImage *)image
+{
+    //描画は描画用のキューで行い、送信はメインスレッドから開始する
+    SmartTagType type = [SmarttagData type];
+    dispatch_async(renderQueue, ^{
+        NSData *frame = [self _frameOfImage:image type:type];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self _showFrame:frame];
+        });
+    });
+}
+
+//指定したスマートタグに画像を表示
+//  描画中も送信待ちの順番は確保し、描画が終わった時点で送信できるようにする
+- (void) _showImage:(UIImage *)image forIDm:(NSString *)idm completion:(AdapterCompletion)completion
+{
+    SmartTagSession *session = [self _sessionOfIDm:idm];
+    if(session == nil)
+    {
+        if(completion != nil) completion(NO);
+        return;
+    }
+    
+    NSMutableDictionary *commands = [self _addSessionFrame:nil forIDm:idm completion:completion];
+    SmartTagType type = session.type;
+    dispatch_async(renderQueue, ^{
+        NSData *frame = [self _frameOfImage:image type:type];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [commands setObject:frame forKey:@"FRAME"];
+            [commands removeObjectForKey:@"RENDERING"];
+            [self _runNextSessionCommands];
+        });
+    });
+}
+
+//パネル形式の画像(1bpp)を表示 (前回表示した画像から変化した部分のみ送信)
+- (void) _showFrame:(NSData *)frame
 {
     [self _resetCommandQue];
     
-    CGImageRef inputImageRef = [image CGImage];
-    CFDataRef inputData = CGDataProviderCopyData(CGImageGetDataProvider(inputImageRef));
-    unsigned char *pixelData = (unsigned char *) CFDataGetBytePtr(inputData);
-    int pixelDataLength = CFDataGetLength(inputData);
+    NSString *idm = [NSString stringWithString:[SmarttagData felicaIDm]];
+    if(smarttag_cache_hash([frame bytes], (UINT32)[frame length]) == [self _cachedFrameHashOfIDm:[SmarttagData felicaIDmData]])
+    {
+        //表示済み (アプリの再起動前に表示した画像を含む)
+        NSLog(@"Show Frame : not changed (cached)");
+    }
+    else
+    {
+        for (CardCommand *command in [self _showFrameCommands:frame type:[SmarttagData type] idm:idm])
+        {
+            [self _addCommandToQueue:command code:S_HEADER_WWE];
+        }
+    }
+    //表示が変わるので完了するまで表示済みの画像は不明
+    [shownFrames removeObjectForKey:idm];
+    showingFrame = frame;
+    
+    [Adapter addObserver:self selector:@selector(_showImageComplete) name:ADAPTER_EVENT_ALL_CARD_COMMAND_COMPLETE];
+    [self _startSendCardCommandFlow];
+}
+
+//画像をパネル形式(1bpp、MSBから、1が黒)に変換
+- (NSData *) _frameOfImage:(UIImage *)image type:(SmartTagType)type
+{
+    UINT32 panel = (type == TAGTYPE_27_INCH) ? EPAPER_PANEL_27INCH : EPAPER_PANEL_20INCH;
+    UINT32 width, height, frameLength, scratchLength;
+    epaper_get_panel_size(panel, &width, &height, &frameLength);
+    
+    //RGBAで描き直す (元画像の形式によらない)
+    CGImageRef imageRef = [image CGImage];
+    size_t imageWidth = CGImageGetWidth(imageRef);
+    size_t imageHeight = CGImageGetHeight(imageRef);
+    NSMutableData *pixels = [NSMutableData dataWithLength:imageWidth * imageHeight * 4];
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate([pixels mutableBytes], imageWidth, imageHeight, 8, imageWidth * 4,
+                                                 colorSpace, kCGImageAlphaNoneSkipLast | kCGBitmapByteOrderDefault);
+    CGContextDrawImage(context, CGRectMake(0, 0, imageWidth, imageHeight), imageRef);
+    CGContextRelease(context);
+    CGColorSpaceRelease(colorSpace);
+    
+    epaper_image_t source = { (const UINT8 *)[pixels bytes], (UINT32)imageWidth, (UINT32)imageHeight,
+                              (UINT32)(imageWidth * 4), EPAPER_FORMAT_RGBA8888 };
+    epaper_rect_t rect = { 0, 0, source.width, source.height };
+    epaper_option_t option = { EPAPER_TONE_IDENTITY, EPAPER_DITHER_NONE };
+    NSMutableData *frame = [NSMutableData dataWithLength:frameLength];
+    
+    epaper_get_scratch_len(panel, &rect, &scratchLength);
+    NSMutableData *scratch = [NSMutableData dataWithLength:scratchLength];
+    UINT32 rc = epaper_render(&source, &rect, panel, &option, [scratch mutableBytes], scratchLength,
+                              [frame mutableBytes], frameLength);
+    if(rc != ICS_ERROR_SUCCESS)
+    {
+        NSLog(@"epaper_render error:%u", rc);
+    }
+    return frame;
+}
+
+//前回表示した画像との差分から画像表示のコマンドを作成
+//  スマートタグが対応している送信方法のうち、送信時間が最も短いものを選ぶ
+//  (全体、変化したブロックの部分書き換え、圧縮、前回の画像とのXORの圧縮)
+//  部分書き換えと圧縮は、それぞれS_USE_SHOW_DISPLAY_2とS_USE_SHOW_DISPLAY_CODECで有効にした場合のみ
+- (NSArray *) _showFrameCommands:(NSData *)frame type:(SmartTagType)type idm:(NSString *)idm
+{
+    NSData *shownFrame = [shownFrames objectForKey:idm];
+    if([shownFrame length] != [frame length]) shownFrame = nil;
+    unsigned char version = [[smartTagVersions objectForKey:idm] unsignedCharValue];
     
-    unsigned char parameter[8] = { 0x01, 0x01, 0x00, 0x00, 0x19, 0x00, 0x00, 0x03 };
-    int smartTagfSum =14;
-    if([SmarttagData type]==TAGTYPE_27_INCH){
-        parameter[4] = 0x21;
-        smartTagfSum =33;
+    return [self _showFrameCommands:frame type:type shownFrame:shownFrame version:version];
+}
+
+//表示済みの画像とバージョンから画像表示のコマンドを作成 (描画用のキューからも呼ぶ)
+- (NSArray *) _showFrameCommands:(NSData *)frame type:(SmartTagType)type shownFrame:(NSData *)shownFrame version:(unsigned char)version
+{
+    if([shownFrame isEqualToData:frame])
+    {
+        //表示済み
+        NSLog(@"Show Frame : not changed");
+        return [NSArray array];
     }
     
-    for(int i = 0; i < smartTagfSum; i++)
+    NSMutableArray *candidates = [NSMutableArray arrayWithCapacity:0];
+    if(S_USE_SHOW_DISPLAY_2 && shownFrame != nil && version >= S_SHOW_DISPLAY_2_VERSION)
     {
-        unsigned char data[176];
-        for(int j = 0; j < 176; j++)
+        [candidates addObject:[self _showFrameCommands:frame type:type chunks:[self _dirtyChunksOfFrame:frame shownFrame:shownFrame type:type]]];
+    }
+    if(S_USE_SHOW_DISPLAY_CODEC && version >= S_SHOW_DISPLAY_CODEC_VERSION)
+    {
+        NSArray *commands = [self _encodedFrameCommands:frame type:type codec:EPAPER_CODEC_PACKBITS shownFrame:nil];
+        if(commands != nil) [candidates addObject:commands];
+        if(shownFrame != nil)
         {
-            unsigned char dot = 0x00;
-            
-            for(int k = 0; k < 8; k++)
-            {
-                int pixelIndex = (i * 176 * 8 + j * 8 + k) * 4;
-                
-                if(pixelIndex < pixelDataLength)
-                {
-                    unsigned char col = *(pixelData + pixelIndex + 1);
-                
-                    if((int)col < 128)
-                    {
-                        dot |= 1 << (7 - k);
-                    }
-                }
-            }
-            data[j] = dot;
+            commands = [self _encodedFrameCommands:frame type:type codec:EPAPER_CODEC_XOR_PACKBITS shownFrame:shownFrame];
+            if(commands != nil) [candidates addObject:commands];
+        }
+    }
+    
+    //対応していない場合は全体を送信
+    NSArray *commands = [self _showFrameCommands:frame type:type chunks:nil];
+    float time = [self _estimatedWWETimeOfCommands:commands];
+    for (NSArray *candidate in candidates)
+    {
+        float candidateTime = [self _estimatedWWETimeOfCommands:candidate];
+        if(candidateTime < time)
+        {
+            commands = candidate;
+            time = candidateTime;
+        }
+    }
+    NSLog(@"Show Frame : %d commands", (int)[commands count]);
+    return commands;
+}
+
+//前回表示した画像から変化したブロック
+- (NSIndexSet *) _dirtyChunksOfFrame:(NSData *)frame shownFrame:(NSData *)shownFrame type:(SmartTagType)type
+{
+    const unsigned char *frameData = [frame bytes];
+    const unsigned char *shownFrameData = [shownFrame bytes];
+    int frameLength = (int)[frame length];
+    int numChunks = [self _numFrameChunks:type];
+    
+    NSMutableIndexSet *dirtyChunks = [NSMutableIndexSet indexSet];
+    for(int i = 0; i < numChunks; i++)
+    {
+        int offset = i * S_FRAME_CHUNK_LENGTH;
+        if(offset >= frameLength) break;
+        if(memcmp(frameData + offset, shownFrameData + offset, MIN(S_FRAME_CHUNK_LENGTH, frameLength - offset)) != 0)
+        {
+            [dirtyChunks addIndex:i];
+        }
+    }
+    return dirtyChunks;
+}
+
+//パネル形式の画像から画像表示のコマンドを作成
+//  chunksがnilの場合は全体(S_CMD_SHOW_DISPLAY)、
+//  それ以外は指定したブロックの部分書き換え(S_CMD_SHOW_DISPLAY_2、パラメータ2がブロックの位置)
+- (NSArray *) _showFrameCommands:(NSData *)frame type:(SmartTagType)type chunks:(NSIndexSet *)chunks
+{
+    NSMutableArray *commands = [NSMutableArray arrayWithCapacity:0];
+    
+    const unsigned char *frameData = [frame bytes];
+    int frameLength = [frame length];
+    
+    unsigned char parameter[8];
+    [self _getShowFrameParameter:parameter type:type];
+    
+    unsigned char function = S_CMD_SHOW_DISPLAY;
+    if(chunks == nil)
+    {
+        chunks = [NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, [self _numFrameChunks:type])];
+    }
+    else
+    {
+        function = S_CMD_SHOW_DISPLAY_2;
+    }
+    int smartTagfSum = (int)[chunks count];
+    
+    __block int smartTagfNum = 1;
+    [chunks enumerateIndexesUsingBlock:^(NSUInteger i, BOOL *stop) {
+        //最後のブロックの余りは白
+        unsigned char data[S_FRAME_CHUNK_LENGTH];
+        memset(data, 0x00, sizeof(data));
+        int offset = (int)i * S_FRAME_CHUNK_LENGTH;
+        if(offset < frameLength)
+        {
+            memcpy(data, frameData + offset, MIN(S_FRAME_CHUNK_LENGTH, frameLength - offset));
         }
+        parameter[2] = (function == S_CMD_SHOW_DISPLAY_2) ? (unsigned char)i : 0x00;
         
+        CardCommand *command = [[CardCommand alloc] initWithFunction:function
+                                                        fSum:smartTagfSum
+                                                        fNum:smartTagfNum
+                                                        data:data
+                                                  dataLength:S_FRAME_CHUNK_LENGTH
+                                                   parameter:parameter];
+        [commands addObject:command];
+        smartTagfNum++;
+    }];
+    return commands;
+}
+
+//圧縮した画像から画像表示のコマンドを作成 (パラメータ3が圧縮方法)
+//  全体のコマンド数に収まらない場合はnil
+- (NSArray *) _encodedFrameCommands:(NSData *)frame type:(SmartTagType)type codec:(UINT32)codec shownFrame:(NSData *)shownFrame
+{
+    int numChunks = [self _numFrameChunks:type];
+    NSMutableData *encoded = [NSMutableData dataWithLength:numChunks * S_FRAME_CHUNK_LENGTH];
+    UINT32 encodedLength;
+    UINT32 rc = epaper_encode(codec, [frame bytes], [shownFrame bytes], (UINT32)[frame length],
+                              [encoded mutableBytes], (UINT32)[encoded length], &encodedLength);
+    if(rc != ICS_ERROR_SUCCESS) return nil;
+    
+    NSMutableArray *commands = [NSMutableArray arrayWithCapacity:0];
+    const unsigned char *encodedData = [encoded bytes];
+    
+    unsigned char parameter[8];
+    [self _getShowFrameParameter:parameter type:type];
+    parameter[3] = (unsigned char)codec;
+    
+    int smartTagfSum = (encodedLength + S_FRAME_CHUNK_LENGTH - 1) / S_FRAME_CHUNK_LENGTH;
+    for(int i = 0; i < smartTagfSum; i++)
+    {
+        int offset = i * S_FRAME_CHUNK_LENGTH;
         CardCommand *command = [[CardCommand alloc] initWithFunction:S_CMD_SHOW_DISPLAY
                                                         fSum:smartTagfSum
                                                         fNum:i+1
-                                                        data:data
-                                                  dataLength:176
+                                                        data:(unsigned char *)encodedData + offset
+                                                  dataLength:MIN(S_FRAME_CHUNK_LENGTH, (int)encodedLength - offset)
                                                    parameter:parameter];
-        [self _addCommandToQueue:command code:S_HEADER_WWE];
-         
-    }
-    CFRelease(inputData);
-    /*
-    for (int m=0; m<96; m++) {
-        NSMutableString *log = [NSMutableString stringWithString:@""];
-        for (int n=0; n<25; n++) {
-            [log appendString:[NSString stringWithFormat:@"%02x", d[n + m*25]]];
-        }
-        NSLog(@"%d : %@", m, log);
+        [commands addObject:command];
     }
-    */
-    [Adapter addObserver:self selector:@selector(_showImageComplete) name:ADAPTER_EVENT_ALL_CARD_COMMAND_COMPLETE];
-    [self _startSendCardCommandFlow];
+    return commands;
+}
+
+//画像表示のパラメータ
+- (void) _getShowFrameParameter:(unsigned char *)parameter type:(SmartTagType)type
+{
+    unsigned char showFrameParameter[8] = { 0x01, 0x01, 0x00, 0x00, 0x19, 0x00, 0x00, 0x03 };
+    if(type==TAGTYPE_27_INCH){
+        showFrameParameter[4] = 0x21;
+    }
+    memcpy(parameter, showFrameParameter, sizeof(showFrameParameter));
+}
+
+//コマンドの送信時間の見積もり
+- (float) _estimatedWWETimeOfCommands:(NSArray *)commands
+{
+    float time = 0.0f;
+    for (CardCommand *command in commands)
+    {
+        time += [command estimatedWWETime];
+    }
+    return time;
 }
+
+//画像表示のコマンド数 (パネル全体)
+- (int) _numFrameChunks:(SmartTagType)type
+{
+    return (type == TAGTYPE_27_INCH) ? 33 : 14;
+}
+
+//表示済みの画像を記録 (次回の差分の元)
+- (void) _setShownFrame:(NSData *)frame forIDm:(NSString *)idm
+{
+    [shownFrames setObject:frame forKey:idm];
+}
+
 //完了
 - (void) _showImageComplete
 {
     [Adapter removeObserver:self name:ADAPTER_EVENT_ALL_CARD_COMMAND_COMPLETE];
+    if(showingFrame != nil)
+    {
+        [self _setShownFrame:showingFrame forIDm:[SmarttagData felicaIDm]];
+        UINT32 frameHash = smarttag_cache_hash([showingFrame bytes], (UINT32)[showingFrame length]);
+        if(frameHash != [self _cachedFrameHashOfIDm:[SmarttagData felicaIDmData]])
+        {
+            [self _cacheWrittenFrameHash:frameHash ofIDm:[SmarttagData felicaIDmData]];
+        }
+        showingFrame = nil;
+    }
     [self postNotification:ADAPTER_EVENT_SHOW_IMAGE_COMPLETE];
 }
 
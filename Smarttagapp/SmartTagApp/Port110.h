@@ -31,6 +31,28 @@ const unsigned char R_STS_CMD_ERR           =  0x44; // コマンドまたは
 
 #define PORT110_FIND_TIMEOUT 2
 
+//1回のポーリングで検出するカードの最大数
+#define PORT110_MAX_CARDS 4
+
+//同時に接続するリーダーの最大数
+#define PORT110_MAX_READERS 4
+
+//find/findWithNameで接続するリーダーの番号
+#define PORT110_DEFAULT_READER 0
+
+//I/Oキューでの通信の完了 (result:PORT110_SUCCESS/FAILURE、errorCode:R_STS_*、data:受信データ)
+typedef void (^Port110Completion)(int result, unsigned char errorCode, NSData *data);
+
+//リーダーの接続の完了 (reader:リーダーの番号、失敗した場合は-1)
+typedef void (^Port110ReaderCompletion)(int reader);
+
+//連続ポーリングのイベント
+#define PORT110_POLLING_TOUCHED 1
+#define PORT110_POLLING_RELEASED 2
+
+//連続ポーリングのイベント (event:PORT110_POLLING_*、reader:検出したリーダーの番号、idm:スマートタグのIDm)
+typedef void (^Port110PollingHandler)(int event, int reader, NSData *idm);
+
 // Port110 interface
 @interface Port110 : NSObject
 {
@@ -52,6 +74,25 @@ const unsigned char R_STS_CMD_ERR           =  0x44; // コマンドまたは
 + (int) polling;
 + (int) write:(NSMutableData *)command;
 + (int) read:(int)num_block;
++ (int) writeSync:(NSData *)command;
++ (int) readSync:(int)num_block;
++ (int) readSync:(int)num_block data:(NSData **)data;
++ (void) pollingWithCompletion:(Port110Completion)completion;
++ (void) write:(NSData *)command completion:(Port110Completion)completion;
++ (void) write:(NSData *)command queue:(dispatch_queue_t)queue completion:(Port110Completion)completion;
++ (void) read:(int)num_block completion:(Port110Completion)completion;
++ (BOOL) selectCard:(NSData *)idm;
+
+// Port110 reader pool methods
++ (void) openReader:(NSString *)uuid completion:(Port110ReaderCompletion)completion;
++ (void) closeReader:(int)reader;
++ (NSArray *) openReaders;
++ (void) pollingReader:(int)reader completion:(Port110Completion)completion;
++ (int) readerOfIDm:(NSData *)idm;
++ (void) write:(NSData *)command toIDm:(NSData *)idm queue:(dispatch_queue_t)queue completion:(Port110Completion)completion;
++ (void) read:(int)num_block fromIDm:(NSData *)idm queue:(dispatch_queue_t)queue completion:(Port110Completion)completion;
++ (int) writeSync:(NSData *)command toIDm:(NSData *)idm;
++ (int) readSync:(int)num_block fromIDm:(NSData *)idm data:(NSData **)data;
 + (NSMutableData *) getRecievedData;
 + (unsigned char) getResponsStatus;
 + (unsigned char) getErrorCode;
@@ -59,6 +100,15 @@ const unsigned char R_STS_CMD_ERR           =  0x44; // コマンドまたは
 + (BOOL) isReady;
 + (NSString *)peripheralName;
 
+// Port110 continuous polling methods
++ (void) startPollingWithHandler:(Port110PollingHandler)handler;
++ (void) stopPolling;
+
+// Port110 trace methods (ICSTRACE_ENABLEを定義してビルドした場合のみ記録)
++ (int) startTrace;
++ (void) stopTrace;
++ (BOOL) saveTrace:(NSString *)path;
+
 // Port110 event methods
 + (void) addObserver:(id)notificationObserver selector:(SEL)notificationSelector name:(NSString*)notificationName;
 + (void) removeObserver:(id)notificationObserver;
@@ -10,6 +10,7 @@
 #import "felica_card.h"
 #import "felica_cc.h"
 #import "felica_cc_stub.h"
+#import "felica_poller.h"
 
 #import "ics_types.h"
 #import "ics_error.h"
@@ -17,6 +18,8 @@
 #import "icsdrv.h"
 #import "icslib_chk.h"
 #import "icslog.h"
+#import "icstrace.h"
+#import "nfc110.h"
 
 #ifndef DEFAULT_UUID
 #define DEFAULT_UUID ""
@@ -37,7 +40,7 @@
 #define DEFAULT_POLLING_OPTION 0
 #endif
 #ifndef DEFAULT_POLLING_TIMESLOT
-#define DEFAULT_POLLING_TIMESLOT 0
+#define DEFAULT_POLLING_TIMESLOT (PORT110_MAX_CARDS - 1)
 #endif
 #ifndef DEFAULT_COMMAND_MAX_RETRY_TIMES
 #define DEFAULT_COMMAND_MAX_RETRY_TIMES 2
@@ -47,43 +50,90 @@
 extern const icsdrv_basic_func_t* g_drv_func;
 extern UINT32 (*g_felica_cc_stub_initialize_func)(felica_cc_devf_t* devf,
                                                   ICS_HW_DEVICE* dev);
+extern UINT32 (*g_drv_set_max_connections_func)(UINT32 max_connections);
 
-static const char* s_uuid = DEFAULT_UUID;
 static UINT32 s_timeout = DEFAULT_TIMEOUT;
 static UINT16 s_system_code = DEFAULT_SYSTEM_CODE;
 static UINT8 s_polling_option = DEFAULT_POLLING_OPTION;
 static UINT8 s_polling_timeslot = DEFAULT_POLLING_TIMESLOT;
 static UINT32 s_command_max_retry_times = DEFAULT_COMMAND_MAX_RETRY_TIMES;
 
-ICS_HW_DEVICE dev;
-felica_cc_devf_t devf;
-felica_card_t card;
-
-
 // サービスリスト
 const UINT16 service_code_list[1] = {
     0x0009
 };
 
-//ブロックリスト
-const UINT8 block_list[2 * 4] = {
-    0x80, 0x00, /* service code list #0, block #0 */
-    0x80, 0x01, /* service code list #0, block #1 */
-    0x80, 0x02, /* service code list #0, block #2 */
-    0x80, 0x03, /* service code list #0, block #3 */
-};
+//ペリフェラル名 (既定のリーダー)
+NSString* _peripheralName;
 
-//受信済みレスポンスデータから取り出したメインのデータ
-NSMutableData *recievedData;
+//リーダーのI/Oキューの識別 (値は実行中のリーダー)
+static void *s_io_queue_key = &s_io_queue_key;
 
-//受信済みレスポンスのコマンドステータス
-unsigned char responsStatus;
+//リーダー (番号順、PORT110_DEFAULT_READERはfind/findWithNameで接続する)
+static NSMutableArray *s_readers;
 
-//受信済みレスポンスのエラーコード
-unsigned char errorCode;
+//スマートタグを直前のポーリングで検出したリーダーの番号 (IDmがキー)
+static NSMutableDictionary *s_tag_readers;
+
+//リーダーを指定しない通信の対象 (selectCardで選択したカードを検出したリーダー)
+static int s_selected_reader = PORT110_DEFAULT_READER;
+
+//初期化済みのリーダーのペリフェラルUUIDを保存するキー
+//  保存済みのリーダーは再接続時にコマンドタイプの確認とpingを省略する
+static NSString * const kKnownReadersKey = @"port110.knownReaders";
+
+//連続ポーリングのイベントの通知先 (nilの場合は停止中、後から接続したリーダーも開始する)
+static Port110PollingHandler s_polling_handler;
+
+
+//リーダー
+//  リーダーごとにデバイス、検出したカード、I/Oキューを持ち、
+//  複数のリーダーと並行して通信する。felica_ccの呼び出しはすべてリーダーのI/Oキューで行う。
+@interface Port110Reader : NSObject
+{
+@public
+    ICS_HW_DEVICE dev;
+    felica_cc_devf_t devf;
+    //通信対象のカード
+    felica_card_t card;
+    //直前のポーリングで検出したカード
+    felica_card_t polledCards[PORT110_MAX_CARDS];
+    UINT32 numPolledCards;
+    //Read/Write Without Encryptionのバッチ (ブロックをまとめて送信する)
+    felica_cc_batch_t batch;
+    //受信済みレスポンスデータから取り出したメインのデータ
+    NSMutableData *recievedData;
+    //受信済みレスポンスのコマンドステータス
+    unsigned char responsStatus;
+    //受信済みレスポンスのエラーコード
+    unsigned char errorCode;
+    //通信を直列に実行するI/Oキュー
+    dispatch_queue_t queue;
+    //連続ポーリング (検出中のカードを保持し、タッチとリリースを通知する)
+    felica_poller_t poller;
+}
+
+@property (nonatomic) int index;
+@property (nonatomic, strong) NSString *uuid;
+@property (nonatomic, strong) NSString *name;
+//接続中かどうか
+@property (nonatomic) BOOL isOpen;
+//接続処理中かどうか
+@property (nonatomic) BOOL isOpening;
+//連続ポーリング中かどうか
+@property (nonatomic) BOOL isPolling;
+//連続ポーリングの開始ごとの番号 (停止前に予約したポーリングは実行しない)
+@property (nonatomic) UINT32 pollingGeneration;
+//連続ポーリングのイベントの通知先
+@property (nonatomic, copy) Port110PollingHandler pollingHandler;
+//検出中のカードのIDm (s_tag_readersのロック中に更新する)
+@property (nonatomic, strong) NSArray *polledIDms;
+
+@end
+
+@implementation Port110Reader
+@end
 
-//ペリフェラル名
-NSString* _peripheralName;
 
 @implementation Port110
 
@@ -142,6 +192,168 @@ NSString* _peripheralName;
     return [[Port110 shared] _read:block_number];
 }
 
+//I/Oキューで送信し、完了まで待つ(通知なし)
++ (int) writeSync:(NSData *)command
+{
+    return [Port110 writeSync:command toIDm:nil];
+}
+
+//I/Oキューで読み出し、完了まで待つ(通知なし)
++ (int) readSync:(int)block_number
+{
+    return [Port110 readSync:block_number data:nil];
+}
+
+//I/Oキューで読み出し、受信データとともに返す(通知なし)
++ (int) readSync:(int)block_number data:(NSData **)data
+{
+    return [Port110 readSync:block_number fromIDm:nil data:data];
+}
+
+//I/Oキューでポーリングし、完了をメインキューで通知
++ (void) pollingWithCompletion:(Port110Completion)completion
+{
+    [Port110 pollingReader:PORT110_DEFAULT_READER completion:completion];
+}
+
+//I/Oキューで送信し、完了をメインキューで通知
++ (void) write:(NSData *)command completion:(Port110Completion)completion
+{
+    [Port110 write:command queue:dispatch_get_main_queue() completion:completion];
+}
+
+//I/Oキューで送信し、完了を指定したキューで通知 (nilの場合はI/Oキューで直接呼ぶ)
++ (void) write:(NSData *)command queue:(dispatch_queue_t)queue completion:(Port110Completion)completion
+{
+    [Port110 write:command toIDm:nil queue:queue completion:completion];
+}
+
+//I/Oキューで読み出し、完了をメインキューで通知
++ (void) read:(int)block_number completion:(Port110Completion)completion
+{
+    [Port110 read:block_number fromIDm:nil queue:dispatch_get_main_queue() completion:completion];
+}
+
+//ポーリングで検出したカードから通信対象を選択 (リーダーを指定しない通信の対象になる)
++ (BOOL) selectCard:(NSData *)idm
+{
+    Port110Reader *reader = p110_reader_of_idm(idm);
+    if (reader == nil) return NO;
+    
+    __block BOOL found;
+    p110_io_sync(reader, ^{
+        found = p110_find_card(reader, idm, &reader->card);
+    });
+    if (found) s_selected_reader = reader.index;
+    return found;
+}
+
+#pragma mark -
+#pragma mark - Port110 reader pool public methods
+
+//リーダーを追加で接続し、完了時にリーダーの番号(失敗した場合は-1)をメインキューで通知
+//  (uuidが空の場合は接続していないリーダーを探す)
++ (void) openReader:(NSString *)uuid completion:(Port110ReaderCompletion)completion
+{
+    [[Port110 shared] _openReader:uuid completion:completion];
+}
+
+//リーダーを切断
++ (void) closeReader:(int)index
+{
+    Port110Reader *reader = p110_reader(index);
+    if (reader == nil) return;
+    
+    dispatch_async(reader->queue, ^{
+        p110_stop_polling(reader);
+        if (reader.isOpen) _close(reader);
+        reader.isOpen = NO;
+        reader->numPolledCards = 0;
+        p110_update_tag_readers(reader);
+    });
+}
+
+//接続中のリーダーの番号
++ (NSArray *) openReaders
+{
+    NSMutableArray *indexes = [NSMutableArray arrayWithCapacity:PORT110_MAX_READERS];
+    @synchronized (s_readers) {
+        for (Port110Reader *reader in s_readers) {
+            if (reader.isOpen) [indexes addObject:[NSNumber numberWithInt:reader.index]];
+        }
+    }
+    return indexes;
+}
+
+//指定したリーダーのI/Oキューでポーリングし、完了をメインキューで通知 (data:検出したカードのIDmを連結)
++ (void) pollingReader:(int)index completion:(Port110Completion)completion
+{
+    [[Port110 shared] _performIO:^int(Port110Reader *reader) {
+        int result = p110_polling(reader);
+        p110_update_tag_readers(reader);
+        return result;
+    } reader:p110_reader(index) queue:dispatch_get_main_queue() completion:completion];
+}
+
+//スマートタグを直前のポーリングで検出したリーダーの番号 (検出していない場合は-1)
++ (int) readerOfIDm:(NSData *)idm
+{
+    Port110Reader *reader = p110_reader_of_idm(idm);
+    return (reader != nil) ? reader.index : -1;
+}
+
+//スマートタグを検出したリーダーのI/Oキューで送信し、完了を指定したキューで通知 (nilの場合はI/Oキューで直接呼ぶ)
+//  idmがnilの場合はselectCardで選択したカード
++ (void) write:(NSData *)command toIDm:(NSData *)idm queue:(dispatch_queue_t)queue completion:(Port110Completion)completion
+{
+    [[Port110 shared] _performIO:^int(Port110Reader *reader) {
+        felica_card_t target;
+        if (!p110_find_card(reader, idm, &target)) return PORT110_FAILURE;
+        return p110_write(reader, &target, command);
+    } reader:p110_reader_of_idm(idm) queue:queue completion:completion];
+}
+
+//スマートタグを検出したリーダーのI/Oキューで読み出し、完了を指定したキューで通知 (nilの場合はI/Oキューで直接呼ぶ)
++ (void) read:(int)block_number fromIDm:(NSData *)idm queue:(dispatch_queue_t)queue completion:(Port110Completion)completion
+{
+    [[Port110 shared] _performIO:^int(Port110Reader *reader) {
+        felica_card_t target;
+        if (!p110_find_card(reader, idm, &target)) return PORT110_FAILURE;
+        return p110_read(reader, &target, block_number, nil);
+    } reader:p110_reader_of_idm(idm) queue:queue completion:completion];
+}
+
+//スマートタグを検出したリーダーのI/Oキューで送信し、完了まで待つ
++ (int) writeSync:(NSData *)command toIDm:(NSData *)idm
+{
+    Port110Reader *reader = p110_reader_of_idm(idm);
+    if (reader == nil) return PORT110_FAILURE;
+    
+    __block int result;
+    p110_io_sync(reader, ^{
+        felica_card_t target;
+        result = p110_find_card(reader, idm, &target) ? p110_write(reader, &target, command) : PORT110_FAILURE;
+    });
+    return result;
+}
+
+//スマートタグを検出したリーダーのI/Oキューで読み出し、受信データとともに返す
++ (int) readSync:(int)block_number fromIDm:(NSData *)idm data:(NSData **)data
+{
+    Port110Reader *reader = p110_reader_of_idm(idm);
+    if (reader == nil) return PORT110_FAILURE;
+    
+    __block int result;
+    __block NSData *response = nil;
+    p110_io_sync(reader, ^{
+        felica_card_t target;
+        result = p110_find_card(reader, idm, &target) ? p110_read(reader, &target, block_number, nil) : PORT110_FAILURE;
+        if (result == PORT110_SUCCESS) response = [reader->recievedData copy];
+    });
+    if (data != nil) *data = response;
+    return result;
+}
+
 + (BOOL) isConnected
 {
     return [[Port110 shared] _isConnected];
@@ -172,6 +384,61 @@ NSString* _peripheralName;
     return [[Port110 shared] _getErrorCode];
 }
 
+#pragma mark -
+#pragma mark - Port110 continuous polling public methods
+
+//接続中のすべてのリーダーで連続ポーリングを開始し、タッチとリリースをメインキューで通知
+//  カードを検出している間はRFをオンのままにし、検出しない間は間隔を延ばしてアイドル後にRFをオフにする
++ (void) startPollingWithHandler:(Port110PollingHandler)handler
+{
+    s_polling_handler = [handler copy];
+    for (int index = 0; index < PORT110_MAX_READERS; index++) {
+        p110_start_polling(p110_reader(index), s_polling_handler);
+    }
+}
+
+//連続ポーリングを停止 (検出中のスマートタグはリリースを通知する)
++ (void) stopPolling
+{
+    s_polling_handler = nil;
+    for (int index = 0; index < PORT110_MAX_READERS; index++) {
+        Port110Reader *reader = p110_reader(index);
+        dispatch_async(reader->queue, ^{
+            p110_stop_polling(reader);
+        });
+    }
+}
+
+#pragma mark -
+#pragma mark - Port110 trace public methods
+
+//トレースの記録開始 (記録済みのイベントは破棄)
++ (int) startTrace
+{
+    icstrace_clear();
+    return (icstrace_start(NULL) == ICS_ERROR_SUCCESS) ? PORT110_SUCCESS : PORT110_FAILURE;
+}
+
++ (void) stopTrace
+{
+    icstrace_stop();
+}
+
+//記録済みのイベントをトレースファイルに保存 (sample_trace_dumpで変換する)
++ (BOOL) saveTrace:(NSString *)path
+{
+    UINT32 num_events = 0;
+    NSMutableData *events = [NSMutableData dataWithLength:sizeof(icstrace_event_t) * ICSTRACE_MAX_THREADS * ICSTRACE_RING_LEN];
+    icstrace_snapshot([events mutableBytes], ICSTRACE_MAX_THREADS * ICSTRACE_RING_LEN, &num_events);
+    [events setLength:sizeof(icstrace_event_t) * num_events];
+    
+    icstrace_file_header_t header;
+    icstrace_get_file_header(num_events, &header);
+    NSMutableData *file = [NSMutableData dataWithBytes:&header length:sizeof(header)];
+    [file appendData:events];
+    return [file writeToFile:path atomically:YES];
+}
+
 #pragma mark -
 #pragma mark - Port110 public event methods
 
@@ -213,14 +480,25 @@ NSString* _peripheralName;
     isCallFind = NO;
     findName = @"";
 
+    //ドライバが同時に接続するリーダーの数 (ドライバの他の関数より先に設定する)
+    if (g_drv_set_max_connections_func != NULL) {
+        UINT32 rc = (*g_drv_set_max_connections_func)(PORT110_MAX_READERS);
+        if (rc != ICS_ERROR_SUCCESS) {
+            NSLog(@"Port110 : set_max_connections error:%u", rc);
+            return PORT110_FAILURE;
+        }
+    }
+
     return PORT110_SUCCESS;
 }
 
 - (int) _findModule:(int) timeout
 {
-    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+    Port110Reader *reader = p110_reader(PORT110_DEFAULT_READER);
+    dispatch_async(reader->queue, ^{
         int res;
-        res = _open(&dev, &devf);
+        res = _open(reader);
+        reader.isOpen = (res == 0);
         if (res != 0) {
             dispatch_async(dispatch_get_main_queue(), ^{
                 [[Port110 shared] postNotification:PORT110_EVENT_PERIPHERAL_NOT_FOUND];
@@ -230,6 +508,7 @@ NSString* _peripheralName;
             dispatch_async(dispatch_get_main_queue(), ^{
                 isReady = YES;
                 isConnected = YES;
+                if (s_polling_handler != nil) p110_start_polling(reader, s_polling_handler);
                 [[Port110 shared] postNotification:PORT110_EVENT_CONNECTED];
             });
         }
@@ -239,59 +518,110 @@ NSString* _peripheralName;
 }
 
 - (int) _findModuleWithName:(NSString*)name timeout:(int)timeout{
-    s_uuid = name.UTF8String;
+    p110_reader(PORT110_DEFAULT_READER).uuid = name;
     return [self _findModule:timeout];
 }
 
 - (NSMutableData *) _getRecievedData
 {
-    return recievedData;
+    return p110_reader(PORT110_DEFAULT_READER)->recievedData;
 }
 
 - (unsigned char) _getResponsStatus
 {
-    return responsStatus;
+    return p110_reader(PORT110_DEFAULT_READER)->responsStatus;
 }
 
 - (unsigned char) _getErrorCode
 {
-    return errorCode;
+    return p110_reader(PORT110_DEFAULT_READER)->errorCode;
 }
 
 -(int) _polling
 {
-    p110_polling(&dev, &devf, &card);
-
-    [[Port110 shared] postNotification:PORT110_EVENT_POLLING_COMPLETE];
+    [Port110 pollingWithCompletion:^(int result, unsigned char code, NSData *data) {
+        [self postNotification:PORT110_EVENT_POLLING_COMPLETE];
+    }];
 
     return PORT110_SUCCESS;
 }
 
 -(int) _write:(NSMutableData *)command
 {
-    dispatch_sync(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-
-        p110_write(command);
-        dispatch_async(dispatch_get_main_queue(), ^{
-            [self postNotification:PORT110_EVENT_RECEIVE_WWER_COMPLETE];
-        });
-    });
+    [Port110 write:command completion:^(int result, unsigned char code, NSData *data) {
+        [self postNotification:PORT110_EVENT_RECEIVE_WWER_COMPLETE];
+    }];
     
     return PORT110_SUCCESS;
  }
 
 -(int) _read:(int)block_number
 {
-    dispatch_sync(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+    [Port110 read:block_number completion:^(int result, unsigned char code, NSData *data) {
+        [self postNotification:PORT110_EVENT_SEND_RWE_COMPLETE];
+    }];
+    
+    return PORT110_SUCCESS;
+}
 
-        NSMutableData* response;
-        p110_read(block_number,response);
-        dispatch_async(dispatch_get_main_queue(), ^{
-            [self postNotification:PORT110_EVENT_SEND_RWE_COMPLETE];
+//リーダーのI/Oキューで通信を実行し、結果と受信データを完了のブロックに渡す
+- (void) _performIO:(int (^)(Port110Reader *reader))io reader:(Port110Reader *)reader queue:(dispatch_queue_t)queue completion:(Port110Completion)completion
+{
+    //スマートタグを検出したリーダーがない場合はタグが応答しないものとする
+    if (reader == nil) {
+        if (completion == nil) return;
+        dispatch_async((queue != nil) ? queue : dispatch_get_main_queue(), ^{
+            completion(PORT110_FAILURE, R_STS_TIME_OVR, nil);
         });
+        return;
+    }
+    
+    dispatch_async(reader->queue, ^{
+        int result = io(reader);
+        unsigned char code = reader->errorCode;
+        NSData *data = [reader->recievedData copy];
+        
+        if (completion == nil) return;
+        if (queue == nil) {
+            completion(result, code, data);
+        } else {
+            dispatch_async(queue, ^{
+                completion(result, code, data);
+            });
+        }
     });
+}
+
+//空いている番号のリーダーを接続
+- (void) _openReader:(NSString *)uuid completion:(Port110ReaderCompletion)completion
+{
+    Port110Reader *reader = nil;
+    for (int index = PORT110_DEFAULT_READER + 1; index < PORT110_MAX_READERS; index++) {
+        Port110Reader *candidate = p110_reader(index);
+        @synchronized (s_readers) {
+            if (!candidate.isOpen && !candidate.isOpening) {
+                candidate.isOpening = YES;
+                reader = candidate;
+            }
+        }
+        if (reader != nil) break;
+    }
+    if (reader == nil) {
+        NSLog(@"Port110 : no free reader");
+        if (completion != nil) completion(-1);
+        return;
+    }
     
-    return PORT110_SUCCESS;
+    reader.uuid = (uuid != nil) ? uuid : @"";
+    dispatch_async(reader->queue, ^{
+        int res = _open(reader);
+        dispatch_async(dispatch_get_main_queue(), ^{
+            reader.isOpen = (res == 0);
+            reader.isOpening = NO;
+            if (reader.isOpen && s_polling_handler != nil) p110_start_polling(reader, s_polling_handler);
+            if (completion != nil) completion(reader.isOpen ? reader.index : -1);
+        });
+    });
 }
 
 - (int) _disconnectModule
@@ -312,26 +642,189 @@ NSString* _peripheralName;
 #pragma mark -
 #pragma mark - Port110 control private C functions
 
-static int _open(ICS_HW_DEVICE* dev,
-                           felica_cc_devf_t* devf)
+//番号のリーダー (初回にPORT110_MAX_READERS個のリーダーを作成する)
+static Port110Reader* p110_reader(int index)
+{
+    static dispatch_once_t pred;
+    dispatch_once(&pred, ^{
+        s_readers = [NSMutableArray arrayWithCapacity:PORT110_MAX_READERS];
+        s_tag_readers = [NSMutableDictionary dictionaryWithCapacity:0];
+        for (int i = 0; i < PORT110_MAX_READERS; i++) {
+            Port110Reader *reader = [[Port110Reader alloc] init];
+            NSString *label = [NSString stringWithFormat:@"SmartTagApp.Port110.io.%d", i];
+            reader.index = i;
+            reader.uuid = @DEFAULT_UUID;
+            reader->queue = dispatch_queue_create([label UTF8String], DISPATCH_QUEUE_SERIAL);
+            dispatch_queue_set_specific(reader->queue, s_io_queue_key, (__bridge void *)reader, NULL);
+            [s_readers addObject:reader];
+        }
+    });
+    if (index < 0 || index >= PORT110_MAX_READERS) return nil;
+    return [s_readers objectAtIndex:index];
+}
+
+//スマートタグを直前のポーリングで検出したリーダー (検出していない場合はnil、idmがnilの場合は選択中のリーダー)
+static Port110Reader* p110_reader_of_idm(NSData *idm)
+{
+    NSNumber *index;
+    if (idm == nil) return p110_reader(s_selected_reader);
+    
+    p110_reader(PORT110_DEFAULT_READER);
+    @synchronized (s_tag_readers) {
+        index = [s_tag_readers objectForKey:idm];
+    }
+    return (index != nil) ? p110_reader([index intValue]) : nil;
+}
+
+//リーダーのポーリングの結果をスマートタグとリーダーの対応に反映 (リーダーのI/Oキューで実行)
+//  複数のリーダーが検出した場合は、後でポーリングしたリーダーを使う
+//  検出しなくなったスマートタグは、他のリーダーが検出中であればそのリーダーに戻す
+static void p110_update_tag_readers(Port110Reader* reader)
+{
+    NSNumber *index = [NSNumber numberWithInt:reader.index];
+    NSMutableArray *idms = [NSMutableArray arrayWithCapacity:reader->numPolledCards];
+    for (UINT32 i = 0; i < reader->numPolledCards; i++) {
+        [idms addObject:[NSData dataWithBytes:reader->polledCards[i].idm length:8]];
+    }
+    @synchronized (s_tag_readers) {
+        NSArray *lostIDms = [s_tag_readers allKeysForObject:index];
+        [s_tag_readers removeObjectsForKeys:lostIDms];
+        reader.polledIDms = idms;
+        for (NSData *idm in idms) {
+            [s_tag_readers setObject:index forKey:idm];
+        }
+        for (NSData *idm in lostIDms) {
+            if ([s_tag_readers objectForKey:idm] != nil) continue;
+            for (Port110Reader *other in s_readers) {
+                if (other != reader && [other.polledIDms containsObject:idm]) {
+                    [s_tag_readers setObject:[NSNumber numberWithInt:other.index] forKey:idm];
+                    break;
+                }
+            }
+        }
+    }
+}
+
+//リーダーが直前のポーリングで検出したカードからIDmのカードを取得 (リーダーのI/Oキューで実行、idmがnilの場合は選択中のカード)
+static BOOL p110_find_card(Port110Reader* reader, NSData *idm, felica_card_t* card)
+{
+    const void *target;
+    
+    //idmがnilの場合は通信対象のカード (直前のポーリングで検出しなくなった場合は失敗する)
+    if (idm == nil) {
+        target = reader->card.idm;
+    } else if (idm.length == 8) {
+        target = idm.bytes;
+    } else {
+        target = NULL;
+    }
+    
+    for (UINT32 i = 0; (target != NULL) && (i < reader->numPolledCards); i++) {
+        if (memcmp(reader->polledCards[i].idm, target, 8) == 0) {
+            *card = reader->polledCards[i];
+            return YES;
+        }
+    }
+    //フィールド内にいない場合はタグが応答しないものとする
+    reader->errorCode = R_STS_TIME_OVR;
+    return NO;
+}
+
+//ポーリングのパラメータ (システムコード、リクエストコード、タイムスロット)
+static void p110_get_polling_param(UINT8 polling_param[4])
+{
+    polling_param[0] = (UINT8)((s_system_code >> 8) & 0xff);
+    polling_param[1] = (UINT8)((s_system_code >> 0) & 0xff);
+    polling_param[2] = s_polling_option;
+    polling_param[3] = s_polling_timeslot;
+}
+
+//通信対象のカードが検出されなかった場合は先頭のカードを通信対象にする (リーダーのI/Oキューで実行)
+static void p110_select_polled_card(Port110Reader* reader)
+{
+    UINT32 n;
+    
+    if (reader->numPolledCards == 0) return;
+    for (n = 0; n < reader->numPolledCards; n++) {
+        if (memcmp(reader->polledCards[n].idm, reader->card.idm, 8) == 0) {
+            reader->card = reader->polledCards[n];
+            return;
+        }
+    }
+    reader->card = reader->polledCards[0];
+}
+
+//リーダーのI/Oキューで同期実行 (同じリーダーのI/Oキュー上からの呼び出しはそのまま実行)
+static void p110_io_sync(Port110Reader* reader, dispatch_block_t block)
+{
+    if (dispatch_get_specific(s_io_queue_key) == (__bridge void *)reader) {
+        block();
+    } else {
+        dispatch_sync(reader->queue, block);
+    }
+}
+
+//初期化済みのリーダーかどうか
+static BOOL p110_is_known_reader(NSString *uuid)
+{
+    if (uuid.length == 0) return NO;
+    NSUserDefaults *ud = [NSUserDefaults standardUserDefaults];
+    NSArray *known = [ud stringArrayForKey:kKnownReadersKey];
+    return [known containsObject:uuid];
+}
+
+//初期化済みのリーダーを保存
+static void p110_add_known_reader(NSString *uuid)
+{
+    if (uuid.length == 0) return;
+    @synchronized (kKnownReadersKey) {
+        NSUserDefaults *ud = [NSUserDefaults standardUserDefaults];
+        NSArray *known = [ud stringArrayForKey:kKnownReadersKey];
+        if ([known containsObject:uuid]) return;
+        NSMutableArray *md = [NSMutableArray arrayWithArray:known];
+        [md addObject:uuid];
+        [ud setObject:md forKey:kKnownReadersKey];
+        [ud synchronize];
+    }
+}
+
+static int _open(Port110Reader* reader)
 {
 #undef ICSLOG_FUNC
 #define ICSLOG_FUNC "_open"
     UINT32 rc;
+    ICS_HW_DEVICE* dev = &reader->dev;
+    felica_cc_devf_t* devf = &reader->devf;
+    const char* uuid = reader.uuid.UTF8String;
+    BOOL resumed = NO;
     
     ICSLOG_FUNC_BEGIN;
     ICSLOG_DBG_PTR(dev);
     ICSLOG_DBG_PTR(devf);
 
-    ICSLOG_DBG_PRINT_ARG("calling open(%s) ...\n", s_uuid);
-    rc = g_drv_func->open(dev, s_uuid);
+    ICSLOG_DBG_PRINT_ARG("calling open(%s) ...\n", uuid);
+    //BLEの接続は同時に1つしか行えないため、リーダー間で直列にする
+    @synchronized ([Port110Reader class]) {
+        rc = g_drv_func->open(dev, uuid);
+    }
     if (rc != ICS_ERROR_SUCCESS) {
         ICSLOG_ERR_STR(rc, "failure in open()");
-        errorCode = R_STS_ERR;
+        reader->errorCode = R_STS_ERR;
         return PORT110_FAILURE;
     }
     
-    if (g_drv_func->initialize_device != NULL) {
+    //初期化済みのリーダーはコマンドタイプの設定とリセットだけを行う (失敗した場合は初期化し直す)
+    if (p110_is_known_reader(reader.uuid)) {
+        ICSLOG_DBG_PRINT_ARG("calling nfc110_resume_device() ...\n");
+        rc = nfc110_resume_device(dev, s_timeout);
+        if (rc != ICS_ERROR_SUCCESS) {
+            ICSLOG_ERR_STR(rc, "failure in nfc110_resume_device()");
+            /* Note: continue */
+        }
+        resumed = (rc == ICS_ERROR_SUCCESS);
+    }
+    
+    if (!resumed && (g_drv_func->initialize_device != NULL)) {
         ICSLOG_DBG_PRINT_ARG("calling initialize_device() ...\n");
         rc = g_drv_func->initialize_device(dev, s_timeout);
         if (rc != ICS_ERROR_SUCCESS) {
@@ -341,7 +834,7 @@ static int _open(ICS_HW_DEVICE* dev,
                 ICSLOG_ERR_STR(rc, "failure in close()");
                 /* Note: continue */
             }
-            errorCode = R_STS_ERR;
+            reader->errorCode = R_STS_ERR;
             return PORT110_FAILURE;
         }
     }
@@ -355,12 +848,13 @@ static int _open(ICS_HW_DEVICE* dev,
             ICSLOG_ERR_STR(rc, "failure in close()");
             /* Note: continue */
         }
-        errorCode = R_STS_ERR;
+        reader->errorCode = R_STS_ERR;
         return PORT110_FAILURE;
     }
     
-    ICSLOG_DBG_PRINT_ARG("calling ping() ...\n");
-    if (g_drv_func->ping != NULL) {
+    //再接続したリーダーは直前のコマンドで応答を確認済み
+    if (!resumed && (g_drv_func->ping != NULL)) {
+        ICSLOG_DBG_PRINT_ARG("calling ping() ...\n");
         rc = g_drv_func->ping(dev, s_timeout);
         if (rc != ICS_ERROR_SUCCESS) {
             ICSLOG_ERR_STR(rc, "failure in ping()");
@@ -369,30 +863,41 @@ static int _open(ICS_HW_DEVICE* dev,
                 ICSLOG_ERR_STR(rc, "failure in close()");
                 /* Note: continue */
             }
-            errorCode = R_STS_ERR;
+            reader->errorCode = R_STS_ERR;
             return PORT110_FAILURE;
         }
     }
     unsigned char arg[ARG_MAX];
     rc = nfc110_get_attribute(dev, &arg);
 
-    _peripheralName = [NSString stringWithCString: (const char*)arg encoding:NSUTF8StringEncoding];
+    reader.name = [NSString stringWithCString: (const char*)arg encoding:NSUTF8StringEncoding];
+    if (reader.index == PORT110_DEFAULT_READER) {
+        _peripheralName = reader.name;
+    }
+    //開き直し(ポーリングの復旧など)で同じリーダーに接続し、初期化済みかどうかを同じ名前で調べる
+    if ((rc == ICS_ERROR_SUCCESS) && (reader.name.length > 0)) {
+        reader.uuid = reader.name;
+        if (!resumed) {
+            p110_add_known_reader(reader.uuid);
+        }
+    }
 
-    errorCode = R_STS_OK;
+    reader->errorCode = R_STS_OK;
     ICSLOG_FUNC_END;
     return PORT110_SUCCESS;
 }
 
-static int _close(ICS_HW_DEVICE* dev)
+static int _close(Port110Reader* reader)
 {
 #undef ICSLOG_FUNC
 #define ICSLOG_FUNC "p110_finalize"
     UINT32 rc;
+    ICS_HW_DEVICE* dev = &reader->dev;
     
     ICSLOG_FUNC_BEGIN;
     ICSLOG_DBG_PTR(dev);
     
-    errorCode = R_STS_OK;
+    reader->errorCode = R_STS_OK;
 
     if (g_drv_func->rf_off != NULL) {
         printf("  calling rf_off() ...\n");
@@ -400,7 +905,7 @@ static int _close(ICS_HW_DEVICE* dev)
         if (rc != ICS_ERROR_SUCCESS) {
             ICSLOG_ERR_STR(rc, "failure in rf_off()");
             /* Note: continue */
-            errorCode = R_STS_ERR;
+            reader->errorCode = R_STS_ERR;
         }
     }
     
@@ -408,7 +913,7 @@ static int _close(ICS_HW_DEVICE* dev)
     rc = g_drv_func->close(dev);
     if (rc != ICS_ERROR_SUCCESS) {
         ICSLOG_ERR_STR(rc, "failure in close()");
-        errorCode = R_STS_ERR;
+        reader->errorCode = R_STS_ERR;
         return PORT110_FAILURE;
     }
     
@@ -416,12 +921,13 @@ static int _close(ICS_HW_DEVICE* dev)
     return PORT110_SUCCESS;
 }
 
-static int _reset(ICS_HW_DEVICE* dev)
+static int _reset(Port110Reader* reader)
 {
 #undef ICSLOG_FUNC
 #define ICSLOG_FUNC "p110_reset"
     UINT32 rc;
     UINT32 timeout;
+    ICS_HW_DEVICE* dev = &reader->dev;
     
     ICSLOG_FUNC_BEGIN;
     ICSLOG_DBG_PTR(dev);
@@ -435,175 +941,289 @@ static int _reset(ICS_HW_DEVICE* dev)
     return PORT110_SUCCESS;
 }
 
-static int p110_polling(ICS_HW_DEVICE* dev,
-                        felica_cc_devf_t* devf,
-                        felica_card_t* card)
+static int p110_polling(Port110Reader* reader)
 {
 #undef ICSLOG_FUNC
 #define ICSLOG_FUNC "p110_polling"
     UINT32 rc;
+    ICS_HW_DEVICE* dev = &reader->dev;
+    felica_cc_devf_t* devf = &reader->devf;
     
     int i;
-    felica_card_option_t card_option;
+    UINT32 n;
+    felica_card_option_t card_options[PORT110_MAX_CARDS];
     
     ICSLOG_FUNC_BEGIN;
-    ICSLOG_DBG_PTR(&devf);
+    ICSLOG_DBG_PTR(&reader->devf);
 
     ICSLOG_DBG_PRINT_ARG("FeliCa Polling\n");
 
     UINT8 polling_param[4];
     
-    polling_param[0] = (UINT8)((s_system_code >> 8) & 0xff);
-    polling_param[1] = (UINT8)((s_system_code >> 0) & 0xff);
-    polling_param[2] = s_polling_option;
-    polling_param[3] = s_polling_timeslot;
+    p110_get_polling_param(polling_param);
     
     ICSLOG_DUMP(polling_param, 4);
     ICSLOG_DBG_UINT(s_timeout);
 
     ICSLOG_DBG_PRINT_ARG("start Polling...\n");
 
-    ICSLOG_DBG_PRINT_ARG("calling felica_cc_polling() ...\n");
-    rc = felica_cc_polling(devf,
-                           polling_param,
-                           card,
-                           &card_option,
-                           s_timeout);
+    ICSLOG_DBG_PRINT_ARG("calling felica_cc_polling_multiple() ...\n");
+    rc = felica_cc_polling_multiple(devf,
+                                    polling_param,
+                                    PORT110_MAX_CARDS,
+                                    &reader->numPolledCards,
+                                    reader->polledCards,
+                                    card_options,
+                                    s_timeout);
+    if (rc == ICS_ERROR_BUF_OVERFLOW) {
+        //検出しきれなかったカードは次のポーリングで検出する
+        rc = ICS_ERROR_SUCCESS;
+    }
 
     if (rc == ICS_ERROR_TIMEOUT) {
-        //タイムアウト
+        //タイムアウト (カードがないのでRFをオフにする)
+        reader->numPolledCards = 0;
         ICSLOG_ERR_STR(rc, "polling timeout");
+        nfc110_rf_off(dev, s_timeout);
         
-        responsStatus = R_CMD_RESPONSE_ERROR;
-        errorCode = R_STS_TIME_OVR;
+        reader->responsStatus = R_CMD_RESPONSE_ERROR;
+        reader->errorCode = R_STS_TIME_OVR;
 
         return PORT110_SUCCESS;
     }
     if (rc != ICS_ERROR_SUCCESS) {
         //エラー
+        reader->numPolledCards = 0;
         ICSLOG_ERR_STR(rc, "failure");
-        _close(dev);
-        _reset(dev);
-        _open(dev, devf);
-        responsStatus = R_CMD_RESPONSE_ERROR;
-        errorCode = R_STS_CMD_ERR;
+        _close(reader);
+        _reset(reader);
+        _open(reader);
+        reader->responsStatus = R_CMD_RESPONSE_ERROR;
+        reader->errorCode = R_STS_CMD_ERR;
 
         return PORT110_FAILURE;
     }
-    nfc110_rf_off(dev,s_timeout);
+    //検出したカードと続けて通信するのでRFはオンのままにする
+    p110_select_polled_card(reader);
     
-    ICSLOG_DBG_PRINT_ARG("    IDm: %02x%02x%02x%02x%02x%02x%02x%02x\n",
-           card->idm[0], card->idm[1], card->idm[2], card->idm[3],
-           card->idm[4], card->idm[5], card->idm[6], card->idm[7]);
-    ICSLOG_DBG_PRINT_ARG("    PMm: %02x%02x%02x%02x%02x%02x%02x%02x\n",
-           card->pmm[0], card->pmm[1], card->pmm[2], card->pmm[3],
-           card->pmm[4], card->pmm[5], card->pmm[6], card->pmm[7]);
-    ICSLOG_DBG_PRINT_ARG("    Option: ");
-    for (i = 0; i < (int)card_option.option_len; i++) {
-        ICSLOG_DBG_PRINT_ARG("%02x", card_option.option[i]);
+    //検出したカードのIDmを連結して返す
+    reader->recievedData = [NSMutableData dataWithCapacity:(8 * reader->numPolledCards)];
+    for (n = 0; n < reader->numPolledCards; n++) {
+        ICSLOG_DBG_PRINT_ARG("    IDm: %02x%02x%02x%02x%02x%02x%02x%02x\n",
+               reader->polledCards[n].idm[0], reader->polledCards[n].idm[1], reader->polledCards[n].idm[2], reader->polledCards[n].idm[3],
+               reader->polledCards[n].idm[4], reader->polledCards[n].idm[5], reader->polledCards[n].idm[6], reader->polledCards[n].idm[7]);
+        ICSLOG_DBG_PRINT_ARG("    PMm: %02x%02x%02x%02x%02x%02x%02x%02x\n",
+               reader->polledCards[n].pmm[0], reader->polledCards[n].pmm[1], reader->polledCards[n].pmm[2], reader->polledCards[n].pmm[3],
+               reader->polledCards[n].pmm[4], reader->polledCards[n].pmm[5], reader->polledCards[n].pmm[6], reader->polledCards[n].pmm[7]);
+        ICSLOG_DBG_PRINT_ARG("    Option: ");
+        for (i = 0; i < (int)card_options[n].option_len; i++) {
+            ICSLOG_DBG_PRINT_ARG("%02x", card_options[n].option[i]);
+        }
+        ICSLOG_DBG_PRINT_ARG("\n");
+        
+        [reader->recievedData appendBytes:(const void *)reader->polledCards[n].idm length:(sizeof(unsigned char) * 8)];
     }
-    ICSLOG_DBG_PRINT_ARG("\n");
-    
-    recievedData = [NSData dataWithBytes:(const void *)card->idm length:(sizeof(unsigned char) * 8)];
-    responsStatus = R_CMD_RESPONSE_DATA;
-    errorCode = R_STS_OK;
+    reader->responsStatus = R_CMD_RESPONSE_DATA;
+    reader->errorCode = R_STS_OK;
     
     ICSLOG_FUNC_END;
     return PORT110_SUCCESS;
 }
 
-static int p110_write(NSMutableData* command)
+//連続ポーリングのイベント (リーダーのI/Oキューで呼ばれる)
+//  検出中のカードとスマートタグのリーダーの対応を更新してから、メインキューで通知する
+static void p110_polling_event(void* arg, UINT32 event, const felica_card_t* card)
+{
+    Port110Reader *reader = (__bridge Port110Reader *)arg;
+    Port110PollingHandler handler = reader.pollingHandler;
+    
+    reader->numPolledCards = reader->poller.num_of_cards;
+    memcpy(reader->polledCards, reader->poller.cards, sizeof(felica_card_t) * reader->numPolledCards);
+    p110_select_polled_card(reader);
+    p110_update_tag_readers(reader);
+    
+    if (handler == nil) return;
+    int index = reader.index;
+    int pollingEvent = (event == FELICA_POLLER_EVENT_TOUCH) ? PORT110_POLLING_TOUCHED : PORT110_POLLING_RELEASED;
+    NSData *idm = [NSData dataWithBytes:card->idm length:8];
+    dispatch_async(dispatch_get_main_queue(), ^{
+        handler(pollingEvent, index, idm);
+    });
+}
+
+//連続ポーリングの1回分 (リーダーのI/Oキューで実行し、次回をポーラーが決めた間隔で予約する)
+static void p110_poll_step(Port110Reader* reader, UINT32 generation)
 {
 #undef ICSLOG_FUNC
-#define ICSLOG_FUNC "p110_write"
+#define ICSLOG_FUNC "p110_poll_step"
+    UINT32 rc;
+    UINT32 interval;
+    
+    if (!reader.isPolling || reader.pollingGeneration != generation) return;
+    
+    rc = felica_poller_poll(&reader->poller, s_timeout, &interval);
+    if (rc != ICS_ERROR_SUCCESS) {
+        //エラー時はリーダーを開き直す (検出中のカードは次のポーリングで確認する)
+        ICSLOG_ERR_STR(rc, "felica_poller_poll()");
+        _close(reader);
+        _reset(reader);
+        _open(reader);
+        interval = reader->poller.config.max_interval;
+    }
+    
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)interval * NSEC_PER_MSEC), reader->queue, ^{
+        p110_poll_step(reader, generation);
+    });
+}
+
+//リーダーの連続ポーリングを開始 (接続していないリーダーは何もしない)
+static void p110_start_polling(Port110Reader* reader, Port110PollingHandler handler)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "p110_start_polling"
+    dispatch_async(reader->queue, ^{
+        UINT32 rc;
+        UINT8 polling_param[4];
+        
+        if (reader.isPolling || !reader.isOpen) return;
+        
+        p110_get_polling_param(polling_param);
+        rc = felica_poller_initialize(&reader->poller,
+                                      &reader->devf,
+                                      g_drv_func,
+                                      &reader->dev,
+                                      polling_param,
+                                      PORT110_MAX_CARDS,
+                                      NULL,
+                                      p110_polling_event,
+                                      (__bridge void *)reader);
+        if (rc != ICS_ERROR_SUCCESS) {
+            ICSLOG_ERR_STR(rc, "felica_poller_initialize()");
+            return;
+        }
+        reader.pollingHandler = handler;
+        reader.pollingGeneration++;
+        reader.isPolling = YES;
+        p110_poll_step(reader, reader.pollingGeneration);
+    });
+}
+
+//リーダーの連続ポーリングを停止 (リーダーのI/Oキューで実行、検出中のカードはリリースを通知する)
+static void p110_stop_polling(Port110Reader* reader)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "p110_stop_polling"
     UINT32 rc;
+    
+    if (!reader.isPolling) return;
+    reader.isPolling = NO;
+    
+    rc = felica_poller_stop(&reader->poller, s_timeout);
+    if (rc != ICS_ERROR_SUCCESS) {
+        ICSLOG_ERR_STR(rc, "felica_poller_stop()");
+    }
+    reader.pollingHandler = nil;
+}
 
-    UINT8 status_flag1;
-    UINT8 status_flag2;
-    UINT32 command_timeout=DEFAULT_TIMEOUT;
+static int p110_write(Port110Reader* reader, felica_card_t* card, NSData* command)
+{
+#undef ICSLOG_FUNC
+#define ICSLOG_FUNC "p110_write"
+    UINT32 rc;
+    UINT32 i;
+    UINT32 len;
+    UINT8 block[16];
 
     ICSLOG_FUNC_BEGIN;
-    ICSLOG_DBG_PTR(&devf);
+    ICSLOG_DBG_PTR(&reader->devf);
 
     int numBlocks = ceil(command.length/16.0) ;
 
-    ICSLOG_DBG_PRINT_ARG("calling felica_cc_write_without_encryption() ...\n");
-    rc = felica_cc_write_without_encryption(&devf,
-                                            &card,
-                                            1,
-                                            service_code_list,
-                                            numBlocks,
-                                            block_list,
-                                            command.bytes,
-                                            
-                                            &status_flag1,
-                                            &status_flag2,
-                                            command_timeout);
+    //タイムアウトはPMmから計算する
+    felica_cc_batch_initialize(&reader->batch, &reader->devf);
+    rc = ICS_ERROR_SUCCESS;
+    for (i = 0; i < numBlocks; i++) {
+        len = MIN(16, command.length - (16 * i));
+        memset(block, 0, sizeof(block));
+        memcpy(block, (const UINT8*)command.bytes + (16 * i), len);
+        rc = felica_cc_batch_write(&reader->batch, card, service_code_list[0], i, block);
+        if (rc != ICS_ERROR_SUCCESS) {
+            break;
+        }
+    }
+    if (rc == ICS_ERROR_SUCCESS) {
+        ICSLOG_DBG_PRINT_ARG("calling felica_cc_batch_flush() ...\n");
+        rc = felica_cc_batch_flush(&reader->batch);
+    }
     if (rc != ICS_ERROR_SUCCESS) {
-        errorCode = R_STS_ERR;
+        reader->errorCode = R_STS_ERR;
         return PORT110_FAILURE;
     }
     
-    errorCode = R_STS_OK;
+    reader->errorCode = R_STS_OK;
 
     ICSLOG_FUNC_END;
     return PORT110_SUCCESS;
 }
 
-static int p110_read(UINT32 block_number, NSMutableData* response)
+static int p110_read(Port110Reader* reader, felica_card_t* card, UINT32 block_number, NSMutableData* response)
 {
 #undef ICSLOG_FUNC
 #define ICSLOG_FUNC "p110_read"
     UINT32 rc;
 
     UINT32 nretries;
+    UINT32 i;
 
-    UINT8 block_data[12 * 16];
-    UINT8 status_flag1;
-    UINT8 status_flag2;
+    UINT8 block_data[FELICA_CC_READ_WE_NUM_OF_BLOCKS_MAX * 16];
     
     ICSLOG_FUNC_BEGIN;
-    ICSLOG_DBG_PTR(&devf);
-    
-    UINT32 command_timeout=DEFAULT_TIMEOUT;
+    ICSLOG_DBG_PTR(&reader->devf);
     
+    if (block_number > FELICA_CC_READ_WE_NUM_OF_BLOCKS_MAX) {
+        reader->errorCode = R_STS_ERR;
+        return PORT110_FAILURE;
+    }
     
     for (nretries = 0; nretries <= s_command_max_retry_times; nretries++) {
-        ICSLOG_DBG_PRINT_ARG("calling felica_cc_read_without_encryption() ...\n");
-        rc = felica_cc_read_without_encryption(&devf,
-                                               &card,
-                                               1,
-                                               service_code_list,
-                                               block_number,
-                                               block_list,
-                                               block_data,
-                                               &status_flag1,
-                                               &status_flag2,
-                                               command_timeout);
+        //タイムアウトはPMmから計算する
+        felica_cc_batch_initialize(&reader->batch, &reader->devf);
+        rc = ICS_ERROR_SUCCESS;
+        for (i = 0; i < block_number; i++) {
+            rc = felica_cc_batch_read(&reader->batch, card, service_code_list[0], i, block_data + (16 * i));
+            if (rc != ICS_ERROR_SUCCESS) {
+                break;
+            }
+        }
+        if (rc == ICS_ERROR_SUCCESS) {
+            ICSLOG_DBG_PRINT_ARG("calling felica_cc_batch_flush() ...\n");
+            rc = felica_cc_batch_flush(&reader->batch);
+        }
         if ((rc != ICS_ERROR_TIMEOUT) &&
             (rc != ICS_ERROR_FRAME_CRC)) {
             break;
         }
+        ICSTRACE(ICSTRACE_EVENT_RETRY, ICSTRACE_TAG_RWE, (nretries + 1));
     }
     if (rc != ICS_ERROR_SUCCESS) {
         fprintf(stderr,
-                "    failure in felica_cc_read_without_encryption():%u\n",
+                "    failure in felica_cc_batch_flush():%u\n",
                 rc);
         if (rc == ICS_ERROR_STATUS_FLAG1) {
-            ICSLOG_DBG_PRINT_ARG("    status_flag1 = %02x\n", status_flag1);
-            ICSLOG_DBG_PRINT_ARG("    status_flag2 = %02x\n", status_flag2);
+            ICSLOG_DBG_PRINT_ARG("    status_flag1 = %02x\n", reader->batch.status_flag1);
+            ICSLOG_DBG_PRINT_ARG("    status_flag2 = %02x\n", reader->batch.status_flag2);
         }
-        errorCode = R_STS_ERR;
+        reader->errorCode = R_STS_ERR;
         return PORT110_FAILURE;
     }
     
-    ICSLOG_DBG_PRINT_ARG("    status_flag1 = %02x\n", status_flag1);
-    ICSLOG_DBG_PRINT_ARG("    status_flag2 = %02x\n", status_flag2);
+    ICSLOG_DBG_PRINT_ARG("    status_flag1 = %02x\n", reader->batch.status_flag1);
+    ICSLOG_DBG_PRINT_ARG("    status_flag2 = %02x\n", reader->batch.status_flag2);
 
     response = [NSMutableData dataWithBytes:(const void *)block_data length:block_number*16];
-    recievedData = [NSData dataWithBytes:(const void *)block_data length:block_number*16];
+    reader->recievedData = [NSMutableData dataWithBytes:(const void *)block_data length:block_number*16];
     
-    errorCode = R_STS_OK;
+    reader->errorCode = R_STS_OK;
 
     ICSLOG_FUNC_END;
     return PORT110_SUCCESS;
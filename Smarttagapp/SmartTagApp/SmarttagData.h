@@ -16,6 +16,11 @@
 #define SMARTTAG_27_1_IDM_PREFIX  @"03FE001D10" // 2.7インチ電池なし
 #define SMARTTAG_27_2_IDM_PREFIX  @"03FE001D12" // 2.7インチ電池あり
 
+//プレフィックスの5バイト目 (種類)
+#define SMARTTAG_20_IDM_BYTE      0x00 // 2インチ
+#define SMARTTAG_27_1_IDM_BYTE    0x10 // 2.7インチ電池なし
+#define SMARTTAG_27_2_IDM_BYTE    0x12 // 2.7インチ電池あり
+
 
 typedef NS_ENUM(NSInteger, BatteryStatus) {
     BATTERY_HIGH   = 0, // 通常
@@ -57,6 +62,7 @@ typedef NS_ENUM(unsigned char, SmartTagStatus)
 
 +(void)initializeData;
 +(void)setStatusWithResponse:(CardResponse *)response;
++(void)setStatus:(SmartTagStatus)status battery:(BatteryStatus)battery version:(unsigned char)version;
 +(void)setFelicaIDm:(unsigned char *)idm;
 +(NSMutableData *)felicaIDmData;
 +(NSMutableString *)felicaIDm;
@@ -65,4 +71,6 @@ typedef NS_ENUM(unsigned char, SmartTagStatus)
 +(BOOL)isSmarttag;
 +(SmartTagType)type;
 +(SmartTagStatus)status;
++(BOOL)isSmarttagIDm:(const unsigned char *)idm;
++(SmartTagType)typeOfIDm:(const unsigned char *)idm;
 @end
@@ -19,6 +19,9 @@ unsigned char __status;
 SmartTagType __type;
 BOOL __isSmarttag;
 
+//スマートタグ共通のIDmのプレフィックス (SMARTTAG_IDM_PREFIX)
+static const unsigned char smarttagIDmPrefix[4] = { 0x03, 0xFE, 0x00, 0x1D };
+
 +(SmarttagData *) shared
 {
     static SmarttagData *_data = nil;
@@ -65,30 +68,34 @@ BOOL __isSmarttag;
     }
 
     
-    //スマートタグのIDMパターンと照合
-    __isSmarttag = (BOOL)[[[SmarttagData felicaIDm] substringToIndex:8] isEqualToString:SMARTTAG_IDM_PREFIX];
-    
-    //スマートタグの種類を判定
-    if(__isSmarttag)
+    //スマートタグの種類を判定 (IDmのバイト列のプレフィックスと照合)
+    __type = [SmarttagData typeOfIDm:idm];
+    __isSmarttag = [SmarttagData isSmarttagIDm:idm];
+}
+
+
+//IDmがスマートタグの物かをチェック
++(BOOL)isSmarttagIDm:(const unsigned char *)idm
+{
+    return memcmp(idm, smarttagIDmPrefix, sizeof(smarttagIDmPrefix)) == 0;
+}
+
+//IDmからスマートタグの種類を判定
++(SmartTagType)typeOfIDm:(const unsigned char *)idm
+{
+    if(![SmarttagData isSmarttagIDm:idm])
+    {
+        return TAGTYPE_OTHER;
+    }
+    if(idm[4] == SMARTTAG_20_IDM_BYTE)
     {
-        if([[[SmarttagData felicaIDm] substringToIndex:10] isEqualToString:SMARTTAG_20_IDM_PREFIX])
-        {
-            __type = TAGTYPE_20_INCH;
-        }
-        else if([[[SmarttagData felicaIDm] substringToIndex:10] isEqualToString:SMARTTAG_27_1_IDM_PREFIX] ||
-                [[[SmarttagData felicaIDm] substringToIndex:10] isEqualToString:SMARTTAG_27_2_IDM_PREFIX])
-        {
-            __type = TAGTYPE_27_INCH;
-        }
-        else
-        {
-            __type = TAGTYPE_OTHER;
-        }
+        return TAGTYPE_20_INCH;
     }
-    else
+    if(idm[4] == SMARTTAG_27_1_IDM_BYTE || idm[4] == SMARTTAG_27_2_IDM_BYTE)
     {
-        __type = TAGTYPE_OTHER;
+        return TAGTYPE_27_INCH;
     }
+    return TAGTYPE_OTHER;
 }
 
 
@@ -163,6 +170,19 @@ BOOL __isSmarttag;
     __version = headerBlock[15];
 }
 
+//キャッシュしたステータスを設定 (ステータスチェックを省いた場合)
++(void)setStatus:(SmartTagStatus)status battery:(BatteryStatus)battery version:(unsigned char)version
+{
+    [[SmarttagData shared] _setStatus:status battery:battery version:version];
+}
+
+-(void)_setStatus:(SmartTagStatus)status battery:(BatteryStatus)battery version:(unsigned char)version
+{
+    __status = status;
+    __battery = battery;
+    __version = version;
+}
+
 
 //IDmがスマートタグの物かをチェック
 +(BOOL)isSmarttag
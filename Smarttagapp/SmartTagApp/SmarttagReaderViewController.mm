@@ -3,14 +3,14 @@
 //  SmartTagApp
 //
 
-#import <opencv2/opencv.hpp>
-#import <CoreImage/CoreImage.h>
 #import "SmarttagReaderViewController.h"
 #import "BarcodeReaderViewController.h"
 #import "ShowInputTextViewController.h"
 #import "Adapter.h"
 #import "SmarttagData.h"
 #import "CellContentWithImageView.h"
+#import "ics_error.h"
+#import "epaper.h"
 
 @interface SmarttagReaderViewController ()
 
@@ -41,6 +41,9 @@ int showRegisteredLayoutIndex;
 
 UIImage *photoImage;
 
+//撮影画像のパネル形式の画像(1bpp)
+NSData *photoFrame;
+
 UIImage *textImage;
 
 NSString *writeURLText;
@@ -185,7 +188,7 @@ NSString *showInputTextString;
             break;
             
         case SHOW_PHOTO: //撮影画像を表示
-            [self showImage:photoImage];
+            [self showFrame:photoFrame];
             break;
             
         case SHOW_INPUT_TEXT: //入力文字を表示
@@ -762,48 +765,115 @@ NSString *showInputTextString;
     //カメラコントローラーを隠す
     [self dismissModalViewControllerAnimated:YES];
     
-    UIImage* originalImage = image;
-    
-    //画像の向きを補正
-    UIGraphicsBeginImageContext(originalImage.size);
-    [originalImage drawInRect:CGRectMake(0, 0, originalImage.size.width, originalImage.size.height)];
-    originalImage = UIGraphicsGetImageFromCurrentImageContext();
-    UIGraphicsEndImageContext();
+    //向きの補正、切り抜き、２値化
+    photoFrame = [self renderPhoto:image];
+    photoImage = [self imageOfFrame:photoFrame];
     
-    //切り抜いて２値化
+    UITableViewCell *cell = [_menuTable cellForRowAtIndexPath:[NSIndexPath indexPathForRow:SHOW_PHOTO inSection:0]];
+    CellContentWithImageView *contentView = [[cell.contentView subviews] objectAtIndex:0];
     if([SmarttagData type] == TAGTYPE_27_INCH) {
-        UIImage *processedImage = [self resizeImage:originalImage width:276 height:369];  //2.7
-        processedImage = [self clipImage:processedImage rect:CGRectMake(6, 46, 264, 176)];   //2.7
-        
-        processedImage = [self binalize:processedImage];
-        photoImage = processedImage;
-        
-        UITableViewCell *cell = [_menuTable cellForRowAtIndexPath:[NSIndexPath indexPathForRow:SHOW_PHOTO inSection:0]];
-        CellContentWithImageView *contentView = [[cell.contentView subviews] objectAtIndex:0];
         contentView.image = [self resizeImage:photoImage width:72 height:48];
-        contentView.contentMode = UIViewContentModeScaleAspectFit;
-        doImageFunction = YES;
-        
-    }else if([SmarttagData type] == TAGTYPE_20_INCH){
-    
-        UIImage *processedImage = [self resizeImage:originalImage width:212 height:284];  //2.0
-        processedImage = [self clipImage:processedImage rect:CGRectMake(6, 52, 200, 96)];  //2.0
-    
-        processedImage = [self binalize:processedImage];
-        photoImage = processedImage;
-    
-        UITableViewCell *cell = [_menuTable cellForRowAtIndexPath:[NSIndexPath indexPathForRow:SHOW_PHOTO inSection:0]];
-        CellContentWithImageView *contentView = [[cell.contentView subviews] objectAtIndex:0];
-
-
+    }else{
         contentView.image = [self resizeImage:photoImage width:100 height:48];
-        contentView.contentMode = UIViewContentModeScaleAspectFit;
-        doImageFunction = YES;
-
     }
+    contentView.contentMode = UIViewContentModeScaleAspectFit;
     doImageFunction = YES;
 }
 
+//表示するパネル
+- (UINT32)panel
+{
+    return ([SmarttagData type] == TAGTYPE_27_INCH)? EPAPER_PANEL_27INCH : EPAPER_PANEL_20INCH;
+}
+
+//撮影画像をパネル形式の画像(1bpp)に変換
+//（縮小・切り抜き・モノクロ・ディザリングを1回の走査で行う）
+- (NSData *)renderPhoto:(UIImage *)image
+{
+    UINT32 panel = [self panel];
+    UINT32 width, height, frameLength, scratchLength;
+    epaper_get_panel_size(panel, &width, &height, &frameLength);
+    
+    //縮小後の大きさと切り抜く位置
+    CGSize scaledSize = CGSizeMake(212, 284);   //2.0
+    CGPoint clipOrigin = CGPointMake(6, 52);    //2.0
+    if(panel == EPAPER_PANEL_27INCH) {
+        scaledSize = CGSizeMake(276, 369);      //2.7
+        clipOrigin = CGPointMake(6, 46);        //2.7
+    }
+    
+    //画像の向きを補正してRGBAで描画
+    size_t imageWidth = (size_t)image.size.width;
+    size_t imageHeight = (size_t)image.size.height;
+    NSMutableData *pixels = [NSMutableData dataWithLength:imageWidth * imageHeight * 4];
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate([pixels mutableBytes], imageWidth, imageHeight, 8, imageWidth * 4,
+                                                 colorSpace, kCGImageAlphaNoneSkipLast | kCGBitmapByteOrderDefault);
+    CGContextTranslateCTM(context, 0, imageHeight);
+    CGContextScaleCTM(context, 1.0, -1.0);
+    UIGraphicsPushContext(context);
+    [image drawInRect:CGRectMake(0, 0, imageWidth, imageHeight)];
+    UIGraphicsPopContext();
+    CGContextRelease(context);
+    CGColorSpaceRelease(colorSpace);
+    
+    //縮小後の切り抜き範囲を元画像の座標に換算
+    epaper_image_t source = { (const UINT8 *)[pixels bytes], (UINT32)imageWidth, (UINT32)imageHeight,
+                              (UINT32)(imageWidth * 4), EPAPER_FORMAT_RGBA8888 };
+    epaper_rect_t rect;
+    rect.width = MIN((UINT32)(width * imageWidth / scaledSize.width + 0.5), source.width);
+    rect.height = MIN((UINT32)(height * imageHeight / scaledSize.height + 0.5), source.height);
+    rect.x = MIN((UINT32)(clipOrigin.x * imageWidth / scaledSize.width + 0.5), source.width - rect.width);
+    rect.y = MIN((UINT32)(clipOrigin.y * imageHeight / scaledSize.height + 0.5), source.height - rect.height);
+    
+    //モノクロフィルター(0.75)相当のトーンで誤差拡散
+    epaper_option_t option = { EPAPER_TONE_PHOTO, EPAPER_DITHER_JJN };
+    NSMutableData *frame = [NSMutableData dataWithLength:frameLength];
+    
+    epaper_get_scratch_len(panel, &rect, &scratchLength);
+    NSMutableData *scratch = [NSMutableData dataWithLength:scratchLength];
+    UINT32 rc = epaper_render(&source, &rect, panel, &option, [scratch mutableBytes], scratchLength,
+                              [frame mutableBytes], frameLength);
+    if(rc != ICS_ERROR_SUCCESS)
+    {
+        NSLog(@"epaper_render error:%u", rc);
+        return nil;
+    }
+    return frame;
+}
+
+//パネル形式の画像(1bpp、1が黒)をそのまま表示用の画像にする
+- (UIImage *)imageOfFrame:(NSData *)frame
+{
+    if(frame == nil) return nil;
+    
+    UINT32 width, height, frameLength;
+    epaper_get_panel_size([self panel], &width, &height, &frameLength);
+    
+    const CGFloat decode[2] = { 1.0, 0.0 };
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceGray();
+    CGDataProviderRef provider = CGDataProviderCreateWithCFData((__bridge CFDataRef)frame);
+    CGImageRef imageRef = CGImageCreate(width,
+                                        height,
+                                        1,
+                                        1,
+                                        width / 8,
+                                        colorSpace,
+                                        kCGImageAlphaNone|kCGBitmapByteOrderDefault,
+                                        provider,
+                                        decode,
+                                        false,
+                                        kCGRenderingIntentDefault
+                                        );
+    UIImage *ret = [UIImage imageWithCGImage:imageRef];
+    
+    CGImageRelease(imageRef);
+    CGDataProviderRelease(provider);
+    CGColorSpaceRelease(colorSpace);
+    
+    return ret;
+}
+
 //画像切り抜き
 -(UIImage*)clipImage:(UIImage*)image rect:(CGRect)rect
 {
@@ -851,270 +921,26 @@ NSString *showInputTextString;
     return retImg;
 }
 
-//画像の２値化
-- (UIImage *)binalize:(UIImage *)source
-{
-    // UIImageをCIImageに変換
-    CIImage *filteredImage = [[CIImage alloc] initWithCGImage:source.CGImage];
-    
-    // トーンカーブフィルター
-    //CIFilter *tonecurvefilter = [CIFilter filterWithName:@"CIToneCurve"];
-    //[tonecurvefilter setDefaults];
-    //[tonecurvefilter setValue:filteredImage forKey:kCIInputImageKey];
-    //[tonecurvefilter setValue:[CIVector vectorWithX:0.0 Y:0.0] forKey:@"inputPoint0"];
-    //[tonecurvefilter setValue:[CIVector vectorWithX:0.25 Y:0.225] forKey:@"inputPoint1"];
-    //[tonecurvefilter setValue:[CIVector vectorWithX:0.50 Y:0.45] forKey:@"inputPoint2"];
-    //[tonecurvefilter setValue:[CIVector vectorWithX:0.75 Y:0.725] forKey:@"inputPoint3"];
-    //[tonecurvefilter setValue:[CIVector vectorWithX:1.0 Y:1.0] forKey:@"inputPoint4"];
-    //filteredImage =  [tonecurvefilter outputImage];
-
-    
-    // モノクロフィルター
-    CIFilter *filter = [CIFilter filterWithName:@"CIColorMonochrome"
-                                  keysAndValues:
-                        kCIInputImageKey, filteredImage,
-                        @"inputColor", [CIColor colorWithRed:0.75 green:0.75 blue:0.75],
-                        @"inputIntensity", [NSNumber numberWithFloat:1.0],
-                        nil];
-    filteredImage = filter.outputImage;
-    
-    // ポスタライズフィルター
-    //    CIFilter *filter2 = [CIFilter filterWithName:@"CIColorPosterize"
-    //                                   keysAndValues:
-    //                         kCIInputImageKey, filteredImage,
-    //                         @"inputLevels", [NSNumber numberWithFloat:2.0],
-    //                         nil];
-    //
-    //    filteredImage = filter2.outputImage;
-    
-
-    
-    // CIImageをUIImageに変換する
-    // 画面に表示する。
-    CIContext *ciContext = [CIContext contextWithOptions:nil];
-    CGImageRef imageRef = [ciContext createCGImage:filteredImage
-                                          fromRect:[filteredImage extent]];
-    //トリミング
-    UIImage *outputImage  = [UIImage imageWithCGImage:imageRef
-                                                scale:1.0f
-                                          orientation:UIImageOrientationUp];
-
-    
-    //    UIImage* src = [UIImage imageNamed:@"icebraker.png"];
-    IplImage* imgA = [self IplImageFromUIImage:outputImage];
-    /** OpenCVによる画像処理　**/
-    
-    IplImage *imgB =[self IplImageFromUIImage:outputImage];
-    DITHERING(imgA, imgB);
-    
-    //  IplImage *imgC =[self getImage:imgB];
-    UIImage *imgProcessed = [self UIImageFromIplImage:imgB];
-    
-    
-    //   使わなくなったものをリリースする。
-    cvReleaseImage(&imgA);
-    cvReleaseImage(&imgB);
-    CGImageRelease(imageRef);
-    
-    
-    return imgProcessed;
-}
-
-int GetAverage(int red, int green, int blue)
-{
-    //return (int)((float)(red + green + blue) / 3);
-    //NTSC加重平均法
-    return (int)((float)(red   * 0.298912f) +
-                 (float)(green * 0.586611f) +
-                 (float)(blue  * 0.114478f)  );
-}
 
-void DITHERING(IplImage *imgA,IplImage *dst)
+//スマートタグに画像を表示（撮影画像、文字兼用）
+- (void)showImage:(UIImage *)image
 {
-    //
-    //cvCopy(imgA,dst);
-    //
-    
-    // NTSC加重平均法で均す
-/*    for(int j = 0;j < dst->height; j++)
-    {
-        for(int i = 0;i < dst->width; i++)
-        {
-            int pixcelIndex  = j*dst->width + i;
-            int rgbDataIndex = pixcelIndex * dst->nChannels;
-            int avg = GetAverage(dst->imageData[rgbDataIndex+2],
-                                 dst->imageData[rgbDataIndex+1],
-                                 dst->imageData[rgbDataIndex+0]);
-            
-            dst->imageData[rgbDataIndex+0] = (char)avg;
-            dst->imageData[rgbDataIndex+1] = (char)avg;
-            dst->imageData[rgbDataIndex+2] = (char)avg;
-            dst->imageData[rgbDataIndex+3] = (char)avg;
-        }
-    }
-    
-    return;
-*/
-    double e;
-    for(int j = 0;j<dst->height;j++)
+    if(image == nil)
     {
-        for(int i = 0;i<dst->widthStep;i++)
-        {
-            
-            if( (unsigned char)(dst->imageData[j*dst->widthStep + i]) > (unsigned char)(127))
-            {
-                e = double(dst->imageData[j*dst->widthStep + i] - char (255));
-                dst->imageData[j*dst->widthStep + i] = char (255);
-            }else
-            {
-                e = double(dst->imageData[j*dst->widthStep + i]);
-                dst->imageData[j*dst->widthStep + i] = char (0);
-            }
-            
-            if ( i < dst->widthStep - 1)
-            {
-                //dst->imageData[j*dst->widthStep + i+dst->nChannels] += char(double(e)*(7/16.0));
-                dst->imageData[j*dst->widthStep + i+dst->nChannels] += char(double(e)*(7/48.0));
-            }
-            
-            if ( i < (dst->widthStep*2) - 1)
-            {
-                dst->imageData[j*dst->widthStep + i+(dst->nChannels * 2)] += char(double(e)*(5/48.0));
-            }
-            
-            if ( j < dst->height - 1)
-            {
-                //dst->imageData[(j+1)*dst->widthStep + dst->nChannels] += char(double(e)*(5/16.0));
-                dst->imageData[(j+1)*dst->widthStep + i] += char(double(e)*(7/48.0));
-                
-                if(i-(dst->nChannels * 2) > 0)
-                {
-                    dst->imageData[(j+1)*dst->widthStep + i-(dst->nChannels * 2)] += char(double(e)*(3/48.0));
-                }
-                
-                if(i-dst->nChannels > 0)
-                {
-                    //dst->imageData[(j+1)*dst->widthStep + i-dst->nChannels] += char(double(e)*(3/16.0));
-                    dst->imageData[(j+1)*dst->widthStep + i-dst->nChannels] += char(double(e)*(5/48.0));
-                }
-                if ( i+dst->nChannels < dst->widthStep)
-                {
-                    //dst->imageData[(j+1)*dst->widthStep + i+dst->nChannels] += char(double(e)*(1/16.0));
-                    dst->imageData[(j+1)*dst->widthStep + i+dst->nChannels] += char(double(e)*(5/48.0));
-                }
-                
-                if ( i < (dst->widthStep*2) - 1)
-                {
-                    dst->imageData[(j+1)*dst->widthStep + i+(dst->nChannels * 2)] += char(double(e)*(7/48.0));
-                }
-            }
-            
-            if ( j < dst->height - 2)
-            {
-                dst->imageData[(j+2)*dst->widthStep + i] += char(double(e)*(5/48.0));
-                
-                if(i-(dst->nChannels * 2) > 0)
-                {
-                    dst->imageData[(j+2)*dst->widthStep + i-(dst->nChannels * 2)] += char(double(e)*(1/48.0));
-                }
-                
-                if(i-dst->nChannels > 0)
-                {
-                    dst->imageData[(j+2)*dst->widthStep + i-dst->nChannels] += char(double(e)*(3/48.0));
-                }
-                if ( i+dst->nChannels < dst->widthStep)
-                {
-                    dst->imageData[(j+2)*dst->widthStep + i+dst->nChannels] += char(double(e)*(3/48.0));
-                }
-                
-                if ( i < (dst->widthStep*2) - 1)
-                {
-                    dst->imageData[(j+2)*dst->widthStep + i+(dst->nChannels * 2)] += char(double(e)*(1/48.0));
-                }
-
-            }
-            
-        }
+        [self functionComplete];
+        return;
     }
     
-    return;
-}
-
-- (IplImage*)IplImageFromUIImage:(UIImage *)image
-{
-    CGImageRef imageRef = image.CGImage;
-    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
-    IplImage *iplimage = cvCreateImage(cvSize(image.size.width,image.size.height), IPL_DEPTH_8U, 4 );
-    
-    printf("width=%d\n",iplimage->width);
-    printf("width=%d\n",iplimage->height);
-    printf("width=%d\n",iplimage->depth);
-    printf("width=%d\n",iplimage->widthStep);
-    
-    
-    CGContextRef contextRef = CGBitmapContextCreate(
-                                                    iplimage->imageData,
-                                                    iplimage->width,
-                                                    iplimage->height,
-                                                    iplimage->depth,
-                                                    iplimage->widthStep,
-                                                    colorSpace,
-                                                    kCGImageAlphaPremultipliedLast|kCGBitmapByteOrderDefault);
-    CGContextDrawImage(contextRef,
-                       CGRectMake(0, 0, image.size.width, image.size.height),
-                       imageRef);
-    
-    CGContextRelease(contextRef);
-    CGColorSpaceRelease(colorSpace);
-    
-    IplImage *ret = cvCreateImage(cvGetSize(iplimage), IPL_DEPTH_8U, 4);
-    cvCvtColor(iplimage, ret, CV_BGRA2RGBA);
-    cvReleaseImage(&iplimage);
-    
-    return ret;
-}
-- (UIImage*)UIImageFromIplImage:(IplImage*)image
-{
-    CGColorSpaceRef colorSpace;
-    colorSpace = CGColorSpaceCreateDeviceGray();
-
-//    if (image->nChannels == 1)
-//    {
-//        colorSpace = CGColorSpaceCreateDeviceGray();
-//    } else {
-//        colorSpace = CGColorSpaceCreateDeviceRGB();
-//        //BGRになっているのでRGBに変換
-//        cvCvtColor(image, image, CV_BGRA2RGBA);
-//    }
-    
-    NSData *data = [NSData dataWithBytes:image->imageData length:image->imageSize];
-    CGDataProviderRef provider = CGDataProviderCreateWithCFData((__bridge CFDataRef)data);
-    CGImageRef imageRef = CGImageCreate(image->width,
-                                        image->height,
-                                        image->depth,
-                                        image->depth * image->nChannels,
-                                        image->widthStep,
-                                        colorSpace,
-                                        kCGImageAlphaNone|kCGBitmapByteOrderDefault,
-                                        provider,
-                                        NULL,
-                                        false,
-                                        kCGRenderingIntentDefault
-                                        );
-    UIImage *ret = [UIImage imageWithCGImage:imageRef];
-    
-    CGImageRelease(imageRef);
-    CGDataProviderRelease(provider);
-    CGColorSpaceRelease(colorSpace);
-    
-    return ret;
+    [SVProgressHUD showWithMaskType:SVProgressHUDMaskTypeClear];
+    [Adapter addObserver:self selector:@selector(showImageComplete) name:ADAPTER_EVENT_SHOW_IMAGE_COMPLETE];
+    [Adapter addObserver:self selector:@selector(showImageError:) name:ADAPTER_EVENT_ERROR];
+    [Adapter showImage:image];
 }
 
-
-//スマートタグに画像を表示（撮影画像、文字兼用）
-- (void)showImage:(UIImage *)image
+//スマートタグにパネル形式の画像を表示（撮影画像）
+- (void)showFrame:(NSData *)frame
 {
-    if(image == nil)
+    if(frame == nil)
     {
         [self functionComplete];
         return;
@@ -1123,7 +949,7 @@ void DITHERING(IplImage *imgA,IplImage *dst)
     [SVProgressHUD showWithMaskType:SVProgressHUDMaskTypeClear];
     [Adapter addObserver:self selector:@selector(showImageComplete) name:ADAPTER_EVENT_SHOW_IMAGE_COMPLETE];
     [Adapter addObserver:self selector:@selector(showImageError:) name:ADAPTER_EVENT_ERROR];
-    [Adapter showImage:image];
+    [Adapter showFrame:frame];
 }
 
 //エラー
@@ -11,3 +11,6 @@ const icsdrv_basic_func_t* g_drv_func = &nfc110_ble_basic_func;
 UINT32 (*g_felica_cc_stub_initialize_func)(
     felica_cc_devf_t* devf,
     ICS_HW_DEVICE* dev) = felica_cc_stub_nfc110_initialize;
+
+UINT32 (*g_drv_set_max_connections_func)(
+    UINT32 max_connections) = nfc110_ble_raw_set_max_connections;